@@ -0,0 +1,23 @@
+/* WARNING! All changes made to this file will be lost! */
+
+#ifndef W_SRC_CONFIG_H_WAF
+#define W_SRC_CONFIG_H_WAF
+
+#define SCISQL_PREFIX scisql_
+#define HAVE_ATTRIBUTE_VISIBILITY 1
+#define HAVE_ATTRIBUTE_UNUSED 1
+#define HAVE_ATTRIBUTE_ALIGNED 1
+#define HAVE_AVX2_INTRINSICS 1
+#define HAVE_AVX512F_INTRINSICS 1
+#define IS_LITTLE_ENDIAN 1
+#define HAVE_PTHREAD_H 1
+#define HAVE_ZLIB 1
+#define SCISQL_VERSION_STRING "0.3"
+#define SCISQL_VERSION_STRING_LENGTH 3
+#define SCISQL_VERSION_MAJOR 0
+#define SCISQL_VERSION_MINOR 3
+#define SCISQL_VERSION_PATCH 0
+#define SCISQL_VERSION_NUM 300
+#define SCISQL_VSUFFIX _0_3_0
+
+#endif /* W_SRC_CONFIG_H_WAF */
@@ -69,6 +69,15 @@
 #   define SCISQL_INLINE static SCISQL_UNUSED
 #endif
 
+/*  Forced inlining, for generic functions taking function pointer arguments
+    that should be specialized for each caller.
+ */
+#if __GNUC__
+#   define SCISQL_ALWAYS_INLINE static inline __attribute__ ((always_inline))
+#else
+#   define SCISQL_ALWAYS_INLINE SCISQL_INLINE
+#endif
+
 /*  Alignment support
  */
 #if HAVE_ATTRIBUTE_ALIGNED
@@ -77,6 +86,13 @@
 #   define SCISQL_ALIGNED(x)
 #endif
 
+/*  Per-function instruction set selection, for SIMD kernels that are
+    dispatched to at run-time after checking CPU features.
+ */
+#if HAVE_AVX2_INTRINSICS || HAVE_AVX512F_INTRINSICS
+#   define SCISQL_TARGET(isa) __attribute__ ((target(isa)))
+#endif
+
 /*  Testing for IEEE specials
  */
 #if __STDC_VERSION__ >= 199901L
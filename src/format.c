@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    This file contains the implementation of functions declared in "format.h".
+*/
+
+#include "format.h"
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  Two digit decimal strings for the integers 0 through 99.
+ */
+static const char _scisql_digits[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/*  Returns the number of decimal digits in u.
+ */
+SCISQL_INLINE int _scisql_count_digits(uint64_t u) {
+    static const uint64_t pow10[20] = {
+        UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+        UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+        UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+        UINT64_C(10000000000), UINT64_C(100000000000),
+        UINT64_C(1000000000000), UINT64_C(10000000000000),
+        UINT64_C(100000000000000), UINT64_C(1000000000000000),
+        UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+        UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+    };
+    int nbits;
+#if __GNUC__
+    nbits = 64 - __builtin_clzll(u | 1);
+#else
+    uint64_t v = u | 1;
+    for (nbits = 0; v != 0; v >>= 1, ++nbits) { }
+#endif
+    /* 1233/4096 ~ log10(2); u | 1 makes 0 a one digit number */
+    nbits = (nbits * 1233) >> 12;
+    return nbits + 1 - ((u | 1) < pow10[nbits]);
+}
+
+
+SCISQL_LOCAL size_t scisql_format_int64(char *s, int64_t v) {
+    uint64_t u = (uint64_t) v;
+    size_t neg = 0, n;
+    char *p;
+    if (v < 0) {
+        *s++ = '-';
+        u = 0 - u;
+        neg = 1;
+    }
+    n = (size_t) _scisql_count_digits(u);
+    p = s + n;
+    while (u >= 100) {
+        size_t i = 2 * (size_t) (u % 100);
+        u /= 100;
+        p -= 2;
+        memcpy(p, _scisql_digits + i, 2);
+    }
+    if (u >= 10) {
+        memcpy(p - 2, _scisql_digits + 2 * (size_t) u, 2);
+    } else {
+        p[-1] = (char) ('0' + u);
+    }
+    return n + neg;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Fast conversion of integers to text.
+*/
+
+#ifndef SCISQL_FORMAT_H
+#define SCISQL_FORMAT_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  Writes the decimal representation of v to s, which must have room for
+    at least 20 characters. No terminating NUL is written.
+
+    Returns the number of characters written.
+ */
+SCISQL_LOCAL size_t scisql_format_int64(char *s, int64_t v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCISQL_FORMAT_H */
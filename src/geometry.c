@@ -26,8 +26,13 @@
 
 #include "geometry.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+#if HAVE_AVX2_INTRINSICS || HAVE_AVX512F_INTRINSICS
+#   include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -201,6 +206,140 @@ SCISQL_LOCAL int scisql_s2cpoly_cv3(const scisql_s2cpoly *cp,
 }
 
 
+SCISQL_LOCAL void scisql_s2cpoly_tosoa(scisql_s2cpoly_soa *out,
+                                       const scisql_s2cpoly *cp)
+{
+    size_t i;
+    out->n = cp->n;
+    for (i = 0; i < cp->n; ++i) {
+        out->x[i] = cp->edges[i].x;
+        out->y[i] = cp->edges[i].y;
+        out->z[i] = cp->edges[i].z;
+    }
+}
+
+
+#if HAVE_AVX2_INTRINSICS
+
+/*  Tests 4 positions at a time against all polygon edges, 4 <= n. The
+    trailing n % 4 positions are left to the caller. Dot products are
+    evaluated in the same order as by scisql_v3_dot(), and a position is
+    rejected exactly when scisql_s2cpoly_cv3() would reject it, i.e. when
+    a dot product is less than zero.
+ */
+SCISQL_TARGET("avx2") static void _scisql_s2cpoly_cv3_avx2(
+    const scisql_s2cpoly_soa *cp,
+    const double *x,
+    const double *y,
+    const double *z,
+    unsigned char *inside,
+    size_t n)
+{
+    size_t i, e;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d px = _mm256_loadu_pd(x + i);
+        __m256d py = _mm256_loadu_pd(y + i);
+        __m256d pz = _mm256_loadu_pd(z + i);
+        __m256d in = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        int mask;
+        for (e = 0; e < cp->n; ++e) {
+            __m256d d = _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(px, _mm256_set1_pd(cp->x[e])),
+                              _mm256_mul_pd(py, _mm256_set1_pd(cp->y[e]))),
+                _mm256_mul_pd(pz, _mm256_set1_pd(cp->z[e])));
+            in = _mm256_and_pd(in, _mm256_cmp_pd(d, _mm256_setzero_pd(),
+                                                 _CMP_NLT_UQ));
+            if (_mm256_testz_pd(in, in)) {
+                break;
+            }
+        }
+        mask = _mm256_movemask_pd(in);
+        inside[i] = (unsigned char) (mask & 1);
+        inside[i + 1] = (unsigned char) ((mask >> 1) & 1);
+        inside[i + 2] = (unsigned char) ((mask >> 2) & 1);
+        inside[i + 3] = (unsigned char) ((mask >> 3) & 1);
+    }
+}
+
+#endif /* HAVE_AVX2_INTRINSICS */
+
+#if HAVE_AVX512F_INTRINSICS
+
+/*  Tests 8 positions at a time against all polygon edges, 8 <= n. The
+    trailing n % 8 positions are left to the caller.
+ */
+SCISQL_TARGET("avx512f") static void _scisql_s2cpoly_cv3_avx512(
+    const scisql_s2cpoly_soa *cp,
+    const double *x,
+    const double *y,
+    const double *z,
+    unsigned char *inside,
+    size_t n)
+{
+    size_t i, e;
+    int k;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m512d px = _mm512_loadu_pd(x + i);
+        __m512d py = _mm512_loadu_pd(y + i);
+        __m512d pz = _mm512_loadu_pd(z + i);
+        __mmask8 in = 0xff;
+        for (e = 0; e < cp->n && in != 0; ++e) {
+            __m512d d = _mm512_add_pd(
+                _mm512_add_pd(_mm512_mul_pd(px, _mm512_set1_pd(cp->x[e])),
+                              _mm512_mul_pd(py, _mm512_set1_pd(cp->y[e]))),
+                _mm512_mul_pd(pz, _mm512_set1_pd(cp->z[e])));
+            in = _mm512_mask_cmp_pd_mask(in, d, _mm512_setzero_pd(),
+                                         _CMP_NLT_UQ);
+        }
+        for (k = 0; k < 8; ++k) {
+            inside[i + k] = (unsigned char) ((in >> k) & 1);
+        }
+    }
+}
+
+#endif /* HAVE_AVX512F_INTRINSICS */
+
+
+SCISQL_LOCAL int scisql_s2cpoly_cv3_batch(const scisql_s2cpoly_soa *cp,
+                                          const double *x,
+                                          const double *y,
+                                          const double *z,
+                                          unsigned char *inside,
+                                          size_t n)
+{
+    size_t i = 0, e;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (cp == 0 || x == 0 || y == 0 || z == 0 || inside == 0) {
+        return 1;
+    }
+#if HAVE_AVX512F_INTRINSICS
+    if (i == 0 && __builtin_cpu_supports("avx512f")) {
+        _scisql_s2cpoly_cv3_avx512(cp, x, y, z, inside, n);
+        i = n - n % 8;
+    }
+#endif
+#if HAVE_AVX2_INTRINSICS
+    if (i == 0 && __builtin_cpu_supports("avx2")) {
+        _scisql_s2cpoly_cv3_avx2(cp, x, y, z, inside, n);
+        i = n - n % 4;
+    }
+#endif
+    for (; i < n; ++i) {
+        int in = 1;
+        for (e = 0; e < cp->n; ++e) {
+            in &= !(x[i] * cp->x[e] + y[i] * cp->y[e] + z[i] * cp->z[e] < 0.0);
+        }
+        inside[i] = (unsigned char) in;
+    }
+    return 0;
+}
+
+
 #if IS_LITTLE_ENDIAN
 #   define SCISQL_COPY_DBL_BYTES(dst, src) \
     do { memcpy((dst), (src), sizeof(double)); } while(0)
@@ -215,11 +354,39 @@ SCISQL_LOCAL int scisql_s2cpoly_cv3(const scisql_s2cpoly *cp,
 #endif
 
 
+/*  Reads a 3-vector from its byte string representation.
+ */
+static void _scisql_v3_frombin(scisql_v3 *out, const unsigned char *s) {
+    _scisql_double_bytes dbytes;
+    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
+    out->x = dbytes.value;
+    s += sizeof(double);
+    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
+    out->y = dbytes.value;
+    s += sizeof(double);
+    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
+    out->z = dbytes.value;
+}
+
+/*  Writes the byte string representation of a 3-vector.
+ */
+static void _scisql_v3_tobin(unsigned char *out, const scisql_v3 *v) {
+    _scisql_double_bytes dbytes;
+    dbytes.value = v->x;
+    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
+    out += sizeof(double);
+    dbytes.value = v->y;
+    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
+    out += sizeof(double);
+    dbytes.value = v->z;
+    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
+}
+
+
 SCISQL_LOCAL int scisql_s2cpoly_frombin(scisql_s2cpoly *out,
                                         const unsigned char *s,
                                         size_t len)
 {
-    _scisql_double_bytes dbytes;
     size_t i, n;
     if (out == 0 || s == 0) {
         return 1;
@@ -229,25 +396,10 @@ SCISQL_LOCAL int scisql_s2cpoly_frombin(scisql_s2cpoly *out,
         return 1;
     }
     out->n = n - 1;
-    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-    out->vsum.x = dbytes.value;
-    s += sizeof(double);
-    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-    out->vsum.y = dbytes.value;
-    s += sizeof(double);
-    SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-    out->vsum.z = dbytes.value;
-    s += sizeof(double);
+    _scisql_v3_frombin(&out->vsum, s);
     for (i = 0; i < n - 1; ++i) {
-        SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-        out->edges[i].x = dbytes.value;
-        s += sizeof(double);
-        SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-        out->edges[i].y = dbytes.value;
-        s += sizeof(double);
-        SCISQL_COPY_DBL_BYTES(dbytes.bytes, s);
-        out->edges[i].z = dbytes.value;
-        s += sizeof(double);
+        s += 3 * sizeof(double);
+        _scisql_v3_frombin(&out->edges[i], s);
     }
     return 0;
 }
@@ -257,7 +409,6 @@ SCISQL_LOCAL size_t scisql_s2cpoly_tobin(unsigned char *out,
                                          size_t len,
                                          const scisql_s2cpoly *cp)
 {
-    _scisql_double_bytes dbytes;
     size_t i, n;
     if (out == 0 || cp == 0) {
         return 0;
@@ -266,25 +417,10 @@ SCISQL_LOCAL size_t scisql_s2cpoly_tobin(unsigned char *out,
     if ((n + 1) * 3 * sizeof(double) > len) {
         return 0;
     }
-    dbytes.value = cp->vsum.x;
-    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-    out += sizeof(double);
-    dbytes.value = cp->vsum.y;
-    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-    out += sizeof(double);
-    dbytes.value = cp->vsum.z;
-    SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-    out += sizeof(double);
+    _scisql_v3_tobin(out, &cp->vsum);
     for (i = 0; i < n; ++i) {
-        dbytes.value = cp->edges[i].x;
-        SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-        out += sizeof(double);
-        dbytes.value = cp->edges[i].y;
-        SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-        out += sizeof(double);
-        dbytes.value = cp->edges[i].z;
-        SCISQL_COPY_DBL_BYTES(out, dbytes.bytes);
-        out += sizeof(double);
+        out += 3 * sizeof(double);
+        _scisql_v3_tobin(out, &cp->edges[i]);
     }
     return (n + 1) * 3 * sizeof(double);
 }
@@ -292,6 +428,590 @@ SCISQL_LOCAL size_t scisql_s2cpoly_tobin(unsigned char *out,
 #undef SCISQL_COPY_DBL_BYTES
 
 
+/* ---- Large Convex Spherical Polygons ---- */
+
+/*  Allocates a large polygon with n vertices in a single block of memory.
+ */
+static scisql_s2lpoly * _scisql_s2lpoly_alloc(size_t n) {
+    scisql_s2lpoly *poly = (scisql_s2lpoly *) malloc(
+        sizeof(scisql_s2lpoly) +
+        n * (2 * sizeof(scisql_v3) + sizeof(double)));
+    if (poly != 0) {
+        poly->n = n;
+        poly->verts = poly->edges + n;
+        poly->angles = (double *) (poly->verts + n);
+    }
+    return poly;
+}
+
+/*  Computes unit vectors east and north spanning the plane orthogonal to
+    the unit vector c, such that (east, north, c) is right-handed.
+ */
+static void _scisql_v3_basis(scisql_v3 *east,
+                             scisql_v3 *north,
+                             const scisql_v3 *c)
+{
+    scisql_v3 axis = { 0.0, 0.0, 0.0 };
+    /* use the coordinate axis least aligned with c */
+    if (fabs(c->x) <= fabs(c->y) && fabs(c->x) <= fabs(c->z)) {
+        axis.x = 1.0;
+    } else if (fabs(c->y) <= fabs(c->z)) {
+        axis.y = 1.0;
+    } else {
+        axis.z = 1.0;
+    }
+    scisql_v3_cross(east, &axis, c);
+    scisql_v3_normalize(east, east);
+    scisql_v3_cross(north, c, east);
+}
+
+/*  Computes the position angles of the vertices of poly around the
+    normalized vertex sum, and stores the vertices and edges of poly
+    in order of increasing position angle, starting with the vertex of
+    minimum position angle. Edge i of the input connects vertex i to
+    vertex i + 1 (mod n).
+
+    Returns 0 on success, and 1 if the vertices do not wind around the
+    vertex sum exactly once, or if the first vertex following some edge
+    does not lie strictly on the inner side of the edge plane - that is,
+    if the polygon is not convex and hemispherical.
+ */
+static int _scisql_s2lpoly_index(scisql_s2lpoly *poly,
+                                 const scisql_v3 *verts,
+                                 const scisql_v3 *edges)
+{
+    scisql_v3 c;
+    size_t i, start, n = poly->n;
+    int reverse;
+
+    if (scisql_v3_norm2(&poly->vsum) == 0.0) {
+        return 1;
+    }
+    scisql_v3_normalize(&c, &poly->vsum);
+    _scisql_v3_basis(&poly->east, &poly->north, &c);
+    for (i = 0, start = 0; i < n; ++i) {
+        poly->angles[i] = atan2(scisql_v3_dot(&verts[i], &poly->north),
+                                scisql_v3_dot(&verts[i], &poly->east));
+        if (poly->angles[i] < poly->angles[start]) {
+            start = i;
+        }
+    }
+    reverse = poly->angles[(start + n - 1) % n] <
+              poly->angles[(start + 1) % n];
+    for (i = 0; i < n; ++i) {
+        size_t v, e;
+        if (reverse) {
+            v = (start + n - i) % n;
+            e = (start + 2*n - i - 1) % n;
+        } else {
+            v = (start + i) % n;
+            e = v;
+        }
+        poly->verts[i] = verts[v];
+        poly->edges[i] = edges[e];
+    }
+    /* recompute angles in the new order, and check that they increase */
+    for (i = 0; i < n; ++i) {
+        poly->angles[i] = atan2(scisql_v3_dot(&poly->verts[i], &poly->north),
+                                scisql_v3_dot(&poly->verts[i], &poly->east));
+        if (i > 0 && poly->angles[i] <= poly->angles[i - 1]) {
+            return 1;
+        }
+    }
+    /* since the vertices wind around c exactly once, the polygon is
+       convex if every vertex turn is convex, i.e. if the vertex following
+       each edge lies strictly on the inner side of the edge plane */
+    for (i = 0; i < n; ++i) {
+        const scisql_v3 *v = &poly->verts[(i + 2) % n];
+        if (scisql_v3_dot(v, &poly->edges[i]) <= 0.0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL scisql_s2lpoly * scisql_s2lpoly_new(const scisql_v3 *verts,
+                                                 size_t n)
+{
+    scisql_s2lpoly *poly;
+    scisql_v3 *edges;
+    size_t i;
+
+    if (verts == 0 || n < 3 || n > SCISQL_MAX_LARGE_VERTS) {
+        return 0;
+    }
+    edges = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+    poly = _scisql_s2lpoly_alloc(n);
+    if (edges == 0 || poly == 0) {
+        free(edges);
+        free(poly);
+        return 0;
+    }
+    /* edge planes are computed as in scisql_s2cpoly_init() */
+    poly->vsum = verts[n - 1];
+    for (i = 0; i < n - 1; ++i) {
+        scisql_v3_rcross(&edges[i], &verts[i], &verts[i + 1]);
+        scisql_v3_add(&poly->vsum, &poly->vsum, &verts[i]);
+    }
+    scisql_v3_rcross(&edges[n - 1], &verts[n - 1], &verts[0]);
+    if (scisql_v3_dot(&poly->vsum, &edges[0]) < 0.0) {
+        for (i = 0; i < n; ++i) {
+            scisql_v3_neg(&edges[i], &edges[i]);
+        }
+    }
+    i = _scisql_s2lpoly_index(poly, verts, edges);
+    free(edges);
+    if (i != 0) {
+        free(poly);
+        return 0;
+    }
+    return poly;
+}
+
+
+SCISQL_LOCAL scisql_s2lpoly * scisql_s2lpoly_frombin(const unsigned char *s,
+                                                     size_t len)
+{
+    scisql_s2lpoly *poly;
+    scisql_v3 *buf;
+    size_t i, n;
+
+    if (s == 0) {
+        return 0;
+    }
+    n = len / (3 * sizeof(double));
+    if (n < 4 || n > SCISQL_MAX_LARGE_VERTS + 1 ||
+        n * 3 * sizeof(double) != len) {
+        return 0;
+    }
+    --n;
+    buf = (scisql_v3 *) malloc(2 * n * sizeof(scisql_v3));
+    poly = _scisql_s2lpoly_alloc(n);
+    if (buf == 0 || poly == 0) {
+        free(buf);
+        free(poly);
+        return 0;
+    }
+    _scisql_v3_frombin(&poly->vsum, s);
+    for (i = 0; i < n; ++i) {
+        s += 3 * sizeof(double);
+        _scisql_v3_frombin(&buf[i], s);
+    }
+    /* vertex i lies on the planes of edges i - 1 and i */
+    for (i = 0; i < n; ++i) {
+        scisql_v3 *v = &buf[n + i];
+        scisql_v3_cross(v, &buf[(i + n - 1) % n], &buf[i]);
+        if (scisql_v3_norm2(v) == 0.0) {
+            break;
+        }
+        scisql_v3_normalize(v, v);
+        if (scisql_v3_dot(v, &poly->vsum) < 0.0) {
+            scisql_v3_neg(v, v);
+        }
+    }
+    if (i != n || _scisql_s2lpoly_index(poly, buf + n, buf) != 0) {
+        free(buf);
+        free(poly);
+        return 0;
+    }
+    free(buf);
+    return poly;
+}
+
+
+SCISQL_LOCAL int scisql_s2lpoly_cv3(const scisql_s2lpoly *poly,
+                                    const scisql_v3 *v)
+{
+    const double *angles = poly->angles;
+    double a = atan2(scisql_v3_dot(v, &poly->north),
+                     scisql_v3_dot(v, &poly->east));
+    size_t i = 0, n = poly->n;
+
+    /* find the last vertex with position angle at most a. Positions with
+       angles below that of the first vertex lie between the last vertex
+       and the first one. */
+    if (a < angles[0]) {
+        i = n - 1;
+    } else {
+        while (n > 1) {
+            size_t half = n / 2;
+            i = (angles[i + half] <= a) ? i + half : i;
+            n -= half;
+        }
+    }
+    return (scisql_v3_dot(v, &poly->edges[i]) < 0.0) ? 0 : 1;
+}
+
+
+SCISQL_LOCAL size_t scisql_s2lpoly_tobin(unsigned char *out,
+                                         size_t len,
+                                         const scisql_s2lpoly *poly)
+{
+    size_t i, n;
+    if (out == 0 || poly == 0) {
+        return 0;
+    }
+    n = poly->n;
+    if ((n + 1) * 3 * sizeof(double) > len) {
+        return 0;
+    }
+    _scisql_v3_tobin(out, &poly->vsum);
+    for (i = 0; i < n; ++i) {
+        out += 3 * sizeof(double);
+        _scisql_v3_tobin(out, &poly->edges[i]);
+    }
+    return (n + 1) * 3 * sizeof(double);
+}
+
+
+SCISQL_LOCAL size_t scisql_s2lpoly_npieces(const scisql_s2lpoly *poly) {
+    return (poly->n - 2 + SCISQL_MAX_VERTS - 3) / (SCISQL_MAX_VERTS - 2);
+}
+
+
+SCISQL_LOCAL int scisql_s2lpoly_piece(scisql_s2cpoly *out,
+                                      const scisql_s2lpoly *poly,
+                                      size_t k)
+{
+    scisql_v3 verts[SCISQL_MAX_VERTS];
+    size_t first, last;
+
+    if (out == 0 || poly == 0 || k >= scisql_s2lpoly_npieces(poly)) {
+        return 1;
+    }
+    first = 1 + k * (SCISQL_MAX_VERTS - 2);
+    last = first + (SCISQL_MAX_VERTS - 2);
+    if (last > poly->n - 1) {
+        last = poly->n - 1;
+    }
+    verts[0] = poly->verts[0];
+    memcpy(verts + 1, poly->verts + first,
+           (last - first + 1) * sizeof(scisql_v3));
+    return scisql_s2cpoly_init(out, verts, last - first + 2);
+}
+
+/* ---- Simple Spherical Polygons ---- */
+
+/*  Allocates a simple polygon with n vertices in a single block of memory.
+ */
+static scisql_s2spoly * _scisql_s2spoly_alloc(size_t n) {
+    scisql_s2spoly *poly = (scisql_s2spoly *) malloc(
+        sizeof(scisql_s2spoly) +
+        n * (2 * sizeof(scisql_v3) + 2 * sizeof(double)));
+    if (poly != 0) {
+        poly->n = n;
+        poly->edges = poly->verts + n;
+        poly->x = (double *) (poly->edges + n);
+        poly->y = poly->x + n;
+    }
+    return poly;
+}
+
+/*  Returns twice the signed area of the planar triangle (a, b, c), which
+    is positive if the triangle is oriented counter-clockwise.
+ */
+SCISQL_INLINE double _scisql_orient2(const double *x,
+                                     const double *y,
+                                     size_t a,
+                                     size_t b,
+                                     size_t c)
+{
+    return (x[b] - x[a]) * (y[c] - y[a]) - (y[b] - y[a]) * (x[c] - x[a]);
+}
+
+/*  Returns 1 if point c, which must be collinear with the planar segment
+    from a to b, lies on that segment.
+ */
+SCISQL_INLINE int _scisql_onseg2(const double *x,
+                                 const double *y,
+                                 size_t a,
+                                 size_t b,
+                                 size_t c)
+{
+    return x[c] >= fmin(x[a], x[b]) && x[c] <= fmax(x[a], x[b]) &&
+           y[c] >= fmin(y[a], y[b]) && y[c] <= fmax(y[a], y[b]);
+}
+
+/*  Returns 1 if the closed planar segments (a, b) and (c, d) intersect.
+ */
+static int _scisql_segs_isect2(const double *x,
+                               const double *y,
+                               size_t a,
+                               size_t b,
+                               size_t c,
+                               size_t d)
+{
+    double d1 = _scisql_orient2(x, y, c, d, a);
+    double d2 = _scisql_orient2(x, y, c, d, b);
+    double d3 = _scisql_orient2(x, y, a, b, c);
+    double d4 = _scisql_orient2(x, y, a, b, d);
+    if (((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) &&
+        ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0))) {
+        return 1;
+    }
+    return (d1 == 0.0 && _scisql_onseg2(x, y, c, d, a)) ||
+           (d2 == 0.0 && _scisql_onseg2(x, y, c, d, b)) ||
+           (d3 == 0.0 && _scisql_onseg2(x, y, a, b, c)) ||
+           (d4 == 0.0 && _scisql_onseg2(x, y, a, b, d));
+}
+
+/*  Checks that the projected edges of poly form a simple polygon with
+    non-zero area: adjacent edges must not overlap, and non-adjacent
+    edges must not intersect at all.
+
+    Returns 0 if the polygon is simple and 1 otherwise.
+ */
+static int _scisql_s2spoly_check(const scisql_s2spoly *poly) {
+    const double *x = poly->x;
+    const double *y = poly->y;
+    double area = 0.0;
+    size_t i, j, n = poly->n;
+
+    for (i = 0; i < n; ++i) {
+        size_t p = (i + n - 1) % n;
+        size_t q = (i + 1) % n;
+        if (x[i] == x[q] && y[i] == y[q]) {
+            return 1;
+        }
+        /* adjacent edges folding back onto each other */
+        if (_scisql_orient2(x, y, p, i, q) == 0.0 &&
+            (_scisql_onseg2(x, y, i, q, p) || _scisql_onseg2(x, y, p, i, q))) {
+            return 1;
+        }
+        area += x[i] * y[q] - x[q] * y[i];
+    }
+    if (area == 0.0) {
+        return 1;
+    }
+    for (i = 0; i + 2 < n; ++i) {
+        for (j = i + 2; j < n; ++j) {
+            if (i == 0 && j == n - 1) {
+                continue;
+            }
+            if (_scisql_segs_isect2(x, y, i, i + 1, j, (j + 1) % n) != 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL scisql_s2spoly * scisql_s2spoly_new(const scisql_v3 *verts,
+                                                 size_t n)
+{
+    scisql_s2spoly *poly;
+    scisql_v3 vsum = { 0.0, 0.0, 0.0 };
+    size_t i;
+
+    if (verts == 0 || n < 3 || n > SCISQL_MAX_SIMPLE_VERTS) {
+        return 0;
+    }
+    poly = _scisql_s2spoly_alloc(n);
+    if (poly == 0) {
+        return 0;
+    }
+    for (i = 0; i < n; ++i) {
+        if (scisql_v3_norm2(&verts[i]) == 0.0) {
+            break;
+        }
+        scisql_v3_normalize(&poly->verts[i], &verts[i]);
+        scisql_v3_add(&vsum, &vsum, &poly->verts[i]);
+    }
+    if (i != n || scisql_v3_norm2(&vsum) == 0.0) {
+        free(poly);
+        return 0;
+    }
+    scisql_v3_normalize(&poly->center, &vsum);
+    _scisql_v3_basis(&poly->east, &poly->north, &poly->center);
+    for (i = 0; i < n; ++i) {
+        scisql_v3_rcross(&poly->edges[i], &poly->verts[i],
+                         &poly->verts[(i + 1) % n]);
+        if (scisql_s2spoly_project(&poly->x[i], &poly->y[i], poly,
+                                   &poly->verts[i]) != 0) {
+            break;
+        }
+    }
+    if (i != n || _scisql_s2spoly_check(poly) != 0) {
+        free(poly);
+        return 0;
+    }
+    return poly;
+}
+
+
+SCISQL_LOCAL scisql_s2spoly * scisql_s2spoly_frombin(const unsigned char *s,
+                                                     size_t len)
+{
+    scisql_s2spoly *poly;
+    scisql_v3 *verts;
+    size_t i, n, m = sizeof(SCISQL_S2SPOLY_MAGIC) - 1;
+
+    if (s == 0 || len < m || memcmp(s, SCISQL_S2SPOLY_MAGIC, m) != 0) {
+        return 0;
+    }
+    n = (len - m) / (3 * sizeof(double));
+    if (n < 3 || n > SCISQL_MAX_SIMPLE_VERTS ||
+        m + n * 3 * sizeof(double) != len) {
+        return 0;
+    }
+    verts = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+    if (verts == 0) {
+        return 0;
+    }
+    for (i = 0, s += m; i < n; ++i, s += 3 * sizeof(double)) {
+        _scisql_v3_frombin(&verts[i], s);
+    }
+    poly = scisql_s2spoly_new(verts, n);
+    free(verts);
+    return poly;
+}
+
+
+SCISQL_LOCAL int scisql_s2spoly_project(double *x,
+                                        double *y,
+                                        const scisql_s2spoly *poly,
+                                        const scisql_v3 *v)
+{
+    double d = scisql_v3_dot(v, &poly->center);
+    if (!(d > 0.0)) {
+        return 1;
+    }
+    *x = scisql_v3_dot(v, &poly->east) / d;
+    *y = scisql_v3_dot(v, &poly->north) / d;
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_s2spoly_cv3(const scisql_s2spoly *poly,
+                                    const scisql_v3 *v)
+{
+    const double *x = poly->x;
+    const double *y = poly->y;
+    double px, py;
+    size_t i, j, n = poly->n;
+    int inside = 0;
+
+    if (scisql_s2spoly_project(&px, &py, poly, v) != 0) {
+        return 0;
+    }
+    /* count crossings of the ray from (px, py) in the +x direction,
+       treating vertices on the ray as lying just above it */
+    for (i = 0, j = n - 1; i < n; j = i++) {
+        if ((y[i] > py) != (y[j] > py) &&
+            px < (x[j] - x[i]) * (py - y[i]) / (y[j] - y[i]) + x[i]) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+
+SCISQL_LOCAL size_t scisql_s2spoly_tobin(unsigned char *out,
+                                         size_t len,
+                                         const scisql_s2spoly *poly)
+{
+    size_t i, n, m = sizeof(SCISQL_S2SPOLY_MAGIC) - 1;
+    if (out == 0 || poly == 0) {
+        return 0;
+    }
+    n = poly->n;
+    if (m + n * 3 * sizeof(double) > len) {
+        return 0;
+    }
+    memcpy(out, SCISQL_S2SPOLY_MAGIC, m);
+    for (i = 0, out += m; i < n; ++i, out += 3 * sizeof(double)) {
+        _scisql_v3_tobin(out, &poly->verts[i]);
+    }
+    return m + n * 3 * sizeof(double);
+}
+
+
+
+/* ---- Longitude/Latitude Boxes ---- */
+
+SCISQL_LOCAL int scisql_s2box_init(scisql_s2box *out,
+                                   const scisql_sc *min,
+                                   const scisql_sc *max)
+{
+    if (max->lon < min->lon && (max->lon < 0.0 || min->lon > 360.0)) {
+        return 1;
+    }
+    out->latMin = min->lat;
+    out->latMax = max->lat;
+    out->allLon = (max->lon - min->lon >= 360.0);
+    out->lonMin = scisql_angred(min->lon);
+    out->lonMax = scisql_angred(max->lon);
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_s2box_csc(const scisql_s2box *b, const scisql_sc *p) {
+    double lon;
+    /* Check if latitude is in range */
+    if (b->latMin > b->latMax || p->lat < b->latMin || p->lat > b->latMax) {
+        return 0;
+    }
+    if (b->allLon) {
+        return 1;
+    }
+    lon = scisql_angred(p->lon);
+    if (b->lonMin <= b->lonMax) {
+        return lon >= b->lonMin && lon <= b->lonMax;
+    } else {
+        return lon >= b->lonMin || lon <= b->lonMax;
+    }
+}
+
+
+/* ---- Spherical Ellipses ---- */
+
+SCISQL_LOCAL int scisql_s2ellipse_init(scisql_s2ellipse *out,
+                                       const scisql_sc *center,
+                                       double semiMajor,
+                                       double semiMinor,
+                                       double posAngle)
+{
+    double M = semiMajor;
+    double m = semiMinor;
+    double posang = posAngle * SCISQL_RAD_PER_DEG;
+    if (SCISQL_ISSPECIAL(posang) || SCISQL_ISNAN(M) || SCISQL_ISNAN(m)) {
+        return 1;
+    }
+    /* Semi-minor axis length m and semi-major axis length M must satisfy
+       0 <= m <= M <= 10 deg */
+    if (m < 0.0 || m > M || M > SCISQL_MAX_SEMI_MAJOR) {
+        return 1;
+    }
+    out->sinLon = sin(center->lon * SCISQL_RAD_PER_DEG);
+    out->cosLon = cos(center->lon * SCISQL_RAD_PER_DEG);
+    out->sinLat = sin(center->lat * SCISQL_RAD_PER_DEG);
+    out->cosLat = cos(center->lat * SCISQL_RAD_PER_DEG);
+    out->sinPosAng = sin(posang);
+    out->cosPosAng = cos(posang);
+    m = m * SCISQL_RAD_PER_DEG / SCISQL_ARCSEC_PER_DEG;
+    M = M * SCISQL_RAD_PER_DEG / SCISQL_ARCSEC_PER_DEG;
+    out->invMinor2 = 1.0 / (m * m);
+    out->invMajor2 = 1.0 / (M * M);
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_s2ellipse_cv3(const scisql_s2ellipse *e,
+                                      const scisql_v3 *v)
+{
+    double xne, yne, x, y;
+    /* get coords of input point in (N,E) basis at ellipse center */
+    xne = e->cosLat * v->z - e->sinLat * (e->sinLon * v->y + e->cosLon * v->x);
+    yne = e->cosLon * v->y - e->sinLon * v->x;
+    /* rotate by negated position angle */
+    x = e->sinPosAng * yne + e->cosPosAng * xne;
+    y = e->cosPosAng * yne - e->sinPosAng * xne;
+    /* perform standard 2D axis-aligned point-in-ellipse test */
+    return (x * x * e->invMajor2 + y * y * e->invMinor2 <= 1.0);
+}
+
 #ifdef __cplusplus
 }
 #endif
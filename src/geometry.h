@@ -324,6 +324,263 @@ SCISQL_LOCAL size_t scisql_s2cpoly_tobin(unsigned char *out,
                                          size_t len,
                                          const scisql_s2cpoly *cp);
 
+/*  The edge plane normals of a scisql_s2cpoly, stored as separate x, y
+    and z coordinate arrays for batched point-in-polygon tests.
+ */
+typedef struct {
+    size_t n; /* number of edges */
+    double x[SCISQL_MAX_VERTS];
+    double y[SCISQL_MAX_VERTS];
+    double z[SCISQL_MAX_VERTS];
+} scisql_s2cpoly_soa;
+
+/*  Copies the edge plane normals of cp to out.
+ */
+SCISQL_LOCAL void scisql_s2cpoly_tosoa(scisql_s2cpoly_soa *out,
+                                       const scisql_s2cpoly *cp);
+
+/*  Tests n positions stored in structure-of-arrays form, i.e. the i-th
+    position is (x[i], y[i], z[i]), for containment in a spherical convex
+    polygon, and sets inside[i] to 1 if the i-th position is inside and
+    to 0 otherwise. Positions are tested against all edges several at a
+    time using SIMD instructions when the CPU supports them; the results
+    are identical to those of scisql_s2cpoly_cv3().
+
+    Returns 0 on success and 1 on error.
+ */
+SCISQL_LOCAL int scisql_s2cpoly_cv3_batch(const scisql_s2cpoly_soa *cp,
+                                          const double *x,
+                                          const double *y,
+                                          const double *z,
+                                          unsigned char *inside,
+                                          size_t n);
+
+
+/* ---- Large Convex Spherical Polygons ---- */
+
+#define SCISQL_MAX_LARGE_VERTS 65536
+
+/** A convex polygon on the sphere with up to SCISQL_MAX_LARGE_VERTS
+    vertices. Vertices are stored in order of increasing position angle
+    around the vertex sum, so that the single edge a point must be tested
+    against is found with a binary search. A large polygon is allocated
+    in a single block of memory and can be cleaned up by passing it to
+    free().
+ */
+typedef struct {
+    size_t n;          /* number of edges (and vertices). */
+    scisql_v3 vsum;    /* sum of all vertices in polygon. */
+    scisql_v3 east;    /* unit vectors spanning the plane orthogonal */
+    scisql_v3 north;   /* to vsum, used to compute position angles. */
+    double *angles;    /* position angles of the vertices, increasing. */
+    scisql_v3 *verts;  /* vertices; edge i connects vertex i and i + 1. */
+    scisql_v3 edges[]; /* edge plane normals. */
+} scisql_s2lpoly;
+
+/*  Creates a large polygon from a list of between 3 and
+    SCISQL_MAX_LARGE_VERTS vertices. The same assumptions as for
+    scisql_s2cpoly_init() apply.
+
+    Returns a null pointer on error, e.g. if the vertices are found not
+    to wind around their sum exactly once, if the polygon is not convex,
+    or if memory allocation fails.
+ */
+SCISQL_LOCAL scisql_s2lpoly * scisql_s2lpoly_new(const scisql_v3 *verts,
+                                                 size_t n);
+
+/*  Creates a large polygon from a byte string representation, as
+    produced by scisql_s2lpoly_tobin() or scisql_s2cpoly_tobin().
+
+    Returns a null pointer on error.
+ */
+SCISQL_LOCAL scisql_s2lpoly * scisql_s2lpoly_frombin(const unsigned char *s,
+                                                     size_t len);
+
+/*  Returns 1 if the large polygon poly contains vector v, and 0 otherwise.
+    Runs in time logarithmic in the number of polygon vertices.
+ */
+SCISQL_LOCAL int scisql_s2lpoly_cv3(const scisql_s2lpoly *poly,
+                                    const scisql_v3 *v);
+
+/*  Returns a byte string representation of a large polygon. The format
+    is identical to that of scisql_s2cpoly_tobin(), and requires
+    3*sizeof(double)*(N + 1) bytes of storage for an N vertex polygon.
+
+    Returns the number of bytes written. This will be zero if out
+    or poly is null, or if len is too small.
+ */
+SCISQL_LOCAL size_t scisql_s2lpoly_tobin(unsigned char *out,
+                                         size_t len,
+                                         const scisql_s2lpoly *poly);
+
+/*  Returns the number of convex polygons of at most SCISQL_MAX_VERTS
+    vertices that scisql_s2lpoly_piece() splits poly into.
+ */
+SCISQL_LOCAL size_t scisql_s2lpoly_npieces(const scisql_s2lpoly *poly);
+
+/*  Stores the k-th piece of a triangle fan decomposition of poly into
+    convex polygons of at most SCISQL_MAX_VERTS vertices in out. The
+    union of all pieces is poly, so coverage functions for scisql_s2cpoly
+    can be applied to large polygons piece by piece.
+
+    Returns 0 on success and 1 on error.
+ */
+SCISQL_LOCAL int scisql_s2lpoly_piece(scisql_s2cpoly *out,
+                                      const scisql_s2lpoly *poly,
+                                      size_t k);
+
+
+/* ---- Simple Spherical Polygons ---- */
+
+#define SCISQL_MAX_SIMPLE_VERTS 4096
+
+/*  Magic bytes prefixing the byte string representation of a simple
+    polygon, so that it is never confused with that of a convex polygon.
+ */
+#define SCISQL_S2SPOLY_MAGIC "scisqlS1"
+
+/** A simple polygon on the sphere, which need not be convex. Vertices are
+    also stored as coordinates in the gnomonic projection centered on the
+    normalized vertex sum. This projection maps polygon edges to line
+    segments, so that containment reduces to a planar crossing number test.
+    A simple polygon is allocated in a single block of memory and can be
+    cleaned up by passing it to free().
+ */
+typedef struct {
+    size_t n;          /* number of edges (and vertices). */
+    scisql_v3 center;  /* normalized vertex sum, the projection center. */
+    scisql_v3 east;    /* unit vectors spanning the plane orthogonal */
+    scisql_v3 north;   /* to center, used to compute projections. */
+    double *x;         /* gnomonic coordinates of the vertices. */
+    double *y;
+    scisql_v3 *edges;  /* edge plane normals, not normalized. */
+    scisql_v3 verts[]; /* unit vertices; edge i connects vertex i and
+                          i + 1. */
+} scisql_s2spoly;
+
+/*  Creates a simple polygon from a list of between 3 and
+    SCISQL_MAX_SIMPLE_VERTS vertices, in clockwise or counter-clockwise
+    order. All vertices must lie strictly inside the hemisphere centered
+    on their sum. Checking that no two edges intersect takes time
+    quadratic in the number of vertices.
+
+    Returns a null pointer on error, e.g. if two edges intersect anywhere
+    but at a shared vertex, if the polygon has zero area, or if memory
+    allocation fails.
+ */
+SCISQL_LOCAL scisql_s2spoly * scisql_s2spoly_new(const scisql_v3 *verts,
+                                                 size_t n);
+
+/*  Creates a simple polygon from a byte string representation, as
+    produced by scisql_s2spoly_tobin().
+
+    Returns a null pointer on error.
+ */
+SCISQL_LOCAL scisql_s2spoly * scisql_s2spoly_frombin(const unsigned char *s,
+                                                     size_t len);
+
+/*  Stores the gnomonic coordinates of v in the projection used by poly
+    in x and y.
+
+    Returns 0 on success, and 1 if v does not lie strictly inside the
+    hemisphere centered on the projection center. Such vectors are
+    never inside poly.
+ */
+SCISQL_LOCAL int scisql_s2spoly_project(double *x,
+                                        double *y,
+                                        const scisql_s2spoly *poly,
+                                        const scisql_v3 *v);
+
+/*  Returns 1 if the simple polygon poly contains vector v, and 0 otherwise.
+    Runs in time linear in the number of polygon vertices; see
+    scisql_s2spoly_htmidx_cv3() in htm.h for a faster test.
+ */
+SCISQL_LOCAL int scisql_s2spoly_cv3(const scisql_s2spoly *poly,
+                                    const scisql_v3 *v);
+
+/*  Returns a byte string representation of a simple polygon, consisting
+    of SCISQL_S2SPOLY_MAGIC followed by the polygon vertices. For a
+    polygon with N vertices, 8 + 3*sizeof(double)*N bytes of storage are
+    required.
+
+    Returns the number of bytes written. This will be zero if out
+    or poly is null, or if len is too small.
+ */
+SCISQL_LOCAL size_t scisql_s2spoly_tobin(unsigned char *out,
+                                         size_t len,
+                                         const scisql_s2spoly *poly);
+
+
+/* ---- Longitude/Latitude Boxes ---- */
+
+/*  A longitude/latitude angle box on the sphere.
+ */
+typedef struct {
+    double lonMin; /* minimum longitude, range-reduced to [0, 360) */
+    double lonMax; /* maximum longitude, range-reduced to [0, 360) */
+    double latMin; /* minimum latitude */
+    double latMax; /* maximum latitude */
+    int allLon;    /* does the box span all longitudes? */
+} scisql_s2box;
+
+/*  Initializes a scisql_s2box with the given minimum and maximum corners.
+    If both corner longitudes lie in [0, 360], then the maximum longitude
+    may be less than the minimum, in which case the box spans the 0/360
+    degree longitude angle discontinuity. Otherwise, the minimum longitude
+    must not exceed the maximum. If they are separated by 360 degrees or
+    more, the box spans all longitudes. If the minimum latitude exceeds the
+    maximum, the box is empty.
+
+    Returns 0 on success and 1 if the corner longitudes are invalid.
+ */
+SCISQL_LOCAL int scisql_s2box_init(scisql_s2box *out,
+                                   const scisql_sc *min,
+                                   const scisql_sc *max);
+
+/*  Returns 1 if the box b contains the point p, and 0 otherwise.
+ */
+SCISQL_LOCAL int scisql_s2box_csc(const scisql_s2box *b, const scisql_sc *p);
+
+/* ---- Spherical Ellipses ---- */
+
+/*  An ellipse on the sphere. A point lies inside the ellipse if its
+    orthographic projection onto the plane tangent to the sphere at the
+    ellipse center lies inside the corresponding planar ellipse.
+ */
+typedef struct {
+    double sinLon;    /* sine of ellipse center longitude */
+    double cosLon;    /* cosine of ellipse center longitude */
+    double sinLat;    /* sine of ellipse center latitude */
+    double cosLat;    /* cosine of ellipse center latitude */
+    double sinPosAng; /* sine of ellipse position angle */
+    double cosPosAng; /* cosine of ellipse position angle */
+    double invMinor2; /* 1/(m*m); m = semi-minor axis length (rad) */
+    double invMajor2; /* 1/(M*M); M = semi-major axis length (rad) */
+} scisql_s2ellipse;
+
+/*  Maximum semi-major axis length of a scisql_s2ellipse, arcsec.
+ */
+#define SCISQL_MAX_SEMI_MAJOR (10.0 * SCISQL_ARCSEC_PER_DEG)
+
+/*  Initializes a scisql_s2ellipse with the given center, semi-major and
+    semi-minor axis lengths (arcsec) and position angle (degrees east of
+    north).
+
+    Returns 0 on success and 1 if an input is NaN, if the position angle
+    is not finite, or unless 0 <= semiMinor <= semiMajor <=
+    SCISQL_MAX_SEMI_MAJOR.
+ */
+SCISQL_LOCAL int scisql_s2ellipse_init(scisql_s2ellipse *out,
+                                       const scisql_sc *center,
+                                       double semiMajor,
+                                       double semiMinor,
+                                       double posAngle);
+
+/*  Returns 1 if the spherical ellipse e contains the unit vector v,
+    and 0 otherwise.
+ */
+SCISQL_LOCAL int scisql_s2ellipse_cv3(const scisql_s2ellipse *e,
+                                      const scisql_v3 *v);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,551 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Minimalistic HEALPix library implementation.
+
+    The point to pixel and pixel to position computations follow the
+    reference HEALPix C++ implementation (healpix_base.cc). A pixel on
+    one of the 12 base pixels ("faces") is identified by its face number
+    and by integer coordinates (ix, iy) in [0, Nside) along the two face
+    edges through its southern corner; nested IDs interleave the bits of
+    ix and iy.
+
+    http://healpix.sourceforge.net/
+    http://adsabs.harvard.edu/abs/2005ApJ...622..759G
+*/
+
+#include "healpix.h"
+
+#include <stdlib.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* ---- Types ---- */
+
+/*  HEALPix pixel vs. region classification codes.
+ */
+typedef enum {
+    SCISQL_HPX_DISJOINT = 0,  /* pixel disjoint from region */
+    SCISQL_HPX_INTERSECT = 1, /* pixel may intersect region */
+    SCISQL_HPX_INSIDE = 2     /* pixel completely inside region */
+} _scisql_hpxcov;
+
+/*  A circle bounding a HEALPix pixel.
+ */
+typedef struct {
+    scisql_v3 center; /* pixel center */
+    double radius;    /* bounding circle radius, radians */
+    double sinr;      /* sine of radius, or 1 if radius exceeds pi/2 */
+} _scisql_hpxpix;
+
+typedef _scisql_hpxcov (*_scisql_hpxcovfn)(const _scisql_hpxpix *pix,
+                                           const void *region);
+
+/*  State for a HEALPix coverage computation.
+ */
+typedef struct {
+    scisql_ids *ids;       /* output range list */
+    _scisql_hpxcovfn covfn; /* pixel vs. region classification function */
+    const void *region;    /* region to cover */
+    int order;             /* order of output IDs */
+    int efforder;          /* effective subdivision order */
+    size_t limit;          /* range count triggering an order reduction */
+} _scisql_hpxcover;
+
+
+/* ---- Data ---- */
+
+/*  Ring number (in units of Nside) of the southern corner of each face,
+    counted from the north pole.
+ */
+static const int _scisql_hpx_jrll[SCISQL_HPX_NBASE] = {
+    2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4
+};
+
+/*  Longitude (in units of pi/4) of the southern corner of each face.
+ */
+static const int _scisql_hpx_jpll[SCISQL_HPX_NBASE] = {
+    1, 3, 5, 7, 0, 2, 4, 6, 1, 3, 5, 7
+};
+
+/*  Pixel bounding circles are computed from the distances between the
+    pixel center and its corners and edge mid-points. Since pixel edges
+    are not great circles, the largest of these distances could in
+    principle underestimate the true bounding radius (in practice, the
+    farthest boundary point is a corner). As a safeguard, it is scaled by
+    SCISQL_HPX_RADIUS_PAD and increased by SCISQL_HPX_RADIUS_EPS radians.
+ */
+#define SCISQL_HPX_RADIUS_PAD 1.01
+#define SCISQL_HPX_RADIUS_EPS 1.0e-12
+
+
+/* ---- Implementation details ---- */
+
+/*  Spreads the low 32 bits of v to the even bits of the result.
+ */
+SCISQL_INLINE int64_t _scisql_hpx_spread(uint64_t v) {
+    v &= UINT64_C(0x00000000ffffffff);
+    v = (v | (v << 16)) & UINT64_C(0x0000ffff0000ffff);
+    v = (v | (v << 8)) & UINT64_C(0x00ff00ff00ff00ff);
+    v = (v | (v << 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    v = (v | (v << 2)) & UINT64_C(0x3333333333333333);
+    v = (v | (v << 1)) & UINT64_C(0x5555555555555555);
+    return (int64_t) v;
+}
+
+/*  Gathers the even bits of v into the low 32 bits of the result.
+ */
+SCISQL_INLINE int64_t _scisql_hpx_compress(uint64_t v) {
+    v &= UINT64_C(0x5555555555555555);
+    v = (v | (v >> 1)) & UINT64_C(0x3333333333333333);
+    v = (v | (v >> 2)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+    v = (v | (v >> 4)) & UINT64_C(0x00ff00ff00ff00ff);
+    v = (v | (v >> 8)) & UINT64_C(0x0000ffff0000ffff);
+    v = (v | (v >> 16)) & UINT64_C(0x00000000ffffffff);
+    return (int64_t) v;
+}
+
+SCISQL_INLINE int64_t _scisql_hpx_xyf2nest(int64_t ix,
+                                           int64_t iy,
+                                           int face,
+                                           int order)
+{
+    return (((int64_t) face) << 2*order) +
+           _scisql_hpx_spread((uint64_t) ix) +
+           (_scisql_hpx_spread((uint64_t) iy) << 1);
+}
+
+SCISQL_INLINE void _scisql_hpx_nest2xyf(int64_t *ix,
+                                        int64_t *iy,
+                                        int *face,
+                                        int64_t id,
+                                        int order)
+{
+    int64_t p = id & ((((int64_t) 1) << 2*order) - 1);
+    *face = (int) (id >> 2*order);
+    *ix = _scisql_hpx_compress((uint64_t) p);
+    *iy = _scisql_hpx_compress((uint64_t) p >> 1);
+}
+
+SCISQL_INLINE int _scisql_hpx_valid(int64_t id, int order) {
+    return order >= 0 && order <= SCISQL_HPX_MAX_ORDER && id >= 0 &&
+           id < (((int64_t) SCISQL_HPX_NBASE) << 2*order);
+}
+
+/*  Computes the unit vector corresponding to the continuous coordinates
+    (x, y) on the given face, where (0, 0) is the southern corner and
+    (1, 1) the northern corner of the face.
+ */
+static void _scisql_hpx_xyf2v3(scisql_v3 *out, double x, double y, int face) {
+    double jr = _scisql_hpx_jrll[face] - x - y;
+    double nr, z, sth, phi, tmp;
+
+    if (jr < 1.0) {
+        /* north polar cap */
+        nr = jr;
+        tmp = nr*nr/3.0;
+        z = 1.0 - tmp;
+        sth = sqrt(tmp*(2.0 - tmp));
+    } else if (jr > 3.0) {
+        /* south polar cap */
+        nr = 4.0 - jr;
+        tmp = nr*nr/3.0;
+        z = tmp - 1.0;
+        sth = sqrt(tmp*(2.0 - tmp));
+    } else {
+        /* equatorial region */
+        nr = 1.0;
+        z = (2.0 - jr)*2.0/3.0;
+        sth = sqrt((1.0 - z)*(1.0 + z));
+    }
+    tmp = _scisql_hpx_jpll[face]*nr + x - y;
+    if (tmp < 0.0) {
+        tmp += 8.0;
+    } else if (tmp >= 8.0) {
+        tmp -= 8.0;
+    }
+    phi = (nr < 1.0e-15) ? 0.0 : (45.0*SCISQL_RAD_PER_DEG*tmp)/nr;
+    out->x = sth*cos(phi);
+    out->y = sth*sin(phi);
+    out->z = z;
+}
+
+/*  Returns the angle (in radians) between unit vectors v1 and v2.
+ */
+SCISQL_INLINE double _scisql_hpx_angle(const scisql_v3 *v1,
+                                       const scisql_v3 *v2)
+{
+    double d = 0.5*sqrt(scisql_v3_dist2(v1, v2));
+    return 2.0*asin(d > 1.0 ? 1.0 : d);
+}
+
+/*  Computes a bounding circle for the pixel with the given nested ID.
+ */
+static void _scisql_hpxpix_init(_scisql_hpxpix *pix, int64_t id, int order) {
+    static const double dx[8] = { 1.0, 0.5, 0.0, 0.0, 0.0, 0.5, 1.0, 1.0 };
+    static const double dy[8] = { 1.0, 1.0, 1.0, 0.5, 0.0, 0.0, 0.0, 0.5 };
+    int64_t ix, iy;
+    int face, i;
+    double scale = 1.0 / (double) (((int64_t) 1) << order);
+    double r = 0.0;
+
+    _scisql_hpx_nest2xyf(&ix, &iy, &face, id, order);
+    _scisql_hpx_xyf2v3(&pix->center, (ix + 0.5)*scale, (iy + 0.5)*scale, face);
+    for (i = 0; i < 8; ++i) {
+        scisql_v3 v;
+        double a;
+        _scisql_hpx_xyf2v3(&v, (ix + dx[i])*scale, (iy + dy[i])*scale, face);
+        a = _scisql_hpx_angle(&pix->center, &v);
+        r = (a > r) ? a : r;
+    }
+    pix->radius = r*SCISQL_HPX_RADIUS_PAD + SCISQL_HPX_RADIUS_EPS;
+    pix->sinr = (pix->radius >= 90.0*SCISQL_RAD_PER_DEG) ? 1.0 : sin(pix->radius);
+}
+
+
+/*  A spherical circle, with its radius in radians.
+ */
+typedef struct {
+    const scisql_v3 *center;
+    double radius;
+} _scisql_hpx_s2circle;
+
+static _scisql_hpxcov _scisql_s2circle_hpxcov(const _scisql_hpxpix *pix,
+                                              const void *region)
+{
+    const _scisql_hpx_s2circle *c = (const _scisql_hpx_s2circle *) region;
+    double d = _scisql_hpx_angle(c->center, &pix->center);
+    if (d > c->radius + pix->radius) {
+        return SCISQL_HPX_DISJOINT;
+    } else if (d + pix->radius <= c->radius) {
+        return SCISQL_HPX_INSIDE;
+    }
+    return SCISQL_HPX_INTERSECT;
+}
+
+/*  A spherical convex polygon, with unit edge plane normals.
+ */
+typedef struct {
+    size_t n;
+    scisql_v3 edges[SCISQL_MAX_VERTS];
+} _scisql_hpx_s2cpoly;
+
+static _scisql_hpxcov _scisql_s2cpoly_hpxcov(const _scisql_hpxpix *pix,
+                                             const void *region)
+{
+    const _scisql_hpx_s2cpoly *p = (const _scisql_hpx_s2cpoly *) region;
+    size_t i, nin = 0;
+    if (pix->sinr >= 1.0) {
+        return SCISQL_HPX_INTERSECT;
+    }
+    for (i = 0; i < p->n; ++i) {
+        double d = scisql_v3_dot(&p->edges[i], &pix->center);
+        if (d < -pix->sinr) {
+            /* bounding circle is outside the half-space of edge i */
+            return SCISQL_HPX_DISJOINT;
+        }
+        nin += (d >= pix->sinr);
+    }
+    return (nin == p->n) ? SCISQL_HPX_INSIDE : SCISQL_HPX_INTERSECT;
+}
+
+/*  Appends the ID ranges of the descendants of the given pixel that
+    overlap the coverage region to cov->ids. Pixels are visited in nested
+    ID order, so that ranges are generated in sorted order. Once cov->limit
+    ranges have been generated, the effective subdivision order is reduced
+    just like in the HTM coverage functions.
+
+    Returns 0 on success and 1 if memory (re)allocation fails, in which
+    case cov->ids is freed and set to 0.
+ */
+static int _scisql_hpx_cover(_scisql_hpxcover *cov, int64_t id, int order) {
+    _scisql_hpxpix pix;
+    _scisql_hpxcov c;
+    int shift;
+
+    _scisql_hpxpix_init(&pix, id, order);
+    c = (*cov->covfn)(&pix, cov->region);
+    if (c == SCISQL_HPX_DISJOINT) {
+        return 0;
+    }
+    if (c == SCISQL_HPX_INTERSECT && order < cov->efforder) {
+        int64_t child;
+        for (child = 4*id; child < 4*id + 4; ++child) {
+            if (_scisql_hpx_cover(cov, child, order + 1) != 0) {
+                return 1;
+            }
+            if (order >= cov->efforder) {
+                /* the range list now covers this entire pixel */
+                break;
+            }
+        }
+        return 0;
+    }
+    shift = 2*(cov->order - order);
+    cov->ids = scisql_ids_add(cov->ids, id << shift, ((id + 1) << shift) - 1);
+    if (cov->ids == 0) {
+        return 1;
+    }
+    while (cov->ids->n > cov->limit && cov->efforder != 0) {
+        /* too many ranges: reduce effective subdivision order */
+        --cov->efforder;
+        scisql_ids_simplify(cov->ids, cov->order - cov->efforder);
+    }
+    return 0;
+}
+
+/*  Computes the nested ID ranges of the pixels overlapping a region.
+ */
+static scisql_ids * _scisql_hpx_cover_region(scisql_ids *ids,
+                                             _scisql_hpxcovfn covfn,
+                                             const void *region,
+                                             int order,
+                                             size_t maxranges)
+{
+    _scisql_hpxcover cov;
+    int face;
+
+    ids = scisql_ids_reset(ids);
+    if (ids == 0) {
+        return 0;
+    }
+    cov.ids = ids;
+    cov.covfn = covfn;
+    cov.region = region;
+    cov.order = order;
+    cov.efforder = order;
+    cov.limit = scisql_ids_coarsen_limit(maxranges);
+    for (face = 0; face < SCISQL_HPX_NBASE; ++face) {
+        if (_scisql_hpx_cover(&cov, face, 0) != 0) {
+            return 0;
+        }
+    }
+    return scisql_ids_coarsen(cov.ids, maxranges);
+}
+
+
+/* ---- API ---- */
+
+SCISQL_LOCAL int64_t scisql_v3_hpxid(const scisql_v3 *point, int order) {
+    double norm, z, za, sth, tt;
+    int64_t nside;
+
+    if (point == 0 || order < 0 || order > SCISQL_HPX_MAX_ORDER) {
+        return -1;
+    }
+    norm = scisql_v3_norm(point);
+    if (norm == 0.0) {
+        return -1;
+    }
+    nside = ((int64_t) 1) << order;
+    z = point->z / norm;
+    za = fabs(z);
+    sth = sqrt(point->x*point->x + point->y*point->y) / norm;
+    /* longitude in units of pi/2, in [0, 4) */
+    tt = atan2(point->y, point->x) * (2.0 / (180.0*SCISQL_RAD_PER_DEG));
+    if (tt < 0.0) {
+        tt += 4.0;
+        if (tt >= 4.0) {
+            tt = 0.0;
+        }
+    }
+    if (za <= 2.0/3.0) {
+        /* equatorial region */
+        double temp1 = nside*(0.5 + tt);
+        double temp2 = nside*(z*0.75);
+        int64_t jp = (int64_t) (temp1 - temp2); /* ascending edge line */
+        int64_t jm = (int64_t) (temp1 + temp2); /* descending edge line */
+        int64_t ifp = jp >> order;
+        int64_t ifm = jm >> order;
+        int face;
+        if (ifp == ifm) {
+            face = (int) (ifp | 4);
+        } else if (ifp < ifm) {
+            face = (int) ifp;
+        } else {
+            face = (int) (ifm + 8);
+        }
+        return _scisql_hpx_xyf2nest(jm & (nside - 1),
+                                    nside - (jp & (nside - 1)) - 1,
+                                    face, order);
+    } else {
+        /* polar caps */
+        int ntt = (tt >= 3.0) ? 3 : (int) tt;
+        double tp = tt - ntt;
+        double tmp = (za < 0.99) ? nside*sqrt(3.0*(1.0 - za)) :
+                                   nside*sth/sqrt((1.0 + za)/3.0);
+        int64_t jp = (int64_t) (tp*tmp);         /* increasing edge line */
+        int64_t jm = (int64_t) ((1.0 - tp)*tmp); /* decreasing edge line */
+        /* guard against points very close to the pixel boundary */
+        jp = (jp < nside - 1) ? jp : nside - 1;
+        jm = (jm < nside - 1) ? jm : nside - 1;
+        if (z >= 0.0) {
+            return _scisql_hpx_xyf2nest(nside - jm - 1, nside - jp - 1,
+                                        ntt, order);
+        }
+        return _scisql_hpx_xyf2nest(jp, jm, ntt + 8, order);
+    }
+}
+
+
+SCISQL_LOCAL int64_t scisql_hpx_nest2ring(int64_t id, int order) {
+    int64_t nside, nl4, ix, iy, jr, nr, n_before, kshift, jp;
+    int face;
+
+    if (!_scisql_hpx_valid(id, order)) {
+        return -1;
+    }
+    nside = ((int64_t) 1) << order;
+    nl4 = 4*nside;
+    _scisql_hpx_nest2xyf(&ix, &iy, &face, id, order);
+    /* ring number, counted from the north pole */
+    jr = _scisql_hpx_jrll[face]*nside - ix - iy - 1;
+    if (jr < nside) {
+        nr = jr;
+        n_before = 2*nr*(nr - 1);
+        kshift = 0;
+    } else if (jr > 3*nside) {
+        nr = nl4 - jr;
+        n_before = SCISQL_HPX_NBASE*nside*nside - 2*(nr + 1)*nr;
+        kshift = 0;
+    } else {
+        nr = nside;
+        n_before = 2*nside*(nside - 1) + (jr - nside)*nl4;
+        kshift = (jr - nside) & 1;
+    }
+    /* pixel number in ring */
+    jp = (_scisql_hpx_jpll[face]*nr + ix - iy + 1 + kshift) / 2;
+    if (jp > nl4) {
+        jp -= nl4;
+    } else if (jp < 1) {
+        jp += nl4;
+    }
+    return n_before + jp - 1;
+}
+
+
+SCISQL_LOCAL int scisql_hpx_center(scisql_v3 *center, int64_t id, int order) {
+    int64_t ix, iy;
+    int face;
+    double scale;
+
+    if (center == 0 || !_scisql_hpx_valid(id, order)) {
+        return 1;
+    }
+    scale = 1.0 / (double) (((int64_t) 1) << order);
+    _scisql_hpx_nest2xyf(&ix, &iy, &face, id, order);
+    _scisql_hpx_xyf2v3(center, (ix + 0.5)*scale, (iy + 0.5)*scale, face);
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_hpx_boundary(scisql_v3 *verts,
+                                     int64_t id,
+                                     int order,
+                                     int step)
+{
+    int64_t ix, iy;
+    int face, i;
+    double scale, xc, yc, dc, d;
+
+    if (verts == 0 || step < 1 || !_scisql_hpx_valid(id, order)) {
+        return 1;
+    }
+    scale = 1.0 / (double) (((int64_t) 1) << order);
+    _scisql_hpx_nest2xyf(&ix, &iy, &face, id, order);
+    xc = (ix + 0.5)*scale;
+    yc = (iy + 0.5)*scale;
+    dc = 0.5*scale;
+    d = scale / step;
+    for (i = 0; i < step; ++i) {
+        _scisql_hpx_xyf2v3(&verts[i], xc + dc - i*d, yc + dc, face);
+        _scisql_hpx_xyf2v3(&verts[i + step], xc - dc, yc + dc - i*d, face);
+        _scisql_hpx_xyf2v3(&verts[i + 2*step], xc - dc + i*d, yc - dc, face);
+        _scisql_hpx_xyf2v3(&verts[i + 3*step], xc + dc, yc - dc + i*d, face);
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2circle_hpxids(scisql_ids *ids,
+                                                 const scisql_v3 *center,
+                                                 double radius,
+                                                 int order,
+                                                 size_t maxranges)
+{
+    _scisql_hpx_s2circle circle;
+
+    if (center == 0 || order < 0 || order > SCISQL_HPX_MAX_ORDER) {
+        return 0;
+    }
+    if (radius >= 180.0) {
+        /* the entire sky */
+        ids = scisql_ids_reset(ids);
+        if (ids == 0) {
+            return 0;
+        }
+        return scisql_ids_add(
+            ids, 0, (((int64_t) SCISQL_HPX_NBASE) << 2*order) - 1);
+    }
+    circle.center = center;
+    circle.radius = (radius < 0.0) ? -1.0 : radius*SCISQL_RAD_PER_DEG;
+    return _scisql_hpx_cover_region(ids, &_scisql_s2circle_hpxcov, &circle,
+                                    order, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2cpoly_hpxids(scisql_ids *ids,
+                                                const scisql_s2cpoly *poly,
+                                                int order,
+                                                size_t maxranges)
+{
+    _scisql_hpx_s2cpoly p;
+    size_t i;
+
+    if (poly == 0 || order < 0 || order > SCISQL_HPX_MAX_ORDER) {
+        return 0;
+    }
+    p.n = poly->n;
+    for (i = 0; i < poly->n; ++i) {
+        scisql_v3_normalize(&p.edges[i], &poly->edges[i]);
+    }
+    return _scisql_hpx_cover_region(ids, &_scisql_s2cpoly_hpxcov, &p,
+                                    order, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_hpxids(scisql_ids *ids,
+                                                const scisql_s2lpoly *poly,
+                                                int order,
+                                                size_t maxranges)
+{
+    return scisql_s2lpoly_cover(ids, poly, order, maxranges,
+                                &scisql_s2cpoly_hpxids);
+}
+
+#ifdef __cplusplus
+}
+#endif
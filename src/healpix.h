@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    A minimalistic set of functions for HEALPix indexing.
+
+    HEALPix divides the sphere into 12 base pixels, each of which is
+    recursively divided into 4 pixels of equal area. At order k (where
+    Nside = 2^k) there are 12*4^k pixels. In the nested numbering scheme,
+    the 4 children of pixel p have IDs 4*p, ..., 4*p + 3, so that range
+    lists of nested IDs can be manipulated with the same functions as
+    HTM ID range lists (see htm.h). Nested IDs carry no order information
+    and must always be accompanied by their order.
+
+    The pixelization is described in:
+
+    http://adsabs.harvard.edu/abs/2005ApJ...622..759G
+*/
+
+#ifndef SCISQL_HEALPIX_H
+#define SCISQL_HEALPIX_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "geometry.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Maximum HEALPix order */
+#define SCISQL_HPX_MAX_ORDER 29
+
+/* Number of HEALPix base pixels */
+#define SCISQL_HPX_NBASE 12
+
+/*  Computes the nested HEALPix ID of a position.
+
+    Returns -1 if v is 0 or order is not in [0, SCISQL_HPX_MAX_ORDER].
+    Valid IDs are always non-negative.
+ */
+SCISQL_LOCAL int64_t scisql_v3_hpxid(const scisql_v3 *point, int order);
+
+/*  Converts a nested HEALPix ID at the given order to the corresponding
+    ring scheme ID.
+
+    Returns -1 if order is not in [0, SCISQL_HPX_MAX_ORDER] or id is not a
+    valid nested ID at that order.
+ */
+SCISQL_LOCAL int64_t scisql_hpx_nest2ring(int64_t id, int order);
+
+/*  Stores the center of the HEALPix pixel with the given nested ID and
+    order in center.
+
+    Returns 0 on success and a non-zero value if center is 0, order is
+    not in [0, SCISQL_HPX_MAX_ORDER], or id is not a valid nested ID.
+ */
+SCISQL_LOCAL int scisql_hpx_center(scisql_v3 *center, int64_t id, int order);
+
+/*  Computes 4*step points on the boundary of the HEALPix pixel with the
+    given nested ID and order, and stores them in verts. HEALPix pixel
+    edges are not great circles, so step > 1 yields a better approximation
+    of the pixel than its corners alone. The first point is the northern
+    corner of the pixel, followed by points along the edge towards the
+    western corner, the southern and eastern corners, and points along the
+    remaining edges.
+
+    Returns 0 on success and a non-zero value if verts is 0, step < 1,
+    order is not in [0, SCISQL_HPX_MAX_ORDER], or id is not a valid
+    nested ID.
+ */
+SCISQL_LOCAL int scisql_hpx_boundary(scisql_v3 *verts,
+                                     int64_t id,
+                                     int order,
+                                     int step);
+
+/*  Computes a list of nested HEALPix ID ranges corresponding to the pixels
+    overlapping the given circle. Pixels are tested against the circle
+    using conservative bounding circles, so the range list may include a
+    few pixels very close to, but outside of, the circle.
+
+    Inputs:
+        ids        Existing id range list or 0, as for
+                   scisql_s2circle_htmids().
+        center     Center of circle, must be a unit vector.
+        radius     Circle radius, degrees.
+        order      HEALPix order, [0, SCISQL_HPX_MAX_ORDER].
+        maxranges  Maximum number of ranges to return, as for
+                   scisql_s2circle_htmids().
+
+    Return:
+        A list of nested ID ranges for the pixels overlapping the given
+        circle. A null pointer is returned if center == 0 or order is not
+        in the range [0, SCISQL_HPX_MAX_ORDER], or if an internal memory
+        (re)allocation fails. The notes for scisql_s2circle_htmids() on
+        input list reallocation and cleanup apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2circle_hpxids(scisql_ids *ids,
+                                                 const scisql_v3 *center,
+                                                 double radius,
+                                                 int order,
+                                                 size_t maxranges);
+
+/*  Computes a list of nested HEALPix ID ranges corresponding to the pixels
+    overlapping the given spherical convex polygon. As for
+    scisql_s2circle_hpxids(), the range list may include a few pixels very
+    close to, but outside of, the polygon.
+
+    Inputs:
+        ids        Existing id range list or 0, as for
+                   scisql_s2circle_htmids().
+        poly       Spherical convex polygon.
+        order      HEALPix order, [0, SCISQL_HPX_MAX_ORDER].
+        maxranges  Maximum number of ranges to return, as for
+                   scisql_s2circle_htmids().
+
+    Return:
+        A list of nested ID ranges for the pixels overlapping the given
+        polygon. A null pointer is returned if poly == 0 or order is not
+        in the range [0, SCISQL_HPX_MAX_ORDER], or if an internal memory
+        (re)allocation fails. The notes for scisql_s2circle_htmids() on
+        input list reallocation and cleanup apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2cpoly_hpxids(scisql_ids *ids,
+                                                const scisql_s2cpoly *poly,
+                                                int order,
+                                                size_t maxranges);
+
+/*  Computes a list of nested HEALPix ID ranges corresponding to the pixels
+    overlapping a large spherical convex polygon. This is
+    scisql_s2lpoly_cover() with scisql_s2cpoly_hpxids() as fn.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_hpxids(scisql_ids *ids,
+                                                const scisql_s2lpoly *poly,
+                                                int order,
+                                                size_t maxranges);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCISQL_HEALPIX_H */
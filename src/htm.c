@@ -33,6 +33,13 @@
 #include "htm.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if HAVE_AVX2_INTRINSICS || HAVE_AVX512F_INTRINSICS
+#   include <immintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -100,6 +107,13 @@ typedef enum {
     SCISQL_INSIDE = 3     /* HTM triangle completely inside region */
 } _scisql_htmcov;
 
+/*  Precomputed subdivision data for an HTM triangle.
+ */
+typedef struct {
+  scisql_v3 mid_vert[3];    /* triangle edge mid-points */
+  scisql_v3 mid_edge[3];    /* subdivision plane normals */
+} _scisql_htmsub;
+
 /*  A node (triangle/trixel) in an HTM tree.
  */
 typedef struct {
@@ -107,6 +121,7 @@ typedef struct {
   scisql_v3 mid_edge[3];    /* subdivision plane normals */
   const scisql_v3 *vert[3]; /* triangle vertex pointers */
   const scisql_v3 *edge[3]; /* triangle edge normal pointers */
+  const _scisql_htmsub *sub; /* precomputed subdivision data, or 0 */
   scisql_v3p *end;          /* temporary used for indexing */
   int64_t id;               /* HTM ID of the node */
   int child;                /* index of next child (0-3) */
@@ -120,6 +135,61 @@ typedef struct {
 } _scisql_htmpath;
 
 
+/*  A subtree sorting task for the parallel HTM sort: the points in
+    [beg, end) all belong to the HTM triangle with the given id and level.
+    Triangle vertices and edge normals are stored by value, since tasks
+    outlive the path nodes they are created from.
+ */
+typedef struct {
+  scisql_v3 vert[3];         /* triangle vertices */
+  scisql_v3 edge[3];         /* triangle edge normals */
+  const _scisql_htmsub *sub; /* precomputed subdivision data, or 0 */
+  int64_t id;                /* HTM ID of the triangle */
+  int level;                 /* HTM level of the triangle */
+  size_t beg;                /* index of first point in the task */
+  size_t end;                /* index of one past the last point */
+} _scisql_htmtask;
+
+/*  Maximum number of tasks in a work-stealing deque. Since a worker always
+    processes its most recently created task first, and each split creates
+    at most 4 tasks, the number of queued tasks grows by at most 3 per HTM
+    level.
+ */
+#define SCISQL_HTM_DEQUE_CAP 128
+
+/*  A work-stealing deque, implemented as a ring buffer. The owning thread
+    pushes and pops tasks at the bottom, other threads steal from the top.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t top;               /* index of the top task */
+  size_t n;                 /* number of queued tasks */
+  _scisql_htmtask tasks[SCISQL_HTM_DEQUE_CAP];
+} _scisql_htmdeque;
+
+/*  State shared by the threads of a parallel HTM sort.
+ */
+typedef struct {
+  scisql_v3p *points;
+  int64_t *ids;
+  _scisql_htmdeque *deques; /* one deque per thread */
+  int nthreads;
+  int level;                /* HTM level of the output ids */
+  pthread_mutex_t lock;     /* protects the members below */
+  pthread_cond_t cond;      /* signalled when tasks are created or
+                               when all tasks have completed */
+  size_t pending;           /* number of queued or running tasks */
+  size_t generation;        /* incremented whenever tasks are queued */
+} _scisql_htmsched;
+
+/*  Arguments for a parallel HTM sort thread.
+ */
+typedef struct {
+  _scisql_htmsched *sched;
+  int thread;
+} _scisql_htmworker;
+
+
 /* ---- Data ---- */
 
 /*  HTM root triangle vertices/edge plane normals.
@@ -167,13 +237,98 @@ static const scisql_v3 * const _scisql_htm_root_edge[24] = {
 };
 
 
+/*  Number of HTM subdivision levels for which triangle edge mid-points and
+    subdivision plane normals are precomputed. The table contains an entry
+    for each of the 8*(4^N - 1)/3 triangles with level less than N (10920
+    entries or about 1.5MB for N = 6); entries for the triangles of level L
+    are stored contiguously and in HTM ID order. The table lets level N be
+    reached with 1-3 dot products per level, rather than by recomputing
+    mid-points and normals on every call.
+ */
+#define SCISQL_HTM_TABLE_LEVELS 6
+#define SCISQL_HTM_TABLE_SIZE (8*((1 << 2*SCISQL_HTM_TABLE_LEVELS) - 1)/3)
+
+static _scisql_htmsub _scisql_htm_table[SCISQL_HTM_TABLE_SIZE];
+static pthread_once_t _scisql_htm_table_once = PTHREAD_ONCE_INIT;
+
+
 /* ---- Implementation details ---- */
 
+/*  Computes the normalized average of two input vertices.
+ */
+SCISQL_INLINE void _scisql_htm_vertex(scisql_v3 *out,
+                                      const scisql_v3 *v1,
+                                      const scisql_v3 *v2)
+{
+    scisql_v3_add(out, v1, v2);
+    scisql_v3_normalize(out, out);
+}
+
+/*  Recursively fills in the subdivision table entry with index i for the
+    HTM triangle (v0,v1,v2), along with the entries of its descendants.
+    The children of the triangle with table index i have indexes 4*i + 8,
+    4*i + 9, 4*i + 10 and 4*i + 11. Mid-points and plane normals are
+    computed exactly as in _scisql_htmnode_prep0/1/2 and scisql_v3_htmid.
+ */
+static void _scisql_htmsub_init(size_t i,
+                                const scisql_v3 *v0,
+                                const scisql_v3 *v1,
+                                const scisql_v3 *v2)
+{
+    _scisql_htmsub *sub = &_scisql_htm_table[i];
+    _scisql_htm_vertex(&sub->mid_vert[1], v2, v0);
+    _scisql_htm_vertex(&sub->mid_vert[2], v0, v1);
+    scisql_v3_rcross(&sub->mid_edge[1], &sub->mid_vert[2], &sub->mid_vert[1]);
+    _scisql_htm_vertex(&sub->mid_vert[0], v1, v2);
+    scisql_v3_rcross(&sub->mid_edge[2], &sub->mid_vert[0], &sub->mid_vert[2]);
+    scisql_v3_rcross(&sub->mid_edge[0], &sub->mid_vert[1], &sub->mid_vert[0]);
+    i = 4*i + 8;
+    if (i < SCISQL_HTM_TABLE_SIZE) {
+        _scisql_htmsub_init(i, v0, &sub->mid_vert[2], &sub->mid_vert[1]);
+        _scisql_htmsub_init(i + 1, v1, &sub->mid_vert[0], &sub->mid_vert[2]);
+        _scisql_htmsub_init(i + 2, v2, &sub->mid_vert[1], &sub->mid_vert[0]);
+        _scisql_htmsub_init(i + 3, &sub->mid_vert[0], &sub->mid_vert[1],
+                            &sub->mid_vert[2]);
+    }
+}
+
+static void _scisql_htm_table_init(void) {
+    scisql_htmroot r;
+    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3; ++r) {
+        _scisql_htmsub_init(r, _scisql_htm_root_vert[r*3],
+                            _scisql_htm_root_vert[r*3 + 1],
+                            _scisql_htm_root_vert[r*3 + 2]);
+    }
+}
+
+/*  Returns the subdivision table, computing it on first use.
+ */
+SCISQL_INLINE const _scisql_htmsub * _scisql_htm_table_get(void) {
+    pthread_once(&_scisql_htm_table_once, &_scisql_htm_table_init);
+    return _scisql_htm_table;
+}
+
+/*  Returns the subdivision table entry for child c of the triangle with
+    table index i, or 0 if the child is too deep to have one.
+ */
+SCISQL_INLINE const _scisql_htmsub * _scisql_htmsub_child(
+    const _scisql_htmsub *sub,
+    int c)
+{
+    size_t i;
+    if (sub == 0) {
+        return 0;
+    }
+    i = 4*(size_t) (sub - _scisql_htm_table) + 8 + c;
+    return (i < SCISQL_HTM_TABLE_SIZE) ? &_scisql_htm_table[i] : 0;
+}
+
 /*  Sets path to the i-th HTM root triangle.
  */
 SCISQL_INLINE void _scisql_htmpath_root(_scisql_htmpath *path,
                                         scisql_htmroot r)
 {
+    path->node[0].sub = &_scisql_htm_table_get()[r];
     path->node[0].vert[0] = _scisql_htm_root_vert[r*3];
     path->node[0].vert[1] = _scisql_htm_root_vert[r*3 + 1];
     path->node[0].vert[2] = _scisql_htm_root_vert[r*3 + 2];
@@ -185,19 +340,15 @@ SCISQL_INLINE void _scisql_htmpath_root(_scisql_htmpath *path,
     path->root = r;
 }
 
-/*  Computes the normalized average of two input vertices.
- */
-SCISQL_INLINE void _scisql_htm_vertex(scisql_v3 *out,
-                                      const scisql_v3 *v1,
-                                      const scisql_v3 *v2)
-{
-    scisql_v3_add(out, v1, v2);
-    scisql_v3_normalize(out, out);
-}
-
 /*  Computes quantities needed by _scisql_htmnode_make0(node).
  */
 SCISQL_INLINE void _scisql_htmnode_prep0(_scisql_htmnode *node) {
+    if (node->sub != 0) {
+        node->mid_vert[1] = node->sub->mid_vert[1];
+        node->mid_vert[2] = node->sub->mid_vert[2];
+        node->mid_edge[1] = node->sub->mid_edge[1];
+        return;
+    }
     _scisql_htm_vertex(&node->mid_vert[1], node->vert[2], node->vert[0]);
     _scisql_htm_vertex(&node->mid_vert[2], node->vert[0], node->vert[1]);
     scisql_v3_rcross(&node->mid_edge[1], &node->mid_vert[2], &node->mid_vert[1]);
@@ -215,6 +366,7 @@ SCISQL_INLINE void _scisql_htmnode_make0(_scisql_htmnode *node) {
     node[1].edge[2] = node[0].edge[2];
     node[0].child = 1;
     node[1].id = node[0].id << 2;
+    node[1].sub = _scisql_htmsub_child(node[0].sub, 0);
     node[1].child = 0;
 }
 
@@ -222,6 +374,11 @@ SCISQL_INLINE void _scisql_htmnode_make0(_scisql_htmnode *node) {
     _scisql_htmnode_prep0(node) has been called.
  */
 SCISQL_INLINE void _scisql_htmnode_prep1(_scisql_htmnode *node) {
+    if (node->sub != 0) {
+        node->mid_vert[0] = node->sub->mid_vert[0];
+        node->mid_edge[2] = node->sub->mid_edge[2];
+        return;
+    }
     _scisql_htm_vertex(&node->mid_vert[0], node->vert[1], node->vert[2]);
     scisql_v3_rcross(&node->mid_edge[2], &node->mid_vert[0], &node->mid_vert[2]);
 }
@@ -238,6 +395,7 @@ SCISQL_INLINE void _scisql_htmnode_make1(_scisql_htmnode *node) {
     node[1].edge[2] = node[0].edge[0];
     node[0].child = 2;
     node[1].id = (node[0].id << 2) + 1;
+    node[1].sub = _scisql_htmsub_child(node[0].sub, 1);
     node[1].child = 0;
 }
 
@@ -245,6 +403,10 @@ SCISQL_INLINE void _scisql_htmnode_make1(_scisql_htmnode *node) {
     _scisql_htmnode_prep1 has been called.
  */
 SCISQL_INLINE void _scisql_htmnode_prep2(_scisql_htmnode *node) {
+    if (node->sub != 0) {
+        node->mid_edge[0] = node->sub->mid_edge[0];
+        return;
+    }
     scisql_v3_rcross(&node->mid_edge[0], &node->mid_vert[1], &node->mid_vert[0]);
 }
 
@@ -260,6 +422,7 @@ SCISQL_INLINE void _scisql_htmnode_make2(_scisql_htmnode *node) {
     node[1].edge[2] = node[0].edge[1];
     node[0].child = 3;
     node[1].id = (node[0].id << 2) + 2;
+    node[1].sub = _scisql_htmsub_child(node[0].sub, 2);
     node[1].child = 0;
 }
 
@@ -278,6 +441,7 @@ SCISQL_INLINE void _scisql_htmnode_make3(_scisql_htmnode *node) {
     node[1].edge[2] = &node[0].mid_edge[2];
     node[0].child = 4;
     node[1].id = (node[0].id << 2) + 3;
+    node[1].sub = _scisql_htmsub_child(node[0].sub, 3);
     node[1].child = 0;
 }
 
@@ -402,6 +566,222 @@ static void _scisql_htmpath_sort(_scisql_htmpath *path,
     }
 }
 
+/*  Number of points below which a parallel HTM sort task is no longer
+    split into subtasks. Chosen so that the points and ids of a task fit
+    comfortably in a per-core L2 cache.
+ */
+#define SCISQL_HTM_SORT_GRAIN 16384
+
+/*  Initializes a parallel sort task from a path node.
+ */
+static void _scisql_htmtask_init(_scisql_htmtask *task,
+                                 const _scisql_htmnode *node,
+                                 int level,
+                                 size_t beg,
+                                 size_t end)
+{
+    int i;
+    for (i = 0; i < 3; ++i) {
+        task->vert[i] = *node->vert[i];
+        task->edge[i] = *node->edge[i];
+    }
+    task->sub = node->sub;
+    task->id = node->id;
+    task->level = level;
+    task->beg = beg;
+    task->end = end;
+}
+
+/*  Sets node to the triangle of a parallel sort task.
+ */
+static void _scisql_htmtask_node(_scisql_htmnode *node,
+                                 const _scisql_htmtask *task)
+{
+    int i;
+    for (i = 0; i < 3; ++i) {
+        node->vert[i] = &task->vert[i];
+        node->edge[i] = &task->edge[i];
+    }
+    node->sub = task->sub;
+    node->id = task->id;
+    node->child = 0;
+}
+
+/*  Pushes a task onto the bottom of a deque. Returns 1 if the
+    deque is full and 0 otherwise.
+ */
+static int _scisql_htmdeque_push(_scisql_htmdeque *deque,
+                                 const _scisql_htmtask *task)
+{
+    int full;
+    pthread_mutex_lock(&deque->lock);
+    full = (deque->n == SCISQL_HTM_DEQUE_CAP);
+    if (!full) {
+        deque->tasks[(deque->top + deque->n) % SCISQL_HTM_DEQUE_CAP] = *task;
+        ++deque->n;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return full;
+}
+
+/*  Pops a task from the bottom (steal == 0) or top (steal != 0) of a deque.
+    Returns 1 if the deque is empty and 0 otherwise.
+ */
+static int _scisql_htmdeque_pop(_scisql_htmdeque *deque,
+                                _scisql_htmtask *task,
+                                int steal)
+{
+    int empty;
+    pthread_mutex_lock(&deque->lock);
+    empty = (deque->n == 0);
+    if (!empty) {
+        --deque->n;
+        if (steal) {
+            *task = deque->tasks[deque->top];
+            deque->top = (deque->top + 1) % SCISQL_HTM_DEQUE_CAP;
+        } else {
+            *task = deque->tasks[(deque->top + deque->n) % SCISQL_HTM_DEQUE_CAP];
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return empty;
+}
+
+/*  Queues a task on the given deque. The task is counted as pending
+    before it becomes visible to other threads, so that the pending count
+    cannot drop to 0 while the task exists. Returns 1 if the deque is full
+    and 0 otherwise.
+ */
+static int _scisql_htmsched_push(_scisql_htmsched *sched,
+                                 _scisql_htmdeque *deque,
+                                 const _scisql_htmtask *task)
+{
+    int full;
+    pthread_mutex_lock(&sched->lock);
+    ++sched->pending;
+    pthread_mutex_unlock(&sched->lock);
+    full = _scisql_htmdeque_push(deque, task);
+    pthread_mutex_lock(&sched->lock);
+    if (full) {
+        --sched->pending;
+    } else {
+        ++sched->generation;
+        pthread_cond_broadcast(&sched->cond);
+    }
+    pthread_mutex_unlock(&sched->lock);
+    return full;
+}
+
+/*  Sorts the points of a task directly, or if the task is sufficiently
+    large, splits it into (at most 4) child tasks and queues them on the
+    given deque. Child tasks are split off in exactly the same way as in
+    _scisql_htmpath_sort, so the final ordering of points matches that
+    of the serial sort.
+ */
+static void _scisql_htmtask_run(_scisql_htmsched *sched,
+                                _scisql_htmdeque *deque,
+                                const _scisql_htmtask *task)
+{
+    _scisql_htmnode node[2];
+    _scisql_htmtask child[4];
+    scisql_v3p * const points = sched->points;
+    size_t beg, end, m;
+    size_t nchild = 0;
+
+    if (task->level == sched->level ||
+        task->end - task->beg <= SCISQL_HTM_SORT_GRAIN) {
+        _scisql_htmpath path;
+        _scisql_htmtask_node(&path.node[0], task);
+        _scisql_htmpath_sort(&path, points + task->beg, points + task->end,
+                             sched->ids + task->beg, sched->level - task->level);
+        return;
+    }
+    _scisql_htmtask_node(node, task);
+    beg = task->beg;
+    end = task->end;
+    _scisql_htmnode_prep0(node);
+    m = _scisql_htm_partition(&node->mid_edge[1], points + beg, points + end) - points;
+    if (beg < m) {
+        _scisql_htmnode_make0(node);
+        _scisql_htmtask_init(&child[nchild++], &node[1], task->level + 1, beg, m);
+    }
+    beg = m;
+    _scisql_htmnode_prep1(node);
+    m = _scisql_htm_partition(&node->mid_edge[2], points + beg, points + end) - points;
+    if (beg < m) {
+        _scisql_htmnode_make1(node);
+        _scisql_htmtask_init(&child[nchild++], &node[1], task->level + 1, beg, m);
+    }
+    beg = m;
+    _scisql_htmnode_prep2(node);
+    m = _scisql_htm_partition(&node->mid_edge[0], points + beg, points + end) - points;
+    if (beg < m) {
+        _scisql_htmnode_make2(node);
+        _scisql_htmtask_init(&child[nchild++], &node[1], task->level + 1, beg, m);
+    }
+    if (m < end) {
+        _scisql_htmnode_make3(node);
+        _scisql_htmtask_init(&child[nchild++], &node[1], task->level + 1, m, end);
+    }
+    /* queue children in reverse order, so that the owning thread
+       continues with the first child */
+    while (nchild > 0) {
+        --nchild;
+        if (_scisql_htmsched_push(sched, deque, &child[nchild]) != 0) {
+            /* deque is full - process the task immediately */
+            _scisql_htmtask_run(sched, deque, &child[nchild]);
+        }
+    }
+}
+
+/*  Parallel HTM sort thread. Tasks are taken from the thread's own
+    deque, or stolen from other threads when it is empty.
+ */
+static void * _scisql_htmsort_worker(void *arg) {
+    _scisql_htmworker *worker = (_scisql_htmworker *) arg;
+    _scisql_htmsched *sched = worker->sched;
+    _scisql_htmdeque *deque = &sched->deques[worker->thread];
+    _scisql_htmtask task;
+    size_t generation;
+    int i;
+
+    while (1) {
+        pthread_mutex_lock(&sched->lock);
+        generation = sched->generation;
+        pthread_mutex_unlock(&sched->lock);
+        if (_scisql_htmdeque_pop(deque, &task, 0) != 0) {
+            /* look for a task to steal */
+            for (i = 1; i < sched->nthreads; ++i) {
+                int victim = (worker->thread + i) % sched->nthreads;
+                if (_scisql_htmdeque_pop(&sched->deques[victim], &task, 1) == 0) {
+                    break;
+                }
+            }
+            if (i == sched->nthreads) {
+                /* no work available - wait for tasks to be created,
+                   or for all tasks to complete */
+                pthread_mutex_lock(&sched->lock);
+                while (sched->pending != 0 && sched->generation == generation) {
+                    pthread_cond_wait(&sched->cond, &sched->lock);
+                }
+                if (sched->pending == 0) {
+                    pthread_mutex_unlock(&sched->lock);
+                    return 0;
+                }
+                pthread_mutex_unlock(&sched->lock);
+                continue;
+            }
+        }
+        _scisql_htmtask_run(sched, deque, &task);
+        /* the task and all tasks it queued have been counted */
+        pthread_mutex_lock(&sched->lock);
+        if (--sched->pending == 0) {
+            pthread_cond_broadcast(&sched->cond);
+        }
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
 #define SCISQL_IDS_INIT_CAP 16
 
 static scisql_ids * _scisql_ids_init() {
@@ -651,6 +1031,361 @@ static _scisql_htmcov _scisql_s2cpoly_htmcov(const _scisql_htmnode *node,
     return SCISQL_DISJOINT;
 }
 
+/*  Quantities needed to compute the spatial relationship between HTM
+    triangles and a spherical ellipse.
+
+    A point v (on the same side of the sphere as the ellipse center c)
+    is inside the ellipse if Q(v) = a (v . A)^2 + b (v . B)^2 - (v . c)^2
+    is at most 0, where A and B are unit vectors along the major and minor
+    axes, and a = 1/M^2 - 1, b = 1/m^2 - 1 for semi-axis lengths M and m
+    (radians). Since Q(v) is homogeneous, the ellipse is the intersection
+    of the sphere with an elliptical cone, and its gnomonic projection is
+    an ellipse. It is therefore convex.
+ */
+typedef struct {
+    const scisql_s2ellipse *ellipse;
+    scisql_v3 center; /* c */
+    scisql_v3 major;  /* A */
+    scisql_v3 minor;  /* B */
+    double a;
+    double b;
+    double dist2;     /* square secant distance for the bounding circle */
+} _scisql_s2ellipse_region;
+
+static void _scisql_s2ellipse_region_init(_scisql_s2ellipse_region *r,
+                                          const scisql_s2ellipse *e)
+{
+    scisql_v3 n, east;
+    double M2;
+    r->ellipse = e;
+    r->center.x = e->cosLat * e->cosLon;
+    r->center.y = e->cosLat * e->sinLon;
+    r->center.z = e->sinLat;
+    /* north and east at the ellipse center */
+    n.x = - e->sinLat * e->cosLon;
+    n.y = - e->sinLat * e->sinLon;
+    n.z = e->cosLat;
+    east.x = - e->sinLon;
+    east.y = e->cosLon;
+    east.z = 0.0;
+    r->major.x = e->cosPosAng * n.x + e->sinPosAng * east.x;
+    r->major.y = e->cosPosAng * n.y + e->sinPosAng * east.y;
+    r->major.z = e->cosPosAng * n.z + e->sinPosAng * east.z;
+    r->minor.x = e->cosPosAng * east.x - e->sinPosAng * n.x;
+    r->minor.y = e->cosPosAng * east.y - e->sinPosAng * n.y;
+    r->minor.z = e->cosPosAng * east.z - e->sinPosAng * n.z;
+    r->a = e->invMajor2 - 1.0;
+    r->b = e->invMinor2 - 1.0;
+    /* The ellipse is inside the circle of radius asin(M) around its
+       center. Compute 2 - 2*cos(asin(M)) without cancellation. */
+    M2 = 1.0 / e->invMajor2;
+    r->dist2 = 2.0 * M2 / (1.0 + sqrt(1.0 - M2));
+}
+
+/*  Returns 1 if the edge from v1 to v2 intersects the ellipse, where
+    the i-th element of pa, pb and pc is the dot product of vi with
+    the major axis, minor axis, and center of the ellipse.
+
+    Points on the edge are positive multiples of p(t) = v1 + t (v2 - v1)
+    for t in [0, 1], so Q(p(t)) is a quadratic in t. The points on the
+    edge for which Q(p(t)) <= 0 form at most 2 intervals, each of which
+    lies on one side of the plane through the origin orthogonal to c
+    (p(t) is never 0). Since v1 and v2 are outside the ellipse, only a
+    convex Q(p(t)) can have an interval in the ellipse, and that interval
+    must contain the minimum of Q(p(t)).
+ */
+static int _scisql_s2ellipse_isect_test(const _scisql_s2ellipse_region *r,
+                                        const double pa[2],
+                                        const double pb[2],
+                                        const double pc[2])
+{
+    double da = pa[1] - pa[0];
+    double db = pb[1] - pb[0];
+    double dc = pc[1] - pc[0];
+    double alpha = r->a * da * da + r->b * db * db - dc * dc;
+    double beta = r->a * pa[0] * da + r->b * pb[0] * db - pc[0] * dc;
+    double t, a, b, c;
+    if (alpha <= 0.0) {
+        return 0;
+    }
+    t = scisql_clamp(- beta / alpha, 0.0, 1.0);
+    a = pa[0] + t * da;
+    b = pb[0] + t * db;
+    c = pc[0] + t * dc;
+    return c > 0.0 && r->a * a * a + r->b * b * b - c * c <= 0.0;
+}
+
+/*  Returns the coverage code describing the spatial relationship between the
+    given HTM triangle and spherical ellipse.
+ */
+static _scisql_htmcov _scisql_s2ellipse_htmcov(const _scisql_htmnode *node,
+                                               const _scisql_s2ellipse_region *r)
+{
+    double pa[3], pb[3], pc[3];
+    int i, nin;
+    _scisql_htmcov cov = _scisql_s2circle_htmcov(node, &r->center, r->dist2);
+    if (cov == SCISQL_DISJOINT || cov == SCISQL_CONTAINS) {
+        /* the ellipse is inside its bounding circle */
+        return cov;
+    }
+    for (i = 0, nin = 0; i < 3; ++i) {
+        pa[i] = scisql_v3_dot(node->vert[i], &r->major);
+        pb[i] = scisql_v3_dot(node->vert[i], &r->minor);
+        pc[i] = scisql_v3_dot(node->vert[i], &r->center);
+        nin += (pc[i] > 0.0 && scisql_s2ellipse_cv3(r->ellipse, node->vert[i]));
+    }
+    if (nin == 3) {
+        /* every vertex inside ellipse, so triangle is inside by convexity */
+        return SCISQL_INSIDE;
+    } else if (nin != 0) {
+        return SCISQL_INTERSECT;
+    }
+    for (i = 0; i < 3; ++i) {
+        int j = (i == 2) ? 0 : i + 1;
+        double a[2], b[2], c[2];
+        a[0] = pa[i]; a[1] = pa[j];
+        b[0] = pb[i]; b[1] = pb[j];
+        c[0] = pc[i]; c[1] = pc[j];
+        if (_scisql_s2ellipse_isect_test(r, a, b, c) != 0) {
+            return SCISQL_INTERSECT;
+        }
+    }
+    /* no vertex inside ellipse, no edge intersects the ellipse - ellipse
+       is either inside triangle or disjoint from it */
+    if (scisql_v3_dot(&r->center, node->edge[0]) >= 0.0 &&
+        scisql_v3_dot(&r->center, node->edge[1]) >= 0.0 &&
+        scisql_v3_dot(&r->center, node->edge[2]) >= 0.0) {
+        return SCISQL_CONTAINS;
+    }
+    return SCISQL_DISJOINT;
+}
+
+/*  Tolerance used when deciding that an HTM triangle is disjoint from a
+    longitude/latitude box. Points are only deemed to lie outside of a
+    latitude band or longitude half-space if they do so by more than this
+    amount (a z coordinate, or a dot product with a unit plane normal).
+ */
+#define SCISQL_HTM_BOX_TOL 1.0e-12
+
+/*  Quantities needed to compute the spatial relationship between HTM
+    triangles and a longitude/latitude box. The box is the intersection of
+    the latitude band zmin <= z <= zmax with a longitude lune. The lune is
+    either the intersection (if it is at most 180 degrees wide) or the union
+    of the half-spaces v . east >= 0 and v . west >= 0, where east and west
+    are the normals of the planes containing the minimum and maximum
+    longitude meridians.
+ */
+typedef struct {
+    scisql_v3 east;
+    scisql_v3 west;
+    double zmin;
+    double zmax;
+    int allLon; /* does the box span all longitudes? */
+    int narrow; /* is the lune at most 180 degrees wide? */
+} _scisql_s2box_region;
+
+static void _scisql_s2box_region_init(_scisql_s2box_region *r,
+                                      const scisql_s2box *b)
+{
+    double lonMin = b->lonMin * SCISQL_RAD_PER_DEG;
+    double lonMax = b->lonMax * SCISQL_RAD_PER_DEG;
+    double width = b->lonMax - b->lonMin;
+    if (width < 0.0) {
+        width += 360.0;
+    }
+    r->east.x = - sin(lonMin);
+    r->east.y = cos(lonMin);
+    r->east.z = 0.0;
+    r->west.x = sin(lonMax);
+    r->west.y = - cos(lonMax);
+    r->west.z = 0.0;
+    r->zmin = (b->latMin <= -90.0) ? -1.0 : sin(b->latMin * SCISQL_RAD_PER_DEG);
+    r->zmax = (b->latMax >= 90.0) ? 1.0 : sin(b->latMax * SCISQL_RAD_PER_DEG);
+    r->allLon = b->allLon;
+    r->narrow = (width <= 180.0);
+}
+
+/*  Computes the range of z coordinates [*zlo, *zhi] of the points in an
+    HTM triangle. The extrema are attained at a vertex, at the point of an
+    edge closest to a pole, or at a pole inside the triangle.
+ */
+static void _scisql_htm_zrange(const _scisql_htmnode *node,
+                               double *zlo,
+                               double *zhi)
+{
+    double lo = node->vert[0]->z;
+    double hi = lo;
+    int i, npos = 0, nneg = 0;
+    for (i = 0; i < 3; ++i) {
+        const scisql_v3 *v1 = node->vert[i];
+        const scisql_v3 *v2 = node->vert[(i == 2) ? 0 : i + 1];
+        const scisql_v3 *n = node->edge[i];
+        scisql_v3 p, c;
+        double n2, d1, d2;
+        if (v1->z < lo) {
+            lo = v1->z;
+        } else if (v1->z > hi) {
+            hi = v1->z;
+        }
+        /* p is the point of the edge great circle closest to the north
+           pole (up to scaling), -p the one closest to the south pole */
+        n2 = scisql_v3_norm2(n);
+        p.x = - n->z * n->x;
+        p.y = - n->z * n->y;
+        p.z = n2 - n->z * n->z;
+        scisql_v3_cross(&c, v1, &p);
+        d1 = scisql_v3_dot(&c, n);
+        scisql_v3_cross(&c, &p, v2);
+        d2 = scisql_v3_dot(&c, n);
+        if ((d1 >= 0.0 && d2 >= 0.0) || (d1 <= 0.0 && d2 <= 0.0)) {
+            double z = sqrt((n->x * n->x + n->y * n->y) / n2);
+            if (d1 >= 0.0 && d2 >= 0.0) {
+                /* p is on the edge */
+                hi = (z > hi) ? z : hi;
+            }
+            if (d1 <= 0.0 && d2 <= 0.0) {
+                /* -p is on the edge */
+                lo = (-z < lo) ? -z : lo;
+            }
+        }
+        npos += n->z >= - SCISQL_HTM_BOX_TOL * sqrt(n2);
+        nneg += n->z <= SCISQL_HTM_BOX_TOL * sqrt(n2);
+    }
+    *zlo = (nneg == 3) ? -1.0 : lo;
+    *zhi = (npos == 3) ? 1.0 : hi;
+}
+
+/*  Returns the coverage code describing the spatial relationship between
+    the given HTM triangle and the half-space v . n >= 0, where n is a unit
+    vector. SCISQL_CONTAINS is never returned.
+ */
+static _scisql_htmcov _scisql_halfspace_htmcov(const _scisql_htmnode *node,
+                                               const scisql_v3 *n)
+{
+    double d0 = scisql_v3_dot(node->vert[0], n);
+    double d1 = scisql_v3_dot(node->vert[1], n);
+    double d2 = scisql_v3_dot(node->vert[2], n);
+    if (d0 >= 0.0 && d1 >= 0.0 && d2 >= 0.0) {
+        return SCISQL_INSIDE;
+    }
+    /* the half-space is convex, and so is its complement */
+    if (d0 < - SCISQL_HTM_BOX_TOL && d1 < - SCISQL_HTM_BOX_TOL &&
+        d2 < - SCISQL_HTM_BOX_TOL) {
+        return SCISQL_DISJOINT;
+    }
+    return SCISQL_INTERSECT;
+}
+
+/*  Returns a coverage code describing the spatial relationship between the
+    given HTM triangle and longitude/latitude box. This is conservative:
+    SCISQL_INTERSECT may be returned for triangles that are disjoint from
+    the box, and SCISQL_CONTAINS is never returned.
+ */
+static _scisql_htmcov _scisql_s2box_htmcov(const _scisql_htmnode *node,
+                                           const _scisql_s2box_region *r)
+{
+    _scisql_htmcov cov = SCISQL_INSIDE;
+    double zlo, zhi;
+    _scisql_htm_zrange(node, &zlo, &zhi);
+    if (zhi < r->zmin - SCISQL_HTM_BOX_TOL || zlo > r->zmax + SCISQL_HTM_BOX_TOL) {
+        return SCISQL_DISJOINT;
+    }
+    if (zlo < r->zmin || zhi > r->zmax) {
+        cov = SCISQL_INTERSECT;
+    }
+    if (r->allLon == 0) {
+        _scisql_htmcov e = _scisql_halfspace_htmcov(node, &r->east);
+        _scisql_htmcov w = _scisql_halfspace_htmcov(node, &r->west);
+        if (r->narrow) {
+            /* lune is the intersection of the half-spaces */
+            if (e == SCISQL_DISJOINT || w == SCISQL_DISJOINT) {
+                return SCISQL_DISJOINT;
+            } else if (e != SCISQL_INSIDE || w != SCISQL_INSIDE) {
+                cov = SCISQL_INTERSECT;
+            }
+        } else {
+            /* lune is the union of the half-spaces */
+            if (e == SCISQL_DISJOINT && w == SCISQL_DISJOINT) {
+                return SCISQL_DISJOINT;
+            } else if (e != SCISQL_INSIDE && w != SCISQL_INSIDE) {
+                cov = SCISQL_INTERSECT;
+            }
+        }
+    }
+    return cov;
+}
+
+/*  HTM triangles are only classified as lying inside a region if they lie
+    inside the region shrunk by this angle (radians). This guarantees that
+    a point in such a triangle passes the exact point-in-region test, even
+    though its position and HTM ID are subject to rounding error.
+ */
+#define SCISQL_HTM_INSIDE_MARGIN 1.0e-10
+
+/*  Quantities needed to test whether an HTM triangle lies inside a circle
+    shrunk by SCISQL_HTM_INSIDE_MARGIN.
+ */
+typedef struct {
+    scisql_v3 anticenter; /* antipode of the circle center */
+    double dist2;         /* square secant distance for the shrunk radius */
+    double antidist2;     /* square secant distance for the complement */
+    int convex;           /* is the shrunk radius at most 90 degrees? */
+} _scisql_s2circle_in;
+
+static void _scisql_s2circle_in_init(_scisql_s2circle_in *in,
+                                     const scisql_v3 *center,
+                                     double radius)
+{
+    double r = radius * SCISQL_RAD_PER_DEG - SCISQL_HTM_INSIDE_MARGIN;
+    double d = sin(r * 0.5);
+    in->anticenter.x = -center->x;
+    in->anticenter.y = -center->y;
+    in->anticenter.z = -center->z;
+    in->dist2 = (r < 0.0) ? -1.0 : 4.0 * d * d;
+    d = cos(r * 0.5);
+    in->antidist2 = 4.0 * d * d;
+    in->convex = (r <= 90.0 * SCISQL_RAD_PER_DEG);
+}
+
+/*  Returns 1 if the given HTM triangle lies inside the shrunk circle
+    described by in, and 0 otherwise. A circle with radius at most 90
+    degrees is convex, so it is enough to test the triangle vertices.
+    Otherwise, the triangle must be disjoint from the complement of the
+    circle, which is convex.
+ */
+static int _scisql_s2circle_htmin(const _scisql_htmnode *node,
+                                  const scisql_v3 *center,
+                                  const _scisql_s2circle_in *in)
+{
+    if (in->convex) {
+        return scisql_v3_dist2(center, node->vert[0]) <= in->dist2 &&
+               scisql_v3_dist2(center, node->vert[1]) <= in->dist2 &&
+               scisql_v3_dist2(center, node->vert[2]) <= in->dist2;
+    }
+    return _scisql_s2circle_htmcov(node, &in->anticenter, in->antidist2) ==
+           SCISQL_DISJOINT;
+}
+
+/*  Returns 1 if the given HTM triangle lies inside poly shrunk by
+    SCISQL_HTM_INSIDE_MARGIN, and 0 otherwise. The edge plane normals of
+    poly are not normalized, so the i-th margin is scaled by the norm of
+    the i-th normal, which the caller passes in as tol[i].
+ */
+static int _scisql_s2cpoly_htmin(const _scisql_htmnode *node,
+                                 const scisql_s2cpoly *poly,
+                                 const double *tol)
+{
+    size_t i;
+    for (i = 0; i < poly->n; ++i) {
+        if (scisql_v3_dot(node->vert[0], &poly->edges[i]) < tol[i] ||
+            scisql_v3_dot(node->vert[1], &poly->edges[i]) < tol[i] ||
+            scisql_v3_dot(node->vert[2], &poly->edges[i]) < tol[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /*  Returns the HTM root triangle for a point.
  */
 SCISQL_INLINE scisql_htmroot _scisql_v3_htmroot(const scisql_v3 *v) {
@@ -768,222 +1503,396 @@ static void _scisql_simplify_ids(scisql_ids *ids, int n) {
     ids->n = j;
 }
 
-/*  Counts the number of 1 bits in a 64 bit integer.
+/*  When computing a coverage with a range budget of maxranges, the
+    effective subdivision level is only reduced once the number of ranges
+    exceeds max(maxranges, min(max(SLACK*maxranges, MIN), MAX)). The extra
+    ranges allow _scisql_ids_coarsen() to choose which gaps to fill in,
+    at the cost of a bounded amount of extra work.
  */
-SCISQL_INLINE int _scisql_popcount(uint64_t x) {
-    const uint64_t c1 = UINT64_C(0x5555555555555555); /*  -1/3   */
-    const uint64_t c2 = UINT64_C(0x3333333333333333); /*  -1/5   */
-    const uint64_t c4 = UINT64_C(0x0f0f0f0f0f0f0f0f); /*  -1/17  */
-    const uint64_t f = UINT64_C(0x0101010101010101); /*  -1/255 */
+#define SCISQL_HTM_COARSEN_SLACK 16
+#define SCISQL_HTM_COARSEN_MIN 1024
+#define SCISQL_HTM_COARSEN_MAX (1024*1024)
+
+static size_t _scisql_coarsen_limit(size_t maxranges) {
+    size_t lim;
+    if (maxranges > SCISQL_HTM_COARSEN_MAX / SCISQL_HTM_COARSEN_SLACK) {
+        lim = SCISQL_HTM_COARSEN_MAX;
+    } else {
+        lim = SCISQL_HTM_COARSEN_SLACK * maxranges;
+        if (lim < SCISQL_HTM_COARSEN_MIN) {
+            lim = SCISQL_HTM_COARSEN_MIN;
+        }
+    }
+    return (lim < maxranges) ? maxranges : lim;
+}
 
-    x = x - ((x >> 1)  & c1);
-    x = (x & c2) + ((x >> 2)  & c2);
-    x = (x + (x >> 4)) & c4;
-    x = (x * f) >> 56;
-    return (int) x;
+/*  A gap between two consecutive ranges in a range list.
+ */
+typedef struct {
+    int64_t size; /* number of IDs in the gap */
+    size_t i;     /* index of the range preceding the gap */
+} _scisql_gap;
+
+SCISQL_INLINE int _scisql_gap_lt(const _scisql_gap *a, const _scisql_gap *b) {
+    return a->size < b->size || (a->size == b->size && a->i < b->i);
 }
 
+/*  Restores the heap property of a min-heap of gaps after the gap at
+    index i has been replaced.
+ */
+static void _scisql_gapheap_down(_scisql_gap *heap, size_t n, size_t i) {
+    _scisql_gap g = heap[i];
+    while (1) {
+        size_t c = 2*i + 1;
+        if (c >= n) {
+            break;
+        }
+        if (c + 1 < n && _scisql_gap_lt(&heap[c + 1], &heap[c])) {
+            ++c;
+        }
+        if (!_scisql_gap_lt(&heap[c], &g)) {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = g;
+}
 
-/* ---- API ---- */
+/*  Reduces the number of entries in a sorted list of n ranges to at most
+    maxranges (or 1, if maxranges is 0) by merging consecutive ranges. Each
+    entry consists of stride integers, the first two of which are the range
+    bounds. If stride is 3, the third integer is an inside/partial flag that
+    is cleared for entries resulting from a merge.
 
-SCISQL_LOCAL int64_t scisql_v3_htmid(const scisql_v3 *point, int level) {
-    scisql_v3 v0, v1, v2;
-    scisql_v3 sv0, sv1, sv2;
-    scisql_v3 e;
-    int64_t id;
-    int curlevel;
-    scisql_htmroot r;
+    Since all HTM triangles of a level have similar areas, the sky area
+    added by filling in a gap is approximately proportional to the number
+    of IDs in it. Gaps are therefore filled in order of increasing size,
+    which minimizes the number of IDs (and approximately, the area) added.
 
-    if (point == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
-        return -1;
+    Returns 0 on success and 1 if memory allocation fails, in which case
+    the range list is unchanged.
+ */
+static int _scisql_ranges_coarsen(int64_t *ranges,
+                                  size_t *nranges,
+                                  size_t stride,
+                                  size_t maxranges)
+{
+    _scisql_gap *heap;
+    unsigned char *merge;
+    size_t n = *nranges, ngaps, nmerge, i, j;
+
+    if (maxranges == 0) {
+        maxranges = 1;
     }
-    r = _scisql_v3_htmroot(point);
-    v0 = *_scisql_htm_root_vert[r*3];
-    v1 = *_scisql_htm_root_vert[r*3 + 1];
-    v2 = *_scisql_htm_root_vert[r*3 + 2];
-    id = r + 8;
-    for (curlevel = 0; curlevel < level; ++curlevel) {
-        _scisql_htm_vertex(&sv1, &v2, &v0);
-        _scisql_htm_vertex(&sv2, &v0, &v1);
-        scisql_v3_rcross(&e, &sv2, &sv1);
-        if (scisql_v3_dot(&e, point) >= 0) {
-            v1 = sv2;
-            v2 = sv1;
-            id = id << 2;
-            continue;
-        }
-        _scisql_htm_vertex(&sv0, &v1, &v2);
-        scisql_v3_rcross(&e, &sv0, &sv2);
-        if (scisql_v3_dot(&e, point) >= 0) {
-            v0 = v1;
-            v1 = sv0;
-            v2 = sv2;
-            id = (id << 2) + 1;
-            continue;
-        }
-        scisql_v3_rcross(&e, &sv1, &sv0);
-        if (scisql_v3_dot(&e, point) >= 0) {
-            v0 = v2;
-            v1 = sv1;
-            v2 = sv0;
-            id = (id << 2) + 2;
-        } else {
-            v0 = sv0;
-            v1 = sv1;
-            v2 = sv2;
-            id = (id << 2) + 3;
+    if (n <= maxranges) {
+        return 0;
+    }
+    ngaps = n - 1;
+    heap = (_scisql_gap *) malloc(ngaps * (sizeof(_scisql_gap) + 1));
+    if (heap == 0) {
+        return 1;
+    }
+    merge = (unsigned char *) (heap + ngaps);
+    for (i = 0; i < ngaps; ++i) {
+        heap[i].size = ranges[stride*(i + 1)] - ranges[stride*i + 1] - 1;
+        heap[i].i = i;
+        merge[i] = 0;
+    }
+    for (i = ngaps / 2; i > 0; --i) {
+        _scisql_gapheap_down(heap, ngaps, i - 1);
+    }
+    /* fill in the n - maxranges smallest gaps */
+    for (nmerge = n - maxranges; nmerge > 0; --nmerge) {
+        merge[heap[0].i] = 1;
+        heap[0] = heap[--ngaps];
+        _scisql_gapheap_down(heap, ngaps, 0);
+    }
+    for (i = 0, j = 0; i < n; ++i, ++j) {
+        size_t first = i;
+        int64_t min_id = ranges[stride*i];
+        for (; i < n - 1 && merge[i] != 0; ++i) { }
+        if (stride == 3) {
+            ranges[3*j + 2] = (i == first) ? ranges[3*i + 2] : 0;
         }
+        ranges[stride*j] = min_id;
+        ranges[stride*j + 1] = ranges[stride*i + 1];
     }
-    return id;
+    *nranges = j;
+    free(heap);
+    return 0;
 }
 
+/*  Reduces the number of ranges in ids to at most maxranges (or 1, if
+    maxranges is 0) by filling in the smallest gaps between them.
 
-SCISQL_LOCAL int scisql_v3p_htmsort(scisql_v3p *points,
-                                    int64_t *ids,
-                                    size_t n,
-                                    int level)
-{
-    _scisql_htmpath path;
-    size_t roots[SCISQL_HTM_NROOTS + 1];
-    scisql_htmroot r;
-
-    if (n == 0) {
+    Returns ids, or 0 if memory allocation fails, in which case ids is
+    freed.
+ */
+static scisql_ids * _scisql_ids_coarsen(scisql_ids *ids, size_t maxranges) {
+    if (_scisql_ranges_coarsen(ids->ranges, &ids->n, 2, maxranges) != 0) {
+        free(ids);
         return 0;
     }
-    if (points == 0 || ids == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
-        return 1;
+    return ids;
+}
+
+/*  Classifies each range of ids as lying inside the region or not, given
+    the sub-list of ranges (inside) known to lie inside the region, and
+    then coarsens the result to at most maxranges entries. If cids is
+    non-null, its memory is re-used.
+
+    Both ids and inside are freed. Returns the classified range list, or 0
+    if memory allocation fails, in which case cids is freed as well.
+ */
+static scisql_cids * _scisql_cids_make(scisql_cids *cids,
+                                       scisql_ids *ids,
+                                       scisql_ids *inside,
+                                       size_t maxranges)
+{
+    size_t cap = ids->n + 2 * inside->n;
+    size_t i, j, k;
+
+    if (cids == 0 || cids->cap < cap) {
+        scisql_cids *c = (scisql_cids *) realloc(
+            cids, sizeof(scisql_cids) + 3 * cap * sizeof(int64_t));
+        if (c == 0) {
+            free(cids);
+            free(ids);
+            free(inside);
+            return 0;
+        }
+        cids = c;
+        cids->cap = cap;
     }
-    _scisql_htm_rootsort(roots, points, (unsigned char *) ids, n);
-    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3; ++r) {
-        if (roots[r] < roots[r + 1]) {
-            _scisql_htmpath_root(&path, r);
-            _scisql_htmpath_sort(&path, points + roots[r],
-                                 points + roots[r + 1], ids + roots[r], level);
+    /* inside is a subset of ids: split each range of ids into
+       alternating partial and inside pieces */
+    for (i = 0, j = 0, k = 0; i < ids->n; ++i) {
+        int64_t min_id = ids->ranges[2*i];
+        int64_t max_id = ids->ranges[2*i + 1];
+        for (; j < inside->n && inside->ranges[2*j] <= max_id; ++j) {
+            if (inside->ranges[2*j] > min_id) {
+                cids->ranges[3*k] = min_id;
+                cids->ranges[3*k + 1] = inside->ranges[2*j] - 1;
+                cids->ranges[3*k + 2] = 0;
+                ++k;
+            }
+            cids->ranges[3*k] = inside->ranges[2*j];
+            cids->ranges[3*k + 1] = inside->ranges[2*j + 1];
+            cids->ranges[3*k + 2] = 1;
+            ++k;
+            min_id = inside->ranges[2*j + 1] + 1;
+        }
+        if (min_id <= max_id) {
+            cids->ranges[3*k] = min_id;
+            cids->ranges[3*k + 1] = max_id;
+            cids->ranges[3*k + 2] = 0;
+            ++k;
         }
     }
-    return 0;
+    cids->n = k;
+    free(ids);
+    free(inside);
+    if (_scisql_ranges_coarsen(cids->ranges, &cids->n, 3, maxranges) != 0) {
+        free(cids);
+        return 0;
+    }
+    return cids;
 }
 
+/*  Returns the coverage code describing the spatial relationship between an
+    HTM triangle and a region. If classify is non-zero, SCISQL_INSIDE must
+    only be returned for triangles that lie inside the region shrunk by
+    SCISQL_HTM_INSIDE_MARGIN, and SCISQL_INTERSECT for other triangles that
+    lie inside the region.
+ */
+typedef _scisql_htmcov (*_scisql_htmcovfn)(const _scisql_htmnode *node,
+                                           const void *region,
+                                           int classify);
 
-SCISQL_LOCAL int scisql_htm_level(int64_t id) {
-    if (id < 8) {
-        return -1;
-    }
-    uint64_t x = (uint64_t) id;
-    int l;
-    x |= (x >> 1);
-    x |= (x >> 2);
-    x |= (x >> 4);
-    x |= (x >> 8);
-    x |= (x >> 16);
-    x |= (x >> 32);
-    l = _scisql_popcount(x) - 4;
-    /* check that l is even, in range, and that the 4 MSBs of id
-       give a valid root ID (8-15) */
-    if ((l & 1) != 0 ||
-        ((id >> l) & 0x8) == 0 ||
-        l > SCISQL_HTM_MAX_LEVEL*2) {
-        return -1;
+/*  Circle parameters for _scisql_s2circle_htmcovfn().
+ */
+typedef struct {
+    const scisql_v3 *center;
+    double dist2;            /* square secant distance for the radius */
+    _scisql_s2circle_in in;  /* only set when classifying */
+} _scisql_s2circle_region;
+
+static _scisql_htmcov _scisql_s2circle_htmcovfn(const _scisql_htmnode *node,
+                                                const void *region,
+                                                int classify)
+{
+    const _scisql_s2circle_region *r = (const _scisql_s2circle_region *) region;
+    _scisql_htmcov cov = _scisql_s2circle_htmcov(node, r->center, r->dist2);
+    if (cov == SCISQL_INSIDE && classify != 0 &&
+        _scisql_s2circle_htmin(node, r->center, &r->in) == 0) {
+        /* too close to the circle boundary to be classified as inside */
+        cov = SCISQL_INTERSECT;
     }
-    return l / 2;
+    return cov;
 }
 
+/*  Polygon parameters for _scisql_s2cpoly_htmcovfn().
+ */
+typedef struct {
+    const scisql_s2cpoly *poly;
+    double tol[SCISQL_MAX_VERTS]; /* only set when classifying */
+} _scisql_s2cpoly_region;
 
-SCISQL_LOCAL int scisql_htmtri_init(scisql_htmtri *tri, int64_t id) {
-    scisql_v3 v0, v1, v2;
-    scisql_v3 sv0, sv1, sv2;
-    int shift, level;
-    scisql_htmroot r;
+static _scisql_htmcov _scisql_s2cpoly_htmcovfn(const _scisql_htmnode *node,
+                                               const void *region,
+                                               int classify)
+{
+    const _scisql_s2cpoly_region *r = (const _scisql_s2cpoly_region *) region;
+    _scisql_htmcov cov = _scisql_s2cpoly_htmcov(node, r->poly);
+    if (cov == SCISQL_INSIDE && classify != 0 &&
+        _scisql_s2cpoly_htmin(node, r->poly, r->tol) == 0) {
+        /* too close to the polygon boundary to be classified as inside */
+        cov = SCISQL_INTERSECT;
+    }
+    return cov;
+}
 
-    if (tri == 0) {
-        return -1;
+static _scisql_htmcov _scisql_s2ellipse_htmcovfn(const _scisql_htmnode *node,
+                                                 const void *region,
+                                                 int classify)
+{
+    const _scisql_s2ellipse_region *r = (const _scisql_s2ellipse_region *) region;
+    _scisql_htmcov cov = _scisql_s2ellipse_htmcov(node, r);
+    if (cov == SCISQL_INSIDE && classify != 0) {
+        /* no margin test for ellipses: never classify as inside */
+        cov = SCISQL_INTERSECT;
     }
-    level = scisql_htm_level(id);
-    if (level < 0) {
-        return -1;
+    return cov;
+}
+
+static _scisql_htmcov _scisql_s2box_htmcovfn(const _scisql_htmnode *node,
+                                              const void *region,
+                                              int classify)
+{
+    const _scisql_s2box_region *r = (const _scisql_s2box_region *) region;
+    _scisql_htmcov cov = _scisql_s2box_htmcov(node, r);
+    if (cov == SCISQL_INSIDE && classify != 0) {
+        /* no margin test for boxes: never classify as inside */
+        cov = SCISQL_INTERSECT;
     }
-    tri->id = id;
-    tri->level = level;
-    shift = 2*level;
-    r = (id >> shift) & 0x7;
-    v0 = *_scisql_htm_root_vert[r*3];
-    v1 = *_scisql_htm_root_vert[r*3 + 1];
-    v2 = *_scisql_htm_root_vert[r*3 + 2];
-    for (shift -= 2; shift >= 0; shift -= 2) {
-        int child = (id >> shift) & 0x3;
-        _scisql_htm_vertex(&sv1, &v2, &v0);
-        _scisql_htm_vertex(&sv2, &v0, &v1);
-        _scisql_htm_vertex(&sv0, &v1, &v2);
-        switch (child) {
-            case 0:
-                v1 = sv2;
-                v2 = sv1;
-                break;
-            case 1:
-                v0 = v1;
-                v1 = sv0;
-                v2 = sv2;
-                break;
-            case 2:
-                v0 = v2;
-                v1 = sv1;
-                v2 = sv0;
-                break;
-            case 3:
-                v0 = sv0;
-                v1 = sv1;
-                v2 = sv2;
-                break;
+    return cov;
+}
+
+#define SCISQL_MOC_INIT_CAP 16
+
+/*  Empties moc, or allocates an empty MOC if moc is 0.
+ */
+static scisql_moc * _scisql_moc_reset(scisql_moc *moc) {
+    if (moc == 0) {
+        moc = (scisql_moc *) malloc(
+            sizeof(scisql_moc) + SCISQL_MOC_INIT_CAP * sizeof(int64_t));
+        if (moc == 0) {
+            return 0;
         }
+        moc->cap = SCISQL_MOC_INIT_CAP;
     }
-    tri->verts[0] = v0;
-    tri->verts[1] = v1;
-    tri->verts[2] = v2;
-    scisql_v3_add(&sv0, &v0, &v1);
-    scisql_v3_add(&sv0, &sv0, &v2);
-    scisql_v3_normalize(&tri->center, &sv0);
-    tri->radius = scisql_v3_angsep(&sv0, &v0);
-    return 0;
+    moc->n = 0;
+    return moc;
 }
 
+/*  Appends an HTM ID to moc. On failure, moc is freed and 0 is returned.
+ */
+SCISQL_INLINE scisql_moc * _scisql_moc_add(scisql_moc *moc, int64_t id) {
+    if (moc->n == moc->cap) {
+        size_t cap = 2 * moc->cap;
+        scisql_moc *out = (scisql_moc *) realloc(
+            moc, sizeof(scisql_moc) + cap * sizeof(int64_t));
+        if (out == 0) {
+            free(moc);
+            return 0;
+        }
+        out->cap = cap;
+        moc = out;
+    }
+    moc->cells[moc->n++] = id;
+    return moc;
+}
 
-SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
-                                                 const scisql_v3 *center,
-                                                 double radius,
-                                                 int level,
-                                                 size_t maxranges)
-{
-    _scisql_htmpath path;
-    double dist2;
-    scisql_htmroot root;
-    int efflevel;
+/*  Replaces the last cell of a MOC with n cells by its parent, for as long
+    as it is preceded by its 3 siblings. Returns the new number of cells.
+ */
+static size_t _scisql_moc_merge(int64_t *cells, size_t n) {
+    while (n >= 4) {
+        int64_t id = cells[n - 1];
+        if (id < 32 || (id & 3) != 3 || cells[n - 2] != id - 1 ||
+            cells[n - 3] != id - 2 || cells[n - 4] != id - 3) {
+            break;
+        }
+        n -= 3;
+        cells[n - 1] = id >> 2;
+    }
+    return n;
+}
 
-    if (center == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
-        return 0;
+/*  Appends an HTM ID to moc, which must be ordered by the first descendant
+    of each triangle, and replaces the new triangle and its siblings by
+    their parent if all 4 are present. On failure, moc is freed and 0 is
+    returned.
+ */
+static scisql_moc * _scisql_moc_push(scisql_moc *moc, int64_t id) {
+    moc = _scisql_moc_add(moc, id);
+    if (moc != 0) {
+        moc->n = _scisql_moc_merge(moc->cells, moc->n);
     }
-    if (ids == 0) {
-        ids = _scisql_ids_init();
-        if (ids == 0) {
-            return 0;
+    return moc;
+}
+
+/*  Replaces the triangles of moc finer than the given subdivision level by
+    their ancestors at that level. This mirrors _scisql_simplify_ids().
+ */
+static void _scisql_moc_simplify(scisql_moc *moc, int level) {
+    size_t i, n = 0;
+    for (i = 0; i < moc->n; ++i) {
+        int64_t id = moc->cells[i];
+        int l = scisql_htm_level(id);
+        if (l > level) {
+            id >>= 2*(l - level);
+            l = level;
         }
-    } else {
-        ids->n = 0;
-    }
-    /* Deal with degenerate cases */
-    if (radius < 0.0) {
-        /* empty ID list */
-        return ids;
-    } else if (radius >= 180.0) {
-        /* the entire sky */
-        int64_t min_id = (8 + SCISQL_HTM_S0) << level * 2;
-        int64_t max_id = ((8 + SCISQL_HTM_NROOTS) << level * 2) - 1;
-        return _scisql_ids_add(ids, min_id, max_id);
+        if (n > 0) {
+            /* skip triangles covered by the last (possibly merged) one */
+            int64_t last = moc->cells[n - 1];
+            int lastl = scisql_htm_level(last);
+            if (lastl <= l && (id >> 2*(l - lastl)) == last) {
+                continue;
+            }
+        }
+        moc->cells[n++] = id;
+        n = _scisql_moc_merge(moc->cells, n);
     }
+    moc->n = n;
+}
 
-    efflevel = level;
-    /* compute square of secant distance corresponding to radius */
-    dist2 = sin(radius * 0.5 * SCISQL_RAD_PER_DEG);
-    dist2 = 4.0 * dist2 * dist2;
+
+/*  Appends the HTM ID ranges of the triangles overlapping a region to the
+    empty range list ids, reducing the effective subdivision level once
+    there are more than limit ranges. The relationship between triangles
+    and the region is computed by covfn. If inside is non-null, the ranges
+    of triangles classified as lying inside the region are also appended
+    to *inside. If moc is non-null, the triangles whose ranges are appended
+    to ids are also appended to the empty MOC *moc as they are visited,
+    so that *moc always covers the same IDs as ids.
+
+    Returns ids, or 0 if memory (re)allocation fails, in which case ids,
+    *inside and *moc are freed, and *inside and *moc are set to 0.
+ */
+SCISQL_ALWAYS_INLINE scisql_ids * _scisql_htm_cover(scisql_ids *ids,
+                                                scisql_ids **inside,
+                                                scisql_moc **moc,
+                                                _scisql_htmcovfn covfn,
+                                                const void *region,
+                                                int level,
+                                                size_t limit)
+{
+    _scisql_htmpath path;
+    scisql_htmroot root;
+    int efflevel = level;
 
     for (root = SCISQL_HTM_S0; root <= SCISQL_HTM_N3; ++root) {
         _scisql_htmnode *curnode = path.node;
@@ -992,7 +1901,7 @@ SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
         _scisql_htmpath_root(&path, root);
 
         while (1) {
-            _scisql_htmcov cov = _scisql_s2circle_htmcov(curnode, center, dist2);
+            _scisql_htmcov cov = (*covfn)(curnode, region, inside != 0);
             switch (cov) {
                 case SCISQL_CONTAINS:
                     if (curlevel == 0) {
@@ -1020,22 +1929,47 @@ SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
                         int64_t id = curnode->id << (level - curlevel) * 2;
                         int64_t n = ((int64_t) 1) << (level - curlevel) * 2;
                         ids = _scisql_ids_add(ids, id, id + n - 1);
+                        if (cov == SCISQL_INSIDE && inside != 0 && ids != 0) {
+                            *inside = _scisql_ids_add(*inside, id, id + n - 1);
+                            if (*inside == 0) {
+                                free(ids);
+                                ids = 0;
+                            }
+                        }
+                        if (moc != 0 && ids != 0) {
+                            *moc = _scisql_moc_push(*moc, curnode->id);
+                            if (*moc == 0) {
+                                free(ids);
+                                ids = 0;
+                            }
+                        }
+                        if (ids == 0) {
+                            if (inside != 0) {
+                                free(*inside);
+                                *inside = 0;
+                            }
+                            if (moc != 0) {
+                                free(*moc);
+                                *moc = 0;
+                            }
+                            return 0;
+                        }
                     }
-                    if (ids == 0) {
-                        return ids;
-                    }
-                    while (ids->n > maxranges && efflevel != 0) {
+                    while (ids->n > limit && efflevel != 0) {
                         /* too many ranges: reduce effective subdivision level */
                         --efflevel;
                         if (curlevel > efflevel) {
                            curnode = curnode - (curlevel - efflevel);
-                           curlevel = efflevel; 
+                           curlevel = efflevel;
                         }
                         _scisql_simplify_ids(ids, level - efflevel);
+                        if (moc != 0) {
+                            _scisql_moc_simplify(*moc, efflevel);
+                        }
                     }
                     break;
                 default:
-                    /* HTM triangle does not intersect circle */
+                    /* HTM triangle does not intersect region */
                     break;
             }
             /* ascend towards the root */
@@ -1065,111 +1999,1970 @@ SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
     return ids;
 }
 
-
-SCISQL_LOCAL scisql_ids * scisql_s2cpoly_htmids(scisql_ids * ids,
-                                                const scisql_s2cpoly *poly,
-                                                int level,
-                                                size_t maxranges)
+/*  Appends the HTM ID ranges of the triangles overlapping a circle to the
+    empty range list ids, as for _scisql_htm_cover().
+ */
+static scisql_ids * _scisql_s2circle_cover(scisql_ids *ids,
+                                           scisql_ids **inside,
+                                           scisql_moc **moc,
+                                           const scisql_v3 *center,
+                                           double radius,
+                                           int level,
+                                           size_t limit)
 {
-    _scisql_htmpath path;
-    scisql_htmroot root;
-    int efflevel;
+    _scisql_s2circle_region region;
 
-    if (poly == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
-        return 0;
-    }
-    if (ids == 0) {
-        ids = _scisql_ids_init();
+    /* Deal with degenerate cases */
+    if (radius < 0.0) {
+        /* empty ID list */
+        return ids;
+    } else if (radius >= 180.0) {
+        /* the entire sky */
+        int64_t min_id = (8 + SCISQL_HTM_S0) << level * 2;
+        int64_t max_id = ((8 + SCISQL_HTM_NROOTS) << level * 2) - 1;
+        scisql_htmroot r;
+        ids = _scisql_ids_add(ids, min_id, max_id);
+        if (inside != 0 && ids != 0) {
+            *inside = _scisql_ids_add(*inside, min_id, max_id);
+            if (*inside == 0) {
+                free(ids);
+                ids = 0;
+            }
+        }
+        for (r = SCISQL_HTM_S0; moc != 0 && r <= SCISQL_HTM_N3; ++r) {
+            if (ids != 0) {
+                *moc = _scisql_moc_add(*moc, r + 8);
+                if (*moc == 0) {
+                    free(ids);
+                    ids = 0;
+                }
+            }
+        }
         if (ids == 0) {
-            return 0;
+            if (inside != 0) {
+                free(*inside);
+                *inside = 0;
+            }
+            if (moc != 0) {
+                free(*moc);
+                *moc = 0;
+            }
         }
-    } else {
-        ids->n = 0;
+        return ids;
     }
+    region.center = center;
+    /* compute square of secant distance corresponding to radius */
+    region.dist2 = sin(radius * 0.5 * SCISQL_RAD_PER_DEG);
+    region.dist2 = 4.0 * region.dist2 * region.dist2;
+    if (inside != 0) {
+        _scisql_s2circle_in_init(&region.in, center, radius);
+    }
+    return _scisql_htm_cover(ids, inside, moc, &_scisql_s2circle_htmcovfn,
+                             &region, level, limit);
+}
 
-    efflevel = level;
+/*  Appends the HTM ID ranges of the triangles overlapping a polygon to the
+    empty range list ids, as for _scisql_htm_cover().
+ */
+static scisql_ids * _scisql_s2cpoly_cover(scisql_ids *ids,
+                                          scisql_ids **inside,
+                                          scisql_moc **moc,
+                                          const scisql_s2cpoly *poly,
+                                          int level,
+                                          size_t limit)
+{
+    _scisql_s2cpoly_region region;
 
-    for (root = SCISQL_HTM_S0; root <= SCISQL_HTM_N3; ++root) {
-        _scisql_htmnode *curnode = path.node;
-        int curlevel = 0;
+    region.poly = poly;
+    if (inside != 0) {
+        size_t i;
+        for (i = 0; i < poly->n; ++i) {
+            region.tol[i] = SCISQL_HTM_INSIDE_MARGIN *
+                            scisql_v3_norm(&poly->edges[i]);
+        }
+    }
+    return _scisql_htm_cover(ids, inside, moc, &_scisql_s2cpoly_htmcovfn,
+                             &region, level, limit);
+}
 
-        _scisql_htmpath_root(&path, root);
+/*  Appends the HTM ID ranges of the triangles overlapping an ellipse to the
+    empty range list ids, as for _scisql_htm_cover().
+ */
+static scisql_ids * _scisql_s2ellipse_cover(scisql_ids *ids,
+                                            const scisql_s2ellipse *ellipse,
+                                            int level,
+                                            size_t limit)
+{
+    _scisql_s2ellipse_region region;
 
-        while (1) {
-            _scisql_htmcov cov = _scisql_s2cpoly_htmcov(curnode, poly);
-            switch (cov) {
-                case SCISQL_CONTAINS:
-                    if (curlevel == 0) {
-                        /* no need to consider other roots */
-                        root = SCISQL_HTM_N3;
-                    } else {
-                        /* no need to consider other children of parent */
-                        curnode[-1].child = 4;
-                    }
-                    /* fall-through */
-                case SCISQL_INTERSECT:
-                    if (curlevel < efflevel) {
-                        /* continue subdividing */
-                        _scisql_htmnode_prep0(curnode);
-                        _scisql_htmnode_make0(curnode);
-                        ++curnode;
-                        ++curlevel;
-                        continue;
-                    }
-                    /* fall-through */
-                case SCISQL_INSIDE:
-                    /* reached a leaf or fully covered HTM triangle,
-                       append HTM ID range to results */
-                    {
-                        int64_t id = curnode->id << (level - curlevel) * 2;
-                        int64_t n = ((int64_t) 1) << (level - curlevel) * 2;
-                        ids = _scisql_ids_add(ids, id, id + n - 1);
-                    }
-                    if (ids == 0) {
-                        return ids;
-                    }
-                    while (ids->n > maxranges && efflevel != 0) {
-                        /* too many ranges: reduce effetive subdivision level */
-                        --efflevel;
-                        if (curlevel > efflevel) {
-                           curnode = curnode - (curlevel - efflevel);
-                           curlevel = efflevel;
-                        }
-                        _scisql_simplify_ids(ids, level - efflevel);
-                    }
-                    break;
-                default:
-                    /* HTM triangle does not intersect polygon */
-                    break;
+    if (ellipse->invMinor2 == SCISQL_INF) {
+        /* a zero length semi-minor axis: no point is inside the ellipse */
+        return ids;
+    }
+    _scisql_s2ellipse_region_init(&region, ellipse);
+    return _scisql_htm_cover(ids, 0, 0, &_scisql_s2ellipse_htmcovfn,
+                             &region, level, limit);
+}
+
+/*  Appends the HTM ID ranges of the triangles overlapping a box to the
+    empty range list ids, as for _scisql_htm_cover().
+ */
+static scisql_ids * _scisql_s2box_cover(scisql_ids *ids,
+                                        const scisql_s2box *box,
+                                        int level,
+                                        size_t limit)
+{
+    _scisql_s2box_region region;
+
+    if (box->latMin > box->latMax) {
+        /* empty box */
+        return ids;
+    }
+    _scisql_s2box_region_init(&region, box);
+    return _scisql_htm_cover(ids, 0, 0, &_scisql_s2box_htmcovfn,
+                             &region, level, limit);
+}
+
+/*  Counts the number of 1 bits in a 64 bit integer.
+ */
+SCISQL_INLINE int _scisql_popcount(uint64_t x) {
+    const uint64_t c1 = UINT64_C(0x5555555555555555); /*  -1/3   */
+    const uint64_t c2 = UINT64_C(0x3333333333333333); /*  -1/5   */
+    const uint64_t c4 = UINT64_C(0x0f0f0f0f0f0f0f0f); /*  -1/17  */
+    const uint64_t f = UINT64_C(0x0101010101010101); /*  -1/255 */
+
+    x = x - ((x >> 1)  & c1);
+    x = (x & c2) + ((x >> 2)  & c2);
+    x = (x + (x >> 4)) & c4;
+    x = (x * f) >> 56;
+    return (int) x;
+}
+
+
+#if HAVE_AVX2_INTRINSICS
+
+/*  4 3-vectors, stored as separate x, y and z coordinate vectors.
+ */
+typedef struct {
+    __m256d x;
+    __m256d y;
+    __m256d z;
+} _scisql_v3x4;
+
+/*  Loads vertex k of the root triangles r[0], ..., r[3].
+ */
+SCISQL_TARGET("avx2") SCISQL_INLINE void _scisql_v3x4_root(
+    _scisql_v3x4 *out,
+    const scisql_htmroot r[4],
+    int k)
+{
+    const scisql_v3 *v0 = _scisql_htm_root_vert[r[0]*3 + k];
+    const scisql_v3 *v1 = _scisql_htm_root_vert[r[1]*3 + k];
+    const scisql_v3 *v2 = _scisql_htm_root_vert[r[2]*3 + k];
+    const scisql_v3 *v3 = _scisql_htm_root_vert[r[3]*3 + k];
+    out->x = _mm256_set_pd(v3->x, v2->x, v1->x, v0->x);
+    out->y = _mm256_set_pd(v3->y, v2->y, v1->y, v0->y);
+    out->z = _mm256_set_pd(v3->z, v2->z, v1->z, v0->z);
+}
+
+/*  Vectorized _scisql_htm_vertex(). The sequence of floating point
+    operations is identical to that of the scalar code.
+ */
+SCISQL_TARGET("avx2") SCISQL_INLINE void _scisql_v3x4_vertex(
+    _scisql_v3x4 *out,
+    const _scisql_v3x4 *v1,
+    const _scisql_v3x4 *v2)
+{
+    __m256d x = _mm256_add_pd(v1->x, v2->x);
+    __m256d y = _mm256_add_pd(v1->y, v2->y);
+    __m256d z = _mm256_add_pd(v1->z, v2->z);
+    __m256d norm = _mm256_sqrt_pd(_mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)),
+        _mm256_mul_pd(z, z)));
+    out->x = _mm256_div_pd(x, norm);
+    out->y = _mm256_div_pd(y, norm);
+    out->z = _mm256_div_pd(z, norm);
+}
+
+/*  Returns a mask with all bits set in lanes where the dot product of
+    p with the (twice) cross product of v1 and v2 is non-negative, i.e.
+    a vectorized scisql_v3_rcross() followed by a scisql_v3_dot() >= 0 test.
+ */
+SCISQL_TARGET("avx2") SCISQL_INLINE __m256d _scisql_v3x4_rcross_test(
+    const _scisql_v3x4 *v1,
+    const _scisql_v3x4 *v2,
+    const _scisql_v3x4 *p)
+{
+    __m256d x1 = _mm256_add_pd(v2->x, v1->x);
+    __m256d x2 = _mm256_sub_pd(v2->x, v1->x);
+    __m256d y1 = _mm256_add_pd(v2->y, v1->y);
+    __m256d y2 = _mm256_sub_pd(v2->y, v1->y);
+    __m256d z1 = _mm256_add_pd(v2->z, v1->z);
+    __m256d z2 = _mm256_sub_pd(v2->z, v1->z);
+    __m256d ex = _mm256_sub_pd(_mm256_mul_pd(y1, z2), _mm256_mul_pd(z1, y2));
+    __m256d ey = _mm256_sub_pd(_mm256_mul_pd(z1, x2), _mm256_mul_pd(x1, z2));
+    __m256d ez = _mm256_sub_pd(_mm256_mul_pd(x1, y2), _mm256_mul_pd(y1, x2));
+    __m256d d = _mm256_add_pd(
+        _mm256_add_pd(_mm256_mul_pd(ex, p->x), _mm256_mul_pd(ey, p->y)),
+        _mm256_mul_pd(ez, p->z));
+    return _mm256_cmp_pd(d, _mm256_setzero_pd(), _CMP_GE_OQ);
+}
+
+/*  Selects a in lanes where m0 is set, otherwise b in lanes where m1 is set,
+    otherwise c in lanes where m2 is set, and d in all remaining lanes.
+ */
+SCISQL_TARGET("avx2") SCISQL_INLINE void _scisql_v3x4_select(
+    _scisql_v3x4 *out,
+    __m256d m0, __m256d m1, __m256d m2,
+    const _scisql_v3x4 *a,
+    const _scisql_v3x4 *b,
+    const _scisql_v3x4 *c,
+    const _scisql_v3x4 *d)
+{
+    out->x = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_blendv_pd(
+        d->x, c->x, m2), b->x, m1), a->x, m0);
+    out->y = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_blendv_pd(
+        d->y, c->y, m2), b->y, m1), a->y, m0);
+    out->z = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_blendv_pd(
+        d->z, c->z, m2), b->z, m1), a->z, m0);
+}
+
+/*  Computes HTM IDs for 4 positions at a time, 4 <= n. The trailing
+    n % 4 positions are left to the caller.
+ */
+SCISQL_TARGET("avx2") static void _scisql_v3_htmid_avx2(const double *x,
+                                                        const double *y,
+                                                        const double *z,
+                                                        int64_t *ids,
+                                                        size_t n,
+                                                        int level)
+{
+    const __m256i three = _mm256_set1_epi64x(3);
+    const __m256i eight = _mm256_set1_epi64x(8);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        _scisql_v3x4 p, v0, v1, v2, sv0, sv1, sv2, t0, t1, t2;
+        scisql_htmroot r[4];
+        __m256i id;
+        int k, curlevel;
+
+        p.x = _mm256_loadu_pd(x + i);
+        p.y = _mm256_loadu_pd(y + i);
+        p.z = _mm256_loadu_pd(z + i);
+        for (k = 0; k < 4; ++k) {
+            scisql_v3 v;
+            v.x = x[i + k];
+            v.y = y[i + k];
+            v.z = z[i + k];
+            r[k] = _scisql_v3_htmroot(&v);
+        }
+        _scisql_v3x4_root(&v0, r, 0);
+        _scisql_v3x4_root(&v1, r, 1);
+        _scisql_v3x4_root(&v2, r, 2);
+        id = _mm256_add_epi64(_mm256_set_epi64x(r[3], r[2], r[1], r[0]),
+                              eight);
+        for (curlevel = 0; curlevel < level; ++curlevel) {
+            __m256d c0, c1, c2, m1, m2;
+            __m256i child;
+            _scisql_v3x4_vertex(&sv1, &v2, &v0);
+            _scisql_v3x4_vertex(&sv2, &v0, &v1);
+            _scisql_v3x4_vertex(&sv0, &v1, &v2);
+            c0 = _scisql_v3x4_rcross_test(&sv2, &sv1, &p);
+            c1 = _scisql_v3x4_rcross_test(&sv0, &sv2, &p);
+            c2 = _scisql_v3x4_rcross_test(&sv1, &sv0, &p);
+            /* m1, m2: lanes in which child 1 or child 2 is selected */
+            m1 = _mm256_andnot_pd(c0, c1);
+            m2 = _mm256_andnot_pd(_mm256_or_pd(c0, c1), c2);
+            /* child = 0 if c0, 1 if m1, 2 if m2, and 3 otherwise */
+            child = _mm256_castpd_si256(_mm256_or_pd(c0, _mm256_or_pd(m1, m2)));
+            child = _mm256_andnot_si256(child, three);
+            child = _mm256_or_si256(child, _mm256_and_si256(
+                _mm256_castpd_si256(m1), _mm256_set1_epi64x(1)));
+            child = _mm256_or_si256(child, _mm256_and_si256(
+                _mm256_castpd_si256(m2), _mm256_set1_epi64x(2)));
+            id = _mm256_add_epi64(_mm256_slli_epi64(id, 2), child);
+            _scisql_v3x4_select(&t0, c0, m1, m2, &v0, &v1, &v2, &sv0);
+            _scisql_v3x4_select(&t1, c0, m1, m2, &sv2, &sv0, &sv1, &sv1);
+            _scisql_v3x4_select(&t2, c0, m1, m2, &sv1, &sv2, &sv0, &sv2);
+            v0 = t0;
+            v1 = t1;
+            v2 = t2;
+        }
+        _mm256_storeu_si256((__m256i *) (ids + i), id);
+    }
+}
+
+#endif /* HAVE_AVX2_INTRINSICS */
+
+#if HAVE_AVX512F_INTRINSICS
+
+/*  8 3-vectors, stored as separate x, y and z coordinate vectors.
+ */
+typedef struct {
+    __m512d x;
+    __m512d y;
+    __m512d z;
+} _scisql_v3x8;
+
+/*  Loads vertex k of the root triangles r[0], ..., r[7].
+ */
+SCISQL_TARGET("avx512f") SCISQL_INLINE void _scisql_v3x8_root(
+    _scisql_v3x8 *out,
+    const scisql_htmroot r[8],
+    int k)
+{
+    double SCISQL_ALIGNED(64) c[3][8];
+    int i;
+    for (i = 0; i < 8; ++i) {
+        const scisql_v3 *v = _scisql_htm_root_vert[r[i]*3 + k];
+        c[0][i] = v->x;
+        c[1][i] = v->y;
+        c[2][i] = v->z;
+    }
+    out->x = _mm512_load_pd(c[0]);
+    out->y = _mm512_load_pd(c[1]);
+    out->z = _mm512_load_pd(c[2]);
+}
+
+/*  Vectorized _scisql_htm_vertex(). The sequence of floating point
+    operations is identical to that of the scalar code.
+ */
+SCISQL_TARGET("avx512f") SCISQL_INLINE void _scisql_v3x8_vertex(
+    _scisql_v3x8 *out,
+    const _scisql_v3x8 *v1,
+    const _scisql_v3x8 *v2)
+{
+    __m512d x = _mm512_add_pd(v1->x, v2->x);
+    __m512d y = _mm512_add_pd(v1->y, v2->y);
+    __m512d z = _mm512_add_pd(v1->z, v2->z);
+    __m512d norm = _mm512_sqrt_pd(_mm512_add_pd(
+        _mm512_add_pd(_mm512_mul_pd(x, x), _mm512_mul_pd(y, y)),
+        _mm512_mul_pd(z, z)));
+    out->x = _mm512_div_pd(x, norm);
+    out->y = _mm512_div_pd(y, norm);
+    out->z = _mm512_div_pd(z, norm);
+}
+
+/*  Vectorized scisql_v3_rcross() followed by a scisql_v3_dot() >= 0 test.
+ */
+SCISQL_TARGET("avx512f") SCISQL_INLINE __mmask8 _scisql_v3x8_rcross_test(
+    const _scisql_v3x8 *v1,
+    const _scisql_v3x8 *v2,
+    const _scisql_v3x8 *p)
+{
+    __m512d x1 = _mm512_add_pd(v2->x, v1->x);
+    __m512d x2 = _mm512_sub_pd(v2->x, v1->x);
+    __m512d y1 = _mm512_add_pd(v2->y, v1->y);
+    __m512d y2 = _mm512_sub_pd(v2->y, v1->y);
+    __m512d z1 = _mm512_add_pd(v2->z, v1->z);
+    __m512d z2 = _mm512_sub_pd(v2->z, v1->z);
+    __m512d ex = _mm512_sub_pd(_mm512_mul_pd(y1, z2), _mm512_mul_pd(z1, y2));
+    __m512d ey = _mm512_sub_pd(_mm512_mul_pd(z1, x2), _mm512_mul_pd(x1, z2));
+    __m512d ez = _mm512_sub_pd(_mm512_mul_pd(x1, y2), _mm512_mul_pd(y1, x2));
+    __m512d d = _mm512_add_pd(
+        _mm512_add_pd(_mm512_mul_pd(ex, p->x), _mm512_mul_pd(ey, p->y)),
+        _mm512_mul_pd(ez, p->z));
+    return _mm512_cmp_pd_mask(d, _mm512_setzero_pd(), _CMP_GE_OQ);
+}
+
+/*  Selects a in lanes where m0 is set, otherwise b in lanes where m1 is set,
+    otherwise c in lanes where m2 is set, and d in all remaining lanes.
+ */
+SCISQL_TARGET("avx512f") SCISQL_INLINE void _scisql_v3x8_select(
+    _scisql_v3x8 *out,
+    __mmask8 m0, __mmask8 m1, __mmask8 m2,
+    const _scisql_v3x8 *a,
+    const _scisql_v3x8 *b,
+    const _scisql_v3x8 *c,
+    const _scisql_v3x8 *d)
+{
+    out->x = _mm512_mask_blend_pd(m0, _mm512_mask_blend_pd(m1,
+        _mm512_mask_blend_pd(m2, d->x, c->x), b->x), a->x);
+    out->y = _mm512_mask_blend_pd(m0, _mm512_mask_blend_pd(m1,
+        _mm512_mask_blend_pd(m2, d->y, c->y), b->y), a->y);
+    out->z = _mm512_mask_blend_pd(m0, _mm512_mask_blend_pd(m1,
+        _mm512_mask_blend_pd(m2, d->z, c->z), b->z), a->z);
+}
+
+/*  Computes HTM IDs for 8 positions at a time. The trailing n % 8
+    positions are left to the caller.
+ */
+SCISQL_TARGET("avx512f") static void _scisql_v3_htmid_avx512(const double *x,
+                                                             const double *y,
+                                                             const double *z,
+                                                             int64_t *ids,
+                                                             size_t n,
+                                                             int level)
+{
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i two = _mm512_set1_epi64(2);
+    const __m512i three = _mm512_set1_epi64(3);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        _scisql_v3x8 p, v0, v1, v2, sv0, sv1, sv2, t0, t1, t2;
+        scisql_htmroot r[8];
+        int64_t SCISQL_ALIGNED(64) rid[8];
+        __m512i id;
+        int k, curlevel;
+
+        p.x = _mm512_loadu_pd(x + i);
+        p.y = _mm512_loadu_pd(y + i);
+        p.z = _mm512_loadu_pd(z + i);
+        for (k = 0; k < 8; ++k) {
+            scisql_v3 v;
+            v.x = x[i + k];
+            v.y = y[i + k];
+            v.z = z[i + k];
+            r[k] = _scisql_v3_htmroot(&v);
+            rid[k] = r[k] + 8;
+        }
+        _scisql_v3x8_root(&v0, r, 0);
+        _scisql_v3x8_root(&v1, r, 1);
+        _scisql_v3x8_root(&v2, r, 2);
+        id = _mm512_load_si512(rid);
+        for (curlevel = 0; curlevel < level; ++curlevel) {
+            __mmask8 c0, c1, c2, m1, m2;
+            __m512i child;
+            _scisql_v3x8_vertex(&sv1, &v2, &v0);
+            _scisql_v3x8_vertex(&sv2, &v0, &v1);
+            _scisql_v3x8_vertex(&sv0, &v1, &v2);
+            c0 = _scisql_v3x8_rcross_test(&sv2, &sv1, &p);
+            c1 = _scisql_v3x8_rcross_test(&sv0, &sv2, &p);
+            c2 = _scisql_v3x8_rcross_test(&sv1, &sv0, &p);
+            m1 = (__mmask8) (~c0 & c1);
+            m2 = (__mmask8) (~(c0 | c1) & c2);
+            /* child = 0 if c0, 1 if m1, 2 if m2, and 3 otherwise */
+            child = _mm512_maskz_mov_epi64((__mmask8) ~(c0 | m1 | m2), three);
+            child = _mm512_mask_mov_epi64(child, m1, one);
+            child = _mm512_mask_mov_epi64(child, m2, two);
+            id = _mm512_add_epi64(_mm512_slli_epi64(id, 2), child);
+            _scisql_v3x8_select(&t0, c0, m1, m2, &v0, &v1, &v2, &sv0);
+            _scisql_v3x8_select(&t1, c0, m1, m2, &sv2, &sv0, &sv1, &sv1);
+            _scisql_v3x8_select(&t2, c0, m1, m2, &sv1, &sv2, &sv0, &sv2);
+            v0 = t0;
+            v1 = t1;
+            v2 = t2;
+        }
+        _mm512_storeu_si512((void *) (ids + i), id);
+    }
+}
+
+#endif /* HAVE_AVX512F_INTRINSICS */
+
+
+/* ---- API ---- */
+
+SCISQL_LOCAL int64_t scisql_v3_htmid(const scisql_v3 *point, int level) {
+    const _scisql_htmsub *table;
+    const scisql_v3 *vp[3];
+    scisql_v3 v0, v1, v2;
+    scisql_v3 sv0, sv1, sv2;
+    scisql_v3 e;
+    int64_t id;
+    size_t i;
+    int curlevel;
+    scisql_htmroot r;
+
+    if (point == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return -1;
+    }
+    r = _scisql_v3_htmroot(point);
+    vp[0] = _scisql_htm_root_vert[r*3];
+    vp[1] = _scisql_htm_root_vert[r*3 + 1];
+    vp[2] = _scisql_htm_root_vert[r*3 + 2];
+    id = r + 8;
+    /* descend through the precomputed levels */
+    table = _scisql_htm_table_get();
+    i = r;
+    for (curlevel = 0; curlevel < level && curlevel < SCISQL_HTM_TABLE_LEVELS;
+         ++curlevel) {
+        const _scisql_htmsub *sub = &table[i];
+        int child;
+        if (scisql_v3_dot(&sub->mid_edge[1], point) >= 0) {
+            vp[1] = &sub->mid_vert[2];
+            vp[2] = &sub->mid_vert[1];
+            child = 0;
+        } else if (scisql_v3_dot(&sub->mid_edge[2], point) >= 0) {
+            vp[0] = vp[1];
+            vp[1] = &sub->mid_vert[0];
+            vp[2] = &sub->mid_vert[2];
+            child = 1;
+        } else if (scisql_v3_dot(&sub->mid_edge[0], point) >= 0) {
+            vp[0] = vp[2];
+            vp[1] = &sub->mid_vert[1];
+            vp[2] = &sub->mid_vert[0];
+            child = 2;
+        } else {
+            vp[0] = &sub->mid_vert[0];
+            vp[1] = &sub->mid_vert[1];
+            vp[2] = &sub->mid_vert[2];
+            child = 3;
+        }
+        id = (id << 2) + child;
+        i = 4*i + 8 + child;
+    }
+    v0 = *vp[0];
+    v1 = *vp[1];
+    v2 = *vp[2];
+    for (; curlevel < level; ++curlevel) {
+        _scisql_htm_vertex(&sv1, &v2, &v0);
+        _scisql_htm_vertex(&sv2, &v0, &v1);
+        scisql_v3_rcross(&e, &sv2, &sv1);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v1 = sv2;
+            v2 = sv1;
+            id = id << 2;
+            continue;
+        }
+        _scisql_htm_vertex(&sv0, &v1, &v2);
+        scisql_v3_rcross(&e, &sv0, &sv2);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v0 = v1;
+            v1 = sv0;
+            v2 = sv2;
+            id = (id << 2) + 1;
+            continue;
+        }
+        scisql_v3_rcross(&e, &sv1, &sv0);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v0 = v2;
+            v1 = sv1;
+            v2 = sv0;
+            id = (id << 2) + 2;
+        } else {
+            v0 = sv0;
+            v1 = sv1;
+            v2 = sv2;
+            id = (id << 2) + 3;
+        }
+    }
+    return id;
+}
+
+
+SCISQL_LOCAL int scisql_v3_htmid_batch(const double *x,
+                                       const double *y,
+                                       const double *z,
+                                       int64_t *ids,
+                                       size_t n,
+                                       int level)
+{
+    size_t i = 0;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (x == 0 || y == 0 || z == 0 || ids == 0 ||
+        level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 1;
+    }
+#if HAVE_AVX512F_INTRINSICS
+    if (i == 0 && __builtin_cpu_supports("avx512f")) {
+        _scisql_v3_htmid_avx512(x, y, z, ids, n, level);
+        i = n - n % 8;
+    }
+#endif
+#if HAVE_AVX2_INTRINSICS
+    if (i == 0 && __builtin_cpu_supports("avx2")) {
+        _scisql_v3_htmid_avx2(x, y, z, ids, n, level);
+        i = n - n % 4;
+    }
+#endif
+    for (; i < n; ++i) {
+        scisql_v3 v;
+        v.x = x[i];
+        v.y = y[i];
+        v.z = z[i];
+        ids[i] = scisql_v3_htmid(&v, level);
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_v3p_htmsort(scisql_v3p *points,
+                                    int64_t *ids,
+                                    size_t n,
+                                    int level)
+{
+    _scisql_htmpath path;
+    size_t roots[SCISQL_HTM_NROOTS + 1];
+    scisql_htmroot r;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (points == 0 || ids == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 1;
+    }
+    _scisql_htm_rootsort(roots, points, (unsigned char *) ids, n);
+    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3; ++r) {
+        if (roots[r] < roots[r + 1]) {
+            _scisql_htmpath_root(&path, r);
+            _scisql_htmpath_sort(&path, points + roots[r],
+                                 points + roots[r + 1], ids + roots[r], level);
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_v3p_htmsort_mt(scisql_v3p *points,
+                                       int64_t *ids,
+                                       size_t n,
+                                       int level,
+                                       int nthreads)
+{
+    _scisql_htmsched sched;
+    _scisql_htmworker *workers;
+    pthread_t *threads;
+    size_t roots[SCISQL_HTM_NROOTS + 1];
+    scisql_htmroot r;
+    int i, nstarted;
+
+    if (nthreads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpu > 0) ? (int) ncpu : 1;
+    }
+    if (nthreads < 0) {
+        return 1;
+    }
+    if (nthreads == 1 || n <= SCISQL_HTM_SORT_GRAIN) {
+        return scisql_v3p_htmsort(points, ids, n, level);
+    }
+    if (points == 0 || ids == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 1;
+    }
+    sched.deques = (_scisql_htmdeque *) malloc(
+        nthreads * sizeof(_scisql_htmdeque));
+    workers = (_scisql_htmworker *) malloc(
+        nthreads * sizeof(_scisql_htmworker));
+    threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+    if (sched.deques == 0 || workers == 0 || threads == 0) {
+        free(threads);
+        free(workers);
+        free(sched.deques);
+        return 1;
+    }
+    sched.points = points;
+    sched.ids = ids;
+    sched.nthreads = nthreads;
+    sched.level = level;
+    sched.pending = 0;
+    sched.generation = 0;
+    pthread_mutex_init(&sched.lock, 0);
+    pthread_cond_init(&sched.cond, 0);
+    for (i = 0; i < nthreads; ++i) {
+        pthread_mutex_init(&sched.deques[i].lock, 0);
+        sched.deques[i].top = 0;
+        sched.deques[i].n = 0;
+        workers[i].sched = &sched;
+        workers[i].thread = i;
+    }
+    /* distribute root triangle tasks round-robin */
+    _scisql_htm_rootsort(roots, points, (unsigned char *) ids, n);
+    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3; ++r) {
+        if (roots[r] < roots[r + 1]) {
+            _scisql_htmpath path;
+            _scisql_htmtask task;
+            _scisql_htmpath_root(&path, r);
+            _scisql_htmtask_init(&task, &path.node[0], 0, roots[r], roots[r + 1]);
+            _scisql_htmdeque_push(&sched.deques[sched.pending % nthreads], &task);
+            ++sched.pending;
+        }
+    }
+    /* The calling thread acts as worker 0. Tasks queued for threads that
+       could not be started are stolen by the remaining threads. */
+    for (nstarted = 1; nstarted < nthreads; ++nstarted) {
+        if (pthread_create(&threads[nstarted], 0, &_scisql_htmsort_worker,
+                           &workers[nstarted]) != 0) {
+            break;
+        }
+    }
+    _scisql_htmsort_worker(&workers[0]);
+    for (i = 1; i < nstarted; ++i) {
+        pthread_join(threads[i], 0);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_mutex_destroy(&sched.deques[i].lock);
+    }
+    pthread_cond_destroy(&sched.cond);
+    pthread_mutex_destroy(&sched.lock);
+    free(threads);
+    free(workers);
+    free(sched.deques);
+    return 0;
+}
+
+SCISQL_LOCAL int scisql_htm_level(int64_t id) {
+    if (id < 8) {
+        return -1;
+    }
+    uint64_t x = (uint64_t) id;
+    int l;
+    x |= (x >> 1);
+    x |= (x >> 2);
+    x |= (x >> 4);
+    x |= (x >> 8);
+    x |= (x >> 16);
+    x |= (x >> 32);
+    l = _scisql_popcount(x) - 4;
+    /* check that l is even, in range, and that the 4 MSBs of id
+       give a valid root ID (8-15) */
+    if ((l & 1) != 0 ||
+        ((id >> l) & 0x8) == 0 ||
+        l > SCISQL_HTM_MAX_LEVEL*2) {
+        return -1;
+    }
+    return l / 2;
+}
+
+
+SCISQL_LOCAL int scisql_htmtri_init(scisql_htmtri *tri, int64_t id) {
+    const _scisql_htmsub *table;
+    const scisql_v3 *vp[3];
+    scisql_v3 v0, v1, v2;
+    scisql_v3 sv0, sv1, sv2;
+    size_t i;
+    int shift, level;
+    scisql_htmroot r;
+
+    if (tri == 0) {
+        return -1;
+    }
+    level = scisql_htm_level(id);
+    if (level < 0) {
+        return -1;
+    }
+    tri->id = id;
+    tri->level = level;
+    shift = 2*level;
+    r = (id >> shift) & 0x7;
+    vp[0] = _scisql_htm_root_vert[r*3];
+    vp[1] = _scisql_htm_root_vert[r*3 + 1];
+    vp[2] = _scisql_htm_root_vert[r*3 + 2];
+    /* descend through the precomputed levels */
+    table = _scisql_htm_table_get();
+    i = r;
+    for (shift -= 2; shift >= 0 && i < SCISQL_HTM_TABLE_SIZE; shift -= 2) {
+        const _scisql_htmsub *sub = &table[i];
+        int child = (id >> shift) & 0x3;
+        switch (child) {
+            case 0:
+                vp[1] = &sub->mid_vert[2];
+                vp[2] = &sub->mid_vert[1];
+                break;
+            case 1:
+                vp[0] = vp[1];
+                vp[1] = &sub->mid_vert[0];
+                vp[2] = &sub->mid_vert[2];
+                break;
+            case 2:
+                vp[0] = vp[2];
+                vp[1] = &sub->mid_vert[1];
+                vp[2] = &sub->mid_vert[0];
+                break;
+            case 3:
+                vp[0] = &sub->mid_vert[0];
+                vp[1] = &sub->mid_vert[1];
+                vp[2] = &sub->mid_vert[2];
+                break;
+        }
+        i = 4*i + 8 + child;
+    }
+    v0 = *vp[0];
+    v1 = *vp[1];
+    v2 = *vp[2];
+    for (; shift >= 0; shift -= 2) {
+        int child = (id >> shift) & 0x3;
+        _scisql_htm_vertex(&sv1, &v2, &v0);
+        _scisql_htm_vertex(&sv2, &v0, &v1);
+        _scisql_htm_vertex(&sv0, &v1, &v2);
+        switch (child) {
+            case 0:
+                v1 = sv2;
+                v2 = sv1;
+                break;
+            case 1:
+                v0 = v1;
+                v1 = sv0;
+                v2 = sv2;
+                break;
+            case 2:
+                v0 = v2;
+                v1 = sv1;
+                v2 = sv0;
+                break;
+            case 3:
+                v0 = sv0;
+                v1 = sv1;
+                v2 = sv2;
+                break;
+        }
+    }
+    tri->verts[0] = v0;
+    tri->verts[1] = v1;
+    tri->verts[2] = v2;
+    scisql_v3_add(&sv0, &v0, &v1);
+    scisql_v3_add(&sv0, &sv0, &v2);
+    scisql_v3_normalize(&tri->center, &sv0);
+    tri->radius = scisql_v3_angsep(&sv0, &v0);
+    return 0;
+}
+
+
+/*  Sorts a short array of IDs in ascending order.
+ */
+static void _scisql_id_isort(int64_t *ids, int n) {
+    int i, j;
+    for (i = 1; i < n; ++i) {
+        int64_t id = ids[i];
+        for (j = i; j > 0 && ids[j - 1] > id; --j) {
+            ids[j] = ids[j - 1];
+        }
+        ids[j] = id;
+    }
+}
+
+
+/*  State for a search of the HTM triangles incident to the vertices of a
+    triangle.
+ */
+typedef struct {
+    const scisql_htmtri *tri; /* triangle whose neighbors are searched for */
+    int64_t id;               /* HTM ID of tri */
+    double tol;               /* vertex/edge distance tolerance */
+    int n;                    /* number of candidate neighbors found */
+    int64_t cand[SCISQL_HTM_MAX_NEIGHBORS];
+    int shared[SCISQL_HTM_MAX_NEIGHBORS]; /* number of vertices each
+                                             candidate shares with tri */
+} _scisql_htmnbr_ctx;
+
+/*  Returns 1 if the HTM triangle (v0, v1, v2) contains or comes within
+    ctx->tol of a vertex of ctx->tri, and 0 otherwise.
+ */
+static int _scisql_htmnbr_touches(const _scisql_htmnbr_ctx *ctx,
+                                  const scisql_v3 *v0,
+                                  const scisql_v3 *v1,
+                                  const scisql_v3 *v2)
+{
+    scisql_v3 e[3];
+    double tol[3];
+    int i, j;
+
+    scisql_v3_rcross(&e[0], v0, v1);
+    scisql_v3_rcross(&e[1], v1, v2);
+    scisql_v3_rcross(&e[2], v2, v0);
+    for (j = 0; j < 3; ++j) {
+        tol[j] = -ctx->tol * scisql_v3_norm(&e[j]);
+    }
+    for (i = 0; i < 3; ++i) {
+        const scisql_v3 *v = &ctx->tri->verts[i];
+        if (scisql_v3_dot(v, &e[0]) >= tol[0] &&
+            scisql_v3_dot(v, &e[1]) >= tol[1] &&
+            scisql_v3_dot(v, &e[2]) >= tol[2]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Visits the HTM triangle (v0, v1, v2) with the given id and level l,
+    and the descendants of it that touch a vertex of ctx->tri. Triangles
+    at the level of ctx->tri sharing a vertex with it are recorded as
+    candidate neighbors.
+
+    Returns 0 on success and 1 if there are too many candidates.
+ */
+static int _scisql_htmnbr_visit(_scisql_htmnbr_ctx *ctx,
+                                const scisql_v3 *v0,
+                                const scisql_v3 *v1,
+                                const scisql_v3 *v2,
+                                int64_t id,
+                                int l)
+{
+    if (_scisql_htmnbr_touches(ctx, v0, v1, v2) == 0) {
+        return 0;
+    }
+    if (l < ctx->tri->level) {
+        scisql_v3 m0, m1, m2;
+        _scisql_htm_vertex(&m0, v1, v2);
+        _scisql_htm_vertex(&m1, v2, v0);
+        _scisql_htm_vertex(&m2, v0, v1);
+        return _scisql_htmnbr_visit(ctx, v0, &m2, &m1, 4*id, l + 1) ||
+               _scisql_htmnbr_visit(ctx, v1, &m0, &m2, 4*id + 1, l + 1) ||
+               _scisql_htmnbr_visit(ctx, v2, &m1, &m0, 4*id + 2, l + 1) ||
+               _scisql_htmnbr_visit(ctx, &m0, &m1, &m2, 4*id + 3, l + 1);
+    }
+    if (id != ctx->id) {
+        const scisql_v3 *v[3];
+        double tol2 = ctx->tol * ctx->tol;
+        int i, j, shared = 0;
+        v[0] = v0;
+        v[1] = v1;
+        v[2] = v2;
+        for (i = 0; i < 3; ++i) {
+            for (j = 0; j < 3; ++j) {
+                if (scisql_v3_dist2(&ctx->tri->verts[i], v[j]) <= tol2) {
+                    ++shared;
+                }
+            }
+        }
+        if (shared > 0) {
+            if (ctx->n == SCISQL_HTM_MAX_NEIGHBORS) {
+                return 1;
+            }
+            ctx->cand[ctx->n] = id;
+            ctx->shared[ctx->n] = shared;
+            ++ctx->n;
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL int scisql_htm_neighbors(int64_t *neighbors, int64_t id) {
+    _scisql_htmnbr_ctx ctx;
+    scisql_htmtri tri;
+    scisql_htmroot r;
+    int i, ne = 0, nv = 0;
+
+    if (neighbors == 0 || scisql_htmtri_init(&tri, id) != 0) {
+        return -1;
+    }
+    /* Triangle vertices lie on a lattice with a spacing comparable to the
+       triangle edge length, which is at least 2^-(level + 1) radians. A
+       much smaller tolerance therefore only absorbs rounding errors. */
+    ctx.tri = &tri;
+    ctx.id = id;
+    ctx.tol = 0.125 * ldexp(1.0, -tri.level - 1);
+    ctx.n = 0;
+    /* a single descent visits only the triangles incident to a vertex */
+    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3; ++r) {
+        if (_scisql_htmnbr_visit(&ctx, _scisql_htm_root_vert[r*3],
+                                 _scisql_htm_root_vert[r*3 + 1],
+                                 _scisql_htm_root_vert[r*3 + 2],
+                                 r + 8, 0) != 0) {
+            return -1;
+        }
+    }
+    /* edge neighbors share 2 vertices with the triangle */
+    for (i = 0; i < ctx.n; ++i) {
+        if (ctx.shared[i] == 2) {
+            neighbors[ne++] = ctx.cand[i];
+        }
+    }
+    if (ne != 3) {
+        return -1;
+    }
+    for (i = 0; i < ctx.n; ++i) {
+        if (ctx.shared[i] == 1) {
+            neighbors[ne + nv++] = ctx.cand[i];
+        }
+    }
+    if (ne + nv != ctx.n) {
+        return -1;
+    }
+    _scisql_id_isort(neighbors, ne);
+    _scisql_id_isort(neighbors + ne, nv);
+    return ctx.n;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
+                                                 const scisql_v3 *center,
+                                                 double radius,
+                                                 int level,
+                                                 size_t maxranges)
+{
+    if (center == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    if (ids == 0) {
+        ids = _scisql_ids_init();
+        if (ids == 0) {
+            return 0;
+        }
+    } else {
+        ids->n = 0;
+    }
+    ids = _scisql_s2circle_cover(ids, 0, 0, center, radius, level,
+                                 _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_cids * scisql_s2circle_htmcids(scisql_cids *cids,
+                                                   const scisql_v3 *center,
+                                                   double radius,
+                                                   int level,
+                                                   size_t maxranges)
+{
+    scisql_ids *ids;
+    scisql_ids *inside;
+
+    if (center == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    ids = _scisql_ids_init();
+    inside = _scisql_ids_init();
+    if (ids == 0 || inside == 0) {
+        free(ids);
+        free(inside);
+        free(cids);
+        return 0;
+    }
+    ids = _scisql_s2circle_cover(ids, &inside, 0, center, radius, level,
+                                 _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        free(cids);
+        return 0;
+    }
+    return _scisql_cids_make(cids, ids, inside, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2cpoly_htmids(scisql_ids * ids,
+                                                const scisql_s2cpoly *poly,
+                                                int level,
+                                                size_t maxranges)
+{
+    if (poly == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    if (ids == 0) {
+        ids = _scisql_ids_init();
+        if (ids == 0) {
+            return 0;
+        }
+    } else {
+        ids->n = 0;
+    }
+    ids = _scisql_s2cpoly_cover(ids, 0, 0, poly, level,
+                                _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_cover(scisql_ids *ids,
+                                               const scisql_s2lpoly *poly,
+                                               int level,
+                                               size_t maxranges,
+                                               scisql_s2cpoly_coverfn fn)
+{
+    scisql_s2cpoly piece;
+    scisql_ids *pids = 0, *tmp = 0, *swap;
+    size_t k, npieces;
+
+    if (poly == 0 || fn == 0) {
+        free(ids);
+        return 0;
+    }
+    ids = scisql_ids_reset(ids);
+    npieces = scisql_s2lpoly_npieces(poly);
+    for (k = 0; ids != 0 && k < npieces; ++k) {
+        if (scisql_s2lpoly_piece(&piece, poly, k) != 0) {
+            break;
+        }
+        pids = (*fn)(pids, &piece, level, maxranges);
+        if (pids == 0) {
+            break;
+        }
+        tmp = scisql_ids_union(tmp, ids, pids);
+        if (tmp == 0) {
+            break;
+        }
+        /* swap the union into place, and re-use the old list */
+        swap = ids;
+        ids = tmp;
+        tmp = swap;
+    }
+    free(pids);
+    free(tmp);
+    if (k != npieces) {
+        free(ids);
+        return 0;
+    }
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_htmids(scisql_ids *ids,
+                                                const scisql_s2lpoly *poly,
+                                                int level,
+                                                size_t maxranges)
+{
+    return scisql_s2lpoly_cover(ids, poly, level, maxranges,
+                                &scisql_s2cpoly_htmids);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2ellipse_htmids(scisql_ids *ids,
+                                                  const scisql_s2ellipse *ellipse,
+                                                  int level,
+                                                  size_t maxranges)
+{
+    if (ellipse == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    if (ids == 0) {
+        ids = _scisql_ids_init();
+        if (ids == 0) {
+            return 0;
+        }
+    } else {
+        ids->n = 0;
+    }
+    ids = _scisql_s2ellipse_cover(ids, ellipse, level,
+                                  _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2box_htmids(scisql_ids *ids,
+                                              const scisql_s2box *box,
+                                              int level,
+                                              size_t maxranges)
+{
+    if (box == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    if (ids == 0) {
+        ids = _scisql_ids_init();
+        if (ids == 0) {
+            return 0;
+        }
+    } else {
+        ids->n = 0;
+    }
+    ids = _scisql_s2box_cover(ids, box, level,
+                              _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_cids * scisql_s2cpoly_htmcids(scisql_cids *cids,
+                                                  const scisql_s2cpoly *poly,
+                                                  int level,
+                                                  size_t maxranges)
+{
+    scisql_ids *ids;
+    scisql_ids *inside;
+
+    if (poly == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    ids = _scisql_ids_init();
+    inside = _scisql_ids_init();
+    if (ids == 0 || inside == 0) {
+        free(ids);
+        free(inside);
+        free(cids);
+        return 0;
+    }
+    ids = _scisql_s2cpoly_cover(ids, &inside, 0, poly, level,
+                                _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        free(cids);
+        return 0;
+    }
+    return _scisql_cids_make(cids, ids, inside, maxranges);
+}
+
+
+/*  Appends the unsigned LEB128 varint encoding of v to out. Returns
+    a pointer to the byte following the last one written.
+ */
+SCISQL_INLINE unsigned char * _scisql_put_varint(unsigned char *out,
+                                                 uint64_t v)
+{
+    while (v >= 0x80) {
+        *out++ = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (unsigned char) v;
+    return out;
+}
+
+/*  Reads an unsigned LEB128 varint from [*in, end) into *v, advancing
+    *in past it. Returns 1 if the input is truncated or the value does
+    not fit in 63 bits, and 0 on success.
+ */
+SCISQL_INLINE int _scisql_get_varint(const unsigned char **in,
+                                     const unsigned char *end,
+                                     uint64_t *v)
+{
+    const unsigned char *p = *in;
+    uint64_t u = 0;
+    int shift = 0;
+    while (p != end && shift < 63) {
+        unsigned char b = *p++;
+        u |= (uint64_t) (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *in = p;
+            *v = u;
+            return 0;
+        }
+        shift += 7;
+    }
+    return 1;
+}
+
+
+SCISQL_LOCAL size_t scisql_ids_encode(unsigned char *out,
+                                      const scisql_ids *ids)
+{
+    unsigned char *s = out;
+    int64_t prev = 0;
+    size_t i;
+
+    memcpy(s, SCISQL_HTM_ENCODED_MAGIC, 8);
+    s = _scisql_put_varint(s + 8, (uint64_t) ids->n);
+    for (i = 0; i < ids->n; ++i) {
+        int64_t min_id = ids->ranges[2*i];
+        int64_t max_id = ids->ranges[2*i + 1];
+        s = _scisql_put_varint(s, (uint64_t) (min_id - prev));
+        s = _scisql_put_varint(s, (uint64_t) (max_id - min_id));
+        prev = max_id;
+    }
+    return (size_t) (s - out);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_decode(scisql_ids *ids,
+                                            const unsigned char *blob,
+                                            size_t len)
+{
+    const unsigned char *end = blob + len;
+    size_t i, n;
+    uint64_t u;
+    int encoded;
+
+    if (blob == 0) {
+        free(ids);
+        return 0;
+    }
+    encoded = (len >= 8 && memcmp(blob, SCISQL_HTM_ENCODED_MAGIC, 8) == 0);
+    if (encoded) {
+        blob += 8;
+        /* every range takes at least 2 bytes */
+        if (_scisql_get_varint(&blob, end, &u) != 0 ||
+            u > (uint64_t) (end - blob) / 2) {
+            free(ids);
+            return 0;
+        }
+        n = (size_t) u;
+    } else if (len % (2 * sizeof(int64_t)) == 0) {
+        n = len / (2 * sizeof(int64_t));
+    } else {
+        free(ids);
+        return 0;
+    }
+    if (ids == 0 || ids->cap < n) {
+        size_t cap = (n < SCISQL_IDS_INIT_CAP) ? SCISQL_IDS_INIT_CAP : n;
+        scisql_ids *out = (scisql_ids *) realloc(
+            ids, sizeof(scisql_ids) + 2 * cap * sizeof(int64_t));
+        if (out == 0) {
+            free(ids);
+            return 0;
+        }
+        ids = out;
+        ids->cap = cap;
+    }
+    ids->n = n;
+    if (encoded == 0) {
+        memcpy(ids->ranges, blob, len);
+        /* raw ranges must be as well formed as decoded ones: non-negative,
+           non-empty, sorted and disjoint */
+        for (i = 0; i < n; ++i) {
+            int64_t min_id = ids->ranges[2*i];
+            if (min_id > ids->ranges[2*i + 1] ||
+                (i == 0 ? min_id < 0 : min_id <= ids->ranges[2*i - 1])) {
+                free(ids);
+                return 0;
+            }
+        }
+        return ids;
+    }
+    for (i = 0, u = 0; i < n; ++i) {
+        uint64_t gap, width;
+        if (_scisql_get_varint(&blob, end, &gap) != 0 ||
+            _scisql_get_varint(&blob, end, &width) != 0 ||
+            (i > 0 && gap == 0) ||
+            gap > (uint64_t) INT64_MAX - u ||
+            width > (uint64_t) INT64_MAX - u - gap) {
+            free(ids);
+            return 0;
+        }
+        ids->ranges[2*i] = (int64_t) (u + gap);
+        u += gap + width;
+        ids->ranges[2*i + 1] = (int64_t) u;
+    }
+    if (blob != end) {
+        /* trailing garbage */
+        free(ids);
+        return 0;
+    }
+    return ids;
+}
+
+SCISQL_LOCAL int scisql_ids_contains(const scisql_ids *ids, int64_t id) {
+    const int64_t *base = ids->ranges;
+    size_t n = ids->n;
+
+    if (n == 0 || id < base[0]) {
+        return 0;
+    }
+    /* find the last range with a minimum <= id; the conditional
+       move keeps the loop free of unpredictable branches */
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[2*half] <= id) ? base + 2*half : base;
+        n -= half;
+    }
+    return id <= base[1];
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_reset(scisql_ids *ids) {
+    if (ids == 0) {
+        return _scisql_ids_init();
+    }
+    ids->n = 0;
+    return ids;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_add(scisql_ids *ids,
+                                         int64_t min_id,
+                                         int64_t max_id)
+{
+    return _scisql_ids_add(ids, min_id, max_id);
+}
+
+
+SCISQL_LOCAL void scisql_ids_simplify(scisql_ids *ids, int n) {
+    _scisql_simplify_ids(ids, n);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_coarsen(scisql_ids *ids,
+                                             size_t maxranges)
+{
+    return _scisql_ids_coarsen(ids, maxranges);
+}
+
+
+SCISQL_LOCAL size_t scisql_ids_coarsen_limit(size_t maxranges) {
+    return _scisql_coarsen_limit(maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_tolevel(scisql_ids *ids, int level) {
+    size_t i, n;
+    int from;
+
+    if (ids == 0) {
+        return 0;
+    }
+    if (level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(ids);
+        return 0;
+    }
+    n = ids->n;
+    if (n == 0) {
+        return ids;
+    }
+    from = scisql_htm_level(ids->ranges[0]);
+    for (i = 0; i < 2*n; ++i) {
+        if (scisql_htm_level(ids->ranges[i]) != from || from < 0) {
+            free(ids);
+            return 0;
+        }
+    }
+    if (level > from) {
+        int shift = 2 * (level - from);
+        for (i = 0; i < n; ++i) {
+            ids->ranges[2*i] <<= shift;
+            ids->ranges[2*i + 1] = ((ids->ranges[2*i + 1] + 1) << shift) - 1;
+        }
+    } else if (level < from) {
+        /* map IDs to ancestors, coalescing ranges that end up overlapping
+           or adjacent */
+        int shift = 2 * (from - level);
+        size_t j = 0;
+        for (i = 0; i < n; ++i) {
+            int64_t min_id = ids->ranges[2*i] >> shift;
+            int64_t max_id = ids->ranges[2*i + 1] >> shift;
+            if (j > 0 && min_id <= ids->ranges[2*j - 1] + 1) {
+                ids->ranges[2*j - 1] = max_id;
+            } else {
+                ids->ranges[2*j] = min_id;
+                ids->ranges[2*j + 1] = max_id;
+                ++j;
             }
-            /* ascend towards the root */
-            --curlevel;
-            --curnode;
-            while (curlevel >= 0 && curnode->child == 4) {
-                --curnode;
-                --curlevel;
+        }
+        ids->n = j;
+    }
+    return ids;
+}
+
+
+/*  Appends the range [min_id, max_id] to ids, where min_id must be at
+    least the minimum of the last range in ids. Unlike _scisql_ids_add(),
+    overlapping ranges are merged.
+ */
+SCISQL_INLINE scisql_ids * _scisql_ids_merge(scisql_ids *ids,
+                                             int64_t min_id,
+                                             int64_t max_id)
+{
+    size_t n = ids->n;
+    if (n > 0 && min_id <= ids->ranges[2*n - 1] + 1) {
+        if (max_id > ids->ranges[2*n - 1]) {
+            ids->ranges[2*n - 1] = max_id;
+        }
+        return ids;
+    }
+    if (n == ids->cap) {
+        ids = _scisql_ids_grow(ids);
+        if (ids == 0) {
+            return 0;
+        }
+    }
+    ids->n = n + 1;
+    ids->ranges[2*n] = min_id;
+    ids->ranges[2*n + 1] = max_id;
+    return ids;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_union(scisql_ids *out,
+                                           const scisql_ids *a,
+                                           const scisql_ids *b)
+{
+    size_t i = 0, j = 0;
+
+    out = scisql_ids_reset(out);
+    while (out != 0 && (i < a->n || j < b->n)) {
+        if (j == b->n || (i < a->n && a->ranges[2*i] <= b->ranges[2*j])) {
+            out = _scisql_ids_merge(out, a->ranges[2*i], a->ranges[2*i + 1]);
+            ++i;
+        } else {
+            out = _scisql_ids_merge(out, b->ranges[2*j], b->ranges[2*j + 1]);
+            ++j;
+        }
+    }
+    return out;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_intersect(scisql_ids *out,
+                                               const scisql_ids *a,
+                                               const scisql_ids *b)
+{
+    size_t i = 0, j = 0;
+
+    out = scisql_ids_reset(out);
+    while (out != 0 && i < a->n && j < b->n) {
+        int64_t amax = a->ranges[2*i + 1];
+        int64_t bmax = b->ranges[2*j + 1];
+        int64_t lo = a->ranges[2*i];
+        int64_t hi = (amax < bmax) ? amax : bmax;
+        if (b->ranges[2*j] > lo) {
+            lo = b->ranges[2*j];
+        }
+        if (lo <= hi) {
+            out = _scisql_ids_merge(out, lo, hi);
+        }
+        /* advance past the range that ends first */
+        if (amax < bmax) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return out;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_ids_subtract(scisql_ids *out,
+                                              const scisql_ids *a,
+                                              const scisql_ids *b)
+{
+    size_t i, j = 0;
+
+    out = scisql_ids_reset(out);
+    for (i = 0; out != 0 && i < a->n; ++i) {
+        int64_t cur = a->ranges[2*i];
+        int64_t amax = a->ranges[2*i + 1];
+        /* skip ranges of b that end before the current range of a */
+        while (j < b->n && b->ranges[2*j + 1] < cur) {
+            ++j;
+        }
+        while (j < b->n && b->ranges[2*j] <= amax) {
+            if (b->ranges[2*j] > cur) {
+                out = _scisql_ids_merge(out, cur, b->ranges[2*j] - 1);
+                if (out == 0) {
+                    return 0;
+                }
             }
-            if (curlevel < 0) {
-                /* finished with this root */
+            if (b->ranges[2*j + 1] >= amax) {
+                /* b range may also overlap the next range of a */
+                cur = amax + 1;
                 break;
             }
-            if (curnode->child == 1) {
-                _scisql_htmnode_prep1(curnode);
-                _scisql_htmnode_make1(curnode);
-            } else if (curnode->child == 2) {
-                _scisql_htmnode_prep2(curnode);
-                _scisql_htmnode_make2(curnode);
-            } else {
-                _scisql_htmnode_make3(curnode);
+            cur = b->ranges[2*j + 1] + 1;
+            ++j;
+        }
+        if (cur <= amax) {
+            out = _scisql_ids_merge(out, cur, amax);
+        }
+    }
+    return out;
+}
+
+
+SCISQL_LOCAL scisql_moc * scisql_ids_tomoc(scisql_moc *moc,
+                                           const scisql_ids *ids,
+                                           int level)
+{
+    size_t i;
+
+    if (ids == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(moc);
+        return 0;
+    }
+    moc = _scisql_moc_reset(moc);
+    for (i = 0; moc != 0 && i < ids->n; ++i) {
+        int64_t min_id = ids->ranges[2*i];
+        int64_t max_id = ids->ranges[2*i + 1];
+        while (moc != 0 && min_id <= max_id) {
+            /* find the largest triangle whose descendants at the given
+               level start at min_id and end at or before max_id */
+            int k = 0;
+            for (; k < level; ++k) {
+                int64_t size = ((int64_t) 4) << 2*k;
+                if ((min_id & (size - 1)) != 0 || max_id - min_id < size - 1) {
+                    break;
+                }
             }
-            ++curnode;
-            ++curlevel;
+            moc = _scisql_moc_add(moc, min_id >> 2*k);
+            min_id += ((int64_t) 1) << 2*k;
+        }
+    }
+    return moc;
+}
+
+
+/*  Coarsens the range list ids, computed at the given level alongside moc,
+    to at most maxranges ranges. Filling in gaps between ranges has no
+    counterpart in the triangle hierarchy, so moc is rebuilt from ids if
+    that was necessary. ids is freed.
+
+    Returns moc, or 0 if memory (re)allocation fails, in which case moc is
+    freed.
+ */
+static scisql_moc * _scisql_moc_coarsen(scisql_moc *moc,
+                                        scisql_ids *ids,
+                                        int level,
+                                        size_t maxranges)
+{
+    size_t n = ids->n;
+    ids = _scisql_ids_coarsen(ids, maxranges);
+    if (ids == 0) {
+        free(moc);
+        return 0;
+    }
+    if (ids->n != n) {
+        moc = scisql_ids_tomoc(moc, ids, level);
+    }
+    free(ids);
+    return moc;
+}
+
+
+SCISQL_LOCAL scisql_moc * scisql_s2circle_htmmoc(scisql_moc *moc,
+                                                 const scisql_v3 *center,
+                                                 double radius,
+                                                 int level,
+                                                 size_t maxranges)
+{
+    scisql_ids *ids;
+
+    if (center == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(moc);
+        return 0;
+    }
+    ids = _scisql_ids_init();
+    moc = _scisql_moc_reset(moc);
+    if (ids == 0 || moc == 0) {
+        free(ids);
+        free(moc);
+        return 0;
+    }
+    ids = _scisql_s2circle_cover(ids, 0, &moc, center, radius, level,
+                                 _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_moc_coarsen(moc, ids, level, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_moc * scisql_s2cpoly_htmmoc(scisql_moc *moc,
+                                                const scisql_s2cpoly *poly,
+                                                int level,
+                                                size_t maxranges)
+{
+    scisql_ids *ids;
+
+    if (poly == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(moc);
+        return 0;
+    }
+    ids = _scisql_ids_init();
+    moc = _scisql_moc_reset(moc);
+    if (ids == 0 || moc == 0) {
+        free(ids);
+        free(moc);
+        return 0;
+    }
+    ids = _scisql_s2cpoly_cover(ids, 0, &moc, poly, level,
+                                _scisql_coarsen_limit(maxranges));
+    if (ids == 0) {
+        return 0;
+    }
+    return _scisql_moc_coarsen(moc, ids, level, maxranges);
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_moc_toids(scisql_ids *ids,
+                                           const int64_t *cells,
+                                           size_t n,
+                                           int level)
+{
+    size_t i;
+    int64_t prev = 0;
+
+    if ((cells == 0 && n != 0) || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(ids);
+        return 0;
+    }
+    ids = scisql_ids_reset(ids);
+    for (i = 0; ids != 0 && i < n; ++i) {
+        int64_t id = cells[i];
+        int64_t start;
+        int l = scisql_htm_level(id);
+        if (l < 0) {
+            free(ids);
+            return 0;
+        }
+        /* triangles must be ordered by their first descendant
+           at the maximum subdivision level */
+        start = id << 2*(SCISQL_HTM_MAX_LEVEL - l);
+        if (start < prev) {
+            free(ids);
+            return 0;
+        }
+        prev = start;
+        if (l <= level) {
+            int shift = 2*(level - l);
+            ids = _scisql_ids_merge(ids, id << shift, ((id + 1) << shift) - 1);
+        } else {
+            id >>= 2*(l - level);
+            ids = _scisql_ids_merge(ids, id, id);
         }
     }
     return ids;
 }
 
 
+/*  The subdivision level chosen by scisql_s2spoly_htmidx_new() is the
+    smallest at which HTM triangle edges are at most 1/SCISQL_S2SPOLY_FRAC
+    times the angular radius of the polygon, but no larger than
+    SCISQL_S2SPOLY_MAX_LEVEL.
+ */
+#define SCISQL_S2SPOLY_FRAC 8
+#define SCISQL_S2SPOLY_MAX_LEVEL 20
+
+/*  Relative padding of the bounding circles used to find the polygon
+    edges that may cross an HTM triangle, which absorbs rounding errors.
+ */
+#define SCISQL_S2SPOLY_PAD 1.0e-6
+
+/*  State for a classification of the HTM triangles overlapping a simple
+    polygon.
+ */
+typedef struct {
+    const scisql_s2spoly *poly;
+    scisql_ids *ids;            /* cells inside the polygon when building
+                                   an index, and all overlapping cells when
+                                   computing a coverage */
+    scisql_ids *boundary;       /* boundary cells when building an index */
+    int index;                  /* 1 when building an index */
+    uint32_t *scratch;          /* candidate edge lists, n per level */
+    int level;                  /* subdivision level of output IDs */
+    int efflevel;               /* effective subdivision level */
+    size_t limit;               /* number of ranges triggering a reduction
+                                   of the effective subdivision level */
+} _scisql_s2spoly_ctx;
+
+static int _scisql_s2spoly_level(const scisql_s2spoly *poly) {
+    double r = 0.0, size = 90.0;
+    size_t i;
+    int level = 0;
+    for (i = 0; i < poly->n; ++i) {
+        double d = scisql_v3_angsepu(&poly->center, &poly->verts[i]);
+        if (d > r) {
+            r = d;
+        }
+    }
+    while (level < SCISQL_S2SPOLY_MAX_LEVEL &&
+           size > r / SCISQL_S2SPOLY_FRAC) {
+        size *= 0.5;
+        ++level;
+    }
+    return level;
+}
+
+/*  Appends the range of IDs at the output level corresponding to the HTM
+    triangle with the given id and level to *ids, reducing the effective
+    subdivision level if too many ranges have accumulated.
+
+    Returns 0 on success and 1 if memory allocation fails, in which case
+    *ids is freed and set to 0.
+ */
+static int _scisql_s2spoly_emit(_scisql_s2spoly_ctx *ctx,
+                                scisql_ids **ids,
+                                int64_t id,
+                                int l)
+{
+    int shift = 2 * (ctx->level - l);
+    *ids = _scisql_ids_add(*ids, id << shift, ((id + 1) << shift) - 1);
+    if (*ids == 0) {
+        return 1;
+    }
+    while ((*ids)->n > ctx->limit && ctx->efflevel != 0) {
+        --ctx->efflevel;
+        _scisql_simplify_ids(*ids, ctx->level - ctx->efflevel);
+    }
+    return 0;
+}
+
+/*  Classifies the HTM triangle (v0, v1, v2) with the given id and level
+    l, along with its descendants. Only the ncand polygon edges in cand,
+    which include all edges crossing the triangle, are considered.
+
+    Triangles crossed by no edge lie entirely inside or outside of the
+    polygon. Triangles crossed by an edge are subdivided until the
+    effective subdivision level is reached, and are then recorded as
+    boundary cells (when building an index), or as overlapping the polygon
+    (when computing a coverage).
+
+    Returns 0 on success and 1 if memory allocation fails.
+ */
+static int _scisql_s2spoly_classify(_scisql_s2spoly_ctx *ctx,
+                                    const scisql_v3 *v0,
+                                    const scisql_v3 *v1,
+                                    const scisql_v3 *v2,
+                                    int64_t id,
+                                    int l,
+                                    const uint32_t *cand,
+                                    size_t ncand)
+{
+    const scisql_s2spoly *poly = ctx->poly;
+    uint32_t *sub = ctx->scratch + (size_t) l * poly->n;
+    scisql_v3 c, mid[3];
+    double r2, d;
+    size_t i, nsub = 0;
+
+    /* compute a padded bounding circle for the triangle, and find the
+       candidate edges passing through it */
+    scisql_v3_add(&c, v0, v1);
+    scisql_v3_add(&c, &c, v2);
+    scisql_v3_normalize(&c, &c);
+    r2 = scisql_v3_dist2(&c, v0);
+    d = scisql_v3_dist2(&c, v1);
+    r2 = (d > r2) ? d : r2;
+    d = scisql_v3_dist2(&c, v2);
+    r2 = (d > r2) ? d : r2;
+    r2 *= 1.0 + SCISQL_S2SPOLY_PAD;
+    for (i = 0; i < ncand; ++i) {
+        uint32_t e = cand[i];
+        uint32_t f = (e + 1 == poly->n) ? 0 : e + 1;
+        if (scisql_v3_edgedist2(&c, &poly->verts[e], &poly->verts[f],
+                                &poly->edges[e]) <= r2) {
+            sub[nsub++] = e;
+        }
+    }
+    if (nsub == 0) {
+        /* the triangle lies entirely inside or outside of the polygon */
+        if (scisql_s2spoly_cv3(poly, &c) == 0) {
+            return 0;
+        }
+        return _scisql_s2spoly_emit(ctx, &ctx->ids, id, l);
+    }
+    if (l < ctx->efflevel) {
+        const scisql_v3 *child[4][3];
+        _scisql_htm_vertex(&mid[0], v1, v2);
+        _scisql_htm_vertex(&mid[1], v2, v0);
+        _scisql_htm_vertex(&mid[2], v0, v1);
+        child[0][0] = v0;      child[0][1] = &mid[2]; child[0][2] = &mid[1];
+        child[1][0] = v1;      child[1][1] = &mid[0]; child[1][2] = &mid[2];
+        child[2][0] = v2;      child[2][1] = &mid[1]; child[2][2] = &mid[0];
+        child[3][0] = &mid[0]; child[3][1] = &mid[1]; child[3][2] = &mid[2];
+        /* stop once the effective level has been reduced to l or less,
+           since the ranges of this triangle have then been expanded to
+           cover it entirely */
+        for (i = 0; i < 4 && l < ctx->efflevel; ++i) {
+            if (_scisql_s2spoly_classify(ctx, child[i][0], child[i][1],
+                                         child[i][2], 4*id + (int64_t) i,
+                                         l + 1, sub, nsub) != 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (ctx->index) {
+        return _scisql_s2spoly_emit(ctx, &ctx->boundary, id, l);
+    }
+    return _scisql_s2spoly_emit(ctx, &ctx->ids, id, l);
+}
+
+/*  Classifies the HTM triangles overlapping ctx->poly, starting with the
+    root triangles.
+
+    Returns 0 on success and 1 if memory allocation fails.
+ */
+static int _scisql_s2spoly_run(_scisql_s2spoly_ctx *ctx) {
+    size_t i, n = ctx->poly->n;
+    uint32_t *all;
+    scisql_htmroot r;
+    int ret = 0;
+
+    /* one candidate edge list per level, plus one for the roots */
+    ctx->scratch = (uint32_t *) malloc(
+        (size_t) (ctx->level + 2) * n * sizeof(uint32_t));
+    if (ctx->scratch == 0) {
+        return 1;
+    }
+    all = ctx->scratch + (size_t) (ctx->level + 1) * n;
+    for (i = 0; i < n; ++i) {
+        all[i] = (uint32_t) i;
+    }
+    for (r = SCISQL_HTM_S0; r <= SCISQL_HTM_N3 && ret == 0; ++r) {
+        ret = _scisql_s2spoly_classify(ctx, _scisql_htm_root_vert[r*3],
+                                       _scisql_htm_root_vert[r*3 + 1],
+                                       _scisql_htm_root_vert[r*3 + 2],
+                                       r + 8, 0, all, n);
+    }
+    free(ctx->scratch);
+    return ret;
+}
+
+
+SCISQL_LOCAL scisql_s2spoly_htmidx * scisql_s2spoly_htmidx_new(
+    const scisql_s2spoly *poly,
+    int level)
+{
+    _scisql_s2spoly_ctx ctx;
+    scisql_s2spoly_htmidx *idx;
+
+    if (poly == 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        return 0;
+    }
+    idx = (scisql_s2spoly_htmidx *) calloc(1, sizeof(scisql_s2spoly_htmidx));
+    if (idx == 0) {
+        return 0;
+    }
+    idx->level = (level < 0) ? _scisql_s2spoly_level(poly) : level;
+    ctx.poly = poly;
+    ctx.index = 1;
+    ctx.level = idx->level;
+    ctx.efflevel = idx->level;
+    ctx.limit = SIZE_MAX;
+    ctx.ids = _scisql_ids_init();
+    ctx.boundary = _scisql_ids_init();
+    if (ctx.ids == 0 || ctx.boundary == 0 || _scisql_s2spoly_run(&ctx) != 0) {
+        idx->inside = ctx.ids;
+        idx->boundary = ctx.boundary;
+        scisql_s2spoly_htmidx_free(idx);
+        return 0;
+    }
+    idx->inside = ctx.ids;
+    idx->boundary = ctx.boundary;
+    return idx;
+}
+
+
+SCISQL_LOCAL void scisql_s2spoly_htmidx_free(scisql_s2spoly_htmidx *idx) {
+    if (idx != 0) {
+        free(idx->inside);
+        free(idx->boundary);
+        free(idx);
+    }
+}
+
+
+SCISQL_LOCAL int scisql_s2spoly_htmidx_cv3(const scisql_s2spoly_htmidx *idx,
+                                           const scisql_s2spoly *poly,
+                                           const scisql_v3 *v)
+{
+    int64_t id = scisql_v3_htmid(v, idx->level);
+    if (id < 0) {
+        return 0;
+    }
+    if (scisql_ids_contains(idx->inside, id)) {
+        return 1;
+    }
+    if (scisql_ids_contains(idx->boundary, id)) {
+        return scisql_s2spoly_cv3(poly, v);
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL scisql_ids * scisql_s2spoly_htmids(scisql_ids *ids,
+                                                const scisql_s2spoly *poly,
+                                                int level,
+                                                size_t maxranges)
+{
+    _scisql_s2spoly_ctx ctx;
+
+    if (poly == 0 || level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        free(ids);
+        return 0;
+    }
+    ctx.ids = scisql_ids_reset(ids);
+    if (ctx.ids == 0) {
+        return 0;
+    }
+    ctx.poly = poly;
+    ctx.boundary = 0;
+    ctx.index = 0;
+    ctx.level = level;
+    ctx.efflevel = level;
+    ctx.limit = _scisql_coarsen_limit(maxranges);
+    if (_scisql_s2spoly_run(&ctx) != 0) {
+        free(ctx.ids);
+        return 0;
+    }
+    return _scisql_ids_coarsen(ctx.ids, maxranges);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,6 +52,29 @@ extern "C" {
 /* Maximum number of ranges in a BLOB representation of an HTM ID range list */
 #define SCISQL_HTM_MAX_RANGES (SCISQL_HTM_MAX_BLOB_SIZE / (2*sizeof(int64_t)))
 
+/* Maximum number of ranges in a BLOB representation of a classified
+   HTM ID range list */
+#define SCISQL_HTM_MAX_CRANGES (SCISQL_HTM_MAX_BLOB_SIZE / (3*sizeof(int64_t)))
+
+/* Maximum number of HTM IDs in a BLOB representation of a MOC */
+#define SCISQL_HTM_MAX_MOC_CELLS (SCISQL_HTM_MAX_BLOB_SIZE / sizeof(int64_t))
+
+/*  Magic bytes prefixing the compact encoding of an HTM ID range list.
+    Read as a 64 bit integer, they are larger than any valid HTM ID, so that
+    compact encodings are never confused with arrays of raw int64_t
+    (min, max) pairs.
+ */
+#define SCISQL_HTM_ENCODED_MAGIC "scisqlR1"
+
+/* Upper bound on the size of the compact encoding of n HTM ID ranges */
+#define SCISQL_HTM_ENCODED_SIZE(n) (8 + 10 + 20*(size_t)(n))
+
+/*  Maximum number of edge and vertex neighbors of an HTM triangle. HTM
+    vertices are shared by at most 6 triangles, so a triangle has at most
+    3 edge neighbors and 9 vertex neighbors.
+ */
+#define SCISQL_HTM_MAX_NEIGHBORS 12
+
 /*  Root triangle numbers. The HTM ID of a root triangle is its number plus 8.
  */
 typedef enum {
@@ -75,6 +98,34 @@ typedef struct {
                          and min_j > max_i for all j > i. */
 } scisql_ids;
 
+/*  A sorted list of 64 bit integer ranges, each of which is classified
+    as lying entirely inside some region, or as only partially covered
+    by it.
+ */
+typedef struct {
+    size_t n;         /* number of ranges in list */
+    size_t cap;       /* capacity of the range list */
+    int64_t ranges[]; /* (min_i, max_i, inside_i) triples, where [min_i, max_i]
+                         is a range as for scisql_ids, and inside_i is 1
+                         if the range lies inside the region and 0 if
+                         it is partially covered. */
+} scisql_cids;
+
+/*  A multi-order coverage map (MOC): a list of HTM IDs of mixed subdivision
+    levels. Since an HTM ID determines its own level, no level information
+    needs to be stored alongside the IDs. Regions are represented by the
+    coarsest triangles lying inside them, and by fine triangles only along
+    their boundaries.
+ */
+typedef struct {
+    size_t n;         /* number of triangles in map */
+    size_t cap;       /* capacity of the map */
+    int64_t cells[];  /* HTM IDs of the triangles, in order of the first
+                         descendant of each triangle at any fixed level.
+                         Triangles never overlap, and no 4 triangles with a
+                         common parent are all present. */
+} scisql_moc;
+
 /*  A 3-vector and a pointer to an associated payload.
  */
 typedef struct {
@@ -99,6 +150,21 @@ typedef struct {
  */
 SCISQL_LOCAL int64_t scisql_v3_htmid(const scisql_v3 *point, int level);
 
+/*  Computes HTM IDs for n positions stored in structure-of-arrays form,
+    i.e. the i-th position is (x[i], y[i], z[i]), and stores the i-th ID
+    in ids[i]. Positions are processed several at a time using SIMD
+    instructions when the CPU supports them; the results are identical
+    to those of scisql_v3_htmid().
+
+    Returns 0 on success and 1 on error.
+ */
+SCISQL_LOCAL int scisql_v3_htmid_batch(const double *x,
+                                       const double *y,
+                                       const double *z,
+                                       int64_t *ids,
+                                       size_t n,
+                                       int level);
+
 /*  Computes HTM IDs for a list of positions with payloads. Positions
     and payloads are sorted by HTM ID during the id generation process.
 
@@ -109,6 +175,20 @@ SCISQL_LOCAL int scisql_v3p_htmsort(scisql_v3p *points,
                                     size_t n,
                                     int level);
 
+/*  Parallel version of scisql_v3p_htmsort() that uses nthreads threads,
+    or one thread per online processor if nthreads is 0. HTM subtrees are
+    split into independent tasks until they contain only a few thousand
+    points, and idle threads steal tasks from busy ones. Positions and
+    payloads end up in the same order as with scisql_v3p_htmsort().
+
+    Returns 0 on success and 1 on error.
+ */
+SCISQL_LOCAL int scisql_v3p_htmsort_mt(scisql_v3p *points,
+                                       int64_t *ids,
+                                       size_t n,
+                                       int level,
+                                       int nthreads);
+
 /*  Returns the HTM subdivision level of the given id,
     or -1 if the id is invalid.
  */
@@ -121,6 +201,17 @@ SCISQL_LOCAL int scisql_htm_level(int64_t id);
  */
 SCISQL_LOCAL int scisql_htmtri_init(scisql_htmtri *tri, int64_t id);
 
+/*  Finds the HTM triangles at the same subdivision level as the triangle
+    with the given id that share an edge or a vertex with it. The IDs of
+    the 3 edge neighbors are stored first in ascending order, followed by
+    the IDs of the triangles that share only a vertex, also in ascending
+    order. neighbors must have room for SCISQL_HTM_MAX_NEIGHBORS IDs.
+
+    Returns the number of neighbors found, or -1 if neighbors is 0 or id is
+    not a valid HTM id.
+ */
+SCISQL_LOCAL int scisql_htm_neighbors(int64_t *neighbors, int64_t id);
+
 /*  Computes a list of HTM ID ranges corresponding to the HTM triangles
     overlapping the given circle.
 
@@ -134,15 +225,15 @@ SCISQL_LOCAL int scisql_htmtri_init(scisql_htmtri *tri, int64_t id);
         radius     Circle radius, degrees.
         level      Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
         maxranges  Maximum number of ranges to return. When too many ranges
-                   are generated, the effective subdivision level of HTM ids
-                   is reduced. Since two consecutive ranges that cannot be
-                   merged at level L may become mergable at level L-n, this
+                   are generated, gaps between consecutive ranges are filled
+                   in, smallest first, until the bound is met. This
                    "coarsening" cuts down on the number of ranges (but makes
                    the range list a poorer approximation to the input
-                   geometry). Note that for arbitrary input geometry, up to
-                   4 ranges may be generated no matter what the subdivision
-                   level is. So for maxranges < 4, the requested bound may
-                   not be achieved.
+                   geometry), while adding as few HTM IDs as possible. To
+                   bound the work done for very large range lists, the
+                   effective subdivision level of HTM ids is also reduced
+                   once many more than maxranges ranges are generated. A
+                   maxranges value of 0 is treated like 1.
 
     Return:
         A list of HTM ID ranges for the HTM triangles overlapping the given
@@ -180,15 +271,15 @@ SCISQL_LOCAL scisql_ids * scisql_s2circle_htmids(scisql_ids *ids,
         poly       Spherical convex polygon.
         level      Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
         maxranges  Maximum number of ranges to return. When too many ranges
-                   are generated, the effective subdivision level of HTM ids
-                   is reduced. Since two consecutive ranges that cannot be
-                   merged at level L may become mergable at level L-n, this
+                   are generated, gaps between consecutive ranges are filled
+                   in, smallest first, until the bound is met. This
                    "coarsening" cuts down on the number of ranges (but makes
                    the range list a poorer approximation to the input
-                   geometry). Note that for arbitrary input geometry, up to
-                   4 ranges may be generated no matter what the subdivision
-                   level is. So for maxranges < 4, the requested bound may
-                   not be achieved.
+                   geometry), while adding as few HTM IDs as possible. To
+                   bound the work done for very large range lists, the
+                   effective subdivision level of HTM ids is also reduced
+                   once many more than maxranges ranges are generated. A
+                   maxranges value of 0 is treated like 1.
 
     Return:
         A list of HTM ID ranges for the HTM triangles overlapping the given
@@ -213,6 +304,390 @@ SCISQL_LOCAL scisql_ids * scisql_s2cpoly_htmids(scisql_ids *ids,
                                                 int level,
                                                 size_t maxranges);
 
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given spherical ellipse.
+
+    Inputs:
+        ids        Existing id range list or 0, as for
+                   scisql_s2circle_htmids().
+        ellipse    Spherical ellipse. Only the part of the sphere around
+                   the ellipse center is covered; points near the antipode
+                   of the center that pass scisql_s2ellipse_cv3() are not.
+        level      Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
+        maxranges  Maximum number of ranges to return, as for
+                   scisql_s2circle_htmids().
+
+    Return:
+        A list of HTM ID ranges for the HTM triangles overlapping the given
+        ellipse. A null pointer is returned if ellipse == 0 or level is not
+        in the range [0, SCISQL_HTM_MAX_LEVEL], or if an internal memory
+        (re)allocation fails. The notes for scisql_s2circle_htmids() on
+        input list reallocation and cleanup apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2ellipse_htmids(scisql_ids *ids,
+                                                  const scisql_s2ellipse *ellipse,
+                                                  int level,
+                                                  size_t maxranges);
+
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given longitude/latitude box. The range list may
+    include a few triangles very close to, but outside of, the box.
+
+    Inputs:
+        ids        Existing id range list or 0, as for
+                   scisql_s2circle_htmids().
+        box        Longitude/latitude box.
+        level      Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
+        maxranges  Maximum number of ranges to return, as for
+                   scisql_s2circle_htmids().
+
+    Return:
+        A list of HTM ID ranges for the HTM triangles overlapping the given
+        box. A null pointer is returned if box == 0 or level is not in the
+        range [0, SCISQL_HTM_MAX_LEVEL], or if an internal memory
+        (re)allocation fails. The notes for scisql_s2circle_htmids() on
+        input list reallocation and cleanup apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2box_htmids(scisql_ids *ids,
+                                              const scisql_s2box *box,
+                                              int level,
+                                              size_t maxranges);
+
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given circle, just like scisql_s2circle_htmids(). In
+    addition, each range is classified as being fully inside the circle
+    or not. All points with HTM IDs in a range classified as inside are
+    guaranteed to pass an exact point-in-circle test, so that such a test
+    can be skipped for them. Triangles very close to the circle boundary
+    (within about 20 micro-arcseconds) are never classified as inside.
+
+    Inputs:
+        cids       Existing classified range list or 0. If this argument is
+                   non-null, its memory is re-used.
+        center     Center of circle, must be a unit vector.
+        radius     Circle radius, degrees.
+        level      Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
+        maxranges  Maximum number of ranges to return. Coarsening works as
+                   for scisql_s2circle_htmids(); a range that results from
+                   merging several ranges is classified as partial.
+
+    Return:
+        A classified list of HTM ID ranges for the HTM triangles overlapping
+        the given circle, or a null pointer under the same conditions as for
+        scisql_s2circle_htmids(). As for that function, the return value
+        must replace the input pointer, the input list is freed on failure,
+        and the result can be cleaned up by passing it to free().
+ */
+SCISQL_LOCAL scisql_cids * scisql_s2circle_htmcids(scisql_cids *cids,
+                                                   const scisql_v3 *center,
+                                                   double radius,
+                                                   int level,
+                                                   size_t maxranges);
+
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given spherical convex polygon, just like
+    scisql_s2cpoly_htmids(). In addition, each range is classified as
+    being fully inside the polygon or not, as for scisql_s2circle_htmcids().
+ */
+SCISQL_LOCAL scisql_cids * scisql_s2cpoly_htmcids(scisql_cids *cids,
+                                                  const scisql_s2cpoly *poly,
+                                                  int level,
+                                                  size_t maxranges);
+
+/*  Writes the compact encoding of an HTM ID range list to out, which must
+    have room for at least SCISQL_HTM_ENCODED_SIZE(ids->n) bytes. The
+    encoding consists of SCISQL_HTM_ENCODED_MAGIC, followed by the number
+    of ranges, followed by min_0, max_0 - min_0, min_1 - max_0,
+    max_1 - min_1, etc. Each integer is stored as an unsigned LEB128
+    varint, so that dense range lists at high subdivision levels typically
+    take 2-3 bytes per range rather than 16.
+
+    The range list must be sorted with non-negative IDs, as produced by
+    the coverage functions above.
+
+    Return:
+        The number of bytes written.
+ */
+SCISQL_LOCAL size_t scisql_ids_encode(unsigned char *out,
+                                      const scisql_ids *ids);
+
+/*  Decodes an HTM ID range list from a binary string containing either
+    the compact encoding produced by scisql_ids_encode(), or an array of
+    raw int64_t (min, max) pairs in host byte order.
+
+    Inputs:
+        ids     Existing id range list or 0, as for scisql_s2circle_htmids().
+        blob    Binary string to decode.
+        len     Length of blob in bytes.
+
+    Return:
+        The decoded list of HTM ID ranges. A null pointer is returned if
+        blob is malformed, if its ranges are not non-negative, sorted and
+        disjoint with min <= max, or if an internal memory (re)allocation
+        fails. The notes for scisql_s2circle_htmids() on input list
+        reallocation and cleanup apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_decode(scisql_ids *ids,
+                                            const unsigned char *blob,
+                                            size_t len);
+
+/*  Returns 1 if id lies in one of the ranges of ids and 0 otherwise.
+    The ranges are binary searched without data dependent branches, so
+    that the cost of a lookup does not depend on branch prediction.
+ */
+SCISQL_LOCAL int scisql_ids_contains(const scisql_ids *ids, int64_t id);
+
+/*  Empties ids, or allocates an empty range list if ids is 0. Along with
+    scisql_ids_add(), scisql_ids_simplify() and scisql_ids_coarsen(), this
+    lets other hierarchical pixelizations in which the 4 children of ID i
+    are 4*i, ..., 4*i + 3 build range lists the same way the HTM coverage
+    functions do.
+
+    Return:
+        ids, or a null pointer if memory allocation fails.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_reset(scisql_ids *ids);
+
+/*  Appends the range [min_id, max_id] to ids, coalescing it with the last
+    range in ids if they are adjacent. min_id must be greater than the
+    maximum of the last range in ids.
+
+    Return:
+        ids, or a null pointer if an internal memory reallocation fails,
+        in which case ids is freed.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_add(scisql_ids *ids,
+                                         int64_t min_id,
+                                         int64_t max_id);
+
+/*  Expands each range in ids to cover whole ancestor IDs n levels up in
+    the ID hierarchy, merging ranges that become adjacent or overlap.
+ */
+SCISQL_LOCAL void scisql_ids_simplify(scisql_ids *ids, int n);
+
+/*  Reduces the number of ranges in ids to at most maxranges (or 1, if
+    maxranges is 0) by filling in the smallest gaps between them.
+
+    Return:
+        ids, or a null pointer if memory allocation fails, in which case
+        ids is freed.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_coarsen(scisql_ids *ids,
+                                             size_t maxranges);
+
+/*  Returns the number of ranges a coverage computation with a range budget
+    of maxranges may accumulate before it should reduce its effective
+    subdivision level with scisql_ids_simplify().
+ */
+SCISQL_LOCAL size_t scisql_ids_coarsen_limit(size_t maxranges);
+
+/*  Converts a list of HTM ID ranges, all of which must be at the same
+    subdivision level, to ranges of HTM IDs at the given level. Converting
+    to a finer level is exact. Converting to a coarser level replaces each
+    ID by the ID of its ancestor, so that the result covers a superset of
+    the input triangles.
+
+    Return:
+        The converted list, which replaces ids. A null pointer is returned
+        (and ids is freed) if ids == 0, if level is not in the range
+        [0, SCISQL_HTM_MAX_LEVEL], or if ids contains invalid HTM IDs or
+        IDs at different levels.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_tolevel(scisql_ids *ids, int level);
+
+/*  A function computing a list of ID ranges for the cells of some
+    hierarchical pixelization that overlap a spherical convex polygon,
+    e.g. scisql_s2cpoly_htmids().
+ */
+typedef scisql_ids * (*scisql_s2cpoly_coverfn)(scisql_ids *ids,
+                                               const scisql_s2cpoly *poly,
+                                               int level,
+                                               size_t maxranges);
+
+/*  Computes a list of ID ranges corresponding to the cells overlapping a
+    large spherical convex polygon, by applying fn to each piece of the
+    polygon (see scisql_s2lpoly_piece()) and merging the results. The
+    remaining arguments are as for scisql_s2cpoly_htmids(), and maxranges
+    bounds both the ranges computed for each piece and the final result.
+
+    Return:
+        The list of ranges overlapping the polygon, or a null pointer if
+        poly or fn is 0, if fn fails, or if an internal memory
+        (re)allocation fails. In that case, the input list is freed.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_cover(scisql_ids *ids,
+                                               const scisql_s2lpoly *poly,
+                                               int level,
+                                               size_t maxranges,
+                                               scisql_s2cpoly_coverfn fn);
+
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping a large spherical convex polygon. This is
+    scisql_s2lpoly_cover() with scisql_s2cpoly_htmids() as fn.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2lpoly_htmids(scisql_ids *ids,
+                                                const scisql_s2lpoly *poly,
+                                                int level,
+                                                size_t maxranges);
+
+/*  A classification of the HTM triangles at a fixed subdivision level
+    with respect to a simple polygon. Each triangle lies inside the
+    polygon, outside of it, or may be crossed by polygon edges. Only
+    positions in the latter "boundary" cells need a geometric test.
+ */
+typedef struct {
+    int level;              /* subdivision level of the cells */
+    scisql_ids *inside;     /* ranges of cells inside the polygon */
+    scisql_ids *boundary;   /* ranges of cells that may be crossed by
+                               polygon edges */
+} scisql_s2spoly_htmidx;
+
+/*  Classifies the HTM triangles at the given subdivision level with
+    respect to a simple polygon. A negative level selects a level at which
+    triangles are roughly 8 times smaller than the polygon. The index
+    refers to, but does not copy, poly.
+
+    Return:
+        The index, or a null pointer if poly is 0, if level is greater than
+        SCISQL_HTM_MAX_LEVEL, or if memory allocation fails. An index must
+        be cleaned up with scisql_s2spoly_htmidx_free().
+ */
+SCISQL_LOCAL scisql_s2spoly_htmidx * scisql_s2spoly_htmidx_new(
+    const scisql_s2spoly *poly,
+    int level);
+
+SCISQL_LOCAL void scisql_s2spoly_htmidx_free(scisql_s2spoly_htmidx *idx);
+
+/*  Returns 1 if the simple polygon poly contains vector v, and 0 otherwise.
+    idx must be a classification of poly. Positions in cells inside or
+    outside of the polygon are resolved by looking up their HTM ID, and
+    positions in boundary cells with scisql_s2spoly_cv3(), so that the
+    result is always that of scisql_s2spoly_cv3().
+ */
+SCISQL_LOCAL int scisql_s2spoly_htmidx_cv3(const scisql_s2spoly_htmidx *idx,
+                                           const scisql_s2spoly *poly,
+                                           const scisql_v3 *v);
+
+/*  Computes a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping a simple polygon. Triangles are tested against polygon
+    edges using conservative bounding circles, so the range list may
+    include a few triangles very close to, but outside of, the polygon.
+    The arguments are as for scisql_s2cpoly_htmids().
+
+    Return:
+        The list of ranges overlapping the polygon, or a null pointer if
+        poly is 0, if level is not in the range [0, SCISQL_HTM_MAX_LEVEL],
+        or if an internal memory (re)allocation fails. The notes for
+        scisql_s2circle_htmids() on input list reallocation and cleanup
+        apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_s2spoly_htmids(scisql_ids *ids,
+                                                const scisql_s2spoly *poly,
+                                                int level,
+                                                size_t maxranges);
+
+/*  Converts a list of HTM ID ranges at the given subdivision level (such
+    as those produced by the coverage functions above) to the equivalent
+    multi-order coverage map. Each range is split into the fewest possible
+    whole triangles, so that 4 sibling triangles are always replaced by
+    their parent.
+
+    Inputs:
+        moc     Existing MOC or 0. If this argument is null, a fresh MOC is
+                allocated and returned. If it is non-null, all its entries
+                are removed, but its memory is re-used.
+        ids     Sorted list of HTM ID ranges at the given level.
+        level   Subdivision level of the IDs in ids.
+
+    Return:
+        The MOC, which replaces the input pointer. A null pointer is
+        returned (and moc is freed) if ids == 0, if level is not in the
+        range [0, SCISQL_HTM_MAX_LEVEL], or if an internal memory
+        (re)allocation fails. A MOC can be cleaned up by passing it
+        to free().
+ */
+SCISQL_LOCAL scisql_moc * scisql_ids_tomoc(scisql_moc *moc,
+                                           const scisql_ids *ids,
+                                           int level);
+
+/*  Computes a multi-order coverage map for the HTM triangles at the given
+    level overlapping a circle or spherical convex polygon. The arguments
+    are as for scisql_s2circle_htmids() and scisql_s2cpoly_htmids(), except
+    that moc is an existing MOC or 0 (see scisql_ids_tomoc()). Triangles
+    are added to the MOC as they are classified during the HTM descent,
+    and the MOC is only rebuilt from the underlying range list if gaps
+    between ranges had to be filled in. The maxranges argument bounds the
+    number of ranges in that list, not the number of triangles in the MOC,
+    which is always at least as large.
+
+    Return:
+        The MOC, which replaces the input pointer, or a null pointer under
+        the same conditions as for scisql_s2circle_htmids().
+ */
+SCISQL_LOCAL scisql_moc * scisql_s2circle_htmmoc(scisql_moc *moc,
+                                                 const scisql_v3 *center,
+                                                 double radius,
+                                                 int level,
+                                                 size_t maxranges);
+
+SCISQL_LOCAL scisql_moc * scisql_s2cpoly_htmmoc(scisql_moc *moc,
+                                                const scisql_s2cpoly *poly,
+                                                int level,
+                                                size_t maxranges);
+
+/*  Expands the n HTM IDs of a multi-order coverage map into a list of HTM
+    ID ranges at the given level. Triangles coarser than level are mapped
+    to the ranges of their descendants, and triangles finer than level are
+    replaced by their ancestors, so that the result covers a superset of
+    the map.
+
+    Inputs:
+        ids     Existing id range list or 0, as for scisql_s2circle_htmids().
+        cells   MOC triangle IDs, e.g. the cells of a scisql_moc.
+        n       Number of triangle IDs.
+        level   Subdivision level, [0, SCISQL_HTM_MAX_LEVEL].
+
+    Return:
+        The resulting list of ranges. A null pointer is returned if cells
+        contains an invalid HTM ID, if the triangles are not in MOC order,
+        if level is not in the range [0, SCISQL_HTM_MAX_LEVEL], or if an
+        internal memory (re)allocation fails. The notes for
+        scisql_s2circle_htmids() on input list reallocation and cleanup
+        apply.
+ */
+SCISQL_LOCAL scisql_ids * scisql_moc_toids(scisql_ids *ids,
+                                           const int64_t *cells,
+                                           size_t n,
+                                           int level);
+
+/*  Computes the union, intersection, or difference a - b of two sorted
+    lists of ID ranges with a single linear merge. The inputs are expected
+    to contain IDs at the same subdivision level (see scisql_ids_tolevel()),
+    and are not modified.
+
+    Inputs:
+        out     Existing id range list or 0, as for scisql_s2circle_htmids().
+                Must not be equal to a or b.
+        a, b    Input range lists.
+
+    Return:
+        The resulting list of ranges, in which adjacent ranges are
+        coalesced. A null pointer is returned if an internal memory
+        (re)allocation fails. The notes for scisql_s2circle_htmids() on
+        input list reallocation and cleanup apply to out.
+ */
+SCISQL_LOCAL scisql_ids * scisql_ids_union(scisql_ids *out,
+                                           const scisql_ids *a,
+                                           const scisql_ids *b);
+
+SCISQL_LOCAL scisql_ids * scisql_ids_intersect(scisql_ids *out,
+                                               const scisql_ids *a,
+                                               const scisql_ids *b);
+
+SCISQL_LOCAL scisql_ids * scisql_ids_subtract(scisql_ids *out,
+                                              const scisql_ids *a,
+                                              const scisql_ids *b);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,212 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2BoxHtmRanges"
+     return_type="MEDIUMBLOB"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Returns a binary-string representation of HTM ID ranges
+        overlapping a longitude/latitude box (as defined by
+        ${SCISQL_PREFIX}s2PtInBox()). This string will be at most
+        16MB long, i.e. it will fit in a MEDIUMBLOB.
+    </desc>
+    <args>
+        <arg name="lonMin" type="DOUBLE PRECISION" units="deg">
+            Minimum longitude angle of points in box.
+        </arg>
+        <arg name="latMin" type="DOUBLE PRECISION" units="deg">
+            Minimum latitude angle of points in box.
+        </arg>
+        <arg name="lonMax" type="DOUBLE PRECISION" units="deg">
+            Maximum longitude angle of points in box.
+        </arg>
+        <arg name="latMax" type="DOUBLE PRECISION" units="deg">
+            Maximum latitude angle of points in box.
+        </arg>
+        <arg name="level" type="INTEGER">
+            HTM subdivision level, must be in range [0, 24].
+        </arg>
+        <arg name="maxranges" type="INTEGER">
+            Maximum number of ranges to report.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            The lonMin, latMin, lonMax and latMax arguments must be
+            convertible to type DOUBLE PRECISION. If they are of type
+            BIGINT or DECIMAL, then the conversion can result in loss
+            of precision and hence an inaccurate result. Loss of
+            precision will not occur so long as the inputs are values
+            of type DOUBLE PRECISION, FLOAT, REAL, INTEGER, SMALLINT,
+            or TINYINT.
+        </note>
+        <note>
+            The level and maxranges arguments must be integers.
+        </note>
+        <note>
+            If any parameter is NULL, NaN or +/-Inf, this is an error
+            and NULL is returned.
+        </note>
+        <note>
+            If latMin or latMax lie outside of [-90, 90] degrees,
+            this is an error and NULL is returned. If latMin is greater
+            than latMax, the box is empty and an empty string is
+            returned.
+        </note>
+        <note>
+            Longitude angles are interpreted exactly as for
+            ${SCISQL_PREFIX}s2PtInBox(): boxes may span the 0/360 degree
+            longitude angle discontinuity, and if either lonMin or lonMax
+            lies outside of [0, 360] while lonMax is less than lonMin,
+            NULL is returned.
+        </note>
+        <note>
+            If level does not lie in the range [0, 24], this is an
+            error and NULL is returned.
+        </note>
+        <note>
+            maxranges can be set to any value. In practice, its value
+            is clamped such that the binary return string has size at
+            most 16MB (fits in a MEDIUMBLOB). Negative values are
+            interpreted to mean: "return as many ranges as possible
+            subject to the 16MB output size limit".
+        </note>
+    </notes>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2BoxHtmRanges, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    size_t i;
+    SCISQL_BOOL const_item = 1;
+    if (args->arg_count != 6) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2BoxHtmRanges)
+                 " expects exactly 6 arguments");
+        return 1;
+    }
+    for (i = 0; i < 6; ++i) {
+        if (i < 4) {
+            args->arg_type[i] = REAL_RESULT;
+        } else if (args->arg_type[i] != INT_RESULT) {
+            snprintf(message, MYSQL_ERRMSG_SIZE,
+                     SCISQL_UDF_NAME(s2BoxHtmRanges)
+                     ": fifth and sixth arguments must be integers");
+            return 1;
+        }
+        if (args->args[i] == 0) {
+            const_item = 0;
+        }
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_BLOB_SIZE;
+    initid->const_item = const_item;
+    initid->ptr = 0;
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2BoxHtmRanges, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    scisql_sc bmin, bmax;
+    scisql_s2box box;
+    scisql_ids *ids;
+    long long level;
+    long long maxranges;
+    double **a = (double **) args->args;
+    size_t i;
+
+    /* If any input is NULL, the result is NULL. */
+    for (i = 0; i < 6; ++i) {
+        if (args->args[i] == 0) {
+            *is_null = 1;
+            return result;
+        }
+    }
+    /* extract box and subdivision parameters */
+    if (scisql_sc_init(&bmin, *a[0], *a[1]) != 0 ||
+        scisql_sc_init(&bmax, *a[2], *a[3]) != 0 ||
+        scisql_s2box_init(&box, &bmin, &bmax) != 0) {
+        *is_null = 1;
+        return result;
+    }
+    level = *((long long *) args->args[4]);
+    if (level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+        *is_null = 1;
+        return result;
+    }
+    maxranges = *((long long *) args->args[5]);
+    if (maxranges < 0 || maxranges > (long long) SCISQL_HTM_MAX_RANGES) {
+        maxranges = SCISQL_HTM_MAX_RANGES;
+    }
+    /* compute overlapping HTM ID ranges */
+    ids = scisql_s2box_htmids(
+        (scisql_ids *) initid->ptr, &box, (int) level, (size_t) maxranges);
+    initid->ptr = (char *)  ids;
+    if (ids == 0) {
+        *is_null = 1;
+        return result;
+    }
+    *length = (unsigned long) (2 * sizeof(int64_t) * ids->n);
+    return (char *) ids->ranges;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2BoxHtmRanges, _deinit) (
+    UDF_INIT *initid)
+{
+    free(initid->ptr);
+}
+
+
+SCISQL_UDF_INIT(s2BoxHtmRanges)
+SCISQL_UDF_DEINIT(s2BoxHtmRanges)
+SCISQL_STRING_UDF(s2BoxHtmRanges)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
@@ -124,6 +124,7 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyHtmRanges, SCISQL_NO_SUFFIX) (
     char *error SCISQL_UNUSED)
 {
     scisql_s2cpoly poly;
+    scisql_s2lpoly *lpoly = 0;
     scisql_ids *ids;
     size_t i;
     long long level;
@@ -136,13 +137,7 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyHtmRanges, SCISQL_NO_SUFFIX) (
             return result;
         }
     }
-    /* extract polygon and subdivision parameters */
-    i = scisql_s2cpoly_frombin(&poly, (unsigned char *) args->args[0],
-                               (size_t) args->lengths[0]);
-    if (i != 0) {
-        *is_null = 1;
-        return result;
-    }
+    /* extract subdivision parameters */
     level = *((long long *) args->args[1]);
     if (level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
         *is_null = 1;
@@ -152,9 +147,31 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyHtmRanges, SCISQL_NO_SUFFIX) (
     if (maxranges < 0 || maxranges > (long long) SCISQL_HTM_MAX_RANGES) {
         maxranges = (long long) SCISQL_HTM_MAX_RANGES;
     }
+    /* extract polygon. Polygons too large for a scisql_s2cpoly
+       are covered piece by piece. */
+    if (args->lengths[0] > 3 * sizeof(double) * (SCISQL_MAX_VERTS + 1)) {
+        lpoly = scisql_s2lpoly_frombin((unsigned char *) args->args[0],
+                                       (size_t) args->lengths[0]);
+        i = (lpoly == 0);
+    } else {
+        i = scisql_s2cpoly_frombin(&poly, (unsigned char *) args->args[0],
+                                   (size_t) args->lengths[0]);
+    }
+    if (i != 0) {
+        *is_null = 1;
+        return result;
+    }
     /* compute overlapping HTM ID ranges */
-    ids = scisql_s2cpoly_htmids(
-        (scisql_ids *) initid->ptr, &poly, (int) level, (size_t) maxranges);
+    if (lpoly != 0) {
+        ids = scisql_s2lpoly_htmids(
+            (scisql_ids *) initid->ptr, lpoly, (int) level,
+            (size_t) maxranges);
+        free(lpoly);
+    } else {
+        ids = scisql_s2cpoly_htmids(
+            (scisql_ids *) initid->ptr, &poly, (int) level,
+            (size_t) maxranges);
+    }
     initid->ptr = (char *)  ids;
     if (ids == 0) {
         *is_null = 1;
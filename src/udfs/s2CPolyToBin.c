@@ -24,8 +24,8 @@
     <desc>
         Returns a binary-string representation of a spherical convex
         polygon. The polygon must be specified as a sequence of at least
-        3 and at most 20 vertices. An N vertex input will result in a
-        binary string of length exactly 24*(N + 1).
+        3 vertices. An N vertex input will result in a binary string of
+        length exactly 24*(N + 1). At most 65536 vertices are supported.
     </desc>
     <args varargs="true">
         <arg name="v1Lon" type="DOUBLE PRECISION" units="deg">
@@ -90,6 +90,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "mysql.h"
 
@@ -109,11 +110,11 @@ SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2CPolyToBin, _init) (
     size_t i;
     SCISQL_BOOL const_item = 1;
     if (args->arg_count < 6 ||
-        args->arg_count > 2 * SCISQL_MAX_VERTS ||
+        args->arg_count > 2 * SCISQL_MAX_LARGE_VERTS ||
         (args->arg_count & 1) != 0) {
         snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2CPolyToBin) 
                  " expects between 3 and %d spherical coordinate pairs",
-                 SCISQL_MAX_VERTS);
+                 SCISQL_MAX_LARGE_VERTS);
         return 1;
     }
     for (i = 0; i < args->arg_count; ++i) {
@@ -123,14 +124,26 @@ SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2CPolyToBin, _init) (
         }
     }
     initid->maybe_null = 1;
-    initid->max_length = 3 * sizeof(double) * SCISQL_MAX_VERTS;
+    initid->max_length = 3 * sizeof(double) * (args->arg_count / 2 + 1);
     initid->const_item = const_item;
+    initid->ptr = 0;
+    /* the result of a large polygon doesn't fit in the buffer
+       supplied by MySQL */
+    if (initid->max_length > 255u) {
+        initid->ptr = (char *) malloc(initid->max_length);
+        if (initid->ptr == 0) {
+            snprintf(message, MYSQL_ERRMSG_SIZE,
+                     SCISQL_UDF_NAME(s2CPolyToBin)
+                     " failed to allocate memory for result");
+            return 1;
+        }
+    }
     return 0;
 }
 
 
 SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyToBin, SCISQL_NO_SUFFIX) (
-    UDF_INIT *initid SCISQL_UNUSED,
+    UDF_INIT *initid,
     UDF_ARGS *args,
     char *result,
     unsigned long *length,
@@ -138,9 +151,11 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyToBin, SCISQL_NO_SUFFIX) (
     char *error SCISQL_UNUSED)
 {
     scisql_s2cpoly poly;
+    scisql_s2lpoly *lpoly;
     scisql_sc pt;
     scisql_v3 verts[SCISQL_MAX_VERTS];
-    size_t i, n;
+    scisql_v3 *v = verts;
+    size_t i, n = args->arg_count / 2;
     double **a = (double **) args->args;
 
     /* If any input is NULL, the result is NULL. */
@@ -150,20 +165,37 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyToBin, SCISQL_NO_SUFFIX) (
             return result;
         }
     }
-    for (i = 0, n = 0; i < args->arg_count; i += 2, ++n) {
-        if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+    if (initid->ptr != 0) {
+        result = initid->ptr;
+    }
+    if (n > SCISQL_MAX_VERTS) {
+        v = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+        if (v == 0) {
             *is_null = 1;
             return result;
         }
-        scisql_sctov3(&verts[n], &pt);
     }
-    if (scisql_s2cpoly_init(&poly, verts, n) != 0) {
-        *is_null = 1;
-        return result;
+    for (i = 0, n = 0; i < args->arg_count; i += 2, ++n) {
+        if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+            break;
+        }
+        scisql_sctov3(&v[n], &pt);
+    }
+    *length = 0;
+    if (i == args->arg_count) {
+        if (n > SCISQL_MAX_VERTS) {
+            lpoly = scisql_s2lpoly_new(v, n);
+            *length = (unsigned long) scisql_s2lpoly_tobin(
+                (unsigned char *) result, initid->max_length, lpoly);
+            free(lpoly);
+        } else if (scisql_s2cpoly_init(&poly, v, n) == 0) {
+            *length = (unsigned long) scisql_s2cpoly_tobin(
+                (unsigned char *) result, initid->max_length, &poly);
+        }
+    }
+    if (v != verts) {
+        free(v);
     }
-
-    *length = (unsigned long) scisql_s2cpoly_tobin((unsigned char *) result,
-                                                   255u, &poly);
     if (*length == 0) {
         *is_null = 1;
     }
@@ -171,7 +203,15 @@ SCISQL_API char * SCISQL_VERSIONED_FNAME(s2CPolyToBin, SCISQL_NO_SUFFIX) (
 }
 
 
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2CPolyToBin, _deinit) (
+    UDF_INIT *initid)
+{
+    free(initid->ptr);
+}
+
+
 SCISQL_UDF_INIT(s2CPolyToBin)
+SCISQL_UDF_DEINIT(s2CPolyToBin)
 SCISQL_STRING_UDF(s2CPolyToBin)
 
 
@@ -0,0 +1,139 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HpxNestToRing" return_type="BIGINT" section="s2">
+    <desc>
+        Converts a nested HEALPix ID (as returned by
+        ${SCISQL_PREFIX}s2HpxId()) to the ring scheme ID of the same
+        pixel.
+    </desc>
+    <args>
+        <arg name="hpxId" type="BIGINT">
+            Nested HEALPix ID at the given order.
+        </arg>
+        <arg name="order" type="INTEGER">
+            HEALPix order, required to lie in the range [0, 29].
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If any parameter is NULL, NULL is returned.
+        </note>
+        <note>
+            If order is not in the range [0, 29], or if hpxId is not a
+            valid nested ID at that order (i.e. does not lie in the range
+            [0, 12*4^order)), this is an error and NULL is returned.
+        </note>
+        <note>
+            Ring scheme IDs number pixels by decreasing latitude and then
+            by increasing longitude. Unlike nested IDs, they do not group
+            the children of a pixel together, so ranges of ring IDs are not
+            meaningful spatial regions. The range returning HEALPix UDFs
+            therefore always use nested IDs.
+        </note>
+    </notes>
+    <example>
+        SELECT objectId,
+               ${SCISQL_PREFIX}s2HpxNestToRing(
+                   ${SCISQL_PREFIX}s2HpxId(ra_PS, decl_PS, 12), 12)
+            FROM Object LIMIT 10;
+    </example>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "healpix.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HpxNestToRing, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    size_t i;
+    SCISQL_BOOL const_item = 1;
+    if (args->arg_count != 2) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HpxNestToRing)
+                 " expects exactly 2 arguments");
+        return 1;
+    }
+    for (i = 0; i < 2; ++i) {
+        if (args->arg_type[i] != INT_RESULT) {
+            snprintf(message, MYSQL_ERRMSG_SIZE,
+                     SCISQL_UDF_NAME(s2HpxNestToRing)
+                     " HEALPix ID and order must be integers");
+            return 1;
+        }
+        if (args->args[i] == 0) {
+            const_item = 0;
+        }
+    }
+    initid->maybe_null = 1;
+    initid->const_item = const_item;
+    return 0;
+}
+
+
+SCISQL_API long long SCISQL_VERSIONED_FNAME(s2HpxNestToRing, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid SCISQL_UNUSED,
+    UDF_ARGS *args,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    long long order;
+    int64_t id;
+    /* If any input is null, the result is NULL. */
+    if (args->args[0] == 0 || args->args[1] == 0) {
+        *is_null = 1;
+        return 0;
+    }
+    order = *(long long *) args->args[1];
+    if (order < 0 || order > SCISQL_HPX_MAX_ORDER) {
+        *is_null = 1;
+        return 0;
+    }
+    id = scisql_hpx_nest2ring((int64_t) *(long long *) args->args[0],
+                              (int) order);
+    if (id < 0) {
+        *is_null = 1;
+        return 0;
+    }
+    return (long long) id;
+}
+
+
+SCISQL_UDF_INIT(s2HpxNestToRing)
+SCISQL_INTEGER_UDF(s2HpxNestToRing)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,167 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmInRanges" return_type="INTEGER" section="s2">
+    <desc>
+        Returns 1 if the given HTM ID lies in one of the ranges of an HTM ID
+        range list (as returned by e.g. ${SCISQL_PREFIX}s2CircleHtmRanges()),
+        and 0 otherwise. This provides a cheap per-row filter for
+        restricting a table to the HTM triangles overlapping a region
+        without joining against the `scisql.Region` table.
+    </desc>
+    <args>
+        <arg name="htmId" type="BIGINT">
+            HTM ID to test.
+        </arg>
+        <arg name="htmRanges" type="MEDIUMBLOB">
+            Binary-string representation of HTM ID ranges, in either the
+            raw or compact (${SCISQL_PREFIX}s2HtmRangesEncode()) encoding.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If any parameter is NULL, 0 is returned.
+        </note>
+        <note>
+            If htmRanges is malformed, this is an error and NULL is
+            returned.
+        </note>
+        <note>
+            When htmRanges is a constant (e.g. a user variable or the
+            result of a UDF call with constant arguments), it is decoded
+            once per query, and each row is then tested with a binary
+            search. Otherwise, it is decoded for every row.
+        </note>
+    </notes>
+    <example>
+        SET @r = ${SCISQL_PREFIX}s2CircleHtmRanges(0, 0, 0.1, 20, 256);
+        SELECT objectId, ra_PS, decl_PS
+            FROM Object
+            WHERE ${SCISQL_PREFIX}s2HtmInRanges(htmId20, @r) = 1 AND
+                  ${SCISQL_PREFIX}s2PtInCircle(ra_PS, decl_PS, 0, 0, 0.1) = 1;
+    </example>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    scisql_ids *ids;
+    int cached; /* was a constant range list decoded in _init? */
+} _scisql_inranges_state;
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmInRanges, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    _scisql_inranges_state *state;
+    if (args->arg_count != 2) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 SCISQL_UDF_NAME(s2HtmInRanges) " expects 2 arguments");
+        return 1;
+    }
+    if (args->arg_type[0] != INT_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, "First argument of "
+                 SCISQL_UDF_NAME(s2HtmInRanges) " must be an integer");
+        return 1;
+    }
+    if (args->arg_type[1] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, "Second argument of "
+                 SCISQL_UDF_NAME(s2HtmInRanges) " must be a binary string");
+        return 1;
+    }
+    state = (_scisql_inranges_state *) calloc(1, sizeof(_scisql_inranges_state));
+    if (state == 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmInRanges)
+                 " failed to allocate memory for internal state");
+        return 1;
+    }
+    if (args->args[1] != 0) {
+        /* constant range list: decode it once */
+        state->ids = scisql_ids_decode(
+            0, (const unsigned char *) args->args[1], args->lengths[1]);
+        state->cached = (state->ids != 0);
+    }
+    initid->maybe_null = 1;
+    initid->const_item = (args->args[0] == 0 || args->args[1] == 0) ? 0 : 1;
+    initid->ptr = (char *) state;
+    return 0;
+}
+
+
+SCISQL_API long long SCISQL_VERSIONED_FNAME(s2HtmInRanges, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    _scisql_inranges_state *state = (_scisql_inranges_state *) initid->ptr;
+
+    /* If any input is null, the result is 0. */
+    if (args->args[0] == 0 || args->args[1] == 0) {
+        return 0;
+    }
+    if (state->cached == 0) {
+        state->ids = scisql_ids_decode(
+            state->ids, (const unsigned char *) args->args[1],
+            args->lengths[1]);
+        if (state->ids == 0) {
+            *is_null = 1;
+            return 0;
+        }
+    }
+    return scisql_ids_contains(state->ids, *((long long *) args->args[0]));
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmInRanges, _deinit) (
+    UDF_INIT *initid)
+{
+    _scisql_inranges_state *state = (_scisql_inranges_state *) initid->ptr;
+    if (state != 0) {
+        free(state->ids);
+        free(state);
+    }
+}
+
+
+SCISQL_UDF_INIT(s2HtmInRanges)
+SCISQL_UDF_DEINIT(s2HtmInRanges)
+SCISQL_INTEGER_UDF(s2HtmInRanges)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,183 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmMocToRanges"
+     return_type="MEDIUMBLOB"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Expands a multi-order coverage map (as produced by
+        ${SCISQL_PREFIX}s2CircleHtmMoc() or ${SCISQL_PREFIX}s2CPolyHtmMoc())
+        into a binary-string representation of HTM ID ranges at the
+        given subdivision level. This string will be at most 16MB long,
+        i.e. it will fit in a MEDIUMBLOB.
+    </desc>
+    <args>
+        <arg name="moc" type="MEDIUMBLOB">
+            Binary string representation of a multi-order coverage map.
+        </arg>
+        <arg name="level" type="INTEGER">
+            HTM subdivision level, must be in range [0, 24].
+        </arg>
+    </args>
+    <notes>
+        <note>
+            Triangles of the map that are finer than level are replaced
+            by their ancestors at that level, so the ranges returned
+            cover a superset of the map.
+        </note>
+        <note>
+            If any argument is NULL, if moc is malformed, or if level
+            does not lie in the range [0, 24], NULL is returned.
+        </note>
+        <note>
+            If the result would not fit in 16MB, NULL is returned.
+        </note>
+    </notes>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    int64_t *cells;
+    size_t cap;
+    scisql_ids *out;
+} _scisql_moctoranges_state;
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmMocToRanges, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    if (args->arg_count != 2) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmMocToRanges)
+                 " expects exactly 2 arguments");
+        return 1;
+    }
+    if (args->arg_type[0] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmMocToRanges)
+                 ": first argument must be a binary string");
+        return 1;
+    }
+    if (args->arg_type[1] != INT_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmMocToRanges)
+                 ": second argument must be an integer");
+        return 1;
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_BLOB_SIZE;
+    initid->const_item = (args->args[0] != 0 && args->args[1] != 0);
+    initid->ptr = (char *) calloc(1, sizeof(_scisql_moctoranges_state));
+    if (initid->ptr == 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmMocToRanges)
+                 " failed to allocate memory for internal state");
+        return 1;
+    }
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmMocToRanges, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    _scisql_moctoranges_state *state =
+        (_scisql_moctoranges_state *) initid->ptr;
+    long long level;
+    size_t n;
+
+    /* If any input is NULL, the result is NULL. */
+    if (args->args[0] == 0 || args->args[1] == 0) {
+        *is_null = 1;
+        return result;
+    }
+    level = *((long long *) args->args[1]);
+    if (level < 0 || level > SCISQL_HTM_MAX_LEVEL ||
+        args->lengths[0] % sizeof(int64_t) != 0) {
+        *is_null = 1;
+        return result;
+    }
+    /* copy the map, since MySQL makes no alignment guarantees */
+    n = args->lengths[0] / sizeof(int64_t);
+    if (state->cap < n) {
+        int64_t *cells = (int64_t *) realloc(state->cells,
+                                             n * sizeof(int64_t));
+        if (cells == 0) {
+            *is_null = 1;
+            return result;
+        }
+        state->cells = cells;
+        state->cap = n;
+    }
+    if (n != 0) {
+        memcpy(state->cells, args->args[0], args->lengths[0]);
+    }
+    state->out = scisql_moc_toids(state->out, state->cells, n, (int) level);
+    if (state->out == 0 || state->out->n > SCISQL_HTM_MAX_RANGES) {
+        *is_null = 1;
+        return result;
+    }
+    *length = (unsigned long) (2 * sizeof(int64_t) * state->out->n);
+    return (char *) state->out->ranges;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmMocToRanges, _deinit) (
+    UDF_INIT *initid)
+{
+    _scisql_moctoranges_state *state =
+        (_scisql_moctoranges_state *) initid->ptr;
+    if (state != 0) {
+        free(state->cells);
+        free(state->out);
+        free(state);
+    }
+}
+
+
+SCISQL_UDF_INIT(s2HtmMocToRanges)
+SCISQL_UDF_DEINIT(s2HtmMocToRanges)
+SCISQL_STRING_UDF(s2HtmMocToRanges)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
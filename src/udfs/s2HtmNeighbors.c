@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmNeighbors" return_type="BINARY" section="s2">
+    <desc>
+        Returns a binary-string representation of the IDs of the HTM
+        triangles that share an edge or a vertex with the triangle having
+        the given HTM ID, and that are at the same subdivision level. IDs
+        are stored as 64-bit integers in host byte order, and can be read
+        with ${SCISQL_PREFIX}extractInt64(). The first 3 IDs are those of
+        the edge neighbors, in ascending order. They are followed by the
+        IDs of the triangles sharing only a vertex, also in ascending
+        order. At most 12 IDs are returned.
+    </desc>
+    <args>
+        <arg name="id" type="BIGINT">
+            HTM ID.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If id is NULL or an invalid HTM ID, NULL is returned.
+        </note>
+    </notes>
+    <example>
+        SELECT ${SCISQL_PREFIX}extractInt64(${SCISQL_PREFIX}s2HtmNeighbors(32), 0);
+    </example>
+</udf>
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmNeighbors, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    if (args->arg_count != 1) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmNeighbors)
+                 " expects exactly 1 argument");
+        return 1;
+    }
+    if (args->arg_type[0] != INT_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmNeighbors)
+                 " HTM ID must be an integer");
+        return 1;
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_NEIGHBORS * sizeof(int64_t);
+    initid->const_item = (args->args[0] != 0);
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmNeighbors, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid SCISQL_UNUSED,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    int64_t neighbors[SCISQL_HTM_MAX_NEIGHBORS];
+    int n;
+
+    if (args->args[0] == 0) {
+        *is_null = 1;
+        return result;
+    }
+    n = scisql_htm_neighbors(neighbors, (int64_t) (*(long long *) args->args[0]));
+    if (n < 0) {
+        *is_null = 1;
+        return result;
+    }
+    /* MySQL guarantees that result has room for 255 bytes */
+    memcpy(result, neighbors, (size_t) n * sizeof(int64_t));
+    *length = (unsigned long) ((size_t) n * sizeof(int64_t));
+    return result;
+}
+
+
+SCISQL_UDF_INIT(s2HtmNeighbors)
+SCISQL_STRING_UDF(s2HtmNeighbors)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
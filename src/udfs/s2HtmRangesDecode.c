@@ -0,0 +1,134 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmRangesDecode"
+     return_type="MEDIUMBLOB"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Converts the compact encoding of HTM ID ranges produced by
+        ${SCISQL_PREFIX}s2HtmRangesEncode() back to the raw binary-string
+        representation returned by e.g. ${SCISQL_PREFIX}s2CircleHtmRanges(),
+        i.e. to an array of 64-bit integer (min, max) pairs in host byte
+        order that can be read with ${SCISQL_PREFIX}extractInt64().
+    </desc>
+    <args>
+        <arg name="htmRanges" type="MEDIUMBLOB">
+            Binary-string representation of HTM ID ranges, in either
+            the raw or compact encoding.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If htmRanges is NULL or malformed, NULL is returned.
+        </note>
+        <note>
+            Raw inputs are returned unchanged. Their ranges must be sorted,
+            disjoint and consist of non-negative IDs, and no range may have
+            a minimum greater than its maximum; otherwise they are
+            considered malformed.
+        </note>
+    </notes>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmRangesDecode, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    if (args->arg_count != 1) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 SCISQL_UDF_NAME(s2HtmRangesDecode) " expects 1 argument");
+        return 1;
+    }
+    if (args->arg_type[0] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, "Argument of "
+                 SCISQL_UDF_NAME(s2HtmRangesDecode)
+                 " must be a binary string");
+        return 1;
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_BLOB_SIZE;
+    initid->const_item = (args->args[0] == 0) ? 0 : 1;
+    initid->ptr = 0;
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmRangesDecode, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    scisql_ids *ids;
+
+    /* If the input is null or malformed, the result is null */
+    if (args->args[0] == 0) {
+        *is_null = 1;
+        return result;
+    }
+    ids = scisql_ids_decode((scisql_ids *) initid->ptr,
+                            (const unsigned char *) args->args[0],
+                            args->lengths[0]);
+    initid->ptr = (char *) ids;
+    if (ids == 0) {
+        *is_null = 1;
+        return result;
+    }
+    *length = (unsigned long) (2 * sizeof(int64_t) * ids->n);
+    return (char *) ids->ranges;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmRangesDecode, _deinit) (
+    UDF_INIT *initid)
+{
+    free(initid->ptr);
+}
+
+
+SCISQL_UDF_INIT(s2HtmRangesDecode)
+SCISQL_UDF_DEINIT(s2HtmRangesDecode)
+SCISQL_STRING_UDF(s2HtmRangesDecode)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
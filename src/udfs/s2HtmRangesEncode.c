@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmRangesEncode"
+     return_type="MEDIUMBLOB"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Converts a binary-string representation of HTM ID ranges (as
+        returned by e.g. ${SCISQL_PREFIX}s2CircleHtmRanges()) to a compact
+        delta + varint encoding. Range lists at high subdivision levels
+        are typically 5 or more times smaller in this form, which makes it
+        well suited to shipping between servers. All sciSQL UDFs
+        that accept HTM ID range lists accept both representations.
+    </desc>
+    <args>
+        <arg name="htmRanges" type="MEDIUMBLOB">
+            Binary-string representation of HTM ID ranges, in either
+            the raw or compact encoding.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If htmRanges is NULL or malformed, NULL is returned.
+        </note>
+        <note>
+            The ranges must be sorted, disjoint and consist of non-negative
+            IDs, as is the case for all range lists produced by sciSQL.
+            Other raw inputs are considered malformed.
+        </note>
+    </notes>
+</udf>
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    scisql_ids *ids;
+    size_t cap;
+    unsigned char *buf;
+} _scisql_encode_state;
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmRangesEncode, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    if (args->arg_count != 1) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 SCISQL_UDF_NAME(s2HtmRangesEncode) " expects 1 argument");
+        return 1;
+    }
+    if (args->arg_type[0] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, "Argument of "
+                 SCISQL_UDF_NAME(s2HtmRangesEncode)
+                 " must be a binary string");
+        return 1;
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_ENCODED_SIZE(SCISQL_HTM_MAX_RANGES);
+    initid->const_item = (args->args[0] == 0) ? 0 : 1;
+    initid->ptr = (char *) calloc(1, sizeof(_scisql_encode_state));
+    if (initid->ptr == 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmRangesEncode)
+                 " failed to allocate memory for internal state");
+        return 1;
+    }
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmRangesEncode, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    _scisql_encode_state *state = (_scisql_encode_state *) initid->ptr;
+    scisql_ids *ids;
+    size_t len;
+
+    /* If the input is null or malformed, the result is null */
+    if (args->args[0] == 0) {
+        *is_null = 1;
+        return result;
+    }
+    ids = scisql_ids_decode(state->ids, (const unsigned char *) args->args[0],
+                            args->lengths[0]);
+    state->ids = ids;
+    if (ids == 0) {
+        *is_null = 1;
+        return result;
+    }
+    len = SCISQL_HTM_ENCODED_SIZE(ids->n);
+    if (state->cap < len) {
+        free(state->buf);
+        state->buf = (unsigned char *) malloc(len);
+        if (state->buf == 0) {
+            state->cap = 0;
+            *is_null = 1;
+            return result;
+        }
+        state->cap = len;
+    }
+    *length = (unsigned long) scisql_ids_encode(state->buf, ids);
+    return (char *) state->buf;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmRangesEncode, _deinit) (
+    UDF_INIT *initid)
+{
+    _scisql_encode_state *state = (_scisql_encode_state *) initid->ptr;
+    if (state != 0) {
+        free(state->ids);
+        free(state->buf);
+        free(state);
+    }
+}
+
+
+SCISQL_UDF_INIT(s2HtmRangesEncode)
+SCISQL_UDF_DEINIT(s2HtmRangesEncode)
+SCISQL_STRING_UDF(s2HtmRangesEncode)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "s2HtmRangesSetOp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    scisql_ids *a;
+    scisql_ids *b;
+    scisql_ids *out;
+} _scisql_setop_state;
+
+
+SCISQL_LOCAL SCISQL_BOOL scisql_htm_setop_init(UDF_INIT *initid,
+                                               UDF_ARGS *args,
+                                               char *message,
+                                               const char *name)
+{
+    SCISQL_BOOL const_item = 1;
+    unsigned int i;
+    if (args->arg_count != 2 && args->arg_count != 3) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 "%s expects 2 or 3 arguments", name);
+        return 1;
+    }
+    if (args->arg_type[0] != STRING_RESULT ||
+        args->arg_type[1] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 "%s: first and second arguments must be binary strings",
+                 name);
+        return 1;
+    }
+    if (args->arg_count == 3 && args->arg_type[2] != INT_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 "%s: third argument must be an integer", name);
+        return 1;
+    }
+    for (i = 0; i < args->arg_count; ++i) {
+        if (args->args[i] == 0) {
+            const_item = 0;
+        }
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_BLOB_SIZE;
+    initid->const_item = const_item;
+    initid->ptr = (char *) calloc(1, sizeof(_scisql_setop_state));
+    if (initid->ptr == 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 "%s failed to allocate memory for internal state", name);
+        return 1;
+    }
+    return 0;
+}
+
+
+SCISQL_LOCAL char * scisql_htm_setop(UDF_INIT *initid,
+                                     UDF_ARGS *args,
+                                     char *result,
+                                     unsigned long *length,
+                                     char *is_null,
+                                     scisql_ids_setop op)
+{
+    _scisql_setop_state *state = (_scisql_setop_state *) initid->ptr;
+    unsigned int i;
+    int la, lb;
+
+    /* If any input is NULL, the result is NULL. */
+    for (i = 0; i < args->arg_count; ++i) {
+        if (args->args[i] == 0) {
+            *is_null = 1;
+            return result;
+        }
+    }
+    state->a = scisql_ids_decode(
+        state->a, (const unsigned char *) args->args[0], args->lengths[0]);
+    state->b = scisql_ids_decode(
+        state->b, (const unsigned char *) args->args[1], args->lengths[1]);
+    if (state->a == 0 || state->b == 0) {
+        *is_null = 1;
+        return result;
+    }
+    /* bring both range lists to the same subdivision level */
+    la = (state->a->n == 0) ? -1 : scisql_htm_level(state->a->ranges[0]);
+    lb = (state->b->n == 0) ? -1 : scisql_htm_level(state->b->ranges[0]);
+    if (args->arg_count == 3) {
+        long long level = *((long long *) args->args[2]);
+        if (level < 0 || level > SCISQL_HTM_MAX_LEVEL) {
+            *is_null = 1;
+            return result;
+        }
+        la = lb = (int) level;
+    } else if (la < lb) {
+        la = lb;
+    } else {
+        lb = la;
+    }
+    if (la >= 0) {
+        state->a = scisql_ids_tolevel(state->a, la);
+        state->b = scisql_ids_tolevel(state->b, lb);
+        if (state->a == 0 || state->b == 0) {
+            *is_null = 1;
+            return result;
+        }
+    }
+    state->out = (*op)(state->out, state->a, state->b);
+    if (state->out == 0 || state->out->n > SCISQL_HTM_MAX_RANGES) {
+        *is_null = 1;
+        return result;
+    }
+    *length = (unsigned long) (2 * sizeof(int64_t) * state->out->n);
+    return (char *) state->out->ranges;
+}
+
+
+SCISQL_LOCAL void scisql_htm_setop_deinit(UDF_INIT *initid) {
+    _scisql_setop_state *state = (_scisql_setop_state *) initid->ptr;
+    if (state != 0) {
+        free(state->a);
+        free(state->b);
+        free(state->out);
+        free(state);
+    }
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Argument handling shared by the HTM ID range list set operation
+    UDFs: s2HtmRangesUnion(), s2HtmRangesIntersect() and
+    s2HtmRangesSubtract().
+*/
+
+#ifndef SCISQL_UDFS_S2HTMRANGESSETOP_H
+#define SCISQL_UDFS_S2HTMRANGESSETOP_H
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  A set operation on HTM ID range lists, e.g. scisql_ids_union().
+ */
+typedef scisql_ids * (*scisql_ids_setop)(scisql_ids *out,
+                                         const scisql_ids *a,
+                                         const scisql_ids *b);
+
+/*  Checks the arguments of the set operation UDF with the given name,
+    and allocates its internal state.
+
+    Returns 0 on success and 1 (with an error message) on failure.
+ */
+SCISQL_LOCAL SCISQL_BOOL scisql_htm_setop_init(UDF_INIT *initid,
+                                               UDF_ARGS *args,
+                                               char *message,
+                                               const char *name);
+
+/*  Decodes the two range lists passed to a set operation UDF, brings
+    them to a common subdivision level and applies op. Returns the raw
+    encoding of the result, or sets *is_null.
+ */
+SCISQL_LOCAL char * scisql_htm_setop(UDF_INIT *initid,
+                                     UDF_ARGS *args,
+                                     char *result,
+                                     unsigned long *length,
+                                     char *is_null,
+                                     scisql_ids_setop op);
+
+/*  Frees the internal state of a set operation UDF.
+ */
+SCISQL_LOCAL void scisql_htm_setop_deinit(UDF_INIT *initid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCISQL_UDFS_S2HTMRANGESSETOP_H */
@@ -0,0 +1,116 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmRangesSubtract"
+     return_type="MEDIUMBLOB"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Returns a binary-string representation of the ranges of HTM IDs
+        that are in the first of two HTM ID range lists (as returned by
+        e.g. ${SCISQL_PREFIX}s2CircleHtmRanges()) but not in the second.
+        The ranges are combined with a single linear merge. This string
+        will be at most 16MB long, i.e. it will fit in a MEDIUMBLOB.
+    </desc>
+    <args>
+        <arg name="htmRanges1" type="MEDIUMBLOB">
+            Range list to subtract from.
+        </arg>
+        <arg name="htmRanges2" type="MEDIUMBLOB">
+            Range list to subtract.
+        </arg>
+        <arg name="level" type="INTEGER">
+            Optional HTM subdivision level of the output ranges, must be
+            in range [0, 24].
+        </arg>
+    </args>
+    <notes>
+        <note>
+            The range lists may be in either the raw or the compact
+            (${SCISQL_PREFIX}s2HtmRangesEncode()) encoding. The result
+            is always in the raw encoding.
+        </note>
+        <note>
+            Each range list must consist of HTM IDs at a single subdivision
+            level. If level is specified, both lists are first converted
+            to that level; converting to a coarser level replaces IDs by
+            the IDs of their ancestors. Otherwise, if the lists are at
+            different levels, the coarser list is converted to the level
+            of the finer one, which is exact.
+        </note>
+        <note>
+            If any argument is NULL, or if a range list is malformed,
+            or if level does not lie in the range [0, 24], NULL is returned.
+        </note>
+        <note>
+            If the result would not fit in 16MB, NULL is returned.
+        </note>
+    </notes>
+</udf>
+*/
+
+#include "s2HtmRangesSetOp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmRangesSubtract, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    return scisql_htm_setop_init(initid, args, message,
+                                 SCISQL_UDF_NAME(s2HtmRangesSubtract));
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmRangesSubtract, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    return scisql_htm_setop(initid, args, result, length, is_null,
+                            &scisql_ids_subtract);
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmRangesSubtract, _deinit) (
+    UDF_INIT *initid)
+{
+    scisql_htm_setop_deinit(initid);
+}
+
+
+SCISQL_UDF_INIT(s2HtmRangesSubtract)
+SCISQL_UDF_DEINIT(s2HtmRangesSubtract)
+SCISQL_STRING_UDF(s2HtmRangesSubtract)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
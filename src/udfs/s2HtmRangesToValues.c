@@ -0,0 +1,182 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2HtmRangesToValues"
+     return_type="LONGTEXT"
+     section="s2"
+     internal="true">
+
+    <desc>
+        Converts a binary-string representation of HTM ID ranges (as
+        returned by e.g. ${SCISQL_PREFIX}s2CircleHtmRanges() or
+        ${SCISQL_PREFIX}s2HtmRangesEncode()) to the
+        text of an SQL multi-row VALUES list, i.e. a string of the form
+        "(htmMin1,htmMax1),(htmMin2,htmMax2),...". This allows all ranges
+        to be inserted into a table with a single prepared INSERT
+        statement, rather than with one INSERT per range.
+    </desc>
+    <args>
+        <arg name="htmRanges" type="MEDIUMBLOB">
+            Binary-string representation of HTM ID ranges.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If htmRanges is NULL or malformed, NULL is returned.
+        </note>
+        <note>
+            If htmRanges is empty, an empty string is returned.
+        </note>
+    </notes>
+</udf>
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "format.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Maximum number of characters used to format a single range */
+#define _SCISQL_VALUES_RANGE_LEN 44
+
+typedef struct {
+    scisql_ids *ids;
+    size_t cap;
+    char *buf;
+} _scisql_values_state;
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2HtmRangesToValues, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    if (args->arg_count != 1) {
+        snprintf(message, MYSQL_ERRMSG_SIZE,
+                 SCISQL_UDF_NAME(s2HtmRangesToValues) " expects 1 argument");
+        return 1;
+    }
+    if (args->arg_type[0] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, "Argument of "
+                 SCISQL_UDF_NAME(s2HtmRangesToValues)
+                 " must be a binary string");
+        return 1;
+    }
+    initid->maybe_null = 1;
+    initid->max_length = SCISQL_HTM_MAX_RANGES * _SCISQL_VALUES_RANGE_LEN;
+    initid->const_item = (args->args[0] == 0) ? 0 : 1;
+    initid->ptr = (char *) calloc(1, sizeof(_scisql_values_state));
+    if (initid->ptr == 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2HtmRangesToValues)
+                 " failed to allocate memory for internal state");
+        return 1;
+    }
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2HtmRangesToValues, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    _scisql_values_state *state = (_scisql_values_state *) initid->ptr;
+    scisql_ids *ids;
+    size_t i, len;
+    char *s;
+
+    /* If the input is null or malformed, the result is null */
+    if (args->args[0] == 0) {
+        *is_null = 1;
+        return result;
+    }
+    ids = scisql_ids_decode(state->ids, (const unsigned char *) args->args[0],
+                            args->lengths[0]);
+    state->ids = ids;
+    if (ids == 0) {
+        *is_null = 1;
+        return result;
+    }
+    if (ids->n == 0) {
+        *length = 0;
+        return result;
+    }
+    len = ids->n * _SCISQL_VALUES_RANGE_LEN;
+    if (state->cap < len) {
+        free(state->buf);
+        state->buf = (char *) malloc(len);
+        if (state->buf == 0) {
+            state->cap = 0;
+            *is_null = 1;
+            return result;
+        }
+        state->cap = len;
+    }
+    s = state->buf;
+    for (i = 0; i < ids->n; ++i) {
+        *s++ = '(';
+        s += scisql_format_int64(s, ids->ranges[2*i]);
+        *s++ = ',';
+        s += scisql_format_int64(s, ids->ranges[2*i + 1]);
+        *s++ = ')';
+        *s++ = ',';
+    }
+    /* drop the trailing comma */
+    *length = (unsigned long) (s - state->buf - 1);
+    return state->buf;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2HtmRangesToValues, _deinit) (
+    UDF_INIT *initid)
+{
+    _scisql_values_state *state = (_scisql_values_state *) initid->ptr;
+    if (state != 0) {
+        free(state->ids);
+        free(state->buf);
+        free(state);
+    }
+}
+
+
+SCISQL_UDF_INIT(s2HtmRangesToValues)
+SCISQL_UDF_DEINIT(s2HtmRangesToValues)
+SCISQL_STRING_UDF(s2HtmRangesToValues)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
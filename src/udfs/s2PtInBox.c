@@ -136,6 +136,7 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInBox, SCISQL_NO_SUFFIX) (
     char *error SCISQL_UNUSED)
 {
     scisql_sc p, bmin, bmax;
+    scisql_s2box box;
     double **a = (double **) args->args;
     int i;
 
@@ -147,31 +148,12 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInBox, SCISQL_NO_SUFFIX) (
     }
     if (scisql_sc_init(&p, *a[0], *a[1]) != 0 ||
         scisql_sc_init(&bmin, *a[2], *a[3]) != 0 ||
-        scisql_sc_init(&bmax, *a[4], *a[5]) != 0) {
+        scisql_sc_init(&bmax, *a[4], *a[5]) != 0 ||
+        scisql_s2box_init(&box, &bmin, &bmax) != 0) {
         *is_null = 1;
         return 0;
     }
-
-    if (bmax.lon < bmin.lon && (bmax.lon < 0.0 || bmin.lon > 360.0)) {
-        *is_null = 1;
-        return 0;
-    }
-    /* Check if latitude is in range */
-    if (bmin.lat > bmax.lat || p.lat < bmin.lat || p.lat > bmax.lat) {
-        return 0;
-    }
-    if (bmax.lon - bmin.lon >= 360.0) {
-        return 1;
-    }
-    /* Range-reduce all longitude angles */
-    p.lon = scisql_angred(p.lon);
-    bmin.lon = scisql_angred(bmin.lon);
-    bmax.lon = scisql_angred(bmax.lon);
-    if (bmin.lon <= bmax.lon) {
-        return p.lon >= bmin.lon && p.lon <= bmax.lon;
-    } else {
-        return p.lon >= bmin.lon || p.lon <= bmax.lon;
-    }
+    return scisql_s2box_csc(&box, &p);
 }
 
 
@@ -26,7 +26,7 @@
         spherical convex polygon and 0 otherwise. The polygon may
         be specified either as a VARBINARY byte string (as produced by
         ${SCISQL_PREFIX}s2CPolyToBin()), or as a sequence of at least 3
-        and at most 20 vertex pairs.
+        and at most 65536 vertex pairs.
     </desc>
     <args>
         <arg name="lon" type="DOUBLE PRECISION" units="deg">
@@ -77,6 +77,12 @@
             hemispherical, to define edges that do not intersect except at
             vertices, and to define edges that form a convex polygon.
         </note>
+        <note>
+            Polygons with more than 20 vertices are tested by binary
+            searching for the single edge a point must be tested against,
+            so the cost of a test grows only logarithmically with the
+            number of vertices.
+        </note>
         <note>
             Coordinate values must be convertible to type DOUBLE PRECISION. If
             their actual types are BIGINT or DECIMAL, then the conversion can
@@ -118,6 +124,7 @@ typedef struct {
     int const_poly;
     scisql_v3 pos;
     scisql_s2cpoly poly;
+    scisql_s2lpoly *lpoly; /* set instead of poly for large polygons */
 } _scisql_ptpoly_state;
 
 
@@ -131,11 +138,11 @@ SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2PtInCPoly, _init) (
 
     if (args->arg_count != 3) {
         if (args->arg_count < 8 ||
-            args->arg_count > 2 + 2 * SCISQL_MAX_VERTS ||
+            args->arg_count > 2 + 2 * SCISQL_MAX_LARGE_VERTS ||
             (args->arg_count & 1) != 0) {
             snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2PtInCPoly)
                      " expects between 4 and %d spherical coordinate pairs",
-                     SCISQL_MAX_VERTS + 1);
+                     SCISQL_MAX_LARGE_VERTS + 1);
             return 1;
         }
     } else if (args->arg_type[2] != STRING_RESULT) {
@@ -168,6 +175,7 @@ SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2PtInCPoly, _init) (
             (_scisql_ptpoly_state *) malloc(sizeof(_scisql_ptpoly_state));
         if (state != 0) {
             state->valid = 0;
+            state->lpoly = 0;
             state->const_pos = const_pos;
             state->const_poly = const_poly;
             initid->ptr = (char *) state;
@@ -188,10 +196,13 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInCPoly, SCISQL_NO_SUFFIX) (
     size_t i, n;
     scisql_sc pt;
     scisql_v3 verts[SCISQL_MAX_VERTS];
+    scisql_v3 *v;
+    long long ret;
 
     s.valid = 0;
     s.const_pos = 0;
     s.const_poly = 0;
+    s.lpoly = 0;
     state = (initid->ptr == 0) ? &s : (_scisql_ptpoly_state *) initid->ptr;
 
     if (state->valid == 0 || state->const_pos == 0) {
@@ -210,43 +221,86 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInCPoly, SCISQL_NO_SUFFIX) (
     if (state->valid == 0 || state->const_poly == 0) {
         /* if polygon isn't constant or isn't cached yet, build one
            from the arguments. */
+        free(state->lpoly);
+        state->lpoly = 0;
+        state->valid = 0;
         for (i = 2; i < args->arg_count; ++i) {
             if (args->args[i] == 0) {
                 return 0;
             }
         }
         if (args->arg_count == 3) {
-            i = scisql_s2cpoly_frombin(&state->poly,
-                                       (unsigned char *) args->args[2],
-                                       (size_t) args->lengths[2]);
+            size_t len = (size_t) args->lengths[2];
+            if (len > 3 * sizeof(double) * (SCISQL_MAX_VERTS + 1)) {
+                state->lpoly = scisql_s2lpoly_frombin(
+                    (unsigned char *) args->args[2], len);
+                i = (state->lpoly == 0);
+            } else {
+                i = scisql_s2cpoly_frombin(&state->poly,
+                                           (unsigned char *) args->args[2],
+                                           len);
+            }
             if (i != 0) {
                 *is_null = 1;
                 return 0;
             }
         } else {
             double **a = (double **) args->args;
-            for (i = 2, n = 0; i < args->arg_count; i += 2, ++n) {
-                if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+            n = (args->arg_count - 2) / 2;
+            v = verts;
+            if (n > SCISQL_MAX_VERTS) {
+                v = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+                if (v == 0) {
                     *is_null = 1;
                     return 0;
                 }
-                scisql_sctov3(&verts[n], &pt);
             }
-            if (scisql_s2cpoly_init(&state->poly, verts, n) != 0) {
+            for (i = 2, n = 0; i < args->arg_count; i += 2, ++n) {
+                if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+                    break;
+                }
+                scisql_sctov3(&v[n], &pt);
+            }
+            if (i == args->arg_count) {
+                /* polygons too large for a scisql_s2cpoly are binary
+                   searched */
+                if (n > SCISQL_MAX_VERTS) {
+                    state->lpoly = scisql_s2lpoly_new(v, n);
+                    i = (state->lpoly == 0);
+                } else {
+                    i = scisql_s2cpoly_init(&state->poly, v, n);
+                }
+            }
+            if (v != verts) {
+                free(v);
+            }
+            if (i != 0) {
                 *is_null = 1;
                 return 0;
             }
         }
     }
     state->valid = 1;
-    return scisql_s2cpoly_cv3(&state->poly, &state->pos);
+    if (state->lpoly != 0) {
+        ret = scisql_s2lpoly_cv3(state->lpoly, &state->pos);
+    } else {
+        ret = scisql_s2cpoly_cv3(&state->poly, &state->pos);
+    }
+    if (state == &s) {
+        free(s.lpoly);
+    }
+    return ret;
 }
 
 
 SCISQL_API void SCISQL_VERSIONED_FNAME(s2PtInCPoly, _deinit) (
     UDF_INIT *initid)
 {
-    free(initid->ptr);
+    _scisql_ptpoly_state *state = (_scisql_ptpoly_state *) initid->ptr;
+    if (state != 0) {
+        free(state->lpoly);
+        free(state);
+    }
 }
 
 
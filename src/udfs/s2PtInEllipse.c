@@ -98,14 +98,7 @@ extern "C" {
 
 
 typedef struct {
-    double sinLon;    /* sine of ellipse center longitude */
-    double cosLon;    /* cosine of ellipse center longitude */
-    double sinLat;    /* sine of ellipse center latitude */
-    double cosLat;    /* cosine of ellipse center latitude */
-    double sinPosAng; /* sine of ellipse position angle */
-    double cosPosAng; /* cosine of ellipse position angle */
-    double invMinor2; /* 1/(m*m); m = semi-minor axis length (rad) */
-    double invMajor2; /* 1/(M*M); M = semi-major axis length (rad) */
+    scisql_s2ellipse ellipse;
     int valid;
 } _scisql_s2ellipse;
 
@@ -151,7 +144,6 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInEllipse, SCISQL_NO_SUFFIX) (
     _scisql_s2ellipse ellipse;
     scisql_sc p, cen;
     scisql_v3 v;
-    double xne, yne, x, y;
     _scisql_s2ellipse *ep;
     double **a = (double **) args->args;
     int i;
@@ -170,46 +162,17 @@ SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInEllipse, SCISQL_NO_SUFFIX) (
     ellipse.valid = 0;
     ep = (initid->ptr != 0) ? (_scisql_s2ellipse *) initid->ptr : &ellipse;
     if (ep->valid == 0) {
-        double M = *a[4];
-        double m = *a[5];
-        double posang = *a[6] * SCISQL_RAD_PER_DEG;
-        if (SCISQL_ISSPECIAL(posang) || SCISQL_ISNAN(M) || SCISQL_ISNAN(m)) {
+        if (scisql_sc_init(&cen, *a[2], *a[3]) != 0 ||
+            scisql_s2ellipse_init(&ep->ellipse, &cen, *a[4], *a[5], *a[6]) != 0) {
             *is_null = 1;
             return 0;
         }
-        /* Semi-minor axis length m and semi-major axis length M must satisfy
-           0 <= m <= M <= 10 deg */
-        if (m < 0.0 || m > M || M > 10.0 * SCISQL_ARCSEC_PER_DEG) {
-            *is_null = 1;
-            return 0;
-        }
-        if (scisql_sc_init(&cen, *a[2], *a[3]) != 0) {
-            *is_null = 1;
-            return 0;
-        }
-        ep->sinLon = sin(cen.lon * SCISQL_RAD_PER_DEG);
-        ep->cosLon = cos(cen.lon * SCISQL_RAD_PER_DEG);
-        ep->sinLat = sin(cen.lat * SCISQL_RAD_PER_DEG);
-        ep->cosLat = cos(cen.lat * SCISQL_RAD_PER_DEG);
-        ep->sinPosAng = sin(posang);
-        ep->cosPosAng = cos(posang);
-        m = m * SCISQL_RAD_PER_DEG / SCISQL_ARCSEC_PER_DEG;
-        M = M * SCISQL_RAD_PER_DEG / SCISQL_ARCSEC_PER_DEG;
-        ep->invMinor2 = 1.0 / (m * m);
-        ep->invMajor2 = 1.0 / (M * M);
         ep->valid = 1;
     }
     /* Transform input position from spherical coordinates
        to a unit cartesian vector. */
     scisql_sctov3(&v, &p);
-    /* get coords of input point in (N,E) basis at ellipse center */
-    xne = ep->cosLat * v.z - ep->sinLat * (ep->sinLon * v.y + ep->cosLon * v.x);
-    yne = ep->cosLon * v.y - ep->sinLon * v.x;
-    /* rotate by negated position angle */
-    x = ep->sinPosAng * yne + ep->cosPosAng * xne;
-    y = ep->cosPosAng * yne - ep->sinPosAng * xne;
-    /* perform standard 2D axis-aligned point-in-ellipse test */
-    return (x * x * ep->invMajor2 + y * y * ep->invMinor2 <= 1.0);
+    return scisql_s2ellipse_cv3(&ep->ellipse, &v);
 }
 
 
@@ -0,0 +1,304 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2PtInSPoly" return_type="INTEGER" section="s2">
+    <desc>
+        Returns 1 if the point (lon, lat) lies inside the given simple
+        spherical polygon and 0 otherwise. Unlike the polygons accepted by
+        ${SCISQL_PREFIX}s2PtInCPoly(), simple polygons need not be convex.
+        The polygon may be specified either as a binary string (as produced
+        by ${SCISQL_PREFIX}s2SPolyToBin()), or as a sequence of at least 3
+        and at most 4096 vertex pairs.
+    </desc>
+    <args>
+        <arg name="lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of point to test.
+        </arg>
+        <arg name="lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of point to test.
+        </arg>
+        <arg name="poly" type="VARBINARY">
+            Binary-string representation of polygon.
+        </arg>
+    </args>
+    <args varargs="true">
+        <arg name="lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of point to test.
+        </arg>
+        <arg name="lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of point to test.
+        </arg>
+        <arg name="v1Lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of first polygon vertex.
+        </arg>
+        <arg name="v1Lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of first polygon vertex.
+        </arg>
+        <arg name="v2Lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of second polygon vertex.
+        </arg>
+        <arg name="v2Lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of second polygon vertex.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If any parameter is NULL, 0 is returned.
+        </note>
+        <note>
+            If any coordinate is NaN or +/-Inf, this is an error and NULL is
+            returned (IEEE specials are not currently supported by MySQL).
+        </note>
+        <note>
+            If any latitude angle lies outside of [-90, 90] degrees,
+            this is an error and NULL is returned.
+        </note>
+        <note>
+            Polygon vertices can be specified in either clockwise or
+            counter-clockwise order, and must lie strictly inside the
+            hemisphere centered on their sum. If two polygon edges intersect
+            anywhere but at a shared vertex, this is an error and NULL is
+            returned.
+        </note>
+        <note>
+            When the polygon is constant and has at least 128 vertices, the
+            HTM triangles covering it are classified once, as lying inside
+            the polygon, outside of it, or on its boundary. Points in inside
+            or outside triangles are then resolved by looking up their HTM
+            ID. All other points are tested against every polygon edge, so
+            results never depend on whether the polygon is constant.
+        </note>
+        <note>
+            Coordinate values must be convertible to type DOUBLE PRECISION. If
+            their actual types are BIGINT or DECIMAL, then the conversion can
+            result in loss of precision and hence an inaccurate result. Loss of
+            precision will not occur so long as the inputs are values of type
+            DOUBLE PRECISION, FLOAT, REAL, INTEGER, SMALLINT or TINYINT.
+        </note>
+    </notes>
+    <example>
+        SELECT objectId
+            FROM Object
+            WHERE ${SCISQL_PREFIX}s2PtInSPoly(
+                ra, decl,
+                0, 0,
+                10, 0,
+                10, 10,
+                5, 2,
+                0, 10) = 1;
+    </example>
+</udf>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "htm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Polygons with fewer vertices are tested without an HTM classification */
+#define _SCISQL_MIN_INDEX_VERTS 128
+
+typedef struct {
+    int valid;
+    int const_pos;
+    int const_poly;
+    scisql_v3 pos;
+    scisql_s2spoly *poly;
+    scisql_s2spoly_htmidx *idx; /* HTM classification of a constant poly */
+} _scisql_ptspoly_state;
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2PtInSPoly, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    size_t i;
+    SCISQL_BOOL const_item = 1, const_pos = 1, const_poly = 1;
+
+    if (args->arg_count != 3) {
+        if (args->arg_count < 8 ||
+            args->arg_count > 2 + 2 * SCISQL_MAX_SIMPLE_VERTS ||
+            (args->arg_count & 1) != 0) {
+            snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2PtInSPoly)
+                     " expects between 4 and %d spherical coordinate pairs",
+                     SCISQL_MAX_SIMPLE_VERTS + 1);
+            return 1;
+        }
+    } else if (args->arg_type[2] != STRING_RESULT) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2PtInSPoly)
+                 " expects a spherical coordinate pair and a polygon"
+                 " byte-string");
+        return 1;
+    }
+    for (i = 0; i < 2; ++i) {
+        args->arg_type[i] = REAL_RESULT;
+        if (args->args[i] == 0) {
+            const_item = 0;
+            const_pos = 0;
+        }
+    }
+    for (i = 2; i < args->arg_count; ++i) {
+        if (args->arg_count != 3) {
+            args->arg_type[i] = REAL_RESULT;
+        }
+        if (args->args[i] == 0) {
+            const_item = 0;
+            const_poly = 0;
+        }
+    }
+    initid->maybe_null = 1;
+    initid->const_item = const_item;
+    initid->ptr = 0;
+    if (const_pos != 0 || const_poly != 0) {
+        _scisql_ptspoly_state *state =
+            (_scisql_ptspoly_state *) calloc(1, sizeof(_scisql_ptspoly_state));
+        if (state != 0) {
+            state->const_pos = const_pos;
+            state->const_poly = const_poly;
+            initid->ptr = (char *) state;
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_API long long SCISQL_VERSIONED_FNAME(s2PtInSPoly, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    _scisql_ptspoly_state s;
+    _scisql_ptspoly_state *state;
+    size_t i, n;
+    scisql_sc pt;
+    long long ret;
+
+    s.valid = 0;
+    s.const_pos = 0;
+    s.const_poly = 0;
+    s.poly = 0;
+    s.idx = 0;
+    state = (initid->ptr == 0) ? &s : (_scisql_ptspoly_state *) initid->ptr;
+
+    if (state->valid == 0 || state->const_pos == 0) {
+        /* if position isn't constant or isn't cached yet, extract it
+           from the arguments and convert it to a unit vector. */
+        double **a = (double **) args->args;
+        if (a[0] == 0 || a[1] == 0) {
+            return 0;
+        }
+        if (scisql_sc_init(&pt, *a[0], *a[1]) != 0) {
+            *is_null = 1;
+            return 0;
+        }
+        scisql_sctov3(&state->pos, &pt);
+    }
+    if (state->valid == 0 || state->const_poly == 0) {
+        /* if polygon isn't constant or isn't cached yet, build one
+           from the arguments. */
+        scisql_s2spoly_htmidx_free(state->idx);
+        free(state->poly);
+        state->idx = 0;
+        state->poly = 0;
+        state->valid = 0;
+        for (i = 2; i < args->arg_count; ++i) {
+            if (args->args[i] == 0) {
+                return 0;
+            }
+        }
+        if (args->arg_count == 3) {
+            state->poly = scisql_s2spoly_frombin(
+                (unsigned char *) args->args[2], (size_t) args->lengths[2]);
+        } else {
+            double **a = (double **) args->args;
+            scisql_v3 *v;
+            n = (args->arg_count - 2) / 2;
+            v = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+            if (v == 0) {
+                *is_null = 1;
+                return 0;
+            }
+            for (i = 2, n = 0; i < args->arg_count; i += 2, ++n) {
+                if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+                    break;
+                }
+                scisql_sctov3(&v[n], &pt);
+            }
+            if (i == args->arg_count) {
+                state->poly = scisql_s2spoly_new(v, n);
+            }
+            free(v);
+        }
+        if (state->poly == 0) {
+            *is_null = 1;
+            return 0;
+        }
+        /* classifying HTM triangles only pays off if a polygon with
+           many vertices is tested against many points */
+        if (state->const_poly != 0 &&
+            state->poly->n >= _SCISQL_MIN_INDEX_VERTS) {
+            state->idx = scisql_s2spoly_htmidx_new(state->poly, -1);
+        }
+    }
+    state->valid = 1;
+    if (state->idx != 0) {
+        ret = scisql_s2spoly_htmidx_cv3(state->idx, state->poly, &state->pos);
+    } else {
+        ret = scisql_s2spoly_cv3(state->poly, &state->pos);
+    }
+    if (state == &s) {
+        free(s.poly);
+    }
+    return ret;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2PtInSPoly, _deinit) (
+    UDF_INIT *initid)
+{
+    _scisql_ptspoly_state *state = (_scisql_ptspoly_state *) initid->ptr;
+    if (state != 0) {
+        scisql_s2spoly_htmidx_free(state->idx);
+        free(state->poly);
+        free(state);
+    }
+}
+
+
+SCISQL_UDF_INIT(s2PtInSPoly)
+SCISQL_UDF_DEINIT(s2PtInSPoly)
+SCISQL_INTEGER_UDF(s2PtInSPoly)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+
+/**
+<udf name="${SCISQL_PREFIX}s2SPolyToBin" return_type="BINARY" section="s2">
+    <desc>
+        Returns a binary-string representation of a simple spherical
+        polygon, which need not be convex. The polygon must be specified
+        as a sequence of at least 3 and at most 4096 vertices. An N vertex
+        input will result in a binary string of length exactly 8 + 24*N.
+    </desc>
+    <args varargs="true">
+        <arg name="v1Lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of first polygon vertex.
+        </arg>
+        <arg name="v1Lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of first polygon vertex.
+        </arg>
+        <arg name="v2Lon" type="DOUBLE PRECISION" units="deg">
+            Longitude angle of second polygon vertex.
+        </arg>
+        <arg name="v2Lat" type="DOUBLE PRECISION" units="deg">
+            Latitude angle of second polygon vertex.
+        </arg>
+    </args>
+    <notes>
+        <note>
+            If any parameter is NULL, NaN or +/-Inf, this is an error
+            and NULL is returned.
+        </note>
+        <note>
+            If any latitude angle lies outside of [-90, 90] degrees,
+            this is an error and NULL is returned.
+        </note>
+        <note>
+            Polygon vertices can be specified in either clockwise or
+            counter-clockwise order, and must lie strictly inside the
+            hemisphere centered on their sum. If two polygon edges intersect
+            anywhere but at a shared vertex, this is an error and NULL is
+            returned.
+        </note>
+        <note>
+            Input coordinate must be convertible to type DOUBLE PRECISION.
+            If their actual type is BIGINT or DECIMAL, then the conversion
+            can result in loss of precision and hence an inaccurate result.
+            Loss of precision will not occur so long as the inputs are values of
+            type DOUBLE PRECISION, FLOAT, REAL, INTEGER, SMALLINT, or TINYINT.
+        </note>
+    </notes>
+    <example>
+        SELECT ${SCISQL_PREFIX}s2SPolyToBin(
+            0, 0,
+            10, 0,
+            10, 10,
+            5, 2,
+            0, 10);
+    </example>
+</udf>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mysql.h"
+
+#include "udf.h"
+#include "geometry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+SCISQL_API SCISQL_BOOL SCISQL_VERSIONED_FNAME(s2SPolyToBin, _init) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *message)
+{
+    size_t i;
+    SCISQL_BOOL const_item = 1;
+    if (args->arg_count < 6 ||
+        args->arg_count > 2 * SCISQL_MAX_SIMPLE_VERTS ||
+        (args->arg_count & 1) != 0) {
+        snprintf(message, MYSQL_ERRMSG_SIZE, SCISQL_UDF_NAME(s2SPolyToBin)
+                 " expects between 3 and %d spherical coordinate pairs",
+                 SCISQL_MAX_SIMPLE_VERTS);
+        return 1;
+    }
+    for (i = 0; i < args->arg_count; ++i) {
+        args->arg_type[i] = REAL_RESULT;
+        if (args->args[i] == 0) {
+            const_item = 0;
+        }
+    }
+    initid->maybe_null = 1;
+    initid->max_length = sizeof(SCISQL_S2SPOLY_MAGIC) - 1 +
+                         3 * sizeof(double) * (args->arg_count / 2);
+    initid->const_item = const_item;
+    initid->ptr = 0;
+    /* the result of a large polygon doesn't fit in the buffer
+       supplied by MySQL */
+    if (initid->max_length > 255u) {
+        initid->ptr = (char *) malloc(initid->max_length);
+        if (initid->ptr == 0) {
+            snprintf(message, MYSQL_ERRMSG_SIZE,
+                     SCISQL_UDF_NAME(s2SPolyToBin)
+                     " failed to allocate memory for result");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+SCISQL_API char * SCISQL_VERSIONED_FNAME(s2SPolyToBin, SCISQL_NO_SUFFIX) (
+    UDF_INIT *initid,
+    UDF_ARGS *args,
+    char *result,
+    unsigned long *length,
+    char *is_null,
+    char *error SCISQL_UNUSED)
+{
+    scisql_s2spoly *poly = 0;
+    scisql_sc pt;
+    scisql_v3 *v;
+    size_t i, n = args->arg_count / 2;
+    double **a = (double **) args->args;
+
+    /* If any input is NULL, the result is NULL. */
+    for (i = 0; i < args->arg_count; ++i) {
+        if (a[i] == 0) {
+            *is_null = 1;
+            return result;
+        }
+    }
+    if (initid->ptr != 0) {
+        result = initid->ptr;
+    }
+    v = (scisql_v3 *) malloc(n * sizeof(scisql_v3));
+    if (v == 0) {
+        *is_null = 1;
+        return result;
+    }
+    for (i = 0, n = 0; i < args->arg_count; i += 2, ++n) {
+        if (scisql_sc_init(&pt, *a[i], *a[i + 1]) != 0) {
+            break;
+        }
+        scisql_sctov3(&v[n], &pt);
+    }
+    if (i == args->arg_count) {
+        poly = scisql_s2spoly_new(v, n);
+    }
+    free(v);
+    *length = (unsigned long) scisql_s2spoly_tobin(
+        (unsigned char *) result, initid->max_length, poly);
+    free(poly);
+    if (*length == 0) {
+        *is_null = 1;
+    }
+    return result;
+}
+
+
+SCISQL_API void SCISQL_VERSIONED_FNAME(s2SPolyToBin, _deinit) (
+    UDF_INIT *initid)
+{
+    free(initid->ptr);
+}
+
+
+SCISQL_UDF_INIT(s2SPolyToBin)
+SCISQL_UDF_DEINIT(s2SPolyToBin)
+SCISQL_STRING_UDF(s2SPolyToBin)
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
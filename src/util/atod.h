@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Locale independent, correctly rounded conversion of decimal strings
+    to double precision floating point numbers.
+*/
+
+#ifndef SCISQL_UTIL_ATOD_H
+#define SCISQL_UTIL_ATOD_H
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  Parses a floating point number from the characters in [beg, end), which
+    need not be NUL terminated. No characters at or beyond end are read.
+
+    The accepted syntax is that of strtod() in the "C" locale, minus leading
+    white-space: an optional sign followed by a decimal number with optional
+    exponent, "inf", "infinity" or "nan" (case-insensitive), or a hexadecimal
+    number. Decimal numbers are converted with round-to-nearest-even using the
+    Eisel-Lemire algorithm; the rare inputs it cannot decide (more than 19
+    significant digits very close to a half-way point) and hexadecimal numbers
+    are handed to strtod().
+
+    Returns a pointer to the character following the last one consumed and
+    stores the parsed value in *value. If no number could be parsed, beg is
+    returned and *value is set to 0.0.
+ */
+SCISQL_LOCAL const char * scisql_atod(const char *beg,
+                                       const char *end,
+                                       double *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCISQL_UTIL_ATOD_H */
@@ -0,0 +1,582 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    A bounded-memory external merge sort.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "extsort.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* ---- Types ---- */
+
+/*  An in-memory record. Record data is stored in a separate arena.
+ */
+typedef struct {
+    int64_t min;
+    int64_t max;
+    uint64_t seq;  /* insertion order, used to break ties */
+    size_t off;    /* offset of record data in arena */
+    size_t len;    /* length of record data */
+} _scisql_extrec;
+
+/*  Reads records from a sorted run during a merge.
+ */
+typedef struct {
+    FILE *f;
+    size_t run;    /* index of run, used to break ties */
+    int64_t min;
+    int64_t max;
+    char *data;
+    size_t len;
+    size_t cap;
+} _scisql_runreader;
+
+struct scisql_extsort {
+    char *tmpdir;
+    const char *err;
+    size_t mem;            /* memory limit */
+    _scisql_extrec *recs;  /* in-memory records */
+    size_t nrecs;
+    size_t reccap;
+    char *arena;           /* in-memory record data */
+    size_t arenalen;
+    size_t arenacap;
+    uint64_t seq;          /* number of records added so far */
+    int *runs;             /* file descriptors of sorted runs */
+    size_t nruns;
+    size_t runcap;
+    int finished;
+};
+
+
+/* ---- Implementation details ---- */
+
+static int _scisql_extrec_cmp(const void *a, const void *b) {
+    const _scisql_extrec *r1 = (const _scisql_extrec *) a;
+    const _scisql_extrec *r2 = (const _scisql_extrec *) b;
+    if (r1->min != r2->min) {
+        return (r1->min < r2->min) ? -1 : 1;
+    }
+    if (r1->max != r2->max) {
+        return (r1->max < r2->max) ? -1 : 1;
+    }
+    return (r1->seq < r2->seq) ? -1 : (r1->seq > r2->seq);
+}
+
+/*  Returns the stdio buffer size to use for run files.
+ */
+static size_t _scisql_extsort_bufsz(const scisql_extsort *sorter) {
+    size_t sz = sorter->mem / (2*SCISQL_EXTSORT_FANIN);
+    if (sz < 65536) {
+        sz = 65536;
+    } else if (sz > 4*1024*1024) {
+        sz = 4*1024*1024;
+    }
+    return sz;
+}
+
+/*  Creates an (anonymous) temporary file and opens a buffered write
+    stream for it. The file descriptor of the temporary file is stored
+    in fd, and remains valid after the stream is closed.
+ */
+static FILE * _scisql_extsort_mkrun(scisql_extsort *sorter, int *fd) {
+    static const char suffix[] = "/scisql_sort_XXXXXX";
+    char *path;
+    FILE *f;
+    int fd2;
+
+    path = (char *) malloc(strlen(sorter->tmpdir) + sizeof(suffix));
+    if (path == 0) {
+        sorter->err = "memory allocation failed";
+        return 0;
+    }
+    strcpy(path, sorter->tmpdir);
+    strcat(path, suffix);
+    *fd = mkstemp(path);
+    if (*fd == -1) {
+        sorter->err = "failed to create temporary file";
+        free(path);
+        return 0;
+    }
+    unlink(path);
+    free(path);
+    fd2 = dup(*fd);
+    f = (fd2 == -1) ? 0 : fdopen(fd2, "wb");
+    if (f == 0) {
+        if (fd2 != -1) {
+            close(fd2);
+        }
+        close(*fd);
+        sorter->err = "failed to open temporary file";
+        return 0;
+    }
+    setvbuf(f, 0, _IOFBF, _scisql_extsort_bufsz(sorter));
+    return f;
+}
+
+/*  Appends a run file descriptor to the run list of a sorter.
+ */
+static int _scisql_extsort_addrun(scisql_extsort *sorter, int fd) {
+    if (sorter->nruns == sorter->runcap) {
+        size_t cap = (sorter->runcap == 0) ? 16 : 2*sorter->runcap;
+        int *runs = (int *) realloc(sorter->runs, cap*sizeof(int));
+        if (runs == 0) {
+            sorter->err = "memory allocation failed";
+            close(fd);
+            return 1;
+        }
+        sorter->runs = runs;
+        sorter->runcap = cap;
+    }
+    sorter->runs[sorter->nruns++] = fd;
+    return 0;
+}
+
+/*  Writes a single record to a run file.
+ */
+static int _scisql_run_write(void *arg,
+                             int64_t min,
+                             int64_t max,
+                             const char *data,
+                             size_t len)
+{
+    FILE *f = (FILE *) arg;
+    uint32_t n = (uint32_t) len;
+    if (fwrite(&min, sizeof(int64_t), 1, f) != 1 ||
+        fwrite(&max, sizeof(int64_t), 1, f) != 1 ||
+        fwrite(&n, sizeof(uint32_t), 1, f) != 1) {
+        return 1;
+    }
+    if (len > 0 && fwrite(data, len, 1, f) != 1) {
+        return 1;
+    }
+    return 0;
+}
+
+/*  Reads the next record from a run. Returns 0 on success, -1 at
+    end-of-file, and 1 on error.
+ */
+static int _scisql_runreader_next(_scisql_runreader *r) {
+    uint32_t n;
+    if (fread(&r->min, sizeof(int64_t), 1, r->f) != 1) {
+        return feof(r->f) ? -1 : 1;
+    }
+    if (fread(&r->max, sizeof(int64_t), 1, r->f) != 1 ||
+        fread(&n, sizeof(uint32_t), 1, r->f) != 1) {
+        return 1;
+    }
+    if (n > r->cap) {
+        char *data = (char *) realloc(r->data, n);
+        if (data == 0) {
+            return 1;
+        }
+        r->data = data;
+        r->cap = n;
+    }
+    r->len = n;
+    if (n > 0 && fread(r->data, n, 1, r->f) != 1) {
+        return 1;
+    }
+    return 0;
+}
+
+SCISQL_INLINE int _scisql_runreader_lt(const _scisql_runreader *r1,
+                                       const _scisql_runreader *r2)
+{
+    if (r1->min != r2->min) {
+        return r1->min < r2->min;
+    }
+    if (r1->max != r2->max) {
+        return r1->max < r2->max;
+    }
+    return r1->run < r2->run;
+}
+
+/*  Restores the heap property for the subtree rooted at heap[i].
+ */
+static void _scisql_runheap_down(_scisql_runreader **heap, size_t n, size_t i) {
+    while (1) {
+        size_t c = 2*i + 1;
+        _scisql_runreader *tmp;
+        if (c >= n) {
+            break;
+        }
+        if (c + 1 < n && _scisql_runreader_lt(heap[c + 1], heap[c])) {
+            ++c;
+        }
+        if (!_scisql_runreader_lt(heap[c], heap[i])) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[c];
+        heap[c] = tmp;
+        i = c;
+    }
+}
+
+/*  Merges n sorted runs, passing records to emit in sorted order. Runs
+    must be given in the order they were created, so that ties are broken
+    by insertion order. Run file descriptors are closed.
+ */
+static int _scisql_extsort_merge(scisql_extsort *sorter,
+                                 const int *runs,
+                                 size_t n,
+                                 scisql_extsort_emit emit,
+                                 void *arg)
+{
+    _scisql_runreader *readers;
+    _scisql_runreader **heap;
+    size_t i, nheap = 0;
+    int ret = 1;
+
+    readers = (_scisql_runreader *) calloc(n, sizeof(_scisql_runreader));
+    heap = (_scisql_runreader **) malloc(n*sizeof(_scisql_runreader *));
+    if (readers == 0 || heap == 0) {
+        sorter->err = "memory allocation failed";
+        for (i = 0; i < n; ++i) {
+            close(runs[i]);
+        }
+        goto cleanup;
+    }
+    for (i = 0; i < n; ++i) {
+        readers[i].run = i;
+        if (lseek(runs[i], 0, SEEK_SET) == 0) {
+            readers[i].f = fdopen(runs[i], "rb");
+        }
+        if (readers[i].f == 0) {
+            close(runs[i]);
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        int r;
+        if (readers[i].f == 0) {
+            sorter->err = "failed to read temporary file";
+            goto cleanup;
+        }
+        setvbuf(readers[i].f, 0, _IOFBF, _scisql_extsort_bufsz(sorter));
+        r = _scisql_runreader_next(&readers[i]);
+        if (r > 0) {
+            sorter->err = "failed to read temporary file";
+            goto cleanup;
+        } else if (r == 0) {
+            heap[nheap++] = &readers[i];
+        }
+    }
+    for (i = nheap / 2; i > 0; --i) {
+        _scisql_runheap_down(heap, nheap, i - 1);
+    }
+    while (nheap > 0) {
+        _scisql_runreader *r = heap[0];
+        int status;
+        if (emit(arg, r->min, r->max, r->data, r->len) != 0) {
+            sorter->err = "failed to output sorted record";
+            goto cleanup;
+        }
+        status = _scisql_runreader_next(r);
+        if (status > 0) {
+            sorter->err = "failed to read temporary file";
+            goto cleanup;
+        } else if (status < 0) {
+            heap[0] = heap[--nheap];
+        }
+        _scisql_runheap_down(heap, nheap, 0);
+    }
+    ret = 0;
+cleanup:
+    if (readers != 0) {
+        for (i = 0; i < n; ++i) {
+            if (readers[i].f != 0) {
+                fclose(readers[i].f);
+            }
+            free(readers[i].data);
+        }
+    }
+    free(heap);
+    free(readers);
+    return ret;
+}
+
+/*  Sorts the in-memory records of a sorter.
+ */
+static void _scisql_extsort_sort(scisql_extsort *sorter) {
+    qsort(sorter->recs, sorter->nrecs, sizeof(_scisql_extrec),
+          &_scisql_extrec_cmp);
+}
+
+/*  Sorts the in-memory records of a sorter and writes them to a new run.
+ */
+static int _scisql_extsort_spill(scisql_extsort *sorter) {
+    size_t i;
+    int fd;
+    FILE *f;
+
+    _scisql_extsort_sort(sorter);
+    f = _scisql_extsort_mkrun(sorter, &fd);
+    if (f == 0) {
+        return 1;
+    }
+    for (i = 0; i < sorter->nrecs; ++i) {
+        const _scisql_extrec *rec = &sorter->recs[i];
+        if (_scisql_run_write(f, rec->min, rec->max,
+                              sorter->arena + rec->off, rec->len) != 0) {
+            break;
+        }
+    }
+    if (fclose(f) != 0 || i != sorter->nrecs) {
+        sorter->err = "failed to write temporary file";
+        close(fd);
+        return 1;
+    }
+    sorter->nrecs = 0;
+    sorter->arenalen = 0;
+    return _scisql_extsort_addrun(sorter, fd);
+}
+
+
+/*  Returns the capacity that an array holding n elements and with
+    capacity cap should be grown to, so that it can hold need elements.
+    The capacity is doubled (starting from init), but growth is limited
+    to avail elements when that still leaves room for need elements.
+ */
+static size_t _scisql_extsort_grow(size_t cap,
+                                   size_t need,
+                                   size_t init,
+                                   size_t avail)
+{
+    size_t c = (cap == 0) ? init : cap;
+    if (need <= cap) {
+        return cap;
+    }
+    for (; c < need; c *= 2) { }
+    if (c > avail && avail >= need) {
+        c = avail;
+    }
+    return c;
+}
+
+/*  Makes room for one more in-memory record with len bytes of data.
+    The memory limit applies to the capacity of the record array and
+    arena rather than to the number of bytes in use, since that is what
+    is actually allocated. If growing either would exceed the limit, the
+    in-memory records are spilled to a run first, and the existing
+    allocations are reused.
+
+    Returns 0 on success and 1 on error.
+ */
+static int _scisql_extsort_reserve(scisql_extsort *sorter, size_t len) {
+    const size_t sz = sizeof(_scisql_extrec);
+    size_t reccap, arenacap;
+
+    while (1) {
+        size_t mem = sorter->mem;
+        arenacap = _scisql_extsort_grow(
+            sorter->arenacap, sorter->arenalen + len, 65536,
+            (sorter->reccap*sz < mem) ? mem - sorter->reccap*sz : 0);
+        reccap = _scisql_extsort_grow(
+            sorter->reccap, sorter->nrecs + 1, 1024,
+            (arenacap < mem) ? (mem - arenacap) / sz : 0);
+        if ((reccap == sorter->reccap && arenacap == sorter->arenacap) ||
+            reccap*sz + arenacap <= mem || sorter->nrecs == 0) {
+            break;
+        }
+        if (_scisql_extsort_spill(sorter) != 0) {
+            return 1;
+        }
+    }
+    if (reccap != sorter->reccap) {
+        _scisql_extrec *recs = (_scisql_extrec *) realloc(
+            sorter->recs, reccap*sz);
+        if (recs == 0) {
+            sorter->err = "memory allocation failed";
+            return 1;
+        }
+        sorter->recs = recs;
+        sorter->reccap = reccap;
+    }
+    if (arenacap != sorter->arenacap) {
+        char *arena = (char *) realloc(sorter->arena, arenacap);
+        if (arena == 0) {
+            sorter->err = "memory allocation failed";
+            return 1;
+        }
+        sorter->arena = arena;
+        sorter->arenacap = arenacap;
+    }
+    return 0;
+}
+
+
+/* ---- API ---- */
+
+scisql_extsort * scisql_extsort_new(size_t mem, const char *tmpdir) {
+    scisql_extsort *sorter;
+
+    if (tmpdir == 0) {
+        tmpdir = getenv("TMPDIR");
+        if (tmpdir == 0 || tmpdir[0] == '\0') {
+            tmpdir = "/tmp";
+        }
+    }
+    sorter = (scisql_extsort *) calloc(1, sizeof(scisql_extsort));
+    if (sorter == 0) {
+        return 0;
+    }
+    sorter->tmpdir = (char *) malloc(strlen(tmpdir) + 1);
+    if (sorter->tmpdir == 0) {
+        free(sorter);
+        return 0;
+    }
+    strcpy(sorter->tmpdir, tmpdir);
+    sorter->mem = (mem < SCISQL_EXTSORT_MIN_MEM) ? SCISQL_EXTSORT_MIN_MEM : mem;
+    return sorter;
+}
+
+
+void scisql_extsort_free(scisql_extsort *sorter) {
+    size_t i;
+    if (sorter == 0) {
+        return;
+    }
+    for (i = 0; i < sorter->nruns; ++i) {
+        if (sorter->runs[i] != -1) {
+            close(sorter->runs[i]);
+        }
+    }
+    free(sorter->runs);
+    free(sorter->arena);
+    free(sorter->recs);
+    free(sorter->tmpdir);
+    free(sorter);
+}
+
+
+int scisql_extsort_add(scisql_extsort *sorter,
+                       int64_t min,
+                       int64_t max,
+                       const char *data,
+                       size_t len)
+{
+    _scisql_extrec *rec;
+
+    if (sorter->finished != 0 || len > UINT32_MAX) {
+        sorter->err = "invalid record";
+        return 1;
+    }
+    if (_scisql_extsort_reserve(sorter, len) != 0) {
+        return 1;
+    }
+    rec = &sorter->recs[sorter->nrecs++];
+    rec->min = min;
+    rec->max = max;
+    rec->seq = sorter->seq++;
+    rec->off = sorter->arenalen;
+    rec->len = len;
+    memcpy(sorter->arena + sorter->arenalen, data, len);
+    sorter->arenalen += len;
+    return 0;
+}
+
+
+int scisql_extsort_finish(scisql_extsort *sorter,
+                          scisql_extsort_emit emit,
+                          void *arg)
+{
+    size_t i, j;
+
+    if (sorter->finished != 0) {
+        sorter->err = "sort already finished";
+        return 1;
+    }
+    sorter->finished = 1;
+    if (sorter->nruns == 0) {
+        /* everything fits in memory */
+        _scisql_extsort_sort(sorter);
+        for (i = 0; i < sorter->nrecs; ++i) {
+            const _scisql_extrec *rec = &sorter->recs[i];
+            if (emit(arg, rec->min, rec->max,
+                     sorter->arena + rec->off, rec->len) != 0) {
+                sorter->err = "failed to output sorted record";
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (sorter->nrecs > 0 && _scisql_extsort_spill(sorter) != 0) {
+        return 1;
+    }
+    free(sorter->recs);
+    free(sorter->arena);
+    sorter->recs = 0;
+    sorter->arena = 0;
+    sorter->reccap = 0;
+    sorter->arenacap = 0;
+    /* merge groups of consecutive runs until few enough remain */
+    while (sorter->nruns > SCISQL_EXTSORT_FANIN) {
+        size_t n = sorter->nruns;
+        for (i = 0, j = 0; i < n; i += SCISQL_EXTSORT_FANIN, ++j) {
+            size_t k = (n - i < SCISQL_EXTSORT_FANIN) ? n - i : SCISQL_EXTSORT_FANIN;
+            size_t m;
+            int fd, ret;
+            FILE *f = _scisql_extsort_mkrun(sorter, &fd);
+            if (f == 0) {
+                return 1;
+            }
+            ret = _scisql_extsort_merge(sorter, sorter->runs + i, k,
+                                        &_scisql_run_write, f);
+            for (m = i; m < i + k; ++m) {
+                sorter->runs[m] = -1;
+            }
+            if (fclose(f) != 0 && ret == 0) {
+                sorter->err = "failed to write temporary file";
+                ret = 1;
+            }
+            if (ret != 0) {
+                close(fd);
+                return 1;
+            }
+            /* j <= i, so runs[j] has already been merged */
+            sorter->runs[j] = fd;
+        }
+        sorter->nruns = j;
+    }
+    i = sorter->nruns;
+    sorter->nruns = 0;
+    return _scisql_extsort_merge(sorter, sorter->runs, i, emit, arg);
+}
+
+
+const char * scisql_extsort_error(const scisql_extsort *sorter) {
+    return sorter->err;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    A bounded-memory external merge sort for records consisting of an
+    integer key range and an opaque payload (e.g. an ID column).
+*/
+
+#ifndef SCISQL_UTIL_EXTSORT_H
+#define SCISQL_UTIL_EXTSORT_H
+
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  Maximum number of sorted runs merged at a time. The unit tests
+    override this (and the minimum memory limit) to exercise multi-pass
+    merges with little data.
+ */
+#ifndef SCISQL_EXTSORT_FANIN
+#   define SCISQL_EXTSORT_FANIN 64
+#endif
+
+/*  Minimum amount of memory used by a sorter.
+ */
+#ifndef SCISQL_EXTSORT_MIN_MEM
+#   define SCISQL_EXTSORT_MIN_MEM (4*1024*1024)
+#endif
+
+/*  An external sorter. Records are accumulated in memory until the memory
+    limit is reached, at which point they are sorted and spilled to a
+    temporary file (a "run"). Runs are then combined with k-way merges.
+ */
+typedef struct scisql_extsort scisql_extsort;
+
+/*  Callback invoked on each record, in sorted order. Must return 0 on
+    success and a non-zero value to abort the sort.
+ */
+typedef int (*scisql_extsort_emit)(void *arg,
+                                   int64_t min,
+                                   int64_t max,
+                                   const char *data,
+                                   size_t len);
+
+/*  Creates a sorter that uses (approximately) at most mem bytes of memory,
+    and creates temporary files in directory tmpdir. If tmpdir is 0, the
+    TMPDIR environment variable is consulted, and "/tmp" is used if it is
+    not set.
+
+    Returns 0 if memory allocation fails.
+ */
+scisql_extsort * scisql_extsort_new(size_t mem, const char *tmpdir);
+
+/*  Frees a sorter and all associated resources, including temporary files.
+ */
+void scisql_extsort_free(scisql_extsort *sorter);
+
+/*  Adds a record to a sorter. Records are sorted by min, then max, and
+    then by the order in which they were added.
+
+    Returns 0 on success and 1 on error.
+ */
+int scisql_extsort_add(scisql_extsort *sorter,
+                       int64_t min,
+                       int64_t max,
+                       const char *data,
+                       size_t len);
+
+/*  Passes all records added to a sorter to emit, in sorted order. No
+    further records may be added afterwards.
+
+    Returns 0 on success and 1 on error, or if emit returns a non-zero value.
+ */
+int scisql_extsort_finish(scisql_extsort *sorter,
+                          scisql_extsort_emit emit,
+                          void *arg);
+
+/*  Returns a description of the last error that occurred, or 0.
+ */
+const char * scisql_extsort_error(const scisql_extsort *sorter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCISQL_UTIL_EXTSORT_H */
@@ -20,35 +20,74 @@
 
     ----------------------------------------------------------------
 
-    Simple utility for indexing TSV tables of circles or polygons
-    on the shere.
+    Simple utility for indexing TSV tables of points, circles or
+    polygons on the shere.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
+#include "format.h"
+#include "healpix.h"
 #include "htm.h"
+#include "atod.h"
+#include "extsort.h"
+#if HAVE_ZLIB
+#   include <zlib.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/*  A growable output buffer. If fd is non-negative, the buffer has a
+    fixed capacity and its contents are written to fd whenever it fills
+    up, rather than being grown.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int fd;
+} _scisql_outbuf;
+
+
+/*  Spatial index types, as recorded in binary output headers.
+ */
+typedef enum {
+    SCISQL_INDEX_HTM = 0,    /* HTM IDs */
+    SCISQL_INDEX_HEALPIX = 1 /* nested HEALPix IDs */
+} _scisql_indextype;
+
+
 /*  Options and processing context.
  */
 typedef struct {
     long nskip;       /* Number of initial lines to skip */
     int ranges;       /* Output ID ranges instead of IDs */
+    int binary;       /* Output binary records instead of TSV */
+    int header;       /* Has the binary output header been written? */
+    int sort;         /* Output rows in spatial index ID order */
     int verbose;      /* Verbose output? */
     int ncols;        /* number of columns expected per-row */
-    int level;        /* subdivision level */
+    int level;        /* subdivision level (HEALPix order) */
+    _scisql_indextype index; /* spatial index type */
     size_t maxranges; /* maximum number of ranges to output per region */
+    size_t sortmem;   /* memory limit for sorting, bytes */
+    const char *tmpdir; /* directory for temporary sort files */
+    scisql_extsort *sorter; /* output row sorter, or 0 */
+    _scisql_outbuf out; /* output stream */
+    int nthreads;     /* number of indexing threads */
 } _scisql_context;
 
 
@@ -62,6 +101,8 @@ static void usage(const char *name) {
         "by a trailing list of spatial columns. The number of spatial columns\n"
         "determines how they are interpreted:\n"
         "\n"
+        "\t2:   the last 2 columns are treated as point\n"
+        "\t     longitude and latitude, in degrees.\n"
         "\t3:   the last 3 columns are treated as circle center\n"
         "\t     longitude, center latitude and circle radius,\n"
         "\t     all in degrees.\n"
@@ -71,7 +112,11 @@ static void usage(const char *name) {
         "\n"
         "The number of columns must be consistent for every row in the table,\n"
         "or an error is signalled. Specifying \"-\" as the outut file name\n"
-        "will cause output to be written to standard out.\n"
+        "will cause output to be written to standard out, and specifying\n"
+        "\"-\" as an input file name will cause standard in to be indexed.\n"
+        "Input files that are not regular files (e.g. named pipes) are read\n"
+        "sequentially rather than memory mapped, and gzip compressed input\n"
+        "is decompressed on the fly.\n"
         "\n"
         "    The TSV parser is currently very simplistic:\n"
         "\t- fields must be separated by '\\t'\n"
@@ -82,26 +127,56 @@ static void usage(const char *name) {
         "\t  particular, '\\N' (NULL) values will result in an\n"
         "\t  error.\n"
         "\n"
-        "Each input ID is output multiple times: once for each HTM ID or\n"
-        "range of HTM IDs overlapping the corresponding circle/polygon.\n"
-        "The HTM ID or ID range is appended in one or two trailing\n"
-        "integer-valued columns.\n"
+        "Each input point ID is output once, followed by the HTM ID (or\n"
+        "nested HEALPix ID) of the point. Each input circle/polygon ID is\n"
+        "output multiple times: once for each ID or range of IDs overlapping\n"
+        "the corresponding circle/polygon. The ID or ID range is appended in\n"
+        "one or two trailing integer-valued columns.\n"
+        "\n"
+        "With -b, rows are output as fixed width records of little-endian\n"
+        "64 bit integers instead: (id, htmId) for points and when -r is not\n"
+        "specified, and (id, htmMin, htmMax) otherwise. The ID column must\n"
+        "then contain integers. Records are preceded by a 16 byte header:\n"
+        "\n"
+        "\tbytes 0-7:   the magic string \"SCISQLIX\"\n"
+        "\tbytes 8-9:   format version, currently 1\n"
+        "\tbytes 10-11: index type; 0 for HTM, 1 for HEALPix\n"
+        "\tbytes 12-13: record type; 1 for (id, htmId) and\n"
+        "\t             2 for (id, htmMin, htmMax)\n"
+        "\tbytes 14-15: subdivision level (HEALPix order)\n"
+        "\n"
+        "where all integers are little-endian.\n"
         "\n"
         "Options\n"
+        "\t-b         Output binary records rather than TSV.\n"
         "\t-i <type>  Specifies the spatial index type to use;\n"
-        "\t           for now, only \"htm\" is supported. This\n"
-        "\t           is the default.\n"
-        "\t-l <level> The subdivision level to use when indexing;\n"
-        "\t           the default is 10.\n"
-        "\t-r         Output ID ranges rather than IDs.\n"
-        "\t-m <N>     Bound on the maximum number of HTM ID\n"
-        "\t           ranges generated for a region. Note that with\n"
-        "\t           arbitrary input geometry, up to 4 ranges may\n"
-        "\t           be generated no matter what the subdivision\n"
-        "\t           level is. So for N < 4, the requested bound\n"
-        "\t           may not be achieved.\n"
+        "\t           either \"htm\" (the default) or \"healpix\"\n"
+        "\t           for nested HEALPix IDs.\n"
+        "\t-l <level> The subdivision level to use when indexing,\n"
+        "\t           at most 24 for HTM. For HEALPix, this is\n"
+        "\t           the order, at most 29. The default is 10.\n"
+        "\t-r         Output ID ranges rather than IDs. Has no\n"
+        "\t           effect on point tables.\n"
+        "\t-m <N>     Bound on the maximum number of ID\n"
+        "\t           ranges generated for a region. The gaps\n"
+        "\t           between ranges are filled in, smallest\n"
+        "\t           first, until the bound is met.\n"
         "\t-s <N>     Skip the first N lines in each input\n"
         "\t           file.\n"
+        "\t-S         Output rows in ID order (or in order of\n"
+        "\t           ID range start when -r is specified)\n"
+        "\t           rather than in input order. Rows with equal\n"
+        "\t           IDs are output in input order. Inputs\n"
+        "\t           that do not fit in memory are sorted using\n"
+        "\t           temporary files.\n"
+        "\t-M <N>     Memory to use for sorting, in MiB; the\n"
+        "\t           default is 1024.\n"
+        "\t-t <N>     Number of indexing threads; 0 means one\n"
+        "\t           thread per processor. The default is 1.\n"
+        "\t           Output is identical for any number of\n"
+        "\t           threads.\n"
+        "\t-T <dir>   Directory for temporary sort files; the\n"
+        "\t           default is $TMPDIR, or /tmp if unset.\n"
         "\t-v         Chatty progress messages.\n"
         "\n");
     fflush(stderr);
@@ -117,60 +192,252 @@ SCISQL_INLINE const char * advance(const char *beg, const char *end, char sep) {
 }
 
 
+/*  Size of the output stream buffer.
+ */
+#define SCISQL_OUTPUT_SIZE (8*1024*1024)
+
+/*  Writes the contents of an output buffer followed by n bytes of data
+    to the buffer file descriptor, and empties the buffer.
+ */
+static int outbuf_flush(_scisql_outbuf *buf, const char *data, size_t n) {
+    struct iovec iov[2];
+    int i = 0;
+
+    iov[0].iov_base = buf->data;
+    iov[0].iov_len = buf->len;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = n;
+    buf->len = 0;
+    while (i < 2) {
+        ssize_t nw;
+        if (iov[i].iov_len == 0) {
+            ++i;
+            continue;
+        }
+        nw = writev(buf->fd, &iov[i], 2 - i);
+        if (nw < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        /* skip past whatever was written */
+        for (; i < 2 && (size_t) nw >= iov[i].iov_len; ++i) {
+            nw -= (ssize_t) iov[i].iov_len;
+        }
+        if (i < 2) {
+            iov[i].iov_base = (char *) iov[i].iov_base + nw;
+            iov[i].iov_len -= (size_t) nw;
+        }
+    }
+    return 0;
+}
+
+/*  Ensures that at least n more bytes can be appended to an output buffer.
+ */
+static int outbuf_reserve(_scisql_outbuf *buf, size_t n) {
+    if (buf->len + n > buf->cap) {
+        size_t cap = (buf->cap == 0) ? 65536 : 2*buf->cap;
+        char *data;
+        if (buf->fd >= 0) {
+            if (outbuf_flush(buf, 0, 0) != 0) {
+                return 1;
+            }
+            if (n <= buf->cap) {
+                return 0;
+            }
+        }
+        for (; cap < buf->len + n; cap *= 2) { }
+        data = (char *) realloc(buf->data, cap);
+        if (data == 0) {
+            return 1;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+    return 0;
+}
+
+/*  Appends n bytes to an output buffer. Large amounts of data are written
+    directly to the file descriptor of a fixed capacity buffer.
+ */
+SCISQL_INLINE int outbuf_append(_scisql_outbuf *buf, const void *data, size_t n) {
+    if (buf->fd >= 0 && buf->len + n > buf->cap) {
+        return outbuf_flush(buf, (const char *) data, n);
+    }
+    if (outbuf_reserve(buf, n) != 0) {
+        return 1;
+    }
+    memcpy(buf->data + buf->len, data, n);
+    buf->len += n;
+    return 0;
+}
+
+/*  Stores v at s as a little-endian 64 bit integer.
+ */
+SCISQL_INLINE void put_le64(char *s, int64_t v) {
+    uint64_t u = (uint64_t) v;
+    int i;
+    for (i = 0; i < 8; ++i) {
+        s[i] = (char) (u >> 8*i);
+    }
+}
+
+/*  Size of the binary output header.
+ */
+#define SCISQL_HEADER_SIZE 16
+
+/*  Writes the binary output header, unless it has already been written.
+ */
+static int output_header(_scisql_context *ctx) {
+    char h[SCISQL_HEADER_SIZE];
+    int rectype = (ctx->ranges != 0 && ctx->ncols != 3) ? 2 : 1;
+    if (ctx->binary == 0 || ctx->header != 0) {
+        return 0;
+    }
+    memcpy(h, "SCISQLIX", 8);
+    h[8] = 1;                     /* format version */
+    h[9] = 0;
+    h[10] = (char) ctx->index;    /* index type */
+    h[11] = 0;
+    h[12] = (char) rectype;       /* record type */
+    h[13] = 0;
+    h[14] = (char) ctx->level;    /* subdivision level */
+    h[15] = 0;
+    ctx->header = 1;
+    return outbuf_append(&ctx->out, h, sizeof(h));
+}
+
+/*  Appends a binary record consisting of the given id (a little-endian
+    64 bit integer) followed by an HTM ID or HTM ID range.
+ */
+static int output_binary(_scisql_outbuf *buf,
+                         const char *id,
+                         int64_t min,
+                         int64_t max,
+                         int range)
+{
+    char *s;
+    if (outbuf_reserve(buf, 24) != 0) {
+        return 1;
+    }
+    s = buf->data + buf->len;
+    memcpy(s, id, 8);
+    put_le64(s + 8, min);
+    if (range != 0) {
+        put_le64(s + 16, max);
+        buf->len += 24;
+    } else {
+        buf->len += 16;
+    }
+    return 0;
+}
+
+/*  Appends the given row prefix followed by an HTM ID or HTM ID range
+    in text form.
+ */
+static int output_text(_scisql_outbuf *buf,
+                       const char *beg,
+                       const char *end,
+                       int64_t min,
+                       int64_t max,
+                       int range)
+{
+    size_t n = (size_t) (end - beg);
+    char *s;
+    if (outbuf_reserve(buf, n + 42) != 0) {
+        return 1;
+    }
+    s = buf->data + buf->len;
+    memcpy(s, beg, n);
+    s += n;
+    s += scisql_format_int64(s, min);
+    if (range != 0) {
+        *s++ = '\t';
+        s += scisql_format_int64(s, max);
+    }
+    *s++ = '\n';
+    buf->len = (size_t) (s - buf->data);
+    return 0;
+}
+
+/*  Outputs a row consisting of the given prefix followed by an HTM ID or
+    HTM ID range. In binary mode, the prefix is the row id as a
+    little-endian 64 bit integer. When sorting, rows are stored in binary form - as the
+    range end points, prefix length and prefix - until they are handed to
+    the output row sorter.
+ */
+static int output_row(_scisql_context *ctx,
+                      _scisql_outbuf *buf,
+                      const char *beg,
+                      const char *end,
+                      int64_t min,
+                      int64_t max,
+                      int range)
+{
+    if (ctx->sort != 0) {
+        int64_t r[2];
+        uint32_t n = (uint32_t) (end - beg);
+        r[0] = min;
+        r[1] = max;
+        if (outbuf_append(buf, r, sizeof(r)) != 0 ||
+            outbuf_append(buf, &n, sizeof(uint32_t)) != 0) {
+            return 1;
+        }
+        return outbuf_append(buf, beg, n);
+    } else if (ctx->binary != 0) {
+        return output_binary(buf, beg, min, max, range);
+    }
+    return output_text(buf, beg, end, min, max, range);
+}
+
 /*  Outputs the IDs or ID ranges computed for an input.
  */
 static int output_ids(_scisql_context *ctx,
                       const scisql_ids *ids,
                       const char *beg,
                       const char *end,
-                      FILE *out)
+                      _scisql_outbuf *buf)
 {
-    char buf[128];
-    if (ctx->ranges != 0) {
-        size_t i;
-        int nc;
-        for (i = 0; i < ids->n; ++i) {
-            if (fwrite(beg, end - beg, 1, out) != 1) {
-                return 1;
-            }
-            nc = snprintf(buf, sizeof(buf), "%lld\t%lld\n",
-                          (long long) ids->ranges[2*i],
-                          (long long) ids->ranges[2*i + 1]);
-            if (nc < 0 || nc >= (int) sizeof(buf)) {
-                return 1;
-            }
-            if (fwrite(buf, (size_t) nc, 1, out) != 1) {
+    size_t i;
+    int64_t id;
+    for (i = 0; i < ids->n; ++i) {
+        if (ctx->ranges != 0) {
+            if (output_row(ctx, buf, beg, end, ids->ranges[2*i],
+                           ids->ranges[2*i + 1], 1) != 0) {
                 return 1;
             }
+            continue;
         }
-    } else {
-        size_t i;
-        long long id;
-        int nc;
-        for (i = 0; i < ids->n; ++i) {
-            for (id = ids->ranges[2*i]; id <= ids->ranges[2*i + 1]; ++id) {
-                if (fwrite(beg, end - beg, 1, out) != 1) {
-                    return 1;
-                }
-                nc = snprintf(buf, sizeof(buf), "%lld\n", id);
-                if (nc < 0 || nc >= (int) sizeof(buf)) {
-                    return 1;
-                }
-                if (fwrite(buf, (size_t) nc, 1, out) != 1) {
-                    return 1;
-                }
+        for (id = ids->ranges[2*i]; id <= ids->ranges[2*i + 1]; ++id) {
+            if (output_row(ctx, buf, beg, end, id, id, 0) != 0) {
+                return 1;
             }
         }
     }
     return 0;
 }
 
+/*  Outputs a row in sorted order; called by the output row sorter.
+ */
+static int output_sorted(void *arg,
+                         int64_t min,
+                         int64_t max,
+                         const char *data,
+                         size_t len)
+{
+    _scisql_context *ctx = (_scisql_context *) arg;
+    int range = (ctx->ranges != 0 && ctx->ncols != 3);
+    if (ctx->binary != 0) {
+        return output_binary(&ctx->out, data, min, max, range);
+    }
+    return output_text(&ctx->out, data, data + len, min, max, range);
+}
+
 static double get_double(const char **msg,
                          const char *beg,
-                         const char *end,
-                         int last)
+                         const char *end)
 {
-    char *endptr;
     double d;
     const char *e = end;
 
@@ -183,51 +450,295 @@ static double get_double(const char **msg,
         --e;
     }
     for (; e > beg && e[-1] == ' '; --e) { }
-    if (last == 0 || e != end) {
-        d = strtod(beg, &endptr);
-    } else {
-        /* The very last column of the last row might not be terminated
-           with '\n'. If its last character is the last byte of a page,
-           then strtod would walk off the end of our memory map and
-           seg-fault. */
-        size_t n = (size_t) (e - beg);
-        char *s = (char *) malloc(n + 1);
-        if (s == 0) {
-            *msg = "memory allocation failed";
-            return 0.0;
-        }
-        memcpy(s, beg, n);
-        s[n] = '\0';
-        e = s + n;
-        d = strtod(s, &endptr);
-        free(s);
-    }
-    if (endptr != e) {
+    /* scisql_atod never reads past e, so the last field of a file that
+       doesn't end with '\n' can be parsed directly from the memory map. */
+    if (scisql_atod(beg, e, &d) != e) {
         *msg = "invalid floating point number in field";
         return 0.0;
     }
     return d;
 }
 
-/*  Indexes a table of spherical circles.
+static int64_t get_int64(const char **msg,
+                         const char *beg,
+                         const char *end)
+{
+    uint64_t u = 0;
+    int neg = 0;
+    const char *e = end;
+
+    for (; beg < e && *beg == ' '; ++beg) { }
+    if (beg == e || isspace(*beg)) {
+        *msg = "empty field";
+        return 0;
+    }
+    if (e[-1] == '\t' || e[-1] == '\n') {
+        --e;
+    }
+    for (; e > beg && e[-1] == ' '; --e) { }
+    if (*beg == '-' || *beg == '+') {
+        neg = (*beg == '-');
+        ++beg;
+    }
+    if (beg == e) {
+        *msg = "invalid integer in field";
+        return 0;
+    }
+    for (; beg < e; ++beg) {
+        unsigned int d = (unsigned int) (unsigned char) (*beg - '0');
+        if (d > 9 || u > (UINT64_MAX - d) / 10) {
+            *msg = "invalid integer in field";
+            return 0;
+        }
+        u = 10*u + d;
+    }
+    if (u > (uint64_t) INT64_MAX + (uint64_t) neg) {
+        *msg = "invalid integer in field";
+        return 0;
+    }
+    return neg ? (int64_t) (0 - u) : (int64_t) u;
+}
+
+/*  Determines the output prefix of a row with id column [*beg, *end).
+    For text output this is the id column (and trailing tab) itself. For
+    binary output, the id is parsed and stored in buf as a little-endian
+    64 bit integer, and *beg and *end are updated to point to it.
+ */
+static int get_prefix(_scisql_context *ctx,
+                      const char **msg,
+                      const char **beg,
+                      const char **end,
+                      char *buf)
+{
+    int64_t id;
+    if (ctx->binary == 0) {
+        return 0;
+    }
+    id = get_int64(msg, *beg, *end);
+    if (*msg != 0) {
+        return 1;
+    }
+    put_le64(buf, id);
+    *beg = buf;
+    *end = buf + 8;
+    return 0;
+}
+
+/*  Approximate number of input bytes per chunk.
+ */
+#define SCISQL_CHUNK_SIZE (1024*1024)
+
+/*  Maximum number of points indexed at a time.
+ */
+#define SCISQL_POINT_BLOCK 262144
+
+/*  A chunk of input rows, along with the output generated for them.
+ */
+typedef struct {
+    const char *beg;     /* first row of chunk */
+    const char *end;     /* one past the last row of chunk */
+    _scisql_outbuf buf;  /* output for the rows of the chunk */
+    _scisql_outbuf *out; /* output buffer in use: buf, or the output
+                            stream when rows can be written immediately */
+    long long nrows;     /* number of rows successfully processed */
+    const char *msg;     /* error message, or 0 */
+    int done;            /* has the chunk been processed? */
+} _scisql_chunk;
+
+/*  The id column of a point table row.
+ */
+typedef struct {
+    const char *beg;  /* start of row */
+    const char *end;  /* one past the tab following the id column */
+    int64_t id;       /* value of the id column, for binary output */
+} _scisql_row;
+
+/*  Per-thread indexing state.
+ */
+typedef struct {
+    scisql_ids *ids;      /* HTM ID ranges for a circle/polygon */
+    scisql_v3p *points;   /* a block of points */
+    int64_t *ids_sorted;  /* HTM IDs of points, in HTM ID order */
+    int64_t *ids_input;   /* HTM IDs of points, in input order */
+    _scisql_row *rows;    /* point table rows */
+    size_t cap;           /* capacity of point arrays */
+    scisql_v3 *verts;     /* polygon vertices */
+} _scisql_state;
+
+static void state_free(_scisql_state *state) {
+    free(state->ids);
+    free(state->points);
+    free(state->ids_sorted);
+    free(state->ids_input);
+    free(state->rows);
+    free(state->verts);
+    memset(state, 0, sizeof(_scisql_state));
+}
+
+/*  Indexes the rows of a chunk, appending output to the chunk buffer.
+    On error, the chunk error message is set and 1 is returned.
+ */
+typedef int (*_scisql_indexfn)(_scisql_context *ctx,
+                               _scisql_state *state,
+                               _scisql_chunk *chunk);
+
+/*  Assigns HTM or HEALPix IDs to a block of points and outputs them in
+    input order. The payload of each point is its index in the row array.
+ */
+static int output_points(_scisql_context *ctx,
+                         _scisql_state *state,
+                         size_t n,
+                         _scisql_outbuf *buf)
+{
+    size_t i;
+
+    if (ctx->index == SCISQL_INDEX_HEALPIX) {
+        for (i = 0; i < n; ++i) {
+            state->ids_input[i] = scisql_v3_hpxid(&state->points[i].v, ctx->level);
+        }
+    } else {
+        if (scisql_v3p_htmsort(state->points, state->ids_sorted, n, ctx->level) != 0) {
+            return 1;
+        }
+        /* restore input order */
+        for (i = 0; i < n; ++i) {
+            state->ids_input[(size_t) state->points[i].payload] = state->ids_sorted[i];
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        const _scisql_row *row = &state->rows[i];
+        const char *beg = row->beg, *end = row->end;
+        int64_t id = state->ids_input[i];
+        char idbuf[8];
+        if (ctx->binary != 0) {
+            put_le64(idbuf, row->id);
+            beg = idbuf;
+            end = idbuf + 8;
+        }
+        if (output_row(ctx, buf, beg, end, id, id, 0) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Grows the point arrays of an indexing state.
+ */
+static int state_grow(_scisql_state *state) {
+    void *mem;
+    size_t cap = (state->cap == 0) ? 1024 : 2*state->cap;
+    if (cap > SCISQL_POINT_BLOCK) {
+        cap = SCISQL_POINT_BLOCK;
+    }
+    mem = realloc(state->points, cap*sizeof(scisql_v3p));
+    if (mem == 0) {
+        return 1;
+    }
+    state->points = (scisql_v3p *) mem;
+    mem = realloc(state->ids_sorted, cap*sizeof(int64_t));
+    if (mem == 0) {
+        return 1;
+    }
+    state->ids_sorted = (int64_t *) mem;
+    mem = realloc(state->ids_input, cap*sizeof(int64_t));
+    if (mem == 0) {
+        return 1;
+    }
+    state->ids_input = (int64_t *) mem;
+    mem = realloc(state->rows, cap*sizeof(_scisql_row));
+    if (mem == 0) {
+        return 1;
+    }
+    state->rows = (_scisql_row *) mem;
+    state->cap = cap;
+    return 0;
+}
+
+/*  Indexes a chunk of a table of points on the sphere.
+ */
+static int index_s2point(_scisql_context *ctx,
+                         _scisql_state *state,
+                         _scisql_chunk *chunk)
+{
+    double lon, lat;
+    scisql_sc p;
+    const char *beg = chunk->beg;
+    const char *end = chunk->end;
+    size_t n = 0, first = 0;
+    int64_t id = 0;
+
+    while (beg < end) {
+        const char *sid = beg;
+        const char *eol = advance(beg, end, '\n');
+        const char *slon = advance(sid, eol, '\t');
+        const char *slat = advance(slon, eol, '\t');
+        if (slon == eol || slat == eol || advance(slat, eol, '\t') != eol) {
+            chunk->msg = "invalid row - expecting id lon lat";
+            goto fail;
+        }
+        if (ctx->binary != 0) {
+            id = get_int64(&chunk->msg, sid, slon);
+            if (chunk->msg != 0) {
+                goto fail;
+            }
+        }
+        lon = get_double(&chunk->msg, slon, slat);
+        if (chunk->msg != 0) {
+            goto fail;
+        }
+        lat = get_double(&chunk->msg, slat, eol);
+        if (chunk->msg != 0) {
+            goto fail;
+        }
+        if (scisql_sc_init(&p, lon, lat) != 0) {
+            chunk->msg = "invalid point longitude/latitude (columns 2,3)";
+            goto fail;
+        }
+        if (n == state->cap) {
+            if (n == SCISQL_POINT_BLOCK) {
+                /* output a block of points */
+                if (output_points(ctx, state, n, chunk->out) != 0) {
+                    chunk->msg = "failed to output point indexes";
+                    goto fail;
+                }
+                first += n;
+                n = 0;
+            } else if (state_grow(state) != 0) {
+                chunk->msg = "memory allocation failed";
+                goto fail;
+            }
+        }
+        scisql_sctov3(&state->points[n].v, &p);
+        state->points[n].payload = (void *) n;
+        state->rows[n].beg = sid;
+        state->rows[n].end = slon;
+        state->rows[n].id = id;
+        ++n;
+        beg = eol;
+    }
+    if (n > 0 && output_points(ctx, state, n, chunk->out) != 0) {
+        chunk->msg = "failed to output point indexes";
+        goto fail;
+    }
+    chunk->nrows = (long long) (first + n);
+    return 0;
+fail:
+    chunk->nrows = (long long) (first + n);
+    return 1;
+}
+
+/*  Indexes a chunk of a table of spherical circles.
  */
 static int index_s2circle(_scisql_context *ctx,
-                          const char *file,
-                          const char *beg,
-                          const char *end,
-                          FILE *out)
+                          _scisql_state *state,
+                          _scisql_chunk *chunk)
 {
     double lon, lat, radius;
     scisql_sc p;
     scisql_v3 center;
-    scisql_ids *ids = 0;
-    const char *msg = 0;
-    long long line = ctx->nskip;
-
-    if (ctx->verbose != 0) {
-        fprintf(stderr, "Indexing file %s (spherical circles)\n", file);
-        fflush(stderr);
-    }
+    char idbuf[8];
+    const char *beg = chunk->beg;
+    const char *end = chunk->end;
 
     while (beg < end) {
         const char *sid = beg;
@@ -237,71 +748,80 @@ static int index_s2circle(_scisql_context *ctx,
         const char *sradius = advance(slat, eol, '\t');
         if (slon == eol || slat == eol || sradius == eol ||
             advance(sradius, eol, '\t') != eol) {
-            msg = "invalid row - expecting id lon lat radius";
-            goto fail_msg;
+            chunk->msg = "invalid row - expecting id lon lat radius";
+            return 1;
         }
-        lon = get_double(&msg, slon, slat, 0);
-        if (msg != 0) {
-            goto fail_msg;
+        lon = get_double(&chunk->msg, slon, slat);
+        if (chunk->msg != 0) {
+            return 1;
         }
-        lat = get_double(&msg, slat, sradius, 0);
-        if (msg != 0) {
-            goto fail_msg;
+        lat = get_double(&chunk->msg, slat, sradius);
+        if (chunk->msg != 0) {
+            return 1;
         }
-        radius = get_double(&msg, sradius, eol, eol == end);
-        if (msg != 0) {
-            goto fail_msg;
+        radius = get_double(&chunk->msg, sradius, eol);
+        if (chunk->msg != 0) {
+            return 1;
         }
         if (scisql_sc_init(&p, lon, lat) != 0) {
-            msg = "invalid circle center longitude/latitude (columns 2,3)";
-            goto fail_msg;
+            chunk->msg = "invalid circle center longitude/latitude (columns 2,3)";
+            return 1;
         }
         if (radius < 0.0 || SCISQL_ISNAN(radius)) {
-            msg = "invalid circle radius (column 4)";
-            goto fail_msg;
+            chunk->msg = "invalid circle radius (column 4)";
+            return 1;
         }
         scisql_sctov3(&center, &p);
-        ids = scisql_s2circle_htmids(ids, &center, radius,
-                                     ctx->level, ctx->maxranges);
-        if (ids == 0) {
-            msg = "failed to index circle";
-            goto fail_msg;
+        if (ctx->index == SCISQL_INDEX_HEALPIX) {
+            state->ids = scisql_s2circle_hpxids(state->ids, &center, radius,
+                                                ctx->level, ctx->maxranges);
+        } else {
+            state->ids = scisql_s2circle_htmids(state->ids, &center, radius,
+                                                ctx->level, ctx->maxranges);
         }
-        if (output_ids(ctx, ids, sid, slon, out) != 0) {
-            msg = "failed to output indexes overlapping circle";
-            goto fail_msg;
+        if (state->ids == 0) {
+            chunk->msg = "failed to index circle";
+            return 1;
         }
-        ++line;
+        if (get_prefix(ctx, &chunk->msg, &sid, &slon, idbuf) != 0) {
+            return 1;
+        }
+        if (output_ids(ctx, state->ids, sid, slon, chunk->out) != 0) {
+            chunk->msg = "failed to output indexes overlapping circle";
+            return 1;
+        }
+        ++chunk->nrows;
         beg = eol;
     }
     return 0;
-fail_msg:
-    fprintf(stderr, "ERROR [%s:%lld]: %s\n", file, line, msg);
-    return 1;
 }
 
-/*  Indexes a table of spherical convex polygons.
+/*  Indexes a chunk of a table of spherical convex polygons.
  */
 static int index_s2cpoly(_scisql_context *ctx,
-                         const char *file,
-                         const char *beg,
-                         const char *end,
-                         FILE *out)
+                         _scisql_state *state,
+                         _scisql_chunk *chunk)
 {
     double lon, lat;
     scisql_sc p;
-    scisql_v3 verts[SCISQL_MAX_VERTS];
     scisql_s2cpoly poly;
-    scisql_ids *ids = 0;
-    const char *msg = 0;
-    long long line = ctx->nskip;
+    scisql_s2lpoly *lpoly;
+    char idbuf[8];
+    const char *beg = chunk->beg;
+    const char *end = chunk->end;
     int nv = (ctx->ncols - 1) / 2;
 
-    if (ctx->verbose != 0) {
-        fprintf(stderr, "Indexing file %s (spherical convex polygons)\n", file);
-        fflush(stderr);
+    if (nv > SCISQL_MAX_LARGE_VERTS) {
+        chunk->msg = "too many polygon vertices";
+        return 1;
+    }
+    if (state->verts == 0) {
+        state->verts = (scisql_v3 *) malloc(nv * sizeof(scisql_v3));
+        if (state->verts == 0) {
+            chunk->msg = "memory allocation failed";
+            return 1;
+        }
     }
-
     while (beg < end) {
         const char *sid = beg;
         const char *eol = advance(beg, end, '\n');
@@ -311,50 +831,343 @@ static int index_s2cpoly(_scisql_context *ctx,
         for (i = 0; i < nv; ++i) {
             const char *slat = advance(slon, eol, '\t');
             if (slat == eol) {
-                msg = "invalid row - expecting "
-                      "id lon1 lat1 lon2 lat2...";
-                goto fail_msg;
+                chunk->msg = "invalid row - expecting "
+                             "id lon1 lat1 lon2 lat2...";
+                return 1;
             }
-            lon = get_double(&msg, slon, slat, 0);
-            if (msg != 0) {
-                goto fail_msg;
+            lon = get_double(&chunk->msg, slon, slat);
+            if (chunk->msg != 0) {
+                return 1;
             }
             slon = advance(slat, eol, '\t');
-            lat = get_double(&msg, slat, slon, slon == eol);
-            if (msg != 0) {
-                goto fail_msg;
+            lat = get_double(&chunk->msg, slat, slon);
+            if (chunk->msg != 0) {
+                return 1;
             }
             if (scisql_sc_init(&p, lon, lat) != 0) {
-                msg = "invalid vertex longitude/latitude";
-                goto fail_msg;
+                chunk->msg = "invalid vertex longitude/latitude";
+                return 1;
             }
-            scisql_sctov3(&verts[i], &p);
+            scisql_sctov3(&state->verts[i], &p);
         }
         if (slon != eol) {
-            msg = "invalid row - expecting "
-                  "id lon1 lat1 lon2 lat2...";
-            goto fail_msg;
+            chunk->msg = "invalid row - expecting "
+                         "id lon1 lat1 lon2 lat2...";
+            return 1;
         }
-        if (scisql_s2cpoly_init(&poly, verts, nv) != 0) {
-            msg = "invalid polygon";
-            goto fail_msg;
+        if (nv > SCISQL_MAX_VERTS) {
+            /* split large polygons into pieces */
+            lpoly = scisql_s2lpoly_new(state->verts, nv);
+            if (lpoly == 0) {
+                chunk->msg = "invalid polygon";
+                return 1;
+            }
+            if (ctx->index == SCISQL_INDEX_HEALPIX) {
+                state->ids = scisql_s2lpoly_hpxids(state->ids, lpoly,
+                                                   ctx->level, ctx->maxranges);
+            } else {
+                state->ids = scisql_s2lpoly_htmids(state->ids, lpoly,
+                                                   ctx->level, ctx->maxranges);
+            }
+            free(lpoly);
+        } else {
+            if (scisql_s2cpoly_init(&poly, state->verts, nv) != 0) {
+                chunk->msg = "invalid polygon";
+                return 1;
+            }
+            if (ctx->index == SCISQL_INDEX_HEALPIX) {
+                state->ids = scisql_s2cpoly_hpxids(state->ids, &poly,
+                                                   ctx->level, ctx->maxranges);
+            } else {
+                state->ids = scisql_s2cpoly_htmids(state->ids, &poly,
+                                                   ctx->level, ctx->maxranges);
+            }
+        }
+        if (state->ids == 0) {
+            chunk->msg = "failed to index polygon";
+            return 1;
         }
-        ids = scisql_s2cpoly_htmids(ids, &poly, ctx->level, ctx->maxranges);
-        if (ids == 0) {
-            msg = "failed to index polygon";
-            goto fail_msg;
+        if (get_prefix(ctx, &chunk->msg, &sid, &sidend, idbuf) != 0) {
+            return 1;
         }
-        if (output_ids(ctx, ids, sid, sidend, out) != 0) {
-            msg = "failed to output indexes overlapping polygon";
-            goto fail_msg;
+        if (output_ids(ctx, state->ids, sid, sidend, chunk->out) != 0) {
+            chunk->msg = "failed to output indexes overlapping polygon";
+            return 1;
         }
-        ++line;
+        ++chunk->nrows;
         beg = eol;
     }
     return 0;
-fail_msg:
-    fprintf(stderr, "ERROR [%s:%lld]: %s\n", file, line, msg);
-    return 1;
+}
+
+
+/*  Writes the output generated for a chunk, or passes it to the output
+    row sorter. If the chunk could not be indexed, an error message
+    is printed instead. The line number of the first row in the chunk
+    is stored in line, and is advanced past the chunk.
+ */
+static int flush_chunk(_scisql_context *ctx,
+                       const char *file,
+                       _scisql_chunk *chunk,
+                       long long *line)
+{
+    _scisql_outbuf *buf = &chunk->buf;
+    int ret = 0;
+
+    if (chunk->msg != 0) {
+        fprintf(stderr, "ERROR [%s:%lld]: %s\n",
+                file, *line + chunk->nrows, chunk->msg);
+        ret = 1;
+    } else if (ctx->sort != 0) {
+        size_t i = 0;
+        while (i < buf->len) {
+            int64_t r[2];
+            uint32_t n;
+            memcpy(r, buf->data + i, sizeof(r));
+            memcpy(&n, buf->data + i + sizeof(r), sizeof(uint32_t));
+            i += sizeof(r) + sizeof(uint32_t);
+            if (scisql_extsort_add(ctx->sorter, r[0], r[1],
+                                   buf->data + i, n) != 0) {
+                fprintf(stderr, "ERROR: failed to sort output: %s\n",
+                        scisql_extsort_error(ctx->sorter));
+                ret = 1;
+                break;
+            }
+            i += n;
+        }
+    } else if (chunk->out == buf && outbuf_append(&ctx->out, buf->data, buf->len) != 0) {
+        fprintf(stderr, "ERROR [%s:%lld]: failed to write output\n",
+                file, *line);
+        ret = 1;
+    }
+    *line += chunk->nrows;
+    buf->len = 0;
+    return ret;
+}
+
+/*  Work queue for multi-threaded indexing. Chunks are handed out to
+    worker threads in input order, and the thread that created the queue
+    flushes them in the same order. At most nslots chunks can be handed
+    out but not yet flushed.
+ */
+typedef struct {
+    _scisql_context *ctx;
+    _scisql_indexfn fn;
+    const char *cur;        /* start of next chunk */
+    const char *end;        /* end of input */
+    _scisql_chunk *chunks;  /* ring buffer of chunks */
+    size_t nslots;          /* number of chunks in ring buffer */
+    size_t next;            /* number of chunks handed out */
+    size_t nflushed;        /* number of chunks flushed */
+    int stop;               /* set when an error occurs */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} _scisql_queue;
+
+/*  Sets up the next chunk of input, which must be non-empty.
+ */
+static void next_chunk(_scisql_chunk *chunk,
+                       const char **cur,
+                       const char *end)
+{
+    chunk->beg = *cur;
+    if ((size_t) (end - *cur) <= SCISQL_CHUNK_SIZE) {
+        chunk->end = end;
+    } else {
+        chunk->end = advance(*cur + SCISQL_CHUNK_SIZE - 1, end, '\n');
+    }
+    chunk->nrows = 0;
+    chunk->msg = 0;
+    chunk->done = 0;
+    *cur = chunk->end;
+}
+
+/*  Indexing thread.
+ */
+static void * index_worker(void *arg) {
+    _scisql_queue *queue = (_scisql_queue *) arg;
+    _scisql_state state;
+
+    memset(&state, 0, sizeof(_scisql_state));
+    pthread_mutex_lock(&queue->lock);
+    while (1) {
+        _scisql_chunk *chunk;
+        while (queue->stop == 0 && queue->cur < queue->end &&
+               queue->next >= queue->nflushed + queue->nslots) {
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        }
+        if (queue->stop != 0 || queue->cur >= queue->end) {
+            break;
+        }
+        chunk = &queue->chunks[queue->next % queue->nslots];
+        next_chunk(chunk, &queue->cur, queue->end);
+        ++queue->next;
+        pthread_mutex_unlock(&queue->lock);
+        queue->fn(queue->ctx, &state, chunk);
+        pthread_mutex_lock(&queue->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    state_free(&state);
+    return 0;
+}
+
+/*  Indexes the rows in [beg, end) by splitting them into chunks at line
+    boundaries. Chunks are indexed by ctx->nthreads threads, and their
+    output is flushed in input order. The line number of the first row
+    is stored in line, and is advanced past the rows that were indexed.
+ */
+static int index_chunks(_scisql_context *ctx,
+                        _scisql_indexfn fn,
+                        const char *file,
+                        const char *beg,
+                        const char *end,
+                        long long *line)
+{
+    _scisql_queue queue;
+    pthread_t *threads;
+    int i, nstarted, ret = 0;
+
+    if (ctx->nthreads <= 1) {
+        _scisql_state state;
+        _scisql_chunk chunk;
+        memset(&state, 0, sizeof(_scisql_state));
+        memset(&chunk, 0, sizeof(_scisql_chunk));
+        chunk.buf.fd = -1;
+        /* rows can be written as they are generated unless sorting */
+        chunk.out = (ctx->sort != 0) ? &chunk.buf : &ctx->out;
+        while (beg < end && ret == 0) {
+            next_chunk(&chunk, &beg, end);
+            fn(ctx, &state, &chunk);
+            ret = flush_chunk(ctx, file, &chunk, line);
+        }
+        free(chunk.buf.data);
+        state_free(&state);
+        return ret;
+    }
+    threads = (pthread_t *) malloc(ctx->nthreads*sizeof(pthread_t));
+    queue.nslots = 4*(size_t) ctx->nthreads;
+    queue.chunks = (_scisql_chunk *) calloc(queue.nslots, sizeof(_scisql_chunk));
+    if (threads == 0 || queue.chunks == 0) {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        free(queue.chunks);
+        free(threads);
+        return 1;
+    }
+    for (i = 0; i < (int) queue.nslots; ++i) {
+        queue.chunks[i].buf.fd = -1;
+        queue.chunks[i].out = &queue.chunks[i].buf;
+    }
+    queue.ctx = ctx;
+    queue.fn = fn;
+    queue.cur = beg;
+    queue.end = end;
+    queue.next = 0;
+    queue.nflushed = 0;
+    queue.stop = 0;
+    pthread_mutex_init(&queue.lock, 0);
+    pthread_cond_init(&queue.cond, 0);
+    for (nstarted = 0; nstarted < ctx->nthreads; ++nstarted) {
+        if (pthread_create(&threads[nstarted], 0, &index_worker, &queue) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_lock(&queue.lock);
+    if (nstarted == 0) {
+        fprintf(stderr, "ERROR: failed to start indexing threads\n");
+        queue.stop = 1;
+        ret = 1;
+    }
+    while (queue.stop == 0) {
+        _scisql_chunk *chunk;
+        if (queue.nflushed == queue.next) {
+            if (queue.cur >= queue.end) {
+                break;
+            }
+            pthread_cond_wait(&queue.cond, &queue.lock);
+            continue;
+        }
+        chunk = &queue.chunks[queue.nflushed % queue.nslots];
+        if (chunk->done == 0) {
+            pthread_cond_wait(&queue.cond, &queue.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&queue.lock);
+        ret = flush_chunk(ctx, file, chunk, line);
+        pthread_mutex_lock(&queue.lock);
+        ++queue.nflushed;
+        if (ret != 0) {
+            queue.stop = 1;
+        }
+        pthread_cond_broadcast(&queue.cond);
+    }
+    pthread_mutex_unlock(&queue.lock);
+    for (i = 0; i < nstarted; ++i) {
+        pthread_join(threads[i], 0);
+    }
+    for (i = 0; i < (int) queue.nslots; ++i) {
+        free(queue.chunks[i].buf.data);
+    }
+    pthread_cond_destroy(&queue.cond);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.chunks);
+    free(threads);
+    return ret;
+}
+
+
+/*  Returns the indexing function for a table, based on the column count
+    of its first row (beginning at beg), or 0 if the column count is
+    invalid. The column count of the first table indexed is used for
+    all subsequent tables.
+ */
+static _scisql_indexfn select_indexfn(_scisql_context *ctx,
+                                      const char *file,
+                                      const char *beg,
+                                      const char *end)
+{
+    if (ctx->ncols == 0) {
+        /* parse first row to determine number of columns */
+        const char *field = beg;
+        const char *eol = advance(beg, end, '\n');
+        int ncols = 0;
+        for (; field < eol; field = advance(field, eol, '\t')) {
+            ++ncols;
+        }
+        if (ncols < 3 || ncols == 5 || ncols == 6 ||
+            (ncols > 6 && (ncols & 1) == 0)) {
+            fprintf(stderr, "ERROR: line %ld in file %s has an invalid "
+                    "number of columns\n", ctx->nskip, file);
+            return 0;
+        }
+        ctx->ncols = ncols;
+    }
+    if (output_header(ctx) != 0) {
+        fprintf(stderr, "ERROR: failed to write output header\n");
+        return 0;
+    }
+    if (ctx->ncols == 3) {
+        /* points */
+        if (ctx->verbose != 0) {
+            fprintf(stderr, "Indexing file %s (points)\n", file);
+            fflush(stderr);
+        }
+        return &index_s2point;
+    } else if (ctx->ncols == 4) {
+        /* circles */
+        if (ctx->verbose != 0) {
+            fprintf(stderr, "Indexing file %s (spherical circles)\n", file);
+            fflush(stderr);
+        }
+        return &index_s2circle;
+    }
+    /* polygons */
+    if (ctx->verbose != 0) {
+        fprintf(stderr, "Indexing file %s (spherical convex polygons)\n", file);
+        fflush(stderr);
+    }
+    return &index_s2cpoly;
 }
 
 
@@ -363,9 +1176,10 @@ fail_msg:
 static int index_dispatch(_scisql_context *ctx,
                           const char *file,
                           const char *beg,
-                          const char *end,
-                          FILE *out)
+                          const char *end)
 {
+    _scisql_indexfn fn;
+    long long line = ctx->nskip;
     long n;
     /* skip requested number of initial rows */
     for (n = ctx->nskip; n > 0; --n) {
@@ -379,39 +1193,283 @@ static int index_dispatch(_scisql_context *ctx,
             return 0;
         }
     }
-    if (ctx->ncols == 0) {
-        /* parse first row to determine number of columns */
-        const char *field = beg;
-        const char *eol = advance(beg, end, '\n');
-        int ncols = 0;
-        for (; field < eol; field = advance(field, eol, '\t')) {
-            ++ncols;
+    fn = select_indexfn(ctx, file, beg, end);
+    if (fn == 0) {
+        return 1;
+    }
+    return index_chunks(ctx, fn, file, beg, end, &line);
+}
+
+
+/*  Size of the blocks in which streamed input is read.
+ */
+#define SCISQL_BLOCK_SIZE (16*1024*1024)
+
+/*  A block of streamed input.
+ */
+typedef struct {
+    char *data;   /* block contents */
+    size_t len;   /* length of the complete lines at the start of data */
+    size_t fill;  /* number of bytes in data */
+    size_t cap;   /* capacity of data */
+} _scisql_block;
+
+/*  Reads streamed input in a separate thread. Two blocks are alternately
+    filled by the reader thread and indexed by the consuming thread. The
+    partial line at the end of a block is moved to the start of the next
+    one, so that only complete lines are handed to the consumer.
+ */
+typedef struct {
+    int fd;
+#if HAVE_ZLIB
+    gzFile gz;
+#endif
+    _scisql_block blocks[2];
+    size_t nread;      /* number of blocks read */
+    size_t nhanded;    /* number of blocks handed to the consumer */
+    size_t nconsumed;  /* number of blocks consumed */
+    int eof;           /* no more blocks will be read */
+    int stop;          /* set by the consumer to stop reading early */
+    const char *msg;   /* error message, or 0 */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} _scisql_reader;
+
+/*  Reads up to n bytes of input. Returns the number of bytes read, 0 at
+    end of input, and a negative number on error.
+ */
+static long reader_read(_scisql_reader *r, char *buf, size_t n) {
+    if (n > 1024*1024*1024) {
+        n = 1024*1024*1024;
+    }
+#if HAVE_ZLIB
+    return gzread(r->gz, buf, (unsigned int) n);
+#else
+    while (1) {
+        ssize_t nr = read(r->fd, buf, n);
+        if (nr >= 0 || errno != EINTR) {
+            return (long) nr;
         }
-        if (ncols < 4 || ncols == 5 || ncols == 6 ||
-            (ncols > 6 && (ncols & 1) == 0)) {
-            fprintf(stderr, "ERROR: line %ld in file %s has an invalid "
-                    "number of columns\n", ctx->nskip, file);
-            return 1;
+    }
+#endif
+}
+
+/*  Doubles the capacity of a block.
+ */
+static int block_grow(_scisql_block *b) {
+    size_t cap = (b->cap == 0) ? SCISQL_BLOCK_SIZE : 2*b->cap;
+    char *data = (char *) realloc(b->data, cap);
+    if (data == 0) {
+        return 1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+/*  Returns 1 if the block contents contain a newline, and sets the length
+    of the complete lines in the block.
+ */
+static int block_lines(_scisql_block *b) {
+    size_t i = b->fill;
+    for (; i > 0 && b->data[i - 1] != '\n'; --i) { }
+    b->len = i;
+    return i > 0;
+}
+
+/*  Input reading thread.
+ */
+static void * reader_thread(void *arg) {
+    _scisql_reader *r = (_scisql_reader *) arg;
+    _scisql_block *prev = 0;
+    size_t k;
+
+    for (k = 0; ; ++k) {
+        _scisql_block *b = &r->blocks[k & 1];
+        const char *msg = 0;
+        int eof = 0;
+        /* wait for the consumer to release the block */
+        pthread_mutex_lock(&r->lock);
+        while (r->stop == 0 && r->nread - r->nconsumed == 2) {
+            pthread_cond_wait(&r->cond, &r->lock);
         }
-        ctx->ncols = ncols;
+        if (r->stop != 0) {
+            pthread_mutex_unlock(&r->lock);
+            break;
+        }
+        pthread_mutex_unlock(&r->lock);
+        /* start with the partial line at the end of the previous block */
+        b->fill = 0;
+        if (prev != 0) {
+            size_t tail = prev->fill - prev->len;
+            while (b->cap <= tail) {
+                if (block_grow(b) != 0) {
+                    msg = "memory allocation failed";
+                    break;
+                }
+            }
+            if (msg == 0) {
+                memcpy(b->data, prev->data + prev->len, tail);
+                b->fill = tail;
+            }
+        } else if (block_grow(b) != 0) {
+            msg = "memory allocation failed";
+        }
+        /* fill the block, growing it if it contains no complete line */
+        while (msg == 0) {
+            long nr;
+            if (b->fill == b->cap) {
+                if (block_lines(b) != 0) {
+                    break;
+                }
+                if (block_grow(b) != 0) {
+                    msg = "memory allocation failed";
+                    break;
+                }
+            }
+            nr = reader_read(r, b->data + b->fill, b->cap - b->fill);
+            if (nr < 0) {
+                msg = "failed to read input";
+            } else if (nr == 0) {
+                /* the last line need not be terminated by a newline */
+                b->len = b->fill;
+                eof = 1;
+                break;
+            } else {
+                b->fill += (size_t) nr;
+            }
+        }
+        pthread_mutex_lock(&r->lock);
+        if (msg != 0) {
+            r->msg = msg;
+            r->eof = 1;
+        } else {
+            ++r->nread;
+            r->eof = eof;
+        }
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        if (r->eof != 0) {
+            break;
+        }
+        prev = b;
     }
-    if (ctx->ncols == 4) {
-        /* circles */
-        return index_s2circle(ctx, file, beg, end, out);
+    return 0;
+}
+
+/*  Releases the block previously returned by reader_next() (if any) and
+    returns the next block of input, or 0 at end of input or on error.
+ */
+static _scisql_block * reader_next(_scisql_reader *r) {
+    _scisql_block *b = 0;
+    pthread_mutex_lock(&r->lock);
+    if (r->nhanded > r->nconsumed) {
+        ++r->nconsumed;
+        pthread_cond_broadcast(&r->cond);
     }
-    /* polygons */
-    return index_s2cpoly(ctx, file, beg, end, out);
+    while (r->nread == r->nconsumed && r->eof == 0) {
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    if (r->nread > r->nconsumed) {
+        b = &r->blocks[r->nconsumed & 1];
+        ++r->nhanded;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return b;
+}
+
+/*  Driver routine for indexing a stream (e.g. standard in, a named pipe,
+    or a compressed file). Input is read by a separate thread, while rows
+    are indexed by the calling thread (and any indexing threads).
+ */
+static int index_stream(_scisql_context *ctx, const char *file, int fd) {
+    _scisql_reader r;
+    _scisql_block *b;
+    _scisql_indexfn fn = 0;
+    pthread_t thread;
+    long long line = ctx->nskip;
+    long nskip = ctx->nskip;
+    size_t nbytes = 0;
+    int ret = 0;
+
+    memset(&r, 0, sizeof(_scisql_reader));
+    r.fd = fd;
+#if HAVE_ZLIB
+    /* zlib closes the descriptor it is given, so give it a copy */
+    r.gz = gzdopen(dup(fd), "rb");
+    if (r.gz == 0) {
+        fprintf(stderr, "ERROR: failed to open file %s for reading\n", file);
+        return 1;
+    }
+    gzbuffer(r.gz, 1024*1024);
+#endif
+    pthread_mutex_init(&r.lock, 0);
+    pthread_cond_init(&r.cond, 0);
+    if (pthread_create(&thread, 0, &reader_thread, &r) != 0) {
+        fprintf(stderr, "ERROR: failed to start input reading thread\n");
+        ret = 1;
+    } else {
+        while ((b = reader_next(&r)) != 0) {
+            const char *beg = b->data;
+            const char *end = b->data + b->len;
+            nbytes += b->len;
+            /* skip requested number of initial rows */
+            for (; nskip > 0 && beg < end; --nskip) {
+                beg = advance(beg, end, '\n');
+            }
+            if (beg == end) {
+                continue;
+            }
+            if (fn == 0) {
+                fn = select_indexfn(ctx, file, beg, end);
+                if (fn == 0) {
+                    ret = 1;
+                    break;
+                }
+            }
+            if (index_chunks(ctx, fn, file, beg, end, &line) != 0) {
+                ret = 1;
+                break;
+            }
+        }
+        pthread_mutex_lock(&r.lock);
+        r.stop = 1;
+        pthread_cond_broadcast(&r.cond);
+        pthread_mutex_unlock(&r.lock);
+        pthread_join(thread, 0);
+        if (ret == 0 && r.msg != 0) {
+            fprintf(stderr, "ERROR: %s (file %s)\n", r.msg, file);
+            ret = 1;
+        }
+        if (ret == 0 && fn == 0 && ctx->verbose != 0) {
+            fprintf(stderr, "Skipping file %s (%s)\n", file,
+                    nbytes == 0 ? "empty" : "no records");
+            fflush(stderr);
+        }
+    }
+#if HAVE_ZLIB
+    gzclose(r.gz);
+#endif
+    free(r.blocks[0].data);
+    free(r.blocks[1].data);
+    pthread_cond_destroy(&r.cond);
+    pthread_mutex_destroy(&r.lock);
+    return ret;
 }
 
 
 /*  Driver routine for indexing a TSV file of regions.
  */
-static int index_file(_scisql_context *ctx, const char *file, FILE *out) {
+static int index_file(_scisql_context *ctx, const char *file) {
     struct stat buf;
     size_t nbytes;
     const char *data;
+    unsigned char magic[2];
     int fd, ret, prot, flgs;
 
+    if (strcmp(file, "-") == 0) {
+        return index_stream(ctx, "<stdin>", STDIN_FILENO);
+    }
     /* open input file and determine its size */
     fd = open(file, O_RDONLY);
     if (fd == -1) {
@@ -423,6 +1481,21 @@ static int index_file(_scisql_context *ctx, const char *file, FILE *out) {
         close(fd);
         return 1;
     }
+    if (!S_ISREG(buf.st_mode) ||
+        (pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b)) {
+        /* named pipe, device, or gzip compressed file */
+#if !HAVE_ZLIB
+        if (S_ISREG(buf.st_mode)) {
+            fprintf(stderr, "ERROR: file %s is compressed, but zlib support "
+                    "is not available\n", file);
+            close(fd);
+            return 1;
+        }
+#endif
+        ret = index_stream(ctx, file, fd);
+        close(fd);
+        return ret;
+    }
     nbytes = (size_t) buf.st_size;
     if (nbytes == 0) {
         /* empty file - nothing to do */
@@ -461,7 +1534,7 @@ static int index_file(_scisql_context *ctx, const char *file, FILE *out) {
        through the file. */
     madvise((void *) data, nbytes, MADV_SEQUENTIAL);
     /* dispatch to indexing function */
-    ret = index_dispatch(ctx, file, data, data + nbytes, out);
+    ret = index_dispatch(ctx, file, data, data + nbytes);
     /* resource cleanup */
     munmap((void *) data, nbytes);
     close(fd);
@@ -469,27 +1542,51 @@ static int index_file(_scisql_context *ctx, const char *file, FILE *out) {
 }
 
 
+/*  Writes any buffered output and closes the output stream.
+ */
+static int close_output(_scisql_context *ctx) {
+    int ret = 0;
+    if (ctx->out.data != 0) {
+        ret = outbuf_flush(&ctx->out, 0, 0);
+        free(ctx->out.data);
+        ctx->out.data = 0;
+    }
+    if (ctx->out.fd != STDOUT_FILENO && close(ctx->out.fd) != 0) {
+        ret = 1;
+    }
+    return ret;
+}
+
+
 /* ---- Entry point ---- */
 
 int main(int argc, char **argv) {
     _scisql_context ctx;
-    FILE *out = 0;
     char *end = 0;
     long l;
-    int c, i;
+    int c, i, fd, maxlevel;
 
     memset(&ctx, 0, sizeof(_scisql_context));
     ctx.level = 10;
     ctx.maxranges = SIZE_MAX;
+    ctx.sortmem = (size_t) 1024*1024*1024;
+    ctx.nthreads = 1;
 
     /* parse command line arguments */
     opterr = 0;
-    while ((c = getopt(argc, argv, "i:l:m:rs:v")) != -1) {
+    while ((c = getopt(argc, argv, "bi:l:m:M:rs:St:T:v")) != -1) {
         switch(c) {
+            case 'b':
+                ctx.binary = 1;
+                break;
             case 'i':
-                if (optarg == 0 || strcmp(optarg, "htm") != 0) {
-                    fprintf(stderr, "ERROR: the only supported option value "
-                            "for -%c is currently \"htm\"\n", optopt);
+                if (optarg != 0 && strcmp(optarg, "htm") == 0) {
+                    ctx.index = SCISQL_INDEX_HTM;
+                } else if (optarg != 0 && strcmp(optarg, "healpix") == 0) {
+                    ctx.index = SCISQL_INDEX_HEALPIX;
+                } else {
+                    fprintf(stderr, "ERROR: the supported option values "
+                            "for -i are \"htm\" and \"healpix\"\n");
                     return 1;
                 }
                 break;
@@ -500,16 +1597,11 @@ int main(int argc, char **argv) {
                     return 1;
                 }
                 l = strtol(optarg, &end, 0);
-                if (end == 0 || end == optarg) {
-                    fprintf(stderr, "ERROR: option -%c requires an integer "
-                            "argument in range [0,%d]\n", optopt,
-                            SCISQL_HTM_MAX_LEVEL);
-                    return 1;
-                }
-                if (l < 0 || l > SCISQL_HTM_MAX_LEVEL) {
+                if (end == 0 || end == optarg ||
+                    l < 0 || l > SCISQL_HPX_MAX_ORDER) {
                     fprintf(stderr, "ERROR: option -%c requires an integer "
                             "argument in range [0,%d]\n", optopt,
-                            SCISQL_HTM_MAX_LEVEL);
+                            SCISQL_HPX_MAX_ORDER);
                     return 1;
                 }
                 ctx.level = (int) l;
@@ -527,6 +1619,20 @@ int main(int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case 'M':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                l = strtol(optarg, &end, 0);
+                if (end == 0 || end == optarg || l <= 0) {
+                    fprintf(stderr, "ERROR: option -%c requires a positive "
+                            "integer argument\n", optopt);
+                    return 1;
+                }
+                ctx.sortmem = (size_t) l * 1024 * 1024;
+                break;
             case 'r':
                 ctx.ranges = 1;
                 break;
@@ -543,12 +1649,41 @@ int main(int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case 'S':
+                ctx.sort = 1;
+                break;
+            case 't':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                l = strtol(optarg, &end, 0);
+                if (end == 0 || end == optarg || l < 0 || l > 1024) {
+                    fprintf(stderr, "ERROR: option -%c requires an integer "
+                            "argument in range [0,1024]\n", optopt);
+                    return 1;
+                }
+                if (l == 0) {
+                    l = sysconf(_SC_NPROCESSORS_ONLN);
+                }
+                ctx.nthreads = (l > 0) ? (int) l : 1;
+                break;
+            case 'T':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                ctx.tmpdir = optarg;
+                break;
             case 'v':
                 ctx.verbose = 1;
                 break;
             case '?':
-                if (optopt == 'i' || optopt == 'l' ||
-                    optopt == 'm' || optopt == 's') {
+                if (optopt == 'i' || optopt == 'l' || optopt == 'm' ||
+                    optopt == 'M' || optopt == 's' || optopt == 't' ||
+                    optopt == 'T') {
                     fprintf(stderr, "ERROR: option -%c requires an argument\n",
                             optopt);
                 } else if (isprint(optopt)) {
@@ -563,6 +1698,14 @@ int main(int argc, char **argv) {
                 return 1;
         }
     }
+    /* the valid subdivision levels depend on the index type */
+    maxlevel = (ctx.index == SCISQL_INDEX_HEALPIX) ? SCISQL_HPX_MAX_ORDER :
+                                                     SCISQL_HTM_MAX_LEVEL;
+    if (ctx.level > maxlevel) {
+        fprintf(stderr, "ERROR: option -l requires an integer argument in "
+                "range [0,%d] for this index type\n", maxlevel);
+        return 1;
+    }
     if (ctx.ranges == 0) {
         ctx.maxranges = SIZE_MAX;
     }
@@ -571,22 +1714,53 @@ int main(int argc, char **argv) {
         return 1;
     }
     if (strcmp(argv[optind], "-") == 0) {
-        out = stdout;
+        fd = STDOUT_FILENO;
     } else {
-        out = fopen(argv[optind], "wb");
-        if (out == 0) {
+        fd = open(argv[optind], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1) {
             fprintf(stderr, "ERROR: failed to open output file %s "
                     "for writing\n", argv[optind]);
             return 1;
         }
     }
+    ctx.out.data = (char *) malloc(SCISQL_OUTPUT_SIZE);
+    ctx.out.cap = SCISQL_OUTPUT_SIZE;
+    ctx.out.fd = fd;
+    if (ctx.out.data == 0) {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        close_output(&ctx);
+        return 1;
+    }
+    if (ctx.sort != 0) {
+        ctx.sorter = scisql_extsort_new(ctx.sortmem, ctx.tmpdir);
+        if (ctx.sorter == 0) {
+            fprintf(stderr, "ERROR: failed to create output row sorter\n");
+            close_output(&ctx);
+            return 1;
+        }
+    }
     for (i = optind + 1; i < argc; ++i) {
-        if (index_file(&ctx, argv[i], out) != 0) {
-            fclose(out);
+        if (index_file(&ctx, argv[i]) != 0) {
+            scisql_extsort_free(ctx.sorter);
+            close_output(&ctx);
+            return 1;
+        }
+    }
+    if (ctx.sorter != 0) {
+        if (ctx.verbose != 0) {
+            fprintf(stderr, "Sorting output\n");
+            fflush(stderr);
+        }
+        if (scisql_extsort_finish(ctx.sorter, &output_sorted, &ctx) != 0) {
+            fprintf(stderr, "ERROR: failed to sort output: %s\n",
+                    scisql_extsort_error(ctx.sorter));
+            scisql_extsort_free(ctx.sorter);
+            close_output(&ctx);
             return 1;
         }
+        scisql_extsort_free(ctx.sorter);
     }
-    if (fclose(out) != 0) {
+    if (output_header(&ctx) != 0 || close_output(&ctx) != 0) {
         fprintf(stderr, "ERROR: failed to close output stream\n");
         return 1;
     }
@@ -0,0 +1,908 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Simple utility for spatially cross-matching two tables of points
+    on the sphere.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "format.h"
+#include "geometry.h"
+#include "htm.h"
+#include "atod.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*  A table of points, sorted by HTM ID. The payload of each point is a
+    pointer to the start of the corresponding input row.
+ */
+typedef struct {
+    const char *file;   /* input file name */
+    char *data;         /* input file contents */
+    size_t len;         /* input file size */
+    int binary;         /* is the input made up of binary records? */
+    scisql_v3p *points; /* point positions and payloads */
+    int64_t *ids;       /* HTM IDs of points */
+    size_t n;           /* number of points */
+    size_t cap;         /* capacity of points */
+} _scisql_catalog;
+
+
+/*  Options and processing context.
+ */
+typedef struct {
+    double radius;    /* match radius, degrees */
+    double dist2;     /* squared chord length corresponding to radius */
+    long nskip;       /* Number of initial lines to skip */
+    int level;        /* subdivision level, or -1 to derive it from radius */
+    int nearest;      /* Output nearest match only? */
+    int binary;       /* Output binary records instead of TSV */
+    int verbose;      /* Verbose output? */
+    int nthreads;     /* number of sorting threads */
+    int footprint;    /* Only match points inside poly? */
+    scisql_s2cpoly_soa poly; /* footprint polygon edges */
+    FILE *out;        /* output stream */
+    size_t nmatches;  /* number of matches output */
+} _scisql_context;
+
+
+/*  Describes correct usage.
+ */
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] radius out_file in_file_1 in_file_2\n\n",
+            name);
+    fprintf(stderr,
+        "Finds all pairs of points from two tables that are separated by at\n"
+        "most radius degrees. Each input must either be a tab-separated table\n"
+        "containing a single ID column followed by an arbitrary number of\n"
+        "columns, the last 2 of which are treated as point longitude and\n"
+        "latitude in degrees, or a binary point file. Binary point files\n"
+        "start with a 16 byte header:\n"
+        "\n"
+        "\tbytes 0-7:   the magic string \"SCISQLPT\"\n"
+        "\tbytes 8-9:   format version, currently 1\n"
+        "\tbytes 10-15: reserved, must be 0\n"
+        "\n"
+        "followed by 24 byte (id, lon, lat) records, where id is a 64 bit\n"
+        "integer and lon, lat are IEEE double precision numbers in degrees.\n"
+        "All binary values are little-endian. Specifying \"-\" as the output\n"
+        "file name will cause output to be written to standard out, and\n"
+        "specifying \"-\" as an input file name will cause standard in to be\n"
+        "read. Both inputs are held in memory.\n"
+        "\n"
+        "Points are sorted by HTM ID, and the points in each HTM triangle of\n"
+        "the first table are compared against the points in the HTM triangles\n"
+        "of the second table that overlap the triangle bounding circle\n"
+        "expanded by the match radius. Only pairs of points with chord\n"
+        "distance corresponding to at most radius are output.\n"
+        "\n"
+        "Each match is output as a row containing the ID of the point from\n"
+        "the first table, the ID of the point from the second table, and the\n"
+        "angular separation of the points in degrees. Rows are output in HTM\n"
+        "order of the points in the first table.\n"
+        "\n"
+        "With -b, rows are output as fixed width records consisting of two\n"
+        "little-endian 64 bit integer IDs followed by a little-endian IEEE\n"
+        "double precision separation. ID columns must then contain integers.\n"
+        "Records are preceded by a 16 byte header:\n"
+        "\n"
+        "\tbytes 0-7:   the magic string \"SCISQLXM\"\n"
+        "\tbytes 8-9:   format version, currently 1\n"
+        "\tbytes 10-15: reserved, 0\n"
+        "\n"
+        "Options\n"
+        "\t-b         Output binary records rather than TSV.\n"
+        "\t-l <level> The subdivision level to use when sorting\n"
+        "\t           points. By default, the finest level with\n"
+        "\t           triangles that are larger than the match\n"
+        "\t           radius is used.\n"
+        "\t-n         Output only the nearest match (if any) for\n"
+        "\t           each point in the first table.\n"
+        "\t-p <lon1,lat1,lon2,lat2,...>\n"
+        "\t           Only match points inside the given convex\n"
+        "\t           polygon, specified by a comma separated\n"
+        "\t           list of 3 to 20 vertices in degrees.\n"
+        "\t-s <N>     Skip the first N lines in each TSV input\n"
+        "\t           file.\n"
+        "\t-t <N>     Number of sorting threads; 0 means one\n"
+        "\t           thread per processor. The default is 1.\n"
+        "\t           Output is identical for any number of\n"
+        "\t           threads.\n"
+        "\t-v         Chatty progress messages.\n"
+        "\n");
+    fflush(stderr);
+}
+
+
+/* ---- Input ---- */
+
+/*  Size of the binary point file header and records.
+ */
+#define SCISQL_HEADER_SIZE 16
+#define SCISQL_POINT_RECORD_SIZE 24
+
+/*  Returns the little-endian 64 bit integer stored at s.
+ */
+SCISQL_INLINE uint64_t get_le64(const char *s) {
+    uint64_t u = 0;
+    int i;
+    for (i = 7; i >= 0; --i) {
+        u = (u << 8) | (unsigned char) s[i];
+    }
+    return u;
+}
+
+/*  Stores v at s as a little-endian 64 bit integer.
+ */
+SCISQL_INLINE void put_le64(char *s, uint64_t u) {
+    int i;
+    for (i = 0; i < 8; ++i) {
+        s[i] = (char) (u >> 8*i);
+    }
+}
+
+/*  Reads the entire contents of a file (or of standard in if file is "-")
+    into memory.
+ */
+static int read_file(_scisql_catalog *cat) {
+    struct stat st;
+    size_t cap = 1024*1024;
+    int fd;
+
+    if (strcmp(cat->file, "-") == 0) {
+        fd = STDIN_FILENO;
+    } else {
+        fd = open(cat->file, O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "ERROR: failed to open file %s for reading\n",
+                    cat->file);
+            return 1;
+        }
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        cap = (size_t) st.st_size + 1;
+    }
+    cat->data = (char *) malloc(cap);
+    cat->len = 0;
+    while (cat->data != 0) {
+        ssize_t nr;
+        if (cat->len == cap) {
+            char *data = (char *) realloc(cat->data, 2*cap);
+            if (data == 0) {
+                break;
+            }
+            cat->data = data;
+            cap *= 2;
+        }
+        nr = read(fd, cat->data + cat->len, cap - cat->len);
+        if (nr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: failed to read file %s\n", cat->file);
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            return 1;
+        } else if (nr == 0) {
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            return 0;
+        }
+        cat->len += (size_t) nr;
+    }
+    fprintf(stderr, "ERROR: memory allocation failed\n");
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return 1;
+}
+
+/*  Appends a point to a catalog.
+ */
+static int add_point(_scisql_catalog *cat,
+                     const scisql_sc *sc,
+                     const char *row)
+{
+    if (cat->n == cat->cap) {
+        size_t cap = (cat->cap == 0) ? 65536 : 2*cat->cap;
+        scisql_v3p *points = (scisql_v3p *) realloc(
+            cat->points, cap * sizeof(scisql_v3p));
+        if (points == 0) {
+            return 1;
+        }
+        cat->points = points;
+        cat->cap = cap;
+    }
+    scisql_sctov3(&cat->points[cat->n].v, sc);
+    cat->points[cat->n].payload = (void *) row;
+    ++cat->n;
+    return 0;
+}
+
+/*  Parses a floating point number occupying all of [beg, end).
+ */
+static int get_double(double *d, const char *beg, const char *end) {
+    for (; beg < end && *beg == ' '; ++beg) { }
+    for (; end > beg && end[-1] == ' '; --end) { }
+    if (beg == end || scisql_atod(beg, end, d) != end) {
+        return 1;
+    }
+    return 0;
+}
+
+/*  Extracts points from a TSV input.
+ */
+static int parse_tsv(_scisql_context *ctx, _scisql_catalog *cat) {
+    const char *s = cat->data;
+    const char *end = cat->data + cat->len;
+    size_t line = 0;
+
+    while (s < end) {
+        const char *eol = (const char *) memchr(s, '\n', (size_t) (end - s));
+        const char *lat, *lon, *e;
+        scisql_sc sc;
+        double x, y;
+        if (eol == 0) {
+            eol = end;
+        }
+        ++line;
+        if ((long) line <= ctx->nskip) {
+            s = eol + 1;
+            continue;
+        }
+        e = (eol > s && eol[-1] == '\r') ? eol - 1 : eol;
+        /* the last 2 columns contain the point position */
+        for (lat = e; lat > s && lat[-1] != '\t'; --lat) { }
+        for (lon = (lat > s) ? lat - 1 : s; lon > s && lon[-1] != '\t'; --lon) { }
+        if (lon == s || memchr(s, '\t', (size_t) (lon - s)) == 0) {
+            fprintf(stderr, "ERROR: %s, line %lu: expecting at least 3 "
+                    "columns\n", cat->file, (unsigned long) line);
+            return 1;
+        }
+        if (get_double(&x, lon, lat - 1) != 0 ||
+            get_double(&y, lat, e) != 0 ||
+            scisql_sc_init(&sc, x, y) != 0) {
+            fprintf(stderr, "ERROR: %s, line %lu: invalid point "
+                    "coordinates\n", cat->file, (unsigned long) line);
+            return 1;
+        }
+        if (add_point(cat, &sc, s) != 0) {
+            fprintf(stderr, "ERROR: memory allocation failed\n");
+            return 1;
+        }
+        s = eol + 1;
+    }
+    return 0;
+}
+
+/*  Extracts points from a binary point file.
+ */
+static int parse_binary(_scisql_catalog *cat) {
+    const char *s = cat->data + SCISQL_HEADER_SIZE;
+    const char *end = cat->data + cat->len;
+    size_t i;
+
+    if (get_le64(cat->data + 8) != 1 ||
+        (cat->len - SCISQL_HEADER_SIZE) % SCISQL_POINT_RECORD_SIZE != 0) {
+        fprintf(stderr, "ERROR: %s is not a version 1 binary point file\n",
+                cat->file);
+        return 1;
+    }
+    for (i = 1; s < end; s += SCISQL_POINT_RECORD_SIZE, ++i) {
+        scisql_sc sc;
+        double x, y;
+        uint64_t u;
+        u = get_le64(s + 8);
+        memcpy(&x, &u, sizeof(double));
+        u = get_le64(s + 16);
+        memcpy(&y, &u, sizeof(double));
+        if (scisql_sc_init(&sc, x, y) != 0) {
+            fprintf(stderr, "ERROR: %s, record %lu: invalid point "
+                    "coordinates\n", cat->file, (unsigned long) i);
+            return 1;
+        }
+        if (add_point(cat, &sc, s) != 0) {
+            fprintf(stderr, "ERROR: memory allocation failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Number of positions tested against the footprint polygon at a time.
+ */
+#define SCISQL_FILTER_BLOCK 1024
+
+/*  Removes the points of a catalog that lie outside the footprint polygon.
+    Positions are copied to coordinate arrays a block at a time, so that
+    they can be tested several at a time.
+ */
+static void filter_catalog(_scisql_context *ctx, _scisql_catalog *cat) {
+    double x[SCISQL_FILTER_BLOCK];
+    double y[SCISQL_FILTER_BLOCK];
+    double z[SCISQL_FILTER_BLOCK];
+    unsigned char inside[SCISQL_FILTER_BLOCK];
+    size_t i, j, n = 0;
+
+    for (i = 0; i < cat->n; i += SCISQL_FILTER_BLOCK) {
+        size_t m = cat->n - i;
+        if (m > SCISQL_FILTER_BLOCK) {
+            m = SCISQL_FILTER_BLOCK;
+        }
+        for (j = 0; j < m; ++j) {
+            x[j] = cat->points[i + j].v.x;
+            y[j] = cat->points[i + j].v.y;
+            z[j] = cat->points[i + j].v.z;
+        }
+        scisql_s2cpoly_cv3_batch(&ctx->poly, x, y, z, inside, m);
+        for (j = 0; j < m; ++j) {
+            if (inside[j] != 0) {
+                cat->points[n++] = cat->points[i + j];
+            }
+        }
+    }
+    if (ctx->verbose != 0) {
+        fprintf(stderr, "Kept %lu of %lu points from %s\n",
+                (unsigned long) n, (unsigned long) cat->n, cat->file);
+        fflush(stderr);
+    }
+    cat->n = n;
+}
+
+/*  Reads a catalog into memory and sorts its points by HTM ID.
+ */
+static int load_catalog(_scisql_context *ctx, _scisql_catalog *cat) {
+    int ret;
+
+    if (ctx->verbose != 0) {
+        fprintf(stderr, "Reading %s\n", cat->file);
+        fflush(stderr);
+    }
+    if (read_file(cat) != 0) {
+        return 1;
+    }
+    cat->binary = (cat->len >= SCISQL_HEADER_SIZE &&
+                   memcmp(cat->data, "SCISQLPT", 8) == 0);
+    ret = cat->binary ? parse_binary(cat) : parse_tsv(ctx, cat);
+    if (ret != 0) {
+        return 1;
+    }
+    if (ctx->footprint != 0) {
+        filter_catalog(ctx, cat);
+    }
+    cat->ids = (int64_t *) malloc((cat->n + 1) * sizeof(int64_t));
+    if (cat->ids == 0) {
+        fprintf(stderr, "ERROR: memory allocation failed\n");
+        return 1;
+    }
+    if (ctx->verbose != 0) {
+        fprintf(stderr, "Sorting %lu points from %s\n",
+                (unsigned long) cat->n, cat->file);
+        fflush(stderr);
+    }
+    if (scisql_v3p_htmsort_mt(cat->points, cat->ids, cat->n,
+                              ctx->level, ctx->nthreads) != 0) {
+        fprintf(stderr, "ERROR: failed to sort points from %s\n", cat->file);
+        return 1;
+    }
+    return 0;
+}
+
+static void free_catalog(_scisql_catalog *cat) {
+    free(cat->data);
+    free(cat->points);
+    free(cat->ids);
+}
+
+
+/* ---- Output ---- */
+
+/*  Parses the integer ID column of a TSV row.
+ */
+static int get_int64(int64_t *v, const char *beg, const char *end) {
+    uint64_t u = 0;
+    int neg = 0;
+    for (; beg < end && *beg == ' '; ++beg) { }
+    for (; end > beg && end[-1] == ' '; --end) { }
+    if (beg < end && (*beg == '-' || *beg == '+')) {
+        neg = (*beg == '-');
+        ++beg;
+    }
+    if (beg == end) {
+        return 1;
+    }
+    for (; beg < end; ++beg) {
+        unsigned int d = (unsigned int) (unsigned char) (*beg - '0');
+        if (d > 9 || u > (UINT64_MAX - d) / 10) {
+            return 1;
+        }
+        u = 10*u + d;
+    }
+    if (u > (uint64_t) INT64_MAX + (uint64_t) neg) {
+        return 1;
+    }
+    *v = neg ? (int64_t) (0 - u) : (int64_t) u;
+    return 0;
+}
+
+/*  Returns the length of the ID column of a row. The ID of a binary record
+    is at most 20 characters long in text form.
+ */
+static size_t id_len(const _scisql_catalog *cat, const char *row) {
+    const char *s = row;
+    if (cat->binary) {
+        return 20;
+    }
+    /* TSV rows are known to contain a tab */
+    for (; *s != '\t'; ++s) { }
+    return (size_t) (s - row);
+}
+
+/*  Appends the text form of the ID of the given row to s, returning a
+    pointer to the character following the last one written.
+ */
+static char * text_id(char *s, const _scisql_catalog *cat, const char *row) {
+    size_t n;
+    if (cat->binary) {
+        return s + scisql_format_int64(s, (int64_t) get_le64(row));
+    }
+    n = id_len(cat, row);
+    memcpy(s, row, n);
+    return s + n;
+}
+
+/*  Determines the integer ID of the given row.
+ */
+static int binary_id(int64_t *id, const _scisql_catalog *cat, const char *row) {
+    if (cat->binary) {
+        *id = (int64_t) get_le64(row);
+        return 0;
+    }
+    return get_int64(id, row, row + id_len(cat, row));
+}
+
+/*  Outputs a match between rows r1 and r2, separated by a chord of
+    squared length d2.
+ */
+static int output_match(_scisql_context *ctx,
+                        const _scisql_catalog *c1,
+                        const char *r1,
+                        const _scisql_catalog *c2,
+                        const char *r2,
+                        double d2)
+{
+    double sep = 2.0 * asin(0.5 * sqrt(d2)) * SCISQL_DEG_PER_RAD;
+    ++ctx->nmatches;
+    if (ctx->binary != 0) {
+        char rec[24];
+        int64_t id1, id2;
+        uint64_t u;
+        if (binary_id(&id1, c1, r1) != 0 || binary_id(&id2, c2, r2) != 0) {
+            fprintf(stderr, "ERROR: binary output requires integer IDs\n");
+            return 1;
+        }
+        memcpy(&u, &sep, sizeof(double));
+        put_le64(rec, (uint64_t) id1);
+        put_le64(rec + 8, (uint64_t) id2);
+        put_le64(rec + 16, u);
+        if (fwrite(rec, sizeof(rec), 1, ctx->out) != 1) {
+            fprintf(stderr, "ERROR: failed to write output\n");
+            return 1;
+        }
+        return 0;
+    } else {
+        char buf[128];
+        char *s;
+        size_t n = id_len(c1, r1) + id_len(c2, r2) + 32;
+        char *line = (n <= sizeof(buf)) ? buf : (char *) malloc(n);
+        int ret;
+        if (line == 0) {
+            fprintf(stderr, "ERROR: memory allocation failed\n");
+            return 1;
+        }
+        s = text_id(line, c1, r1);
+        *s++ = '\t';
+        s = text_id(s, c2, r2);
+        *s++ = '\t';
+        s += snprintf(s, 26, "%.17g", sep);
+        *s++ = '\n';
+        ret = fwrite(line, (size_t) (s - line), 1, ctx->out) != 1;
+        if (line != buf) {
+            free(line);
+        }
+        if (ret != 0) {
+            fprintf(stderr, "ERROR: failed to write output\n");
+        }
+        return ret;
+    }
+}
+
+/*  Writes the binary output header.
+ */
+static int output_header(_scisql_context *ctx) {
+    char h[SCISQL_HEADER_SIZE];
+    if (ctx->binary == 0) {
+        return 0;
+    }
+    memset(h, 0, sizeof(h));
+    memcpy(h, "SCISQLXM", 8);
+    h[8] = 1;                     /* format version */
+    return fwrite(h, sizeof(h), 1, ctx->out) != 1;
+}
+
+
+/* ---- Matching ---- */
+
+/*  Returns the index of the first point in cat with HTM ID >= id.
+ */
+static size_t lower_bound(const _scisql_catalog *cat, int64_t id) {
+    size_t lo = 0, hi = cat->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cat->ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*  Maximum number of points from the first table in a block. Points are
+    processed in blocks of points with a common HTM ancestor, so that the
+    cost of computing candidate ID ranges is amortized over many points
+    when the tables are sparse relative to the match radius.
+ */
+#define SCISQL_XMATCH_BLOCK 64
+
+/*  Cross-matches two catalogs sorted by HTM ID. Blocks of points from c1
+    sharing an HTM ancestor triangle are compared against the points of c2
+    in the triangles overlapping the ancestor bounding circle, expanded by
+    the match radius.
+ */
+static int xmatch(_scisql_context *ctx,
+                  const _scisql_catalog *c1,
+                  const _scisql_catalog *c2)
+{
+    scisql_ids *cov = 0;
+    size_t *spans = 0;
+    size_t nspans = 0;
+    size_t i = 0;
+    int ret = 1;
+
+    while (i < c1->n) {
+        scisql_htmtri tri;
+        double brad;
+        size_t j, k, r;
+        int64_t id = c1->ids[i];
+        int shift = 0;
+
+        for (j = i + 1; j < c1->n && c1->ids[j] == id; ++j) { }
+        /* grow the block to the largest ancestor triangle that does not
+           contain too many of the remaining points */
+        while (shift < 2*ctx->level) {
+            int64_t anc = id >> (shift + 2);
+            size_t e = lower_bound(c1, (anc + 1) << (shift + 2));
+            if (e - i > SCISQL_XMATCH_BLOCK) {
+                break;
+            }
+            shift += 2;
+            j = e;
+        }
+        if (scisql_htmtri_init(&tri, id >> shift) != 0) {
+            fprintf(stderr, "ERROR: invalid HTM ID\n");
+            goto done;
+        }
+        /* tri.radius is measured to the first vertex only, so compute a
+           true bounding radius. The slack accounts for points assigned to
+           a triangle they lie just outside of due to rounding. */
+        brad = 0.0;
+        for (k = 0; k < 3; ++k) {
+            double d = scisql_v3_angsep(&tri.center, &tri.verts[k]);
+            brad = (d > brad) ? d : brad;
+        }
+        cov = scisql_s2circle_htmids(cov, &tri.center,
+                                     brad + ctx->radius + 1.0e-9,
+                                     ctx->level, SIZE_MAX);
+        if (cov == 0) {
+            fprintf(stderr, "ERROR: failed to compute HTM ID ranges\n");
+            goto done;
+        }
+        /* locate the points of c2 in each range */
+        if (cov->n > nspans) {
+            free(spans);
+            nspans = cov->cap;
+            spans = (size_t *) malloc(2 * nspans * sizeof(size_t));
+            if (spans == 0) {
+                fprintf(stderr, "ERROR: memory allocation failed\n");
+                goto done;
+            }
+        }
+        for (r = 0; r < cov->n; ++r) {
+            spans[2*r] = lower_bound(c2, cov->ranges[2*r]);
+            spans[2*r + 1] = lower_bound(c2, cov->ranges[2*r + 1] + 1);
+        }
+        for (k = i; k < j; ++k) {
+            const scisql_v3 *v = &c1->points[k].v;
+            const char *best = 0;
+            double bestd2 = ctx->dist2;
+            for (r = 0; r < cov->n; ++r) {
+                size_t m;
+                for (m = spans[2*r]; m < spans[2*r + 1]; ++m) {
+                    double d2 = scisql_v3_dist2(v, &c2->points[m].v);
+                    if (d2 > ctx->dist2) {
+                        continue;
+                    }
+                    if (ctx->nearest == 0) {
+                        if (output_match(ctx, c1, c1->points[k].payload, c2,
+                                         c2->points[m].payload, d2) != 0) {
+                            goto done;
+                        }
+                    } else if (best == 0 || d2 < bestd2) {
+                        best = c2->points[m].payload;
+                        bestd2 = d2;
+                    }
+                }
+            }
+            if (best != 0 && output_match(ctx, c1, c1->points[k].payload,
+                                          c2, best, bestd2) != 0) {
+                goto done;
+            }
+        }
+        i = j;
+    }
+    ret = 0;
+done:
+    free(spans);
+    free(cov);
+    return ret;
+}
+
+/*  Returns the finest subdivision level with triangles larger than the
+    given radius (in degrees). Level L triangles have sides of length
+    roughly 90/2^L degrees, and are never less than half that tall.
+ */
+static int select_level(double radius) {
+    int level = 0;
+    while (level < SCISQL_HTM_MAX_LEVEL &&
+           45.0 / (double) (1 << (level + 1)) >= radius) {
+        ++level;
+    }
+    return level;
+}
+
+
+/* ---- Entry point ---- */
+
+/*  Parses a comma separated list of polygon vertex coordinates (in degrees)
+    into the footprint polygon.
+ */
+static int parse_footprint(_scisql_context *ctx, const char *s) {
+    scisql_v3 verts[SCISQL_MAX_VERTS];
+    scisql_s2cpoly poly;
+    double c[2];
+    size_t n = 0;
+    int i;
+
+    while (1) {
+        const char *e = s;
+        for (i = 0; i < 2; ++i) {
+            e = strchr(s, ',');
+            if (e == 0) {
+                e = s + strlen(s);
+            }
+            if (get_double(&c[i], s, e) != 0 || (i == 0 && *e != ',')) {
+                return 1;
+            }
+            s = e + 1;
+        }
+        if (n == SCISQL_MAX_VERTS) {
+            return 1;
+        } else {
+            scisql_sc sc;
+            if (scisql_sc_init(&sc, c[0], c[1]) != 0) {
+                return 1;
+            }
+            scisql_sctov3(&verts[n++], &sc);
+        }
+        if (*e == '\0') {
+            break;
+        }
+    }
+    if (n < 3 || scisql_s2cpoly_init(&poly, verts, n) != 0) {
+        return 1;
+    }
+    scisql_s2cpoly_tosoa(&ctx->poly, &poly);
+    ctx->footprint = 1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    _scisql_context ctx;
+    _scisql_catalog c1, c2;
+    char *end = 0;
+    long l;
+    int c, ret;
+
+    memset(&ctx, 0, sizeof(_scisql_context));
+    memset(&c1, 0, sizeof(_scisql_catalog));
+    memset(&c2, 0, sizeof(_scisql_catalog));
+    ctx.level = -1;
+    ctx.nthreads = 1;
+
+    /* parse command line arguments */
+    opterr = 0;
+    while ((c = getopt(argc, argv, "bl:np:s:t:v")) != -1) {
+        switch(c) {
+            case 'b':
+                ctx.binary = 1;
+                break;
+            case 'l':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                l = strtol(optarg, &end, 0);
+                if (end == 0 || end == optarg ||
+                    l < 0 || l > SCISQL_HTM_MAX_LEVEL) {
+                    fprintf(stderr, "ERROR: option -%c requires an integer "
+                            "argument in range [0,%d]\n", optopt,
+                            SCISQL_HTM_MAX_LEVEL);
+                    return 1;
+                }
+                ctx.level = (int) l;
+                break;
+            case 'n':
+                ctx.nearest = 1;
+                break;
+            case 'p':
+                if (optarg == 0 || parse_footprint(&ctx, optarg) != 0) {
+                    fprintf(stderr, "ERROR: option -%c requires a comma "
+                            "separated list of 3 to %d convex polygon "
+                            "vertices\n", c, SCISQL_MAX_VERTS);
+                    return 1;
+                }
+                break;
+            case 's':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                ctx.nskip = strtol(optarg, &end, 0);
+                if (end == 0 || end == optarg) {
+                    fprintf(stderr, "ERROR: option -%c requires an integer "
+                            "argument\n", optopt);
+                    return 1;
+                }
+                break;
+            case 't':
+                if (optarg == 0) {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                    return 1;
+                }
+                l = strtol(optarg, &end, 0);
+                if (end == 0 || end == optarg || l < 0 || l > 1024) {
+                    fprintf(stderr, "ERROR: option -%c requires an integer "
+                            "argument in range [0,1024]\n", optopt);
+                    return 1;
+                }
+                ctx.nthreads = (int) l;
+                break;
+            case 'v':
+                ctx.verbose = 1;
+                break;
+            case '?':
+                if (optopt == 'l' || optopt == 'p' || optopt == 's' ||
+                    optopt == 't') {
+                    fprintf(stderr, "ERROR: option -%c requires an argument\n",
+                            optopt);
+                } else if (isprint(optopt)) {
+                    fprintf(stderr, "ERROR: unknown option -%c\n", optopt);
+                } else {
+                    fprintf(stderr, "ERROR: unknown option character \\x%x\n",
+                            optopt);
+                }
+                return 1;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    ctx.radius = strtod(argv[optind], &end);
+    if (end == 0 || end == argv[optind] || *end != '\0' ||
+        !(ctx.radius >= 0.0 && ctx.radius <= 180.0)) {
+        fprintf(stderr, "ERROR: the match radius must be a number in "
+                "range [0,180]\n");
+        return 1;
+    }
+    ctx.dist2 = 2.0 * sin(0.5 * ctx.radius * SCISQL_RAD_PER_DEG);
+    ctx.dist2 *= ctx.dist2;
+    if (ctx.level < 0) {
+        ctx.level = select_level(ctx.radius);
+    }
+    c1.file = argv[optind + 2];
+    c2.file = argv[optind + 3];
+    if (load_catalog(&ctx, &c1) != 0 || load_catalog(&ctx, &c2) != 0) {
+        free_catalog(&c1);
+        free_catalog(&c2);
+        return 1;
+    }
+    if (strcmp(argv[optind + 1], "-") == 0) {
+        ctx.out = stdout;
+    } else {
+        ctx.out = fopen(argv[optind + 1], "wb");
+        if (ctx.out == 0) {
+            fprintf(stderr, "ERROR: failed to open output file %s "
+                    "for writing\n", argv[optind + 1]);
+            free_catalog(&c1);
+            free_catalog(&c2);
+            return 1;
+        }
+    }
+    setvbuf(ctx.out, 0, _IOFBF, 8*1024*1024);
+    if (ctx.verbose != 0) {
+        fprintf(stderr, "Cross-matching at HTM level %d\n", ctx.level);
+        fflush(stderr);
+    }
+    ret = output_header(&ctx);
+    if (ret != 0) {
+        fprintf(stderr, "ERROR: failed to write output\n");
+    } else {
+        ret = xmatch(&ctx, &c1, &c2);
+    }
+    free_catalog(&c1);
+    free_catalog(&c2);
+    if (fclose(ctx.out) != 0 && ret == 0) {
+        fprintf(stderr, "ERROR: failed to close output stream\n");
+        ret = 1;
+    }
+    if (ret == 0 && ctx.verbose != 0) {
+        fprintf(stderr, "Found %lu matches\n", (unsigned long) ctx.nmatches);
+    }
+    return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -23,6 +23,7 @@
 
 import math
 import os
+import struct
 import unittest
 
 try:
@@ -158,3 +159,39 @@ def angSep(ra1, dec1, ra2, dec2):
         return 180.0
     else:
         return 2.0 * math.degrees(math.asin(s))
+
+
+def unpackInt64s(blob):
+    """Returns the 64 bit integers (in host byte order) stored in a binary
+    string, e.g. as returned by s2CircleHtmRanges().
+    """
+    return struct.unpack("=%dq" % (len(blob) // 8), blob)
+
+
+def unpackRanges(blob, width=2):
+    """Returns the tuples of width 64 bit integers stored in a binary string,
+    e.g. the (min, max) HTM ID pairs returned by s2CircleHtmRanges().
+    """
+    v = unpackInt64s(blob)
+    return [v[i:i + width] for i in range(0, len(v), width)]
+
+
+def findRange(i, ranges):
+    """Returns the first range r with r[0] <= i <= r[1], or None.
+    """
+    for r in ranges:
+        if r[0] <= i <= r[1]:
+            return r
+    return None
+
+
+def mergeRanges(ranges):
+    """Returns the (min, max) pairs obtained by merging adjacent ranges.
+    """
+    merged = []
+    for r in ranges:
+        if merged and merged[-1][1] + 1 == r[0]:
+            merged[-1] = (merged[-1][0], r[1])
+        else:
+            merged.append((r[0], r[1]))
+    return merged
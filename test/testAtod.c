@@ -0,0 +1,259 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Checks that scisql_atod() parses decimal strings exactly like a
+    correctly rounding strtod(): every case must produce the same
+    double (bit for bit) and consume the same number of characters.
+*/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/atod.h"
+
+
+#define SCISQL_ASSERT(pred, ...) \
+    do { \
+        if (!(pred)) { \
+            fprintf(stderr, #pred " is false: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while(0)
+
+
+/*  Returns 1 if a and b have identical bit patterns, or are both NaNs
+    with the same sign.
+ */
+static int sameDouble(double a, double b) {
+    if (isnan(a) || isnan(b)) {
+        return isnan(a) && isnan(b) && signbit(a) == signbit(b);
+    }
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+/*  Parses the first n characters of s with scisql_atod() and compares
+    the result to that of strtod() on a NUL terminated copy.
+ */
+static void checkN(const char *s, size_t n) {
+    char buf[1024];
+    char *send;
+    const char *aend;
+    double sv, av;
+
+    SCISQL_ASSERT(n < sizeof(buf), "test string too long");
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    sv = strtod(buf, &send);
+    aend = scisql_atod(s, s + n, &av);
+    SCISQL_ASSERT(sameDouble(sv, av),
+                  "'%s': scisql_atod() returned %.17g (%a), "
+                  "strtod() returned %.17g (%a)", buf, av, av, sv, sv);
+    SCISQL_ASSERT(aend - s == send - buf,
+                  "'%s': scisql_atod() consumed %d characters, "
+                  "strtod() consumed %d", buf,
+                  (int) (aend - s), (int) (send - buf));
+}
+
+static void check(const char *s) {
+    checkN(s, strlen(s));
+}
+
+/*  Tests hand picked edge cases: syntax corner cases, subnormals,
+    overflow/underflow, long digit strings, inf/nan and hex input.
+ */
+static void testEdgeCases(void) {
+    static const char * const cases[] = {
+        /* syntax */
+        "", "+", "-", ".", "+.", "-.", "e5", ".e5", "+e5",
+        "0", "-0", "+0", "0.", ".0", "00000", "-0.0e0",
+        "1", "+1", "-1", ".5", "+.5", "-.5", "5.", "+5.", "5.e1",
+        "1e", "1e+", "1e-", "1E5", "1e+5", "1e-5", "1e5x", "1.5.5",
+        "12abc", "1 ", "0x", "0x.", "0xg", "+-1", "--1",
+        "1e0000000000000000000000000001",
+        /* simple and exactly representable values */
+        "123456789", "9007199254740992", "9007199254740993",
+        "1.5", "0.1", "0.2", "0.3", "3.14159265358979323846",
+        "1e22", "1e23", "1e-22", "1e-23", "123456789012345678",
+        /* 17+ digits and near halfway points */
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "9007199254740993.0000000000000000000000000000000000001",
+        "9007199254740992.9999999999999999999999999999999999999",
+        "2.2250738585072011e-308", "2.2250738585072012e-308",
+        "2.2250738585072014e-308",
+        "1.7976931348623157e308", "1.7976931348623158e308",
+        "1.7976931348623159e308",
+        "179769313486231580793728971405303415079934132710037826936173778"
+        "980444968292764750946649017977587207096330286416692887910946555"
+        "547851940402630657488671505820681908902000708383676273854845817"
+        "711531764475730270069855571366959622842914819860834936475292719"
+        "0749013760",
+        "0.000000000000000000000000000000000000000000000000000000000001",
+        "12345678901234567890", "123456789012345678901234567890",
+        "18446744073709551615", "18446744073709551616",
+        "0.1000000000000000055511151231257827021181583404541015625",
+        "7.3177701707893310e+15",
+        "0.0000000000000000000000000000000000000000000000000000000000000"
+        "000000000000000000000000012345678901234567890123456789e50",
+        /* subnormals and underflow */
+        "4.9406564584124654e-324", "5e-324", "4e-324", "3e-324",
+        "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "2.4703282292062327208828439643411068618252990130716238221279284"
+        "125033775363510437593264991818081799618989828234772285886546332"
+        "835517796989819938739800539093906315035659515570226392290858392"
+        "449105184435931802849936536152500319370457678249219365623669863"
+        "6584",
+        "1e-320", "1.23456789e-310", "2.2250738585072009e-308",
+        "1e-400", "-1e-400", "1e-99999",
+        /* overflow */
+        "1e309", "-1e309", "1e99999", "2e308",
+        /* inf and nan */
+        "inf", "INF", "-Inf", "+inf", "infinity", "INFINITY", "infinit",
+        "infx", "in", "i", "nan", "NaN", "-nan", "+NAN", "nan()",
+        "nan(123)", "nan(abc_9)", "nan(", "nan(1", "nanx", "na",
+        /* hex */
+        "0x1p0", "0x1.8p1", "-0x1.fffffffffffffp1023", "0x1p-1074",
+        "0x1p-1075", "0x1p1024", "0XaBcDeFp-3", "0x.8", "0x1.p1"
+    };
+    size_t i;
+    for (i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i) {
+        check(cases[i]);
+    }
+}
+
+/*  Tests that the end pointer bounds parsing, i.e. that scisql_atod()
+    never looks at characters past it.
+ */
+static void testBounds(void) {
+    static const char * const cases[] = {
+        "1234567890.0987654321e-12", "-.5e+17", "infinity", "nan(12)",
+        "0x1.8p3", "2.2250738585072011e-308", "4.9406564584124654e-324"
+    };
+    size_t i, n;
+    for (i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i) {
+        for (n = 0; n <= strlen(cases[i]); ++n) {
+            checkN(cases[i], n);
+        }
+    }
+}
+
+/*  Returns a random double with a uniformly distributed bit pattern.
+ */
+static double randomBits(unsigned short seed[3]) {
+    uint64_t b = (uint64_t) nrand48(seed);
+    double d;
+    b = (b << 31) ^ (uint64_t) nrand48(seed);
+    b = (b << 31) ^ (uint64_t) nrand48(seed);
+    memcpy(&d, &b, sizeof(double));
+    return d;
+}
+
+/*  Tests random doubles (including subnormals) printed with
+    varying precision.
+ */
+static void testRandomDoubles(void) {
+    static const char * const formats[] = {
+        "%.17g", "%.16g", "%.15g", "%.25e", "%.40g", "%.6e", "%a"
+    };
+    unsigned short seed[3] = { 1, 2, 3 };
+    char buf[128];
+    size_t f;
+    int i;
+    for (i = 0; i < 200000; ++i) {
+        double d = randomBits(seed);
+        if (i % 4 == 0) {
+            /* subnormal */
+            d = ldexp(fmod(fabs(d), 1.0), -1022);
+        }
+        for (f = 0; f < sizeof(formats)/sizeof(formats[0]); ++f) {
+            snprintf(buf, sizeof(buf), formats[f], d);
+            check(buf);
+        }
+    }
+}
+
+/*  Tests random digit strings with random exponents, which exercise
+    inputs longer than 19 digits and values near the extremes of the
+    exponent range.
+ */
+static void testRandomDigits(void) {
+    unsigned short seed[3] = { 4, 5, 6 };
+    char buf[128];
+    int i;
+    for (i = 0; i < 200000; ++i) {
+        int nd = 1 + (int) (erand48(seed) * 40.0);
+        int dot = (int) (erand48(seed) * (nd + 1));
+        int e = (int) (erand48(seed) * 700.0) - 350;
+        int j, k = 0;
+        if (erand48(seed) < 0.5) {
+            buf[k++] = '-';
+        }
+        for (j = 0; j < nd; ++j) {
+            if (j == dot) {
+                buf[k++] = '.';
+            }
+            buf[k++] = (char) ('0' + (int) (erand48(seed) * 10.0));
+        }
+        snprintf(buf + k, sizeof(buf) - k, "e%d", e);
+        check(buf);
+    }
+}
+
+/*  Tests exact decimal representations of points halfway between
+    adjacent doubles, and of the values just above and below them.
+ */
+static void testHalfway(void) {
+    unsigned short seed[3] = { 7, 8, 9 };
+    char buf[128];
+    int i;
+    for (i = 0; i < 100000; ++i) {
+        /* doubles in [1, 2) have 52 fraction bits, so midpoints have 53
+           and are printed exactly with 53 fractional decimal digits */
+        double d = 1.0 + erand48(seed);
+        long double mid = ((long double) d +
+                           (long double) nextafter(d, 2.0)) / 2.0L;
+        size_t n;
+        snprintf(buf, sizeof(buf), "%.53Lf", mid);
+        check(buf);
+        n = strlen(buf);
+        buf[n - 1] = '4';
+        check(buf);
+        buf[n - 1] = '5';
+        buf[n] = '1';
+        buf[n + 1] = '\0';
+        check(buf);
+    }
+}
+
+
+int main(int argc SCISQL_UNUSED, char **argv SCISQL_UNUSED) {
+    testEdgeCases();
+    testBounds();
+    testRandomDoubles();
+    testRandomDigits();
+    testHalfway();
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Tests the external sorter with a memory limit small enough to force
+    many spilled runs (and multi-pass merges, since the test build also
+    lowers the merge fan-in), and checks that the result matches an
+    in-memory sort. Then checks that sorted scisql_index output does not
+    depend on whether rows were spilled, or on whether the input was
+    memory mapped or streamed. The scisql_index executable is expected
+    in the parent directory of the test executable.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/extsort.h"
+
+
+#define SCISQL_ASSERT(pred, ...) \
+    do { \
+        if (!(pred)) { \
+            fprintf(stderr, #pred " is false: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while(0)
+
+/*  Number of records added to the sorter, and rows in the index test.
+ */
+#define NRECS 200000
+#define NROWS 500000
+
+
+typedef struct {
+    int64_t min;
+    int64_t max;
+    size_t seq;
+} rec;
+
+typedef struct {
+    const rec *recs;
+    size_t n;
+} checker;
+
+static char indexPath[4096];
+static char tmpDir[] = "/tmp/scisql_testExtsort_XXXXXX";
+
+
+static int cmpRec(const void *a, const void *b) {
+    const rec *r1 = (const rec *) a;
+    const rec *r2 = (const rec *) b;
+    if (r1->min != r2->min) {
+        return (r1->min < r2->min) ? -1 : 1;
+    }
+    if (r1->max != r2->max) {
+        return (r1->max < r2->max) ? -1 : 1;
+    }
+    return (r1->seq < r2->seq) ? -1 : (r1->seq > r2->seq);
+}
+
+/*  Generates the data of the i-th record: its 8 digit sequence number,
+    padded to a length between 8 and 68 bytes. Returns the length.
+ */
+static size_t recData(char *buf, size_t seq) {
+    size_t i, len = 8 + (seq * 7919) % 61;
+    snprintf(buf, 9, "%08lu", (unsigned long) seq);
+    for (i = 8; i < len; ++i) {
+        buf[i] = (char) ('a' + (seq + i) % 26);
+    }
+    return len;
+}
+
+/*  Checks that records are emitted in the order of an in-memory sort.
+ */
+static int checkRec(void *arg,
+                    int64_t min,
+                    int64_t max,
+                    const char *data,
+                    size_t len)
+{
+    checker *c = (checker *) arg;
+    const rec *r = c->recs + c->n;
+    char buf[128];
+    size_t n = recData(buf, r->seq);
+    SCISQL_ASSERT(min == r->min && max == r->max,
+                  "record %lu has the wrong key", (unsigned long) c->n);
+    SCISQL_ASSERT(len == n && memcmp(data, buf, n) == 0,
+                  "record %lu has the wrong data", (unsigned long) c->n);
+    ++c->n;
+    return 0;
+}
+
+/*  Sorts NRECS random records with many duplicate keys using the
+    given memory limit.
+ */
+static void testSort(size_t mem) {
+    unsigned short seed[3] = { 17, 19, 23 };
+    scisql_extsort *sorter = scisql_extsort_new(mem, 0);
+    rec *recs = (rec *) malloc(NRECS * sizeof(rec));
+    checker c;
+    char buf[128];
+    size_t i, total = 0;
+
+    SCISQL_ASSERT(sorter != 0 && recs != 0, "memory allocation failed");
+    for (i = 0; i < NRECS; ++i) {
+        size_t len = recData(buf, i);
+        recs[i].min = (int64_t) (erand48(seed) * 1000.0) - 500;
+        recs[i].max = recs[i].min + (int64_t) (erand48(seed) * 3.0);
+        recs[i].seq = i;
+        total += len;
+        SCISQL_ASSERT(scisql_extsort_add(sorter, recs[i].min, recs[i].max,
+                                         buf, len) == 0,
+                      "%s", scisql_extsort_error(sorter));
+    }
+    qsort(recs, NRECS, sizeof(rec), &cmpRec);
+    c.recs = recs;
+    c.n = 0;
+    SCISQL_ASSERT(scisql_extsort_finish(sorter, &checkRec, &c) == 0,
+                  "%s", scisql_extsort_error(sorter));
+    SCISQL_ASSERT(c.n == NRECS, "%lu records emitted", (unsigned long) c.n);
+    SCISQL_ASSERT(scisql_extsort_add(sorter, 0, 0, buf, 1) != 0,
+                  "add after finish succeeded");
+    scisql_extsort_free(sorter);
+    free(recs);
+    if (mem == SCISQL_EXTSORT_MIN_MEM) {
+        /* make sure the data really did not fit in a handful of runs */
+        SCISQL_ASSERT(total > 4 * SCISQL_EXTSORT_FANIN * mem,
+                      "too little data to force multi-pass merges");
+    }
+}
+
+/*  Tests a sorter to which no records are added.
+ */
+static void testEmpty(void) {
+    scisql_extsort *sorter = scisql_extsort_new(0, 0);
+    checker c;
+    c.recs = 0;
+    c.n = 0;
+    SCISQL_ASSERT(sorter != 0, "memory allocation failed");
+    SCISQL_ASSERT(scisql_extsort_finish(sorter, &checkRec, &c) == 0,
+                  "%s", scisql_extsort_error(sorter));
+    SCISQL_ASSERT(c.n == 0, "records emitted by an empty sorter");
+    scisql_extsort_free(sorter);
+}
+
+/*  Runs scisql_index on the given input, and returns its binary output.
+ */
+static unsigned char * runIndex(size_t *len, const char *opts,
+                                const char *in)
+{
+    char cmd[3*4096], out[4096];
+    unsigned char *data;
+    long sz;
+    FILE *f;
+
+    snprintf(out, sizeof(out), "%s/out", tmpDir);
+    snprintf(cmd, sizeof(cmd), "'%s' -b -S -l 3 %s '%s' %s",
+             indexPath, opts, out, in);
+    SCISQL_ASSERT(system(cmd) == 0, "%s failed", cmd);
+    f = fopen(out, "rb");
+    SCISQL_ASSERT(f != 0 && fseek(f, 0, SEEK_END) == 0, "%s", out);
+    sz = ftell(f);
+    SCISQL_ASSERT(sz == 16 + 16*NROWS, "%s: bad output size %ld", cmd, sz);
+    *len = (size_t) sz;
+    data = (unsigned char *) malloc(*len);
+    SCISQL_ASSERT(data != 0, "memory allocation failed");
+    rewind(f);
+    SCISQL_ASSERT(fread(data, *len, 1, f) == 1, "failed to read %s", out);
+    fclose(f);
+    unlink(out);
+    return data;
+}
+
+static uint64_t getLe64(const unsigned char *s) {
+    uint64_t u = 0;
+    int i;
+    for (i = 7; i >= 0; --i) {
+        u = (u << 8) | s[i];
+    }
+    return u;
+}
+
+/*  Indexes NROWS random points at a coarse level, so that HTM IDs are
+    heavily duplicated, with and without spilling to disk, and with
+    memory mapped and streamed input.
+ */
+static void testIndex(void) {
+    static const char * const runs[][2] = {
+        { "-M 4", "'%s'" },
+        { "-M 4", "- < '%s'" },
+        { "-M 4 -t 4", "- < '%s'" },
+        { "", "- < '%s'" }
+    };
+    unsigned short seed[3] = { 29, 31, 37 };
+    char tsv[4096], in[5000];
+    unsigned char *expected;
+    size_t i, len;
+    FILE *f;
+
+    snprintf(tsv, sizeof(tsv), "%s/in.tsv", tmpDir);
+    f = fopen(tsv, "w");
+    SCISQL_ASSERT(f != 0, "failed to open %s", tsv);
+    for (i = 0; i < NROWS; ++i) {
+        fprintf(f, "%lu\t%.9f\t%.9f\n", (unsigned long) i,
+                erand48(seed) * 360.0, erand48(seed) * 180.0 - 90.0);
+    }
+    SCISQL_ASSERT(fclose(f) == 0, "failed to write %s", tsv);
+
+    /* the in-memory sort of a memory mapped file is the reference */
+    snprintf(in, sizeof(in), "'%s'", tsv);
+    expected = runIndex(&len, "", in);
+    for (i = 1; i < NROWS; ++i) {
+        const unsigned char *r = expected + 16 + 16*i;
+        uint64_t id0 = getLe64(r - 16), id1 = getLe64(r);
+        int64_t h0 = (int64_t) getLe64(r - 8), h1 = (int64_t) getLe64(r + 8);
+        SCISQL_ASSERT(h0 < h1 || (h0 == h1 && id0 < id1),
+                      "rows %lu and %lu are out of order",
+                      (unsigned long) (i - 1), (unsigned long) i);
+    }
+    for (i = 0; i < sizeof(runs)/sizeof(runs[0]); ++i) {
+        unsigned char *data;
+        size_t n;
+        snprintf(in, sizeof(in), runs[i][1], tsv);
+        data = runIndex(&n, runs[i][0], in);
+        SCISQL_ASSERT(n == len && memcmp(data, expected, len) == 0,
+                      "output of scisql_index %s %s differs", runs[i][0], in);
+        free(data);
+    }
+    free(expected);
+    unlink(tsv);
+}
+
+
+int main(int argc SCISQL_UNUSED, char **argv) {
+    const char *slash = strrchr(argv[0], '/');
+    int dirlen = (slash == 0) ? 1 : (int) (slash - argv[0]);
+
+    testEmpty();
+    testSort(SCISQL_EXTSORT_MIN_MEM);
+    testSort((size_t) 1024*1024*1024);
+
+    snprintf(indexPath, sizeof(indexPath), "%.*s/../scisql_index",
+             dirlen, (slash == 0) ? "." : argv[0]);
+    SCISQL_ASSERT(access(indexPath, X_OK) == 0, "%s not found", indexPath);
+    SCISQL_ASSERT(mkdtemp(tmpDir) != 0, "failed to create a directory");
+    testIndex();
+    rmdir(tmpDir);
+    return 0;
+}
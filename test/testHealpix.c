@@ -0,0 +1,282 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "healpix.h"
+
+
+#define SCISQL_ASSERT(pred, ...) \
+    do { \
+        if (!(pred)) { \
+            fprintf(stderr, #pred " is false: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while(0)
+
+
+/*  Returns a random unit vector.
+ */
+static void randomPoint(scisql_v3 *v, unsigned short seed[3]) {
+    v->x = erand48(seed) - 0.5;
+    v->y = erand48(seed) - 0.5;
+    v->z = erand48(seed) - 0.5;
+    scisql_v3_normalize(v, v);
+}
+
+/*  Returns a random point at angular distance at most r (degrees) from c.
+ */
+static void randomPointNear(scisql_v3 *v,
+                            const scisql_v3 *c,
+                            double r,
+                            unsigned short seed[3])
+{
+    scisql_v3 n, e, t = { 0.0, 0.0, 1.0 };
+    double a = erand48(seed) * 360.0 * SCISQL_RAD_PER_DEG;
+    double d = r * erand48(seed) * SCISQL_RAD_PER_DEG;
+    if (c->z > 0.9 || c->z < -0.9) {
+        t.x = 1.0;
+        t.z = 0.0;
+    }
+    scisql_v3_rcross(&n, c, &t);
+    scisql_v3_normalize(&n, &n);
+    scisql_v3_rcross(&e, c, &n);
+    scisql_v3_normalize(&e, &e);
+    v->x = c->x*cos(d) + sin(d)*(cos(a)*n.x + sin(a)*e.x);
+    v->y = c->y*cos(d) + sin(d)*(cos(a)*n.y + sin(a)*e.y);
+    v->z = c->z*cos(d) + sin(d)*(cos(a)*n.z + sin(a)*e.z);
+}
+
+
+/*  Tests the base pixels and pixels containing the poles.
+ */
+static void testBasePixels() {
+    scisql_v3 v;
+    int64_t id;
+    int face, order, ret;
+    for (face = 0; face < SCISQL_HPX_NBASE; ++face) {
+        double z = (face < 4) ? 2.0/3.0 : ((face < 8) ? 0.0 : -2.0/3.0);
+        double phi = (face >= 4 && face < 8) ? 90.0*(face - 4) :
+                                               45.0 + 90.0*(face % 4);
+        double sth = sqrt(1.0 - z*z);
+        phi *= SCISQL_RAD_PER_DEG;
+        ret = scisql_hpx_center(&v, face, 0);
+        SCISQL_ASSERT(ret == 0, "scisql_hpx_center() failed");
+        SCISQL_ASSERT(fabs(v.x - sth*cos(phi)) < 1.0e-15 &&
+                      fabs(v.y - sth*sin(phi)) < 1.0e-15 &&
+                      fabs(v.z - z) < 1.0e-15,
+                      "base pixel %d has incorrect center", face);
+        SCISQL_ASSERT(scisql_v3_hpxid(&v, 0) == face,
+                      "scisql_v3_hpxid() failed for base pixel %d", face);
+    }
+    for (order = 0; order <= SCISQL_HPX_MAX_ORDER; ++order) {
+        v.x = 0.0; v.y = 0.0; v.z = 1.0;
+        id = scisql_v3_hpxid(&v, order);
+        SCISQL_ASSERT(id == (((int64_t) 1) << 2*order) - 1,
+                      "north pole has incorrect HEALPix ID");
+        v.z = -1.0;
+        id = scisql_v3_hpxid(&v, order);
+        SCISQL_ASSERT(id == ((int64_t) 8) << 2*order,
+                      "south pole has incorrect HEALPix ID");
+    }
+    SCISQL_ASSERT(scisql_v3_hpxid(0, 0) == -1, "null point accepted");
+    SCISQL_ASSERT(scisql_v3_hpxid(&v, -1) == -1, "invalid order accepted");
+    SCISQL_ASSERT(scisql_v3_hpxid(&v, SCISQL_HPX_MAX_ORDER + 1) == -1,
+                  "invalid order accepted");
+    SCISQL_ASSERT(scisql_hpx_center(&v, 12, 0) != 0, "invalid id accepted");
+    SCISQL_ASSERT(scisql_hpx_center(&v, -1, 0) != 0, "invalid id accepted");
+}
+
+
+/*  Tests nested to ring ID conversion.
+ */
+static void testNest2Ring() {
+    static const int64_t ring1[16] = {
+        13, 5, 4, 0, 15, 7, 6, 1, 17, 9, 8, 2, 19, 11, 10, 3
+    };
+    int64_t i;
+    int order;
+    for (i = 0; i < 16; ++i) {
+        SCISQL_ASSERT(scisql_hpx_nest2ring(i, 1) == ring1[i],
+                      "scisql_hpx_nest2ring() failed for id %lld",
+                      (long long) i);
+    }
+    for (order = 0; order <= 6; ++order) {
+        int64_t npix = ((int64_t) SCISQL_HPX_NBASE) << 2*order;
+        int64_t *nest = (int64_t *) malloc(npix * sizeof(int64_t));
+        double z = 1.0, phi = -1.0;
+        SCISQL_ASSERT(nest != 0, "memory allocation failed");
+        for (i = 0; i < npix; ++i) {
+            nest[i] = -1;
+        }
+        for (i = 0; i < npix; ++i) {
+            int64_t r = scisql_hpx_nest2ring(i, order);
+            SCISQL_ASSERT(r >= 0 && r < npix && nest[r] == -1,
+                          "scisql_hpx_nest2ring() is not a permutation");
+            nest[r] = i;
+        }
+        /* ring pixels are ordered by decreasing z, then increasing phi */
+        for (i = 0; i < npix; ++i) {
+            scisql_v3 c;
+            double p;
+            scisql_hpx_center(&c, nest[i], order);
+            p = atan2(c.y, c.x);
+            p = (p < 0.0) ? p + 360.0*SCISQL_RAD_PER_DEG : p;
+            SCISQL_ASSERT(c.z < z + 1.0e-12, "ring IDs not ordered by z");
+            if (c.z > z - 1.0e-12) {
+                SCISQL_ASSERT(p > phi, "ring IDs not ordered by phi");
+            }
+            z = c.z;
+            phi = p;
+        }
+        free(nest);
+    }
+    SCISQL_ASSERT(scisql_hpx_nest2ring(48, 1) == -1, "invalid id accepted");
+}
+
+
+/*  Tests HEALPix indexing of random points.
+ */
+static void testRandomPoints() {
+    unsigned short seed[3] = { 11, 21, 31 };
+    scisql_v3 verts[4];
+    int i, order, ret;
+
+    for (i = 0; i < 10000; ++i) {
+        scisql_v3 v;
+        int64_t prev = -1;
+        randomPoint(&v, seed);
+        for (order = 0; order <= SCISQL_HPX_MAX_ORDER; ++order) {
+            int64_t id = scisql_v3_hpxid(&v, order);
+            SCISQL_ASSERT(id >= 0 && id < ((int64_t) SCISQL_HPX_NBASE) << 2*order,
+                          "scisql_v3_hpxid() returned an invalid ID");
+            if (prev >= 0) {
+                SCISQL_ASSERT(id >> 2 == prev,
+                              "HEALPix ID is not a child of the ID at the "
+                              "previous order");
+            }
+            prev = id;
+            if (order <= 20) {
+                /* the point must be close to the pixel */
+                scisql_v3 c;
+                double r = 0.0;
+                int k;
+                ret = scisql_hpx_center(&c, id, order);
+                SCISQL_ASSERT(ret == 0, "scisql_hpx_center() failed");
+                SCISQL_ASSERT(scisql_v3_hpxid(&c, order) == id,
+                              "pixel center is not in pixel");
+                ret = scisql_hpx_boundary(verts, id, order, 1);
+                SCISQL_ASSERT(ret == 0, "scisql_hpx_boundary() failed");
+                for (k = 0; k < 4; ++k) {
+                    double d = scisql_v3_angsepu(&c, &verts[k]);
+                    r = (d > r) ? d : r;
+                }
+                SCISQL_ASSERT(scisql_v3_angsepu(&c, &v) <= r * 1.01,
+                              "point is too far from its pixel");
+            }
+        }
+    }
+}
+
+
+/*  Tests HEALPix coverage of random circles and polygons.
+ */
+static void testCoverage() {
+    static const scisql_v3 pole = { 0.0, 0.0, 1.0 };
+    unsigned short seed[3] = { 7, 11, 13 };
+    scisql_ids *ids = 0;
+    scisql_ids *coarse = 0;
+    int i, j;
+
+    for (i = 0; i < 200; ++i) {
+        scisql_v3 c, v, verts[4];
+        scisql_s2cpoly poly;
+        double r = pow(10.0, -3.0 + 4.0*erand48(seed));
+        int order = (int) (erand48(seed) * 16.0);
+        size_t k;
+
+        randomPoint(&c, seed);
+        ids = scisql_s2circle_hpxids(ids, &c, r, order, SIZE_MAX);
+        SCISQL_ASSERT(ids != 0, "scisql_s2circle_hpxids() failed");
+        coarse = scisql_s2circle_hpxids(coarse, &c, r, order, 8);
+        SCISQL_ASSERT(coarse != 0, "scisql_s2circle_hpxids() failed");
+        SCISQL_ASSERT(coarse->n <= 8, "too many ranges");
+        for (k = 0; k < ids->n; ++k) {
+            SCISQL_ASSERT(scisql_ids_contains(coarse, ids->ranges[2*k]) &&
+                          scisql_ids_contains(coarse, ids->ranges[2*k + 1]),
+                          "coarsened range list is not a superset");
+        }
+        for (j = 0; j < 1000; ++j) {
+            randomPointNear(&v, &c, r, seed);
+            SCISQL_ASSERT(scisql_ids_contains(ids, scisql_v3_hpxid(&v, order)),
+                          "point in circle is not covered");
+        }
+
+        /* a quadrilateral inscribed in a circle of radius r */
+        for (j = 0; j < 4; ++j) {
+            scisql_v3 n, e, t = { 0.0, 0.0, 1.0 };
+            double a = (90.0*j + 30.0) * SCISQL_RAD_PER_DEG;
+            double d = r * SCISQL_RAD_PER_DEG;
+            if (c.z > 0.9 || c.z < -0.9) {
+                t.x = 1.0;
+                t.z = 0.0;
+            }
+            scisql_v3_rcross(&n, &c, &t);
+            scisql_v3_normalize(&n, &n);
+            scisql_v3_rcross(&e, &c, &n);
+            scisql_v3_normalize(&e, &e);
+            verts[j].x = c.x*cos(d) + sin(d)*(cos(a)*n.x + sin(a)*e.x);
+            verts[j].y = c.y*cos(d) + sin(d)*(cos(a)*n.y + sin(a)*e.y);
+            verts[j].z = c.z*cos(d) + sin(d)*(cos(a)*n.z + sin(a)*e.z);
+        }
+        SCISQL_ASSERT(scisql_s2cpoly_init(&poly, verts, 4) == 0,
+                      "scisql_s2cpoly_init() failed");
+        ids = scisql_s2cpoly_hpxids(ids, &poly, order, SIZE_MAX);
+        SCISQL_ASSERT(ids != 0, "scisql_s2cpoly_hpxids() failed");
+        for (j = 0; j < 1000; ++j) {
+            randomPointNear(&v, &c, r, seed);
+            if (scisql_s2cpoly_cv3(&poly, &v) == 0) {
+                continue;
+            }
+            SCISQL_ASSERT(scisql_ids_contains(ids, scisql_v3_hpxid(&v, order)),
+                          "point in polygon is not covered");
+        }
+    }
+    /* degenerate circles */
+    ids = scisql_s2circle_hpxids(ids, &pole, 180.0, 3, SIZE_MAX);
+    SCISQL_ASSERT(ids != 0 && ids->n == 1 && ids->ranges[0] == 0 &&
+                  ids->ranges[1] == 767, "full sky coverage is incorrect");
+    ids = scisql_s2circle_hpxids(ids, &pole, -1.0, 3, SIZE_MAX);
+    SCISQL_ASSERT(ids != 0 && ids->n == 0, "empty coverage is incorrect");
+    free(coarse);
+    free(ids);
+}
+
+
+int main(int argc SCISQL_UNUSED, char **argv SCISQL_UNUSED) {
+    testBasePixels();
+    testNest2Ring();
+    testRandomPoints();
+    testCoverage();
+    return 0;
+}
@@ -359,6 +359,203 @@ static void testRandomPoints() {
 }
 
 
+/*  Tests that scisql_v3_htmid_batch() agrees with scisql_v3_htmid().
+ */
+static void testBatch() {
+    double *x, *y, *z;
+    int64_t *ids;
+    size_t i;
+    int level, ret;
+    const size_t n = NTEST_POINTS + 1003;
+    unsigned short seed[3] = { 13, 23, 33 };
+
+    x = malloc(sizeof(double) * n);
+    y = malloc(sizeof(double) * n);
+    z = malloc(sizeof(double) * n);
+    ids = malloc(sizeof(int64_t) * n);
+    SCISQL_ASSERT(x != 0 && y != 0 && z != 0 && ids != 0,
+                  "memory allocation failed");
+    for (i = 0; i < NTEST_POINTS; ++i) {
+        x[i] = test_points[i].v.x;
+        y[i] = test_points[i].v.y;
+        z[i] = test_points[i].v.z;
+    }
+    for (; i < n; ++i) {
+        scisql_v3 v;
+        v.x = erand48(seed) - 0.5;
+        v.y = erand48(seed) - 0.5;
+        v.z = erand48(seed) - 0.5;
+        scisql_v3_normalize(&v, &v);
+        x[i] = v.x;
+        y[i] = v.y;
+        z[i] = v.z;
+    }
+    for (level = 0; level <= SCISQL_HTM_MAX_LEVEL; ++level) {
+        /* vary the batch size to exercise the scalar tail handling */
+        size_t m = n - (size_t) level;
+        ret = scisql_v3_htmid_batch(x, y, z, ids, m, level);
+        SCISQL_ASSERT(ret == 0, "scisql_v3_htmid_batch() failed");
+        for (i = 0; i < m; ++i) {
+            scisql_v3 v;
+            v.x = x[i];
+            v.y = y[i];
+            v.z = z[i];
+            SCISQL_ASSERT(ids[i] == scisql_v3_htmid(&v, level),
+                          "scisql_v3_htmid_batch() does not agree "
+                          "with scisql_v3_htmid()");
+        }
+    }
+    ret = scisql_v3_htmid_batch(x, y, z, ids, n, SCISQL_HTM_MAX_LEVEL + 1);
+    SCISQL_ASSERT(ret != 0, "scisql_v3_htmid_batch() accepted invalid level");
+    ret = scisql_v3_htmid_batch(0, y, z, ids, n, 0);
+    SCISQL_ASSERT(ret != 0, "scisql_v3_htmid_batch() accepted null input");
+    free(ids);
+    free(z);
+    free(y);
+    free(x);
+}
+
+
+/*  Reference implementation of scisql_v3_htmid() and scisql_htmtri_init()
+    that does not use precomputed subdivision data. Returns the HTM ID of
+    point at the given level, and stores the vertices of the corresponding
+    triangle in verts.
+ */
+static int64_t refHtmId(scisql_v3 verts[3], const scisql_v3 *point, int level) {
+    static const scisql_v3 rv[6] = {
+        { 0.0,  0.0,  1.0 }, { 1.0,  0.0,  0.0 }, { 0.0,  1.0,  0.0 },
+        {-1.0,  0.0,  0.0 }, { 0.0, -1.0,  0.0 }, { 0.0,  0.0, -1.0 }
+    };
+    static const int ri[8][3] = {
+        { 1, 5, 2 }, { 2, 5, 3 }, { 3, 5, 4 }, { 4, 5, 1 },
+        { 1, 0, 4 }, { 4, 0, 3 }, { 3, 0, 2 }, { 2, 0, 1 }
+    };
+    scisql_v3 v0, v1, v2, sv0, sv1, sv2, e;
+    int64_t id = scisql_v3_htmid(point, 0);
+    int r = (int) (id - 8);
+    int l;
+
+    v0 = rv[ri[r][0]];
+    v1 = rv[ri[r][1]];
+    v2 = rv[ri[r][2]];
+    for (l = 0; l < level; ++l) {
+        scisql_v3_add(&sv1, &v2, &v0);
+        scisql_v3_normalize(&sv1, &sv1);
+        scisql_v3_add(&sv2, &v0, &v1);
+        scisql_v3_normalize(&sv2, &sv2);
+        scisql_v3_add(&sv0, &v1, &v2);
+        scisql_v3_normalize(&sv0, &sv0);
+        scisql_v3_rcross(&e, &sv2, &sv1);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v1 = sv2; v2 = sv1; id = id << 2;
+            continue;
+        }
+        scisql_v3_rcross(&e, &sv0, &sv2);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v0 = v1; v1 = sv0; v2 = sv2; id = (id << 2) + 1;
+            continue;
+        }
+        scisql_v3_rcross(&e, &sv1, &sv0);
+        if (scisql_v3_dot(&e, point) >= 0) {
+            v0 = v2; v1 = sv1; v2 = sv0; id = (id << 2) + 2;
+        } else {
+            v0 = sv0; v1 = sv1; v2 = sv2; id = (id << 2) + 3;
+        }
+    }
+    verts[0] = v0;
+    verts[1] = v1;
+    verts[2] = v2;
+    return id;
+}
+
+
+/*  Tests scisql_v3_htmid() and scisql_htmtri_init() against refHtmId().
+ */
+static void testPrecomputed() {
+    size_t i, j;
+    int level, ret;
+    const size_t n = NTEST_POINTS + 2000;
+    unsigned short seed[3] = { 17, 27, 37 };
+
+    for (i = 0; i < n; ++i) {
+        scisql_v3 v;
+        if (i < NTEST_POINTS) {
+            v = test_points[i].v;
+        } else {
+            v.x = erand48(seed) - 0.5;
+            v.y = erand48(seed) - 0.5;
+            v.z = erand48(seed) - 0.5;
+            scisql_v3_normalize(&v, &v);
+        }
+        for (level = 0; level <= SCISQL_HTM_MAX_LEVEL; ++level) {
+            scisql_v3 verts[3];
+            scisql_htmtri tri;
+            int64_t id = refHtmId(verts, &v, level);
+            SCISQL_ASSERT(scisql_v3_htmid(&v, level) == id,
+                          "scisql_v3_htmid() does not agree with "
+                          "reference implementation");
+            ret = scisql_htmtri_init(&tri, id);
+            SCISQL_ASSERT(ret == 0, "scisql_htmtri_init() failed");
+            for (j = 0; j < 3; ++j) {
+                SCISQL_ASSERT(tri.verts[j].x == verts[j].x &&
+                              tri.verts[j].y == verts[j].y &&
+                              tri.verts[j].z == verts[j].z,
+                              "scisql_htmtri_init() does not agree with "
+                              "reference implementation");
+            }
+        }
+    }
+}
+
+
+/*  Tests that scisql_v3p_htmsort_mt() agrees with scisql_v3p_htmsort().
+ */
+static void testParallelSort() {
+    static const int levels[5] = { 0, 1, 5, 10, SCISQL_HTM_MAX_LEVEL };
+    scisql_v3p *pts1, *pts2;
+    int64_t *ids1, *ids2;
+    size_t i;
+    int l, nthreads, ret;
+    const size_t n = 200000;
+    unsigned short seed[3] = { 19, 29, 39 };
+
+    pts1 = malloc(sizeof(scisql_v3p) * n);
+    pts2 = malloc(sizeof(scisql_v3p) * n);
+    ids1 = malloc(sizeof(int64_t) * n);
+    ids2 = malloc(sizeof(int64_t) * n);
+    SCISQL_ASSERT(pts1 != 0 && pts2 != 0 && ids1 != 0 && ids2 != 0,
+                  "memory allocation failed");
+    for (l = 0; l < 5; ++l) {
+        for (nthreads = 2; nthreads <= 5; nthreads += 3) {
+            for (i = 0; i < n; ++i) {
+                /* cluster half of the points to unbalance the subtrees */
+                double s = (i % 2 == 0) ? 1.0 : 0.01;
+                pts1[i].v.x = s*(erand48(seed) - 0.5) + (i % 2 == 0 ? 0.0 : 0.3);
+                pts1[i].v.y = s*(erand48(seed) - 0.5);
+                pts1[i].v.z = s*(erand48(seed) - 0.5);
+                scisql_v3_normalize(&pts1[i].v, &pts1[i].v);
+                pts1[i].payload = &pts1[i];
+                pts2[i] = pts1[i];
+            }
+            ret = scisql_v3p_htmsort(pts1, ids1, n, levels[l]);
+            SCISQL_ASSERT(ret == 0, "scisql_v3p_htmsort() failed");
+            ret = scisql_v3p_htmsort_mt(pts2, ids2, n, levels[l], nthreads);
+            SCISQL_ASSERT(ret == 0, "scisql_v3p_htmsort_mt() failed");
+            for (i = 0; i < n; ++i) {
+                SCISQL_ASSERT(ids1[i] == ids2[i] &&
+                              pts1[i].payload == pts2[i].payload,
+                              "scisql_v3p_htmsort_mt() does not agree "
+                              "with scisql_v3p_htmsort()");
+            }
+        }
+    }
+    free(ids2);
+    free(ids1);
+    free(pts2);
+    free(pts1);
+}
+
+
 /*  Tests HTM indexing of spherical circles.
  */
 static void testCircles() {
@@ -562,6 +759,421 @@ static void checkSubset(scisql_ids const *a, scisql_ids const *b) {
 }
 
 
+static int cmpInt64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+static int64_t countIds(scisql_ids const *ids) {
+    int64_t n = 0;
+    size_t i;
+    for (i = 0; i < ids->n; ++i) {
+        n += ids->ranges[2*i + 1] - ids->ranges[2*i] + 1;
+    }
+    return n;
+}
+
+/*  Checks that coarse, obtained from fine by imposing a bound of maxranges
+    ranges, respects the bound. If fine is short enough to have been
+    coarsened only by filling in gaps (fewer than 1024 ranges), also checks
+    that exactly the smallest gaps were filled in.
+ */
+static void checkCoarsened(scisql_ids const *fine,
+                           scisql_ids const *coarse,
+                           size_t maxranges)
+{
+    int64_t *gaps;
+    int64_t added = 0;
+    size_t i;
+    SCISQL_ASSERT(coarse->n <= maxranges, "too many ranges");
+    if (fine->n <= maxranges || fine->n > 1024) {
+        return;
+    }
+    gaps = (int64_t *) malloc((fine->n - 1) * sizeof(int64_t));
+    SCISQL_ASSERT(gaps != 0, "memory allocation failed");
+    for (i = 0; i < fine->n - 1; ++i) {
+        gaps[i] = fine->ranges[2*i + 2] - fine->ranges[2*i + 1] - 1;
+    }
+    qsort(gaps, fine->n - 1, sizeof(int64_t), &cmpInt64);
+    for (i = 0; i < fine->n - maxranges; ++i) {
+        added += gaps[i];
+    }
+    free(gaps);
+    SCISQL_ASSERT(coarse->n == maxranges, "too few ranges");
+    SCISQL_ASSERT(countIds(coarse) == countIds(fine) + added,
+                  "coarsening did not fill in the smallest gaps");
+}
+
+
+/*  Tests batched point-in-polygon testing against scisql_s2cpoly_cv3().
+ */
+static void testPolyBatch() {
+    double x[1003], y[1003], z[1003];
+    unsigned char inside[1003];
+    scisql_s2cpoly poly;
+    scisql_s2cpoly_soa soa;
+    unsigned short seed[3] = { 71, 73, 79 };
+    size_t i, m, n = sizeof(x) / sizeof(double);
+    int j, ret, nin = 0;
+
+    for (j = 0; j < 20; ++j) {
+        scisql_sc c;
+        scisql_v3 cv;
+        c.lon = 360.0 * erand48(seed);
+        c.lat = 180.0 * erand48(seed) - 90.0;
+        scisql_sctov3(&cv, &c);
+        ret = ngon(&poly, 3 + j % (SCISQL_MAX_VERTS - 2), &cv,
+                   1.0 + 30.0 * erand48(seed));
+        SCISQL_ASSERT(ret == 0, "ngon() failed");
+        scisql_s2cpoly_tosoa(&soa, &poly);
+        for (i = 0; i < n; ++i) {
+            scisql_v3 v;
+            /* sample points around the polygon center */
+            v.x = cv.x + 0.6 * (erand48(seed) - 0.5);
+            v.y = cv.y + 0.6 * (erand48(seed) - 0.5);
+            v.z = cv.z + 0.6 * (erand48(seed) - 0.5);
+            scisql_v3_normalize(&v, &v);
+            x[i] = v.x;
+            y[i] = v.y;
+            z[i] = v.z;
+        }
+        /* NaN coordinates, both inside vector lanes and in the tail */
+        x[j] = NAN;
+        y[100 + 3*j] = NAN;
+        z[n - 1 - j] = NAN;
+        /* vary the batch size to exercise the scalar tail handling */
+        ret = scisql_s2cpoly_cv3_batch(&soa, x, y, z, inside, n - j);
+        SCISQL_ASSERT(ret == 0, "scisql_s2cpoly_cv3_batch() failed");
+        for (i = 0; i < n - j; ++i) {
+            scisql_v3 v;
+            v.x = x[i];
+            v.y = y[i];
+            v.z = z[i];
+            SCISQL_ASSERT(inside[i] == scisql_s2cpoly_cv3(&poly, &v),
+                          "scisql_s2cpoly_cv3_batch() does not agree "
+                          "with scisql_s2cpoly_cv3()");
+            nin += inside[i];
+        }
+        /* batches shorter than a vector, or with a partial last vector,
+           starting at unaligned positions */
+        for (m = 0; m <= 17; ++m) {
+            size_t off = (size_t) (j + 7*m) % 16;
+            memset(inside, 2, m);
+            ret = scisql_s2cpoly_cv3_batch(&soa, x + off, y + off, z + off,
+                                           inside, m);
+            SCISQL_ASSERT(ret == 0, "scisql_s2cpoly_cv3_batch() failed");
+            for (i = 0; i < m; ++i) {
+                scisql_v3 v;
+                v.x = x[off + i];
+                v.y = y[off + i];
+                v.z = z[off + i];
+                SCISQL_ASSERT(inside[i] == scisql_s2cpoly_cv3(&poly, &v),
+                              "scisql_s2cpoly_cv3_batch() does not agree "
+                              "with scisql_s2cpoly_cv3() for a batch of "
+                              "%d points", (int) m);
+            }
+        }
+    }
+    SCISQL_ASSERT(nin > 0 && nin < (int) (20 * n) - 200,
+                  "scisql_s2cpoly_cv3_batch() test points are degenerate");
+    ret = scisql_s2cpoly_cv3_batch(&soa, 0, y, z, inside, n);
+    SCISQL_ASSERT(ret != 0, "scisql_s2cpoly_cv3_batch() accepted null input");
+}
+
+
+/*  Stores the vertices of an irregular N-gon inscribed in the given
+    circle in verts, in counter-clockwise order if ccw is non-zero and
+    in clockwise order otherwise.
+ */
+static void irregularNgon(scisql_v3 *verts,
+                          int n,
+                          const scisql_v3 *center,
+                          double radius,
+                          int ccw,
+                          unsigned short seed[3])
+{
+    scisql_v3 north, east, v;
+    double sr = sin(radius * SCISQL_RAD_PER_DEG);
+    double cr = cos(radius * SCISQL_RAD_PER_DEG);
+    int i;
+
+    north.x = - center->x * center->z;
+    north.y = - center->y * center->z;
+    north.z = center->x * center->x + center->y * center->y;
+    scisql_v3_rcross(&east, &north, center);
+    scisql_v3_normalize(&north, &north);
+    scisql_v3_normalize(&east, &east);
+    for (i = 0; i < n; ++i) {
+        /* jitter vertex angles, keeping them ordered */
+        double ang = (i + 0.4 * erand48(seed)) * 2.0 * M_PI / n;
+        double sa = sin(ang), ca = cos(ang);
+        v.x = ca * north.x + sa * east.x;
+        v.y = ca * north.y + sa * east.y;
+        v.z = ca * north.z + sa * east.z;
+        verts[ccw ? i : n - 1 - i].x = cr * center->x + sr * v.x;
+        verts[ccw ? i : n - 1 - i].y = cr * center->y + sr * v.y;
+        verts[ccw ? i : n - 1 - i].z = cr * center->z + sr * v.z;
+        scisql_v3_normalize(&verts[ccw ? i : n - 1 - i],
+                            &verts[ccw ? i : n - 1 - i]);
+    }
+}
+
+/*  Returns 1 if poly contains v according to a test against every edge.
+ */
+static int lpolyContains(const scisql_s2lpoly *poly, const scisql_v3 *v) {
+    size_t i;
+    for (i = 0; i < poly->n; ++i) {
+        if (scisql_v3_dot(v, &poly->edges[i]) < 0.0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*  Tests large spherical convex polygons.
+ */
+static void testLargePolygons() {
+    static const int nverts[5] = { 3, 20, 21, 150, 4000 };
+    unsigned short seed[3] = { 83, 89, 97 };
+    scisql_v3 *verts = (scisql_v3 *) malloc(4000 * sizeof(scisql_v3));
+    unsigned char *blob = (unsigned char *) malloc(4001 * 24);
+    scisql_s2lpoly *poly, *copy;
+    scisql_s2cpoly piece;
+    scisql_v3 cv;
+    scisql_ids *ids = 0;
+    size_t len, k;
+    int i, j, nin = 0;
+
+    SCISQL_ASSERT(verts != 0 && blob != 0, "memory allocation failed");
+    SCISQL_ASSERT(scisql_s2lpoly_new(0, 3) == 0,
+                  "scisql_s2lpoly_new() should have failed");
+    for (i = 0; i < 20; ++i) {
+        scisql_sc c;
+        int n = nverts[i % 5];
+        double r = 0.5 + 40.0 * erand48(seed);
+        double w = 2.0 * sin(r * SCISQL_RAD_PER_DEG);
+        c.lon = 360.0 * erand48(seed);
+        c.lat = 170.0 * erand48(seed) - 85.0;
+        scisql_sctov3(&cv, &c);
+        irregularNgon(verts, n, &cv, r, i & 1, seed);
+        poly = scisql_s2lpoly_new(verts, n);
+        SCISQL_ASSERT(poly != 0 && poly->n == (size_t) n,
+                      "scisql_s2lpoly_new() failed");
+        len = scisql_s2lpoly_tobin(blob, 24 * (n + 1), poly);
+        SCISQL_ASSERT(len == 24 * (size_t) (n + 1),
+                      "scisql_s2lpoly_tobin() failed");
+        copy = scisql_s2lpoly_frombin(blob, len);
+        SCISQL_ASSERT(copy != 0, "scisql_s2lpoly_frombin() failed");
+        ids = scisql_s2lpoly_htmids(ids, poly, 10, SIZE_MAX);
+        SCISQL_ASSERT(ids != 0, "scisql_s2lpoly_htmids() failed");
+        for (j = 0; j < 2000; ++j) {
+            scisql_v3 v;
+            int in, inpiece = 0;
+            v.x = cv.x + w * (erand48(seed) - 0.5);
+            v.y = cv.y + w * (erand48(seed) - 0.5);
+            v.z = cv.z + w * (erand48(seed) - 0.5);
+            scisql_v3_normalize(&v, &v);
+            in = scisql_s2lpoly_cv3(poly, &v);
+            SCISQL_ASSERT(in == lpolyContains(poly, &v),
+                          "scisql_s2lpoly_cv3() failed");
+            SCISQL_ASSERT(in == scisql_s2lpoly_cv3(copy, &v),
+                          "scisql_s2lpoly_frombin() did not round trip");
+            for (k = 0; k < scisql_s2lpoly_npieces(poly); ++k) {
+                SCISQL_ASSERT(scisql_s2lpoly_piece(&piece, poly, k) == 0,
+                              "scisql_s2lpoly_piece() failed");
+                inpiece |= scisql_s2cpoly_cv3(&piece, &v);
+            }
+            SCISQL_ASSERT(in == inpiece,
+                          "polygon pieces do not cover polygon");
+            SCISQL_ASSERT(in == 0 ||
+                          scisql_ids_contains(ids, scisql_v3_htmid(&v, 10)),
+                          "scisql_s2lpoly_htmids() missed a point");
+            nin += in;
+        }
+        free(copy);
+        free(poly);
+    }
+    SCISQL_ASSERT(nin > 1000 && nin < 39000,
+                  "large polygon test points are degenerate");
+    /* self-intersecting polygons are rejected */
+    irregularNgon(verts, 100, &cv, 10.0, 1, seed);
+    verts[50] = verts[0];
+    verts[0] = verts[25];
+    SCISQL_ASSERT(scisql_s2lpoly_new(verts, 100) == 0,
+                  "scisql_s2lpoly_new() should have failed");
+    /* so are non-convex polygons, e.g. stars, which wind around their
+       vertex sum exactly once */
+    irregularNgon(verts, 30, &cv, 10.0, 1, seed);
+    for (i = 1; i < 30; i += 2) {
+        verts[i].x = cv.x + 0.5 * (verts[i].x - cv.x);
+        verts[i].y = cv.y + 0.5 * (verts[i].y - cv.y);
+        verts[i].z = cv.z + 0.5 * (verts[i].z - cv.z);
+        scisql_v3_normalize(&verts[i], &verts[i]);
+    }
+    SCISQL_ASSERT(scisql_s2lpoly_new(verts, 30) == 0,
+                  "scisql_s2lpoly_new() should have failed");
+    /* a single reflex vertex is enough */
+    irregularNgon(verts, 30, &cv, 10.0, 0, seed);
+    verts[7].x = cv.x + 0.9 * (verts[7].x - cv.x);
+    verts[7].y = cv.y + 0.9 * (verts[7].y - cv.y);
+    verts[7].z = cv.z + 0.9 * (verts[7].z - cv.z);
+    scisql_v3_normalize(&verts[7], &verts[7]);
+    SCISQL_ASSERT(scisql_s2lpoly_new(verts, 30) == 0,
+                  "scisql_s2lpoly_new() should have failed");
+    free(ids);
+    free(blob);
+    free(verts);
+}
+
+
+/*  Returns 1 if the polygon with the given vertices, which must be star
+    shaped with respect to center, contains v according to a test against
+    each triangle of the fan around center.
+ */
+static int starContains(const scisql_v3 *verts,
+                        int n,
+                        const scisql_v3 *center,
+                        const scisql_v3 *v)
+{
+    scisql_s2cpoly tri;
+    scisql_v3 tv[3];
+    int i;
+    tv[0] = *center;
+    for (i = 0; i < n; ++i) {
+        tv[1] = verts[i];
+        tv[2] = verts[(i + 1) % n];
+        SCISQL_ASSERT(scisql_s2cpoly_init(&tri, tv, 3) == 0,
+                      "scisql_s2cpoly_init() failed");
+        if (scisql_s2cpoly_cv3(&tri, v)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*  Tests simple, non-convex spherical polygons.
+ */
+static void testSimplePolygons() {
+    static const int nverts[5] = { 3, 8, 40, 301, 2000 };
+    unsigned short seed[3] = { 101, 103, 107 };
+    scisql_v3 *verts = (scisql_v3 *) malloc(2000 * sizeof(scisql_v3));
+    unsigned char *blob = (unsigned char *) malloc(8 + 2000 * 24);
+    scisql_s2spoly *poly, *copy;
+    scisql_s2spoly_htmidx *idx, *idx3;
+    scisql_s2cpoly cpoly;
+    scisql_v3 cv;
+    scisql_ids *ids = 0, *coarse = 0;
+    size_t len;
+    int i, j, k, nin = 0;
+
+    SCISQL_ASSERT(verts != 0 && blob != 0, "memory allocation failed");
+    SCISQL_ASSERT(scisql_s2spoly_new(0, 3) == 0,
+                  "scisql_s2spoly_new() should have failed");
+    for (i = 0; i < 20; ++i) {
+        scisql_sc c;
+        int n = nverts[i % 5];
+        double r = 0.01 + 30.0 * erand48(seed);
+        double w = 2.0 * sin(r * SCISQL_RAD_PER_DEG);
+        c.lon = 360.0 * erand48(seed);
+        c.lat = 170.0 * erand48(seed) - 85.0;
+        scisql_sctov3(&cv, &c);
+        irregularNgon(verts, n, &cv, r, i & 1, seed);
+        /* pull every other vertex towards the center to obtain a star
+           shaped, non-convex polygon */
+        for (k = 1; k < n && n > 3; k += 2) {
+            double t = 0.2 + 0.6 * erand48(seed);
+            verts[k].x = cv.x + t * (verts[k].x - cv.x);
+            verts[k].y = cv.y + t * (verts[k].y - cv.y);
+            verts[k].z = cv.z + t * (verts[k].z - cv.z);
+            scisql_v3_normalize(&verts[k], &verts[k]);
+        }
+        poly = scisql_s2spoly_new(verts, n);
+        SCISQL_ASSERT(poly != 0 && poly->n == (size_t) n,
+                      "scisql_s2spoly_new() failed");
+        len = scisql_s2spoly_tobin(blob, 8 + 24 * n, poly);
+        SCISQL_ASSERT(len == 8 + 24 * (size_t) n,
+                      "scisql_s2spoly_tobin() failed");
+        SCISQL_ASSERT(scisql_s2spoly_tobin(blob, len - 1, poly) == 0,
+                      "scisql_s2spoly_tobin() should have failed");
+        copy = scisql_s2spoly_frombin(blob, len);
+        SCISQL_ASSERT(copy != 0, "scisql_s2spoly_frombin() failed");
+        idx = scisql_s2spoly_htmidx_new(poly, -1);
+        SCISQL_ASSERT(idx != 0, "scisql_s2spoly_htmidx_new() failed");
+        SCISQL_ASSERT(n <= 40 || idx->inside->n > 0,
+                      "no HTM triangles classified as inside");
+        idx3 = scisql_s2spoly_htmidx_new(poly, 3);
+        SCISQL_ASSERT(idx3 != 0, "scisql_s2spoly_htmidx_new() failed");
+        ids = scisql_s2spoly_htmids(ids, poly, 10, SIZE_MAX);
+        SCISQL_ASSERT(ids != 0, "scisql_s2spoly_htmids() failed");
+        coarse = scisql_s2spoly_htmids(coarse, poly, 10, 16);
+        SCISQL_ASSERT(coarse != 0, "scisql_s2spoly_htmids() failed");
+        checkSubset(ids, coarse);
+        checkCoarsened(ids, coarse, 16);
+        for (j = 0; j < 2000; ++j) {
+            scisql_v3 v;
+            int in;
+            v.x = cv.x + w * (erand48(seed) - 0.5);
+            v.y = cv.y + w * (erand48(seed) - 0.5);
+            v.z = cv.z + w * (erand48(seed) - 0.5);
+            scisql_v3_normalize(&v, &v);
+            in = scisql_s2spoly_cv3(poly, &v);
+            SCISQL_ASSERT(in == starContains(verts, n, &cv, &v),
+                          "scisql_s2spoly_cv3() failed");
+            SCISQL_ASSERT(in == scisql_s2spoly_cv3(copy, &v),
+                          "scisql_s2spoly_frombin() did not round trip");
+            SCISQL_ASSERT(in == scisql_s2spoly_htmidx_cv3(idx, poly, &v),
+                          "scisql_s2spoly_htmidx_cv3() failed");
+            SCISQL_ASSERT(in == scisql_s2spoly_htmidx_cv3(idx3, poly, &v),
+                          "scisql_s2spoly_htmidx_cv3() failed");
+            SCISQL_ASSERT(in == 0 ||
+                          scisql_ids_contains(ids, scisql_v3_htmid(&v, 10)),
+                          "scisql_s2spoly_htmids() missed a point");
+            nin += in;
+        }
+        /* positions extremely close to edges and vertices must be
+           classified exactly as by scisql_s2spoly_cv3() */
+        for (j = 0; j < 2000; ++j) {
+            const scisql_v3 *a = &verts[j % n];
+            const scisql_v3 *b = &verts[(j + 1) % n];
+            double t = (j & 7) == 0 ? 0.0 : erand48(seed);
+            double eps = pow(10.0, -6.0 - (j % 11));
+            scisql_v3 v;
+            v.x = a->x + t * (b->x - a->x) + eps * (erand48(seed) - 0.5);
+            v.y = a->y + t * (b->y - a->y) + eps * (erand48(seed) - 0.5);
+            v.z = a->z + t * (b->z - a->z) + eps * (erand48(seed) - 0.5);
+            scisql_v3_normalize(&v, &v);
+            k = scisql_s2spoly_cv3(poly, &v);
+            SCISQL_ASSERT(k == scisql_s2spoly_htmidx_cv3(idx, poly, &v),
+                          "scisql_s2spoly_htmidx_cv3() failed near an edge");
+            SCISQL_ASSERT(k == scisql_s2spoly_htmidx_cv3(idx3, poly, &v),
+                          "scisql_s2spoly_htmidx_cv3() failed near an edge");
+        }
+        scisql_s2spoly_htmidx_free(idx3);
+        scisql_s2spoly_htmidx_free(idx);
+        free(copy);
+        free(poly);
+    }
+    SCISQL_ASSERT(nin > 1000 && nin < 39000,
+                  "simple polygon test points are degenerate");
+    /* convex polygon blobs and self-intersecting polygons are rejected */
+    SCISQL_ASSERT(scisql_s2cpoly_init(&cpoly, verts, 3) == 0 &&
+                  scisql_s2cpoly_tobin(blob, 96, &cpoly) == 96 &&
+                  scisql_s2spoly_frombin(blob, 96) == 0,
+                  "scisql_s2spoly_frombin() should have failed");
+    irregularNgon(verts, 100, &cv, 10.0, 1, seed);
+    cv = verts[10];
+    verts[10] = verts[11];
+    verts[11] = cv;
+    SCISQL_ASSERT(scisql_s2spoly_new(verts, 100) == 0,
+                  "scisql_s2spoly_new() should have failed");
+    free(coarse);
+    free(ids);
+    free(blob);
+    free(verts);
+}
+
+
 /*  Tests adaptive coarsening of effective subdivision level with circles.
  */
 static void testAdaptiveCircle() {
@@ -576,7 +1188,8 @@ static void testAdaptiveCircle() {
             SCISQL_ASSERT(fine != 0, "scisql_s2cpoly_htmids() failed");
             coarse = scisql_s2circle_htmids(coarse, &center, radii[i], level, 16);
             SCISQL_ASSERT(coarse != 0, "scisql_s2cpoly_htmids() failed");
-            checkSubset(fine, coarse); 
+            checkSubset(fine, coarse);
+            checkCoarsened(fine, coarse, 16);
        }
     }
     free(coarse);
@@ -602,6 +1215,7 @@ static void testAdaptivePoly() {
             coarse = scisql_s2cpoly_htmids(coarse, &poly, level, 16);
             SCISQL_ASSERT(coarse != 0, "scisql_s2cpoly_htmids() failed");
             checkSubset(fine, coarse);
+            checkCoarsened(fine, coarse, 16);
        }
     }
     free(coarse);
@@ -609,13 +1223,662 @@ static void testAdaptivePoly() {
 }
 
 
+/*  Checks that classified range list c covers exactly the IDs in ids,
+    and that for random points with HTM IDs in inside ranges of c, the
+    exact point-in-region test passes. Either center/dist2 or poly
+    specify the region. Returns the number of such points.
+ */
+static size_t checkClassified(scisql_cids const *c,
+                            scisql_ids const *ids,
+                            const scisql_v3 *center,
+                            double dist2,
+                            const scisql_s2cpoly *poly,
+                            int level,
+                            unsigned short seed[3])
+{
+    size_t i, j, ninside;
+    for (i = 0, j = 0; i < c->n; ++i, ++j) {
+        int64_t max_id = c->ranges[3*i + 1];
+        SCISQL_ASSERT(j < ids->n && c->ranges[3*i] == ids->ranges[2*j],
+                      "classified ranges do not match ranges");
+        for (; i + 1 < c->n && c->ranges[3*i + 3] == max_id + 1; ++i) {
+            max_id = c->ranges[3*i + 4];
+        }
+        SCISQL_ASSERT(max_id == ids->ranges[2*j + 1],
+                      "classified ranges do not match ranges");
+    }
+    SCISQL_ASSERT(j == ids->n, "classified ranges do not match ranges");
+    for (i = 0, ninside = 0; i < 20000; ++i) {
+        scisql_v3 v;
+        int64_t id;
+        v.x = erand48(seed) - 0.5;
+        v.y = erand48(seed) - 0.5;
+        v.z = erand48(seed) - 0.5;
+        scisql_v3_normalize(&v, &v);
+        id = scisql_v3_htmid(&v, level);
+        for (j = 0; j < c->n; ++j) {
+            if (id >= c->ranges[3*j] && id <= c->ranges[3*j + 1]) {
+                break;
+            }
+        }
+        if (j == c->n || c->ranges[3*j + 2] == 0) {
+            continue;
+        }
+        ++ninside;
+        if (poly != 0) {
+            SCISQL_ASSERT(scisql_s2cpoly_cv3(poly, &v) != 0,
+                          "point in inside range is not inside polygon");
+        } else {
+            SCISQL_ASSERT(scisql_v3_dist2(center, &v) <= dist2,
+                          "point in inside range is not inside circle");
+        }
+    }
+    return ninside;
+}
+
+
+/*  Tests classification of HTM ID ranges as inside or partially
+    covered.
+ */
+static void testClassified() {
+    static const double radii[4] = { 0.5, 10.0, 60.0, 120.0 };
+    unsigned short seed[3] = { 7, 11, 13 };
+    scisql_s2cpoly poly;
+    scisql_cids *c = 0;
+    scisql_ids *ids = 0;
+    size_t n;
+    int i, k, level;
+
+    SCISQL_ASSERT(scisql_s2circle_htmcids(0, 0, 1.0, 0, SIZE_MAX) == 0,
+                  "scisql_s2circle_htmcids() should have failed");
+    SCISQL_ASSERT(scisql_s2cpoly_htmcids(0, 0, 0, SIZE_MAX) == 0,
+                  "scisql_s2cpoly_htmcids() should have failed");
+    c = scisql_s2circle_htmcids(c, &test_points[0].v, 180.0, 3, SIZE_MAX);
+    SCISQL_ASSERT(c != 0 && c->n == 1 && c->ranges[2] == 1,
+                  "entire sky should be classified as inside");
+
+    for (k = 0; k < 4; ++k) {
+        for (i = CENTERS; i < CENTERS + 8; i += 3) {
+            const scisql_v3 *center = &test_points[i].v;
+            double d = sin(radii[k] * 0.5 * SCISQL_RAD_PER_DEG);
+            for (level = 0; level <= 8; level += 2) {
+                ids = scisql_s2circle_htmids(ids, center, radii[k], level, SIZE_MAX);
+                SCISQL_ASSERT(ids != 0, "scisql_s2circle_htmids() failed");
+                c = scisql_s2circle_htmcids(c, center, radii[k], level, SIZE_MAX);
+                SCISQL_ASSERT(c != 0, "scisql_s2circle_htmcids() failed");
+                n = checkClassified(c, ids, center, 4.0 * d * d, 0, level, seed);
+                SCISQL_ASSERT(n > 0 || radii[k] < 10.0 || level < 4,
+                              "no ranges classified as inside circle");
+                c = scisql_s2circle_htmcids(c, center, radii[k], level, 16);
+                SCISQL_ASSERT(c != 0 && c->n <= 16,
+                              "scisql_s2circle_htmcids() failed");
+                if (radii[k] > 60.0) {
+                    continue;
+                }
+                SCISQL_ASSERT(ngon(&poly, 5, center, radii[k]) == 0,
+                              "ngon() failed");
+                ids = scisql_s2cpoly_htmids(ids, &poly, level, SIZE_MAX);
+                SCISQL_ASSERT(ids != 0, "scisql_s2cpoly_htmids() failed");
+                c = scisql_s2cpoly_htmcids(c, &poly, level, SIZE_MAX);
+                SCISQL_ASSERT(c != 0, "scisql_s2cpoly_htmcids() failed");
+                n = checkClassified(c, ids, 0, 0.0, &poly, level, seed);
+                SCISQL_ASSERT(n > 0 || radii[k] < 10.0 || level < 4,
+                              "no ranges classified as inside polygon");
+                c = scisql_s2cpoly_htmcids(c, &poly, level, 16);
+                SCISQL_ASSERT(c != 0 && c->n <= 16,
+                              "scisql_s2cpoly_htmcids() failed");
+            }
+        }
+    }
+    free(c);
+    free(ids);
+}
+
+
+/*  Returns 1 if id lies in one of the ranges of ids.
+ */
+static int inRanges(scisql_ids const *ids, int64_t id) {
+    size_t i;
+    for (i = 0; i < ids->n; ++i) {
+        if (id >= ids->ranges[2*i] && id <= ids->ranges[2*i + 1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*  Tests HTM indexing of spherical ellipses: random points inside
+    random ellipses must have HTM IDs in the ellipse coverage, which must
+    be no larger than the coverage of a bounding circle.
+ */
+static void testEllipses() {
+    static const double axes[3] = { 0.5, 60.0, 3600.0 };
+    unsigned short seed[3] = { 3, 5, 17 };
+    scisql_s2ellipse e;
+    scisql_sc cen;
+    scisql_ids *ids = 0;
+    scisql_ids *circle = 0;
+    int i, j, k, level;
+
+    SCISQL_ASSERT(scisql_s2ellipse_htmids(0, 0, 0, SIZE_MAX) == 0,
+                  "scisql_s2ellipse_htmids() should have failed");
+    for (k = 0; k < 3; ++k) {
+        for (i = 0; i < 20; ++i) {
+            double M = axes[k] * (0.5 + erand48(seed));
+            double m = M * erand48(seed);
+            double r = 1.0001 * M / SCISQL_ARCSEC_PER_DEG;
+            scisql_v3 c;
+            int ret;
+            if (i == 0) {
+                /* degenerate: zero length semi-minor axis */
+                m = 0.0;
+            }
+            cen.lon = 360.0 * erand48(seed);
+            cen.lat = (i == 1) ? 90.0 : 180.0 * erand48(seed) - 90.0;
+            ret = scisql_s2ellipse_init(&e, &cen, M, m, 360.0 * erand48(seed));
+            SCISQL_ASSERT(ret == 0, "scisql_s2ellipse_init() failed");
+            scisql_sctov3(&c, &cen);
+            for (level = 0; level <= 16; level += 4) {
+                ids = scisql_s2ellipse_htmids(ids, &e, level, SIZE_MAX);
+                SCISQL_ASSERT(ids != 0, "scisql_s2ellipse_htmids() failed");
+                circle = scisql_s2circle_htmids(circle, &c, r, level, SIZE_MAX);
+                SCISQL_ASSERT(circle != 0, "scisql_s2circle_htmids() failed");
+                SCISQL_ASSERT(ids->n == 0 || countIds(ids) <= countIds(circle),
+                              "ellipse coverage larger than bounding circle "
+                              "coverage");
+                SCISQL_ASSERT(i != 0 || ids->n == 0,
+                              "degenerate ellipse coverage is not empty");
+                for (j = 0; j < 1000; ++j) {
+                    scisql_v3 v;
+                    double d = r * SCISQL_RAD_PER_DEG;
+                    v.x = c.x + d * (2.0 * erand48(seed) - 1.0);
+                    v.y = c.y + d * (2.0 * erand48(seed) - 1.0);
+                    v.z = c.z + d * (2.0 * erand48(seed) - 1.0);
+                    scisql_v3_normalize(&v, &v);
+                    if (scisql_s2ellipse_cv3(&e, &v) == 0) {
+                        continue;
+                    }
+                    SCISQL_ASSERT(inRanges(ids, scisql_v3_htmid(&v, level)),
+                                  "point inside ellipse not covered");
+                }
+                ids = scisql_s2ellipse_htmids(ids, &e, level, 16);
+                SCISQL_ASSERT(ids != 0 && ids->n <= 16,
+                              "scisql_s2ellipse_htmids() failed");
+            }
+        }
+    }
+    free(circle);
+    free(ids);
+}
+
+
+/*  Tests HTM indexing of longitude/latitude boxes: random points inside
+    random boxes (including boxes spanning the 0/360 degree longitude
+    discontinuity, boxes containing a pole and boxes spanning all
+    longitudes) must have HTM IDs in the box coverage, while points far
+    from the box in latitude must not.
+ */
+static void testBoxes() {
+    static const double widths[4] = { 0.01, 5.0, 200.0, 400.0 };
+    unsigned short seed[3] = { 7, 11, 13 };
+    scisql_s2box b;
+    scisql_sc bmin, bmax;
+    scisql_ids *ids = 0;
+    int i, j, k, level, ret;
+
+    SCISQL_ASSERT(scisql_s2box_htmids(0, 0, 0, SIZE_MAX) == 0,
+                  "scisql_s2box_htmids() should have failed");
+    /* empty box */
+    bmin.lon = 0.0; bmin.lat = 10.0;
+    bmax.lon = 10.0; bmax.lat = 0.0;
+    ret = scisql_s2box_init(&b, &bmin, &bmax);
+    SCISQL_ASSERT(ret == 0, "scisql_s2box_init() failed");
+    ids = scisql_s2box_htmids(ids, &b, 10, SIZE_MAX);
+    SCISQL_ASSERT(ids != 0 && ids->n == 0, "empty box coverage is not empty");
+    /* whole sky */
+    bmin.lon = 0.0; bmin.lat = -90.0;
+    bmax.lon = 360.0; bmax.lat = 90.0;
+    ret = scisql_s2box_init(&b, &bmin, &bmax);
+    SCISQL_ASSERT(ret == 0, "scisql_s2box_init() failed");
+    ids = scisql_s2box_htmids(ids, &b, 10, SIZE_MAX);
+    SCISQL_ASSERT(ids != 0 && ids->n == 1 &&
+                  countIds(ids) == 8 * ((int64_t) 1 << 20),
+                  "whole sky box coverage is incomplete");
+    for (k = 0; k < 4; ++k) {
+        for (i = 0; i < 20; ++i) {
+            double w = widths[k] * (0.5 + erand48(seed));
+            double h = (k < 2) ? w : 30.0 * erand48(seed);
+            bmin.lon = 360.0 * erand48(seed);
+            bmax.lon = bmin.lon + w;
+            if (i == 0) {
+                /* north polar cap */
+                bmin.lat = 90.0 - h;
+                bmax.lat = 90.0;
+            } else if (i == 1) {
+                /* south polar cap */
+                bmin.lat = -90.0;
+                bmax.lat = h - 90.0;
+            } else {
+                bmin.lat = (180.0 - h) * erand48(seed) - 90.0;
+                bmax.lat = bmin.lat + h;
+            }
+            if ((i & 1) == 0 && bmax.lon > 360.0 && w < 360.0) {
+                /* wrap-around expressed with lonMax < lonMin */
+                bmax.lon -= 360.0;
+            }
+            ret = scisql_s2box_init(&b, &bmin, &bmax);
+            SCISQL_ASSERT(ret == 0, "scisql_s2box_init() failed");
+            for (level = 0; level <= 16; level += 4) {
+                double far = 180.0 / (double) (1 << level);
+                ids = scisql_s2box_htmids(ids, &b, level, SIZE_MAX);
+                SCISQL_ASSERT(ids != 0, "scisql_s2box_htmids() failed");
+                for (j = 0; j < 1000; ++j) {
+                    scisql_sc p;
+                    scisql_v3 v;
+                    p.lon = bmin.lon + (w + 2.0 * far) * erand48(seed) - far;
+                    p.lat = bmin.lat + (h + 2.0 * far) * erand48(seed) - far;
+                    if (j < 4) {
+                        /* box corners */
+                        p.lon = (j & 1) ? bmax.lon : bmin.lon;
+                        p.lat = (j & 2) ? bmax.lat : bmin.lat;
+                    }
+                    if (p.lat < -90.0 || p.lat > 90.0) {
+                        continue;
+                    }
+                    p.lon = scisql_angred(p.lon);
+                    scisql_sctov3(&v, &p);
+                    if (scisql_s2box_csc(&b, &p) != 0) {
+                        SCISQL_ASSERT(inRanges(ids, scisql_v3_htmid(&v, level)),
+                                      "point inside box not covered");
+                    }
+                }
+                if (level >= 4 && bmin.lat - 2.0 * far > -90.0) {
+                    scisql_sc p;
+                    scisql_v3 v;
+                    p.lon = bmin.lon;
+                    p.lat = bmin.lat - 2.0 * far;
+                    scisql_sctov3(&v, &p);
+                    SCISQL_ASSERT(!inRanges(ids, scisql_v3_htmid(&v, level)),
+                                  "point far outside box covered");
+                }
+                ids = scisql_s2box_htmids(ids, &b, level, 16);
+                SCISQL_ASSERT(ids != 0 && ids->n <= 16,
+                              "scisql_s2box_htmids() failed");
+            }
+        }
+    }
+    free(ids);
+}
+
+
+/*  Tests the compact encoding of HTM ID range lists: coverages must round
+    trip through scisql_ids_encode() and scisql_ids_decode(), well formed
+    raw range arrays must decode unchanged, and malformed inputs must be
+    rejected.
+ */
+static void testEncoding() {
+    unsigned short seed[3] = { 19, 23, 29 };
+    scisql_ids *ids = 0;
+    scisql_ids *dec = 0;
+    unsigned char *buf = 0;
+    size_t rawsz = 0, encsz = 0;
+    int i, level;
+
+    for (i = 0; i < 20; ++i) {
+        scisql_sc cen;
+        scisql_v3 c;
+        cen.lon = 360.0 * erand48(seed);
+        cen.lat = 180.0 * erand48(seed) - 90.0;
+        scisql_sctov3(&c, &cen);
+        for (level = 0; level <= 20; level += 5) {
+            size_t len, j;
+            ids = scisql_s2circle_htmids(ids, &c, 0.1 + erand48(seed),
+                                         level, SIZE_MAX);
+            SCISQL_ASSERT(ids != 0, "scisql_s2circle_htmids() failed");
+            buf = (unsigned char *) realloc(
+                buf, SCISQL_HTM_ENCODED_SIZE(ids->n));
+            SCISQL_ASSERT(buf != 0, "memory allocation failed");
+            len = scisql_ids_encode(buf, ids);
+            SCISQL_ASSERT(len <= SCISQL_HTM_ENCODED_SIZE(ids->n),
+                          "encoding overflowed its size bound");
+            if (level == 20) {
+                rawsz += 2 * sizeof(int64_t) * ids->n;
+                encsz += len;
+            }
+            dec = scisql_ids_decode(dec, buf, len);
+            SCISQL_ASSERT(dec != 0 && dec->n == ids->n &&
+                          memcmp(dec->ranges, ids->ranges,
+                                 2 * sizeof(int64_t) * ids->n) == 0,
+                          "encoded range list did not round trip");
+            /* truncated input */
+            if (len > 8) {
+                dec = scisql_ids_decode(dec, buf, len - 1);
+                SCISQL_ASSERT(dec == 0, "truncated encoding was decoded");
+            }
+            /* raw input */
+            dec = scisql_ids_decode(dec, (unsigned char *) ids->ranges,
+                                    2 * sizeof(int64_t) * ids->n);
+            SCISQL_ASSERT(dec != 0 && dec->n == ids->n,
+                          "raw range list was not decoded");
+            for (j = 0; j < 2 * ids->n; ++j) {
+                SCISQL_ASSERT(dec->ranges[j] == ids->ranges[j],
+                              "raw range list did not round trip");
+            }
+        }
+    }
+    SCISQL_ASSERT(encsz * 4 < rawsz, "level 20 ranges did not compress well");
+    dec = scisql_ids_decode(dec, (unsigned char *) "scisqlR", 7);
+    SCISQL_ASSERT(dec == 0, "malformed range list was decoded");
+    dec = scisql_ids_decode(dec, (unsigned char *) "scisqlR1\x05\x01", 10);
+    SCISQL_ASSERT(dec == 0, "malformed range list was decoded");
+    /* raw ranges that are reversed, negative, unsorted or overlapping */
+    for (i = 0; i < 4; ++i) {
+        static const int64_t bad[4][4] = {
+            { 10, 9, 20, 30 }, { -1, 5, 20, 30 },
+            { 20, 30, 0, 5 }, { 0, 20, 20, 30 }
+        };
+        dec = scisql_ids_decode(dec, (const unsigned char *) bad[i],
+                                sizeof(bad[i]));
+        SCISQL_ASSERT(dec == 0, "malformed raw range list was decoded");
+    }
+    free(buf);
+    free(ids);
+}
+
+
+/*  Tests set operations and binary search membership tests on HTM ID
+    range lists against linear membership tests, and conversion of range
+    lists between subdivision levels.
+ */
+static void testSetOps() {
+    unsigned short seed[3] = { 31, 37, 41 };
+    scisql_ids *a = 0, *b = 0, *u = 0, *x = 0, *d = 0, *c = 0;
+    int i, j;
+
+    for (i = 0; i < 50; ++i) {
+        scisql_sc cen;
+        scisql_v3 va, vb;
+        cen.lon = 10.0 * erand48(seed);
+        cen.lat = 10.0 * erand48(seed);
+        scisql_sctov3(&va, &cen);
+        cen.lon = 10.0 * erand48(seed);
+        cen.lat = 10.0 * erand48(seed);
+        scisql_sctov3(&vb, &cen);
+        a = scisql_s2circle_htmids(a, &va, 5.0 * erand48(seed), 8, SIZE_MAX);
+        b = scisql_s2circle_htmids(b, &vb, 5.0 * erand48(seed), 8,
+                                   (i & 1) ? 4 : SIZE_MAX);
+        SCISQL_ASSERT(a != 0 && b != 0, "scisql_s2circle_htmids() failed");
+        u = scisql_ids_union(u, a, b);
+        x = scisql_ids_intersect(x, a, b);
+        d = scisql_ids_subtract(d, a, b);
+        SCISQL_ASSERT(u != 0 && x != 0 && d != 0, "set operation failed");
+        for (j = 0; j < 2000; ++j) {
+            /* level 8 IDs lie in [8*4^8, 16*4^8) */
+            int64_t id = 8 * 65536 + (int64_t) (8 * 65536 * erand48(seed));
+            int ina = inRanges(a, id);
+            int inb = inRanges(b, id);
+            SCISQL_ASSERT(scisql_ids_contains(a, id) == ina &&
+                          scisql_ids_contains(b, id) == inb,
+                          "scisql_ids_contains() failed");
+            SCISQL_ASSERT(inRanges(u, id) == (ina || inb), "union failed");
+            SCISQL_ASSERT(inRanges(x, id) == (ina && inb),
+                          "intersection failed");
+            SCISQL_ASSERT(inRanges(d, id) == (ina && !inb),
+                          "difference failed");
+        }
+        for (j = 0; j < (int) a->n; ++j) {
+            int64_t lo = a->ranges[2*j], hi = a->ranges[2*j + 1];
+            SCISQL_ASSERT(scisql_ids_contains(a, lo) == 1 &&
+                          scisql_ids_contains(a, hi) == 1 &&
+                          scisql_ids_contains(a, lo - 1) == 0 &&
+                          scisql_ids_contains(a, hi + 1) == 0,
+                          "scisql_ids_contains() failed at range end points");
+        }
+        /* results must be sorted and coalesced */
+        for (j = 1; j < (int) u->n; ++j) {
+            SCISQL_ASSERT(u->ranges[2*j] > u->ranges[2*j - 1] + 1,
+                          "union ranges are not coalesced");
+        }
+        /* refining is exact, and coarsening undoes it */
+        c = scisql_ids_union(c, a, a);
+        SCISQL_ASSERT(c != 0 && c->n == a->n, "union with self failed");
+        c = scisql_ids_tolevel(c, 10);
+        SCISQL_ASSERT(c != 0 && countIds(c) == 16 * countIds(a),
+                      "scisql_ids_tolevel() failed");
+        c = scisql_ids_tolevel(c, 8);
+        SCISQL_ASSERT(c != 0 && c->n == a->n &&
+                      memcmp(c->ranges, a->ranges,
+                             2 * sizeof(int64_t) * a->n) == 0,
+                      "scisql_ids_tolevel() did not round trip");
+    }
+    /* ranges mixing levels are rejected */
+    a->n = 1;
+    a->ranges[0] = 8;
+    a->ranges[1] = 40;
+    a = scisql_ids_tolevel(a, 3);
+    SCISQL_ASSERT(a == 0, "scisql_ids_tolevel() should have failed");
+    free(b);
+    free(u);
+    free(x);
+    free(d);
+    free(c);
+}
+
+
+/*  Returns the number of vertices shared by two HTM triangles.
+ */
+static int sharedVerts(const scisql_htmtri *t1, const scisql_htmtri *t2) {
+    int i, j, n = 0;
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < 3; ++j) {
+            if (scisql_v3_dist2(&t1->verts[i], &t2->verts[j]) < 1e-24) {
+                ++n;
+            }
+        }
+    }
+    return n;
+}
+
+
+/*  Tests HTM neighbor enumeration: edge neighbors must share 2 vertices
+    with a triangle, vertex neighbors exactly 1, and the neighbor relation
+    must be symmetric.
+ */
+static void testNeighbors() {
+    unsigned short seed[3] = { 43, 47, 53 };
+    int64_t nb[SCISQL_HTM_MAX_NEIGHBORS];
+    int64_t nb2[SCISQL_HTM_MAX_NEIGHBORS];
+    int i, j, k, n, level;
+
+    SCISQL_ASSERT(scisql_htm_neighbors(nb, 7) == -1,
+                  "scisql_htm_neighbors() should have failed");
+    /* each root triangle touches all others except its antipode */
+    for (i = 8; i < 16; ++i) {
+        n = scisql_htm_neighbors(nb, i);
+        SCISQL_ASSERT(n == 6, "root triangle should have 6 neighbors");
+    }
+    for (level = 0; level <= SCISQL_HTM_MAX_LEVEL; level += 4) {
+        for (i = 0; i < 50; ++i) {
+            scisql_htmtri tri, ntri;
+            scisql_sc p;
+            scisql_v3 v;
+            int64_t id;
+            p.lon = 360.0 * erand48(seed);
+            p.lat = 180.0 * erand48(seed) - 90.0;
+            scisql_sctov3(&v, &p);
+            id = scisql_v3_htmid(&v, level);
+            n = scisql_htm_neighbors(nb, id);
+            SCISQL_ASSERT(n >= 6 && n <= SCISQL_HTM_MAX_NEIGHBORS,
+                          "scisql_htm_neighbors() failed");
+            scisql_htmtri_init(&tri, id);
+            for (j = 0; j < n; ++j) {
+                int found = 0;
+                SCISQL_ASSERT(scisql_htm_level(nb[j]) == level,
+                              "neighbor at wrong level");
+                SCISQL_ASSERT(j == 0 || j == 3 || nb[j] > nb[j - 1],
+                              "neighbors not sorted");
+                scisql_htmtri_init(&ntri, nb[j]);
+                SCISQL_ASSERT(sharedVerts(&tri, &ntri) == (j < 3 ? 2 : 1),
+                              "neighbor does not share expected vertices");
+                k = scisql_htm_neighbors(nb2, nb[j]);
+                SCISQL_ASSERT(k > 0, "scisql_htm_neighbors() failed");
+                while (k > 0) {
+                    found |= (nb2[--k] == id);
+                }
+                SCISQL_ASSERT(found, "neighbor relation is not symmetric");
+            }
+        }
+    }
+}
+
+
+/*  Returns the number of triangles in the smallest MOC covering the same
+    HTM IDs as ids, a list of ranges at the given level.
+ */
+static size_t mocSize(const scisql_ids *ids, int level) {
+    size_t i, n = 0;
+    for (i = 0; i < ids->n; ++i) {
+        int64_t min_id = ids->ranges[2*i];
+        int64_t max_id = ids->ranges[2*i + 1];
+        while (min_id <= max_id) {
+            int k = 0;
+            while (k < level &&
+                   (min_id & ((((int64_t) 4) << 2*k) - 1)) == 0 &&
+                   max_id - min_id >= (((int64_t) 4) << 2*k) - 1) {
+                ++k;
+            }
+            min_id += ((int64_t) 1) << 2*k;
+            ++n;
+        }
+    }
+    return n;
+}
+
+/*  Checks that moc, computed alongside the range list ids at the given
+    level, is the smallest MOC covering the same HTM IDs as ids.
+ */
+static void checkMoc(const scisql_moc *moc, const scisql_ids *ids, int level) {
+    scisql_moc *copy = scisql_ids_tomoc(0, ids, level);
+    size_t j;
+
+    SCISQL_ASSERT(copy != 0 && copy->n == moc->n &&
+                  memcmp(copy->cells, moc->cells,
+                         sizeof(int64_t) * moc->n) == 0,
+                  "MOC does not match its range list");
+    SCISQL_ASSERT(moc->n == mocSize(ids, level), "MOC is not minimal");
+    /* every range needs at least one triangle, and at most 3 per level
+       on either side of the root triangles it spans */
+    SCISQL_ASSERT(moc->n >= ids->n &&
+                  moc->n <= ids->n * (size_t) (6 * level + 8),
+                  "MOC size is inconsistent with its range list");
+    for (j = 0; j < moc->n; ++j) {
+        int64_t id = moc->cells[j];
+        SCISQL_ASSERT(scisql_htm_level(id) >= 0 &&
+                      scisql_htm_level(id) <= level,
+                      "MOC contains an invalid HTM ID");
+        /* no 4 siblings below the root triangles are present */
+        SCISQL_ASSERT(j < 3 || id < 32 || (id & 3) != 3 ||
+                      moc->cells[j - 1] != id - 1 ||
+                      moc->cells[j - 2] != id - 2 ||
+                      moc->cells[j - 3] != id - 3,
+                      "MOC is not minimal");
+    }
+    free(copy);
+}
+
+/*  Tests multi-order coverage maps: maps computed during HTM coverage
+    must be minimal, match the ranges computed alongside them, and expand
+    back to those ranges.
+ */
+static void testMoc() {
+    unsigned short seed[3] = { 59, 61, 67 };
+    scisql_ids *ids = 0, *out = 0, *c = 0;
+    scisql_moc *moc = 0;
+    scisql_s2cpoly poly;
+    scisql_v3 verts[12];
+    double r;
+    int i;
+    size_t maxranges;
+
+    for (i = 0; i < 100; ++i) {
+        scisql_sc cen;
+        scisql_v3 v;
+        int level = 4 + (i % 12);
+        cen.lon = 360.0 * erand48(seed);
+        cen.lat = 180.0 * erand48(seed) - 90.0;
+        scisql_sctov3(&v, &cen);
+        r = 10.0 * erand48(seed);
+        maxranges = (i & 1) ? 16 : SIZE_MAX;
+        if (i % 4 < 2) {
+            ids = scisql_s2circle_htmids(ids, &v, r, level, maxranges);
+            moc = scisql_s2circle_htmmoc(moc, &v, r, level, maxranges);
+        } else {
+            irregularNgon(verts, 12, &v, r + 0.01, 1, seed);
+            SCISQL_ASSERT(scisql_s2cpoly_init(&poly, verts, 12) == 0,
+                          "failed to build polygon");
+            ids = scisql_s2cpoly_htmids(ids, &poly, level, maxranges);
+            moc = scisql_s2cpoly_htmmoc(moc, &poly, level, maxranges);
+        }
+        SCISQL_ASSERT(ids != 0 && moc != 0, "coverage computation failed");
+        checkMoc(moc, ids, level);
+        out = scisql_moc_toids(out, moc->cells, moc->n, level);
+        SCISQL_ASSERT(out != 0 && out->n == ids->n &&
+                      memcmp(out->ranges, ids->ranges,
+                             2 * sizeof(int64_t) * ids->n) == 0,
+                      "scisql_moc_toids() did not round trip");
+        /* expanding at a coarser level matches coarsening the ranges */
+        out = scisql_moc_toids(out, moc->cells, moc->n, level - 2);
+        c = scisql_ids_union(c, ids, ids);
+        c = scisql_ids_tolevel(c, level - 2);
+        SCISQL_ASSERT(out != 0 && c != 0 && out->n == c->n &&
+                      memcmp(out->ranges, c->ranges,
+                             2 * sizeof(int64_t) * c->n) == 0,
+                      "scisql_moc_toids() failed at a coarser level");
+    }
+    /* the whole sky is represented by the root triangles */
+    moc = scisql_s2circle_htmmoc(moc, &verts[0], 180.0, 10, SIZE_MAX);
+    SCISQL_ASSERT(moc != 0 && moc->n == 8 && moc->cells[0] == 8 &&
+                  moc->cells[7] == 15, "whole sky MOC is incorrect");
+    /* with a budget of 2^20 ranges, the effective subdivision level is
+       reduced during the descent, but no gaps are filled in afterwards */
+    ids = scisql_s2circle_htmids(ids, &verts[0], 30.0, 20, 1 << 20);
+    moc = scisql_s2circle_htmmoc(moc, &verts[0], 30.0, 20, 1 << 20);
+    SCISQL_ASSERT(ids != 0 && moc != 0 && ids->n > 1 << 18,
+                  "coverage computation failed");
+    checkMoc(moc, ids, 20);
+    /* triangles out of order are rejected */
+    moc->n = 2;
+    moc->cells[0] = 9;
+    moc->cells[1] = 35;
+    out = scisql_moc_toids(out, moc->cells, moc->n, 3);
+    SCISQL_ASSERT(out == 0, "scisql_moc_toids() should have failed");
+    free(ids);
+    free(moc);
+    free(c);
+}
+
+
 int main(int argc SCISQL_UNUSED, char **argv SCISQL_UNUSED) {
     testPoints();
     testRandomPoints();
+    testBatch();
+    testPrecomputed();
+    testParallelSort();
     testCircles();
     testPolygons();
+    testPolyBatch();
+    testLargePolygons();
+    testSimplePolygons();
     testAdaptiveCircle();
     testAdaptivePoly();
+    testClassified();
+    testEllipses();
+    testBoxes();
+    testEncoding();
+    testSetOps();
+    testNeighbors();
+    testMoc();
     return 0;
 }
 
@@ -0,0 +1,105 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import random
+import sys
+import unittest
+
+from base import *
+
+
+class S2BoxHtmRangesTestCase(MySqlUdfTestCase):
+    """s2BoxHtmRanges() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        self._boxes = [(10.0, 20.0, 12.0, 21.0),
+                       (359.0, -1.0, 1.0, 1.0),
+                       (0.0, 88.0, 360.0, 90.0),
+                       (100.0, -30.0, 260.0, -29.5)]
+        super(S2BoxHtmRangesTestCase, self).setUp()
+
+    def _s2BoxHtmRanges(self, *args):
+        stmt = "SELECT %ss2BoxHtmRanges(%s)" % (
+            self._prefix, ",".join(map(dbparam, args)))
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        if rows[0][0] is None:
+            return None
+        return unpackRanges(rows[0][0])
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for i in range(4):
+            a = [0.0, 0.0, 1.0, 1.0, 10, -1]
+            a[i] = None
+            self.assertEqual(self._s2BoxHtmRanges(*a), None)
+        for a in ((0.0, -91.0, 1.0, 1.0, 10, -1),
+                  (0.0, 0.0, 1.0, 91.0, 10, -1),
+                  (400.0, 0.0, 1.0, 1.0, 10, -1),
+                  (0.0, 0.0, 1.0, 1.0, -1, -1),
+                  (0.0, 0.0, 1.0, 1.0, 25, -1)):
+            self.assertEqual(self._s2BoxHtmRanges(*a), None)
+        # latMin > latMax gives an empty box
+        self.assertEqual(self._s2BoxHtmRanges(0.0, 1.0, 1.0, 0.0, 10, -1), [])
+        self.assertRaises(Exception, self._s2BoxHtmRanges,
+                          0.0, 0.0, 1.0, 1.0, 10)
+        self.assertRaises(Exception, self._s2BoxHtmRanges,
+                          0.0, 0.0, 1.0, 1.0, 10.0, -1)
+
+    def testCoverage(self):
+        """Test that the ranges cover all points inside a box.
+        """
+        for box in self._boxes:
+            ranges = self._s2BoxHtmRanges(*(box + (10, -1)))
+            self.assertTrue(len(ranges) > 0)
+            # coarsened ranges must contain the full ranges
+            coarse = self._s2BoxHtmRanges(*(box + (10, 4)))
+            self.assertTrue(len(coarse) <= 4)
+            for r in ranges:
+                c = findRange(r[0], coarse)
+                self.assertTrue(c is not None and r[1] <= c[1])
+            lonMin, latMin, lonMax, latMax = box
+            if lonMax < lonMin:
+                lonMax += 360.0
+            for i in range(200):
+                # sample a slightly larger box to exercise its edges
+                a = random.uniform(lonMin - 0.5, lonMax + 0.5) % 360.0
+                d = random.uniform(max(latMin - 0.5, -90.0),
+                                   min(latMax + 0.5, 90.0))
+                stmt = "SELECT %ss2HtmId(%s, %s, 10), %ss2PtInBox(%s)" % (
+                    self._prefix, dbparam(a), dbparam(d), self._prefix,
+                    ",".join(map(dbparam, (a, d) + box)))
+                rows = self.query(stmt)
+                self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+                if rows[0][1] == 1:
+                    self.assertNotEqual(findRange(rows[0][0], ranges), None,
+                                        stmt + ": point not covered")
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2BoxHtmRangesTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
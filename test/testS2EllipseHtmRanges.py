@@ -0,0 +1,105 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import random
+import sys
+import unittest
+
+from base import *
+
+
+class S2EllipseHtmRangesTestCase(MySqlUdfTestCase):
+    """s2EllipseHtmRanges() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        self._ellipses = [(10.0, 20.0, 3600.0, 1800.0, 30.0),
+                          (0.2, -45.0, 7200.0, 360.0, 100.0),
+                          (45.0, 89.5, 3600.0, 3600.0, 0.0)]
+        super(S2EllipseHtmRangesTestCase, self).setUp()
+
+    def _s2EllipseHtmRanges(self, *args):
+        stmt = "SELECT %ss2EllipseHtmRanges(%s)" % (
+            self._prefix, ",".join(map(dbparam, args)))
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        if rows[0][0] is None:
+            return None
+        return unpackRanges(rows[0][0])
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for i in range(5):
+            a = [0.0, 0.0, 3600.0, 1800.0, 0.0, 10, -1]
+            a[i] = None
+            self.assertEqual(self._s2EllipseHtmRanges(*a), None)
+        for a in ((0.0, 91.0, 3600.0, 1800.0, 0.0, 10, -1),
+                  (0.0, -91.0, 3600.0, 1800.0, 0.0, 10, -1),
+                  (0.0, 0.0, 3600.0, -1.0, 0.0, 10, -1),
+                  (0.0, 0.0, 1800.0, 3600.0, 0.0, 10, -1),
+                  (0.0, 0.0, 36001.0, 1800.0, 0.0, 10, -1),
+                  (0.0, 0.0, 3600.0, 1800.0, 0.0, -1, -1),
+                  (0.0, 0.0, 3600.0, 1800.0, 0.0, 25, -1)):
+            self.assertEqual(self._s2EllipseHtmRanges(*a), None)
+        self.assertRaises(Exception, self._s2EllipseHtmRanges,
+                          0.0, 0.0, 3600.0, 1800.0, 0.0, 10)
+        self.assertRaises(Exception, self._s2EllipseHtmRanges,
+                          0.0, 0.0, 3600.0, 1800.0, 0.0, 10.0, -1)
+
+    def testCoverage(self):
+        """Test that the ranges cover all points inside an ellipse.
+        """
+        for ell in self._ellipses:
+            ra, dec, smaa = ell[0], ell[1], ell[2] / 3600.0
+            ranges = self._s2EllipseHtmRanges(*(ell + (10, -1)))
+            self.assertTrue(len(ranges) > 0)
+            # coarsened ranges must contain the full ranges
+            coarse = self._s2EllipseHtmRanges(*(ell + (10, 4)))
+            self.assertTrue(len(coarse) <= 4)
+            for r in ranges:
+                c = findRange(r[0], coarse)
+                self.assertTrue(c is not None and r[1] <= c[1])
+            for i in range(200):
+                d = random.uniform(max(dec - smaa, -90.0), min(dec + smaa, 90.0))
+                c = math.cos(math.radians(d))
+                if c * 180.0 < smaa:
+                    a = random.uniform(0.0, 360.0)
+                else:
+                    a = random.uniform(ra - smaa / c, ra + smaa / c) % 360.0
+                stmt = "SELECT %ss2HtmId(%s, %s, 10), %ss2PtInEllipse(%s)" % (
+                    self._prefix, dbparam(a), dbparam(d), self._prefix,
+                    ",".join(map(dbparam, (a, d) + ell)))
+                rows = self.query(stmt)
+                self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+                if rows[0][1] == 1:
+                    self.assertNotEqual(findRange(rows[0][0], ranges), None,
+                                        stmt + ": point not covered")
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2EllipseHtmRangesTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,247 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import random
+import sys
+import unittest
+
+from base import *
+
+
+def _spread(v):
+    r = 0
+    for i in range(32):
+        r |= ((v >> i) & 1) << (2*i)
+    return r
+
+
+def hpxId(lon, lat, order):
+    """Returns the nested HEALPix ID of a point, following the reference
+    HEALPix implementation.
+    """
+    nside = 1 << order
+    z = math.sin(math.radians(lat))
+    za = abs(z)
+    tt = (math.radians(lon) / (0.5 * math.pi)) % 4.0
+    if za <= 2.0 / 3.0:
+        t1 = nside * (0.5 + tt)
+        t2 = nside * z * 0.75
+        jp = int(t1 - t2)
+        jm = int(t1 + t2)
+        ifp = jp >> order
+        ifm = jm >> order
+        if ifp == ifm:
+            face = 4 if ifp == 4 else ifp + 4
+        elif ifp < ifm:
+            face = ifp
+        else:
+            face = ifm + 8
+        ix = jm & (nside - 1)
+        iy = nside - (jp & (nside - 1)) - 1
+    else:
+        ntt = min(3, int(tt))
+        tp = tt - ntt
+        tmp = nside * math.sqrt(3.0 * (1.0 - za))
+        jp = min(int(tp * tmp), nside - 1)
+        jm = min(int((1.0 - tp) * tmp), nside - 1)
+        if z >= 0:
+            face = ntt
+            ix = nside - jm - 1
+            iy = nside - jp - 1
+        else:
+            face = ntt + 8
+            ix = jp
+            iy = jm
+    return (face << 2*order) + _spread(ix) + (_spread(iy) << 1)
+
+
+def hpxRingId(lon, lat, order):
+    """Returns the ring scheme HEALPix ID of a point, following the
+    reference HEALPix implementation.
+    """
+    nside = 1 << order
+    z = math.sin(math.radians(lat))
+    za = abs(z)
+    tt = (math.radians(lon) / (0.5 * math.pi)) % 4.0
+    if za <= 2.0 / 3.0:
+        t1 = nside * (0.5 + tt)
+        t2 = nside * z * 0.75
+        jp = int(t1 - t2)
+        jm = int(t1 + t2)
+        ir = nside + 1 + jp - jm
+        kshift = 1 - (ir & 1)
+        ip = ((jp + jm - nside + kshift + 1) // 2) % (4 * nside)
+        return 2 * nside * (nside - 1) + (ir - 1) * 4 * nside + ip
+    tp = tt - int(tt)
+    tmp = nside * math.sqrt(3.0 * (1.0 - za))
+    jp = int(tp * tmp)
+    jm = int((1.0 - tp) * tmp)
+    ir = jp + jm + 1
+    ip = int(tt * ir) % (4 * ir)
+    if z > 0:
+        return 2 * ir * (ir - 1) + ip
+    return 12 * nside * nside - 2 * ir * (ir + 1) + ip
+
+
+class S2HpxTestCase(MySqlUdfTestCase):
+    """s2HpxId(), s2HpxNestToRing(), s2CircleHpxRanges() and
+    s2CPolyHpxRanges() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        super(S2HpxTestCase, self).setUp()
+
+    def _query(self, func, *args):
+        stmt = "SELECT %s%s(%s)" % (self._prefix, func, ",".join(args))
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return rows[0][0]
+
+    def _ranges(self, func, *args):
+        r = self._query(func, *args)
+        return None if r is None else unpackRanges(r)
+
+    def _checkCoverage(self, ranges, order, points, ptIn):
+        npix = 12 << 2*order
+        self.assertTrue(len(ranges) > 0)
+        self.assertEqual(mergeRanges(ranges), [tuple(r) for r in ranges])
+        self.assertTrue(ranges[0][0] >= 0 and ranges[-1][1] < npix)
+        for ra, dec in points:
+            stmt = "SELECT %ss2HpxId(%r, %r, %d), %s" % (
+                self._prefix, ra, dec, order, ptIn(ra, dec))
+            rows = self.query(stmt)
+            if rows[0][1] == 1:
+                self.assertNotEqual(findRange(rows[0][0], ranges), None,
+                                    stmt + ": point not covered")
+
+    def _points(self, ra, dec, delta, n=200):
+        points = []
+        for i in range(n):
+            d = random.uniform(max(dec - delta, -90.0), min(dec + delta, 90.0))
+            c = math.cos(math.radians(d))
+            if c * 180.0 < delta:
+                r = random.uniform(0.0, 360.0)
+            else:
+                r = random.uniform(ra - delta / c, ra + delta / c) % 360.0
+            points.append((r, d))
+        return points
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for a in (("NULL", "0", "5"), ("0", "NULL", "5"),
+                  ("0", "91", "5"), ("0", "-91", "5"),
+                  ("0", "0", "-1"), ("0", "0", "30")):
+            self.assertEqual(self._query("s2HpxId", *a), None)
+        self.assertRaises(Exception, self._query, "s2HpxId", "0", "0")
+        for a in (("NULL", "5"), ("0", "NULL"), ("-1", "0"), ("12", "0"),
+                  ("48", "1"), ("0", "-1"), ("0", "30")):
+            self.assertEqual(self._query("s2HpxNestToRing", *a), None)
+        self.assertRaises(Exception, self._query, "s2HpxNestToRing", "0")
+        for a in (("NULL", "0", "1", "5", "-1"), ("0", "91", "1", "5", "-1"),
+                  ("0", "0", "-1", "5", "-1"), ("0", "0", "181", "5", "-1"),
+                  ("0", "0", "1", "-1", "-1"), ("0", "0", "1", "30", "-1")):
+            self.assertEqual(self._query("s2CircleHpxRanges", *a), None)
+        poly = "%ss2CPolyToBin(0, 0, 1, 0, 0, 1)" % self._prefix
+        for a in (("NULL", "5", "-1"), ("'foo'", "5", "-1"),
+                  (poly, "-1", "-1"), (poly, "30", "-1")):
+            self.assertEqual(self._query("s2CPolyHpxRanges", *a), None)
+        # the whole sky
+        for order in (0, 3):
+            ranges = self._ranges("s2CircleHpxRanges",
+                                  "0", "0", "180", str(order), "-1")
+            self.assertEqual(ranges, [(0, (12 << 2*order) - 1)])
+
+    def testHpxId(self):
+        """Test s2HpxId() against a reference implementation.
+        """
+        self.assertEqual(self._query("s2HpxId", "0", "90", "0") < 4, True)
+        self.assertEqual(self._query("s2HpxId", "0", "-90", "0") >= 8, True)
+        for i in range(500):
+            ra = random.uniform(0.0, 360.0)
+            dec = math.degrees(math.asin(random.uniform(-1.0, 1.0)))
+            for order in (0, 1, 5, 12, 20):
+                self.assertEqual(self._query("s2HpxId", repr(ra), repr(dec),
+                                             str(order)),
+                                 hpxId(ra, dec, order),
+                                 "s2HpxId(%r, %r, %d)" % (ra, dec, order))
+
+    def testNestToRing(self):
+        """Test s2HpxNestToRing() against known values and a reference
+        implementation.
+        """
+        ring1 = (13, 5, 4, 0, 15, 7, 6, 1, 17, 9, 8, 2, 19, 11, 10, 3)
+        for i, r in enumerate(ring1):
+            self.assertEqual(self._query("s2HpxNestToRing", str(i), "1"), r)
+        for i in range(500):
+            ra = random.uniform(0.0, 360.0)
+            dec = math.degrees(math.asin(random.uniform(-1.0, 1.0)))
+            for order in (0, 1, 5, 12, 20):
+                nest = "%ss2HpxId(%r, %r, %d)" % (self._prefix, ra, dec, order)
+                self.assertEqual(self._query("s2HpxNestToRing", nest,
+                                             str(order)),
+                                 hpxRingId(ra, dec, order),
+                                 "s2HpxNestToRing(%s, %d)" % (nest, order))
+
+    def testCircleRanges(self):
+        """Test that circle ranges cover all points inside a circle.
+        """
+        for ra, dec, radius in ((10.0, 20.0, 1.0), (359.5, 0.0, 0.75),
+                                (123.0, -89.5, 2.0)):
+            points = self._points(ra, dec, 1.5 * radius)
+            ptIn = lambda a, d: "%ss2PtInCircle(%r, %r, %r, %r, %r)" % (
+                self._prefix, a, d, ra, dec, radius)
+            for order in (4, 9):
+                ranges = self._ranges("s2CircleHpxRanges", repr(ra),
+                                      repr(dec), repr(radius), str(order), "-1")
+                self._checkCoverage(ranges, order, points, ptIn)
+                ranges = self._ranges("s2CircleHpxRanges", repr(ra),
+                                      repr(dec), repr(radius), str(order), "4")
+                self.assertTrue(len(ranges) <= 4)
+                self._checkCoverage(ranges, order, points, ptIn)
+
+    def testPolyRanges(self):
+        """Test that polygon ranges cover all points inside a polygon.
+        """
+        for poly in ((0.0, 0.0, 1.0, 0.0, 0.0, 1.0),
+                     (359.0, -1.0, 1.0, -1.0, 1.0, 1.0, 359.0, 1.0),
+                     (0.0, 88.0, 120.0, 88.0, 240.0, 88.0)):
+            verts = ",".join(map(dbparam, poly))
+            pbin = "%ss2CPolyToBin(%s)" % (self._prefix, verts)
+            points = self._points(poly[0], poly[1], 3.0)
+            ptIn = lambda a, d: "%ss2PtInCPoly(%r, %r, %s)" % (
+                self._prefix, a, d, verts)
+            for order in (4, 9):
+                ranges = self._ranges("s2CPolyHpxRanges", pbin, str(order), "-1")
+                self._checkCoverage(ranges, order, points, ptIn)
+                ranges = self._ranges("s2CPolyHpxRanges", pbin, str(order), "4")
+                self.assertTrue(len(ranges) <= 4)
+                self._checkCoverage(ranges, order, points, ptIn)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HpxTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,108 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import random
+import struct
+import sys
+import unittest
+
+from base import *
+
+
+class S2HtmInRangesTestCase(MySqlUdfTestCase):
+    """s2HtmInRanges() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        super(S2HtmInRangesTestCase, self).setUp()
+
+    def _s2HtmInRanges(self, result, htmId, ranges):
+        stmt = "SELECT %ss2HtmInRanges(%s, %%s)" % (self._prefix, dbparam(htmId))
+        self._cursor.execute(stmt, (ranges,))
+        rows = self._cursor.fetchall()
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        self.assertEqual(rows[0][0], result, "%s did not return %r for %r" % (
+            stmt, result, htmId))
+
+    def _pack(self, ranges):
+        return struct.pack("=%dq" % (2 * len(ranges)), *flatten(ranges))
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        ranges = [(8, 10), (12, 12), (15, 20)]
+        blob = self._pack(ranges)
+        self._s2HtmInRanges(0, None, blob)
+        self._s2HtmInRanges(0, 8, None)
+        self._s2HtmInRanges(None, 8, b"foo")
+        self._s2HtmInRanges(None, 8, self._pack([(10, 8)]))
+        self._s2HtmInRanges(0, 8, b"")
+        for i in range(25):
+            self._s2HtmInRanges(1 if findRange(i, ranges) else 0, i, blob)
+        self.assertRaises(Exception, self.query,
+                          "SELECT %ss2HtmInRanges(8)" % self._prefix)
+
+    def testColumnArgs(self):
+        """Test with arguments taken from a table.
+        """
+        level = 12
+        stmt = "SELECT %ss2CircleHtmRanges(20, 30, 0.5, %d, 16)" % (
+            self._prefix, level)
+        blob = self.query(stmt)[0][0]
+        ranges = unpackRanges(blob)
+        with self.tempTable("S2HtmInRanges", ("htmId BIGINT",
+                                              "ranges MEDIUMBLOB")) as t:
+            rows = []
+            expected = 0
+            for i in range(1000):
+                ra = random.uniform(19.0, 21.0)
+                dec = random.uniform(29.0, 31.0)
+                rows.append((ra, dec))
+            for ra, dec in rows:
+                htmId = self.query("SELECT %ss2HtmId(%r, %r, %d)" % (
+                    self._prefix, ra, dec, level))[0][0]
+                if findRange(htmId, ranges):
+                    expected += 1
+                t.insert((htmId, blob))
+            t.insert((None, blob))
+            self.assertTrue(0 < expected < len(rows))
+            # constant range list
+            self._cursor.execute("SET @r = %s" % stmt[len("SELECT "):])
+            for r in ("@r", stmt.join("()"),
+                      "%ss2HtmRangesEncode(@r)" % self._prefix):
+                n = self.query("""SELECT COUNT(*) FROM S2HtmInRanges
+                                  WHERE %ss2HtmInRanges(htmId, %s) = 1""" % (
+                               self._prefix, r))[0][0]
+                self.assertEqual(n, expected, r)
+            # range list varying per row
+            n = self.query("""SELECT COUNT(*) FROM S2HtmInRanges
+                              WHERE %ss2HtmInRanges(htmId, ranges) = 1""" %
+                           self._prefix)[0][0]
+            self.assertEqual(n, expected)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmInRangesTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,149 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import sys
+import unittest
+
+from base import *
+
+
+def _level(htmId):
+    return (htmId.bit_length() - 4) // 2
+
+
+def _expand(cells, level):
+    """Expands MOC cells to merged HTM ID ranges at the given level.
+    """
+    ranges = []
+    for c in cells:
+        shift = 2 * (level - _level(c))
+        if shift >= 0:
+            ranges.append((c << shift, ((c + 1) << shift) - 1))
+        else:
+            ranges.append((c >> -shift, c >> -shift))
+    ranges.sort()
+    merged = []
+    for r in ranges:
+        if merged and merged[-1][1] + 1 >= r[0]:
+            merged[-1] = (merged[-1][0], max(merged[-1][1], r[1]))
+        else:
+            merged.append(r)
+    return merged
+
+
+class S2HtmMocTestCase(MySqlUdfTestCase):
+    """s2CircleHtmMoc(), s2CPolyHtmMoc() and s2HtmMocToRanges() UDF
+    test-case.
+    """
+    def _query(self, expr):
+        stmt = "SELECT " + expr
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return rows[0][0]
+
+    def _int64s(self, expr):
+        r = self._query(expr)
+        return None if r is None else unpackInt64s(r)
+
+    def _ranges(self, expr):
+        r = self._query(expr)
+        return None if r is None else [tuple(x) for x in unpackRanges(r)]
+
+    def _check(self, moc, ranges, level):
+        """Checks a MOC against the range list computed for the same region.
+        """
+        cells = self._int64s(moc % level)
+        full = self._ranges(ranges % level)
+        self.assertEqual(list(cells), sorted(cells))
+        self.assertTrue(len(cells) >= len(full))
+        for i, c in enumerate(cells):
+            self.assertTrue(0 <= _level(c) <= level)
+            # no 4 siblings below the root triangles are present
+            if i >= 3 and c >= 32 and c & 3 == 3:
+                self.assertNotEqual(cells[i - 3:i + 1], (c - 3, c - 2, c - 1, c))
+        self.assertEqual(_expand(cells, level), full)
+        # expansion at the MOC level and at coarser levels
+        for l in range(max(level - 4, 0), level + 1):
+            expr = "%ss2HtmMocToRanges(%s, %d)" % (self._prefix, moc % level, l)
+            self.assertEqual(self._ranges(expr), _expand(cells, l))
+        # a coarser map covers the full range list
+        coarse = self._int64s(moc.replace("-1)", "8)") % level)
+        coarseRanges = _expand(coarse, level)
+        self.assertTrue(len(coarseRanges) <= 8)
+        for r in full:
+            c = findRange(r[0], coarseRanges)
+            self.assertTrue(c is not None and r[1] <= c[1])
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for args in ("NULL, 0, 1, 8, -1", "0, 91, 1, 8, -1",
+                     "0, 0, -1, 8, -1", "0, 0, 181, 8, -1",
+                     "0, 0, 1, -1, -1", "0, 0, 1, 25, -1"):
+            self.assertEqual(
+                self._query("%ss2CircleHtmMoc(%s)" % (self._prefix, args)), None)
+        poly = "%ss2CPolyToBin(0, 0, 1, 0, 0, 1)" % self._prefix
+        for args in ("NULL, 8, -1", "'foo', 8, -1",
+                     poly + ", -1, -1", poly + ", 25, -1"):
+            self.assertEqual(
+                self._query("%ss2CPolyHtmMoc(%s)" % (self._prefix, args)), None)
+        moc = "%ss2CircleHtmMoc(0, 0, 1, 8, -1)" % self._prefix
+        for args in ("NULL, 8", "'foo', 8", moc + ", -1", moc + ", 25"):
+            self.assertEqual(
+                self._query("%ss2HtmMocToRanges(%s)" % (self._prefix, args)), None)
+        self.assertRaises(Exception, self._query,
+                          "%ss2HtmMocToRanges(%s)" % (self._prefix, moc))
+        # the whole sky consists of the 8 root triangles
+        self.assertEqual(self._int64s(
+            "%ss2CircleHtmMoc(0, 0, 180, 10, -1)" % self._prefix),
+            tuple(range(8, 16)))
+
+    def testCircles(self):
+        """Test circle MOCs against circle range lists.
+        """
+        for ra, dec, radius in ((10.0, 20.0, 1.0), (359.5, 0.0, 5.0),
+                                (123.0, -89.5, 2.0)):
+            args = "%r, %r, %r, %%d, -1" % (ra, dec, radius)
+            moc = "%ss2CircleHtmMoc(%s)" % (self._prefix, args)
+            ranges = "%ss2CircleHtmRanges(%s)" % (self._prefix, args)
+            for level in (6, 10, 14):
+                self._check(moc, ranges, level)
+
+    def testPolygons(self):
+        """Test polygon MOCs against polygon range lists.
+        """
+        for verts in ("0, 0, 1, 0, 0, 1",
+                      "355, -5, 5, -5, 5, 5, 355, 5",
+                      "0, 88, 120, 88, 240, 88"):
+            args = "%ss2CPolyToBin(%s), %%d, -1" % (self._prefix, verts)
+            moc = "%ss2CPolyHtmMoc(%s)" % (self._prefix, args)
+            ranges = "%ss2CPolyHtmRanges(%s)" % (self._prefix, args)
+            for level in (6, 10, 14):
+                self._check(moc, ranges, level)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmMocTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,101 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import random
+import sys
+import unittest
+
+from base import *
+
+
+class S2HtmNeighborsTestCase(MySqlUdfTestCase):
+    """s2HtmNeighbors() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        super(S2HtmNeighborsTestCase, self).setUp()
+
+    def _s2HtmNeighbors(self, htmId):
+        stmt = "SELECT %ss2HtmNeighbors(%s)" % (self._prefix, dbparam(htmId))
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        if rows[0][0] is None:
+            return None
+        return unpackInt64s(rows[0][0])
+
+    def _s2HtmId(self, ra, dec, level):
+        stmt = "SELECT %ss2HtmId(%r, %r, %d)" % (self._prefix, ra, dec, level)
+        return self.query(stmt)[0][0]
+
+    def _checkNeighbors(self, htmId):
+        n = self._s2HtmNeighbors(htmId)
+        self.assertTrue(6 <= len(n) <= 12, repr(n))
+        self.assertEqual(list(n[:3]), sorted(n[:3]))
+        self.assertEqual(list(n[3:]), sorted(n[3:]))
+        self.assertEqual(len(set(n)), len(n))
+        self.assertFalse(htmId in n)
+        for i in n:
+            self.assertEqual(i.bit_length(), htmId.bit_length())
+        return n
+
+    def testConstArgs(self):
+        """Test with constant and invalid arguments.
+        """
+        for htmId in (None, -1, 0, 7, 16, 1 << 60):
+            self.assertEqual(self._s2HtmNeighbors(htmId), None)
+        self.assertRaises(Exception, self.query,
+                          "SELECT %ss2HtmNeighbors()" % self._prefix)
+        # root triangles: all but the opposite one are neighbors
+        for htmId in range(8, 16):
+            self.assertEqual(len(self._checkNeighbors(htmId)), 6)
+
+    def testRandom(self):
+        """Test symmetry of the neighbor relation, and that points close to
+        a point lie in its triangle or in a neighbor.
+        """
+        for level in (1, 5, 12, 20):
+            # triangle edges are at least 2^-(level + 1) radians long
+            eps = math.degrees(math.ldexp(1.0, -level - 1)) * 0.01
+            for i in range(20):
+                ra = random.uniform(0.0, 360.0)
+                dec = math.degrees(math.asin(random.uniform(-1.0, 1.0)))
+                htmId = self._s2HtmId(ra, dec, level)
+                n = self._checkNeighbors(htmId)
+                for j in n[:3]:
+                    self.assertTrue(htmId in self._s2HtmNeighbors(j)[:3])
+                for j in n[3:]:
+                    self.assertTrue(htmId in self._s2HtmNeighbors(j)[3:])
+                c = max(math.cos(math.radians(dec)), 1e-6)
+                for j in range(10):
+                    d = max(min(dec + random.uniform(-eps, eps), 90.0), -90.0)
+                    a = (ra + random.uniform(-eps, eps) / c) % 360.0
+                    near = self._s2HtmId(a, d, level)
+                    self.assertTrue(near == htmId or near in n)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmNeighborsTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
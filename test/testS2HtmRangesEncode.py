@@ -0,0 +1,91 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import struct
+import sys
+import unittest
+
+from base import *
+
+
+class S2HtmRangesEncodeTestCase(MySqlUdfTestCase):
+    """s2HtmRangesEncode() and s2HtmRangesDecode() UDF test-case.
+    """
+    def _query(self, stmt, *params):
+        self._cursor.execute(stmt, params or None)
+        rows = self._cursor.fetchall()
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return rows[0]
+
+    def _pack(self, ranges):
+        return struct.pack("=%dq" % (2 * len(ranges)), *flatten(ranges))
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for func in ("s2HtmRangesEncode", "s2HtmRangesDecode"):
+            stmt = "SELECT %s%s(%%s)" % (self._prefix, func)
+            self.assertEqual(self._query(stmt, None)[0], None)
+            self.assertEqual(self._query(stmt, b"foo")[0], None)
+            # unsorted, overlapping or negative raw ranges are malformed
+            for ranges in ([(5, 3)], [(4, 9), (9, 12)], [(-1, 3)]):
+                self.assertEqual(self._query(stmt, self._pack(ranges))[0],
+                                 None)
+            self.assertRaises(Exception, self.query,
+                              "SELECT %s%s()" % (self._prefix, func))
+        # raw inputs are returned unchanged by the decoder
+        blob = self._pack([(3, 7), (10, 12), (2**62, 2**63 - 1)])
+        stmt = "SELECT %ss2HtmRangesDecode(%%s)" % self._prefix
+        self.assertEqual(bytes(self._query(stmt, blob)[0]), blob)
+
+    def testRoundTrip(self):
+        """Test that decoding an encoded range list gives back the original.
+        """
+        circle = "0.5, -30, %s, %d, -1"
+        for radius in (0.001, 0.1, 2.0):
+            for level in (6, 12, 18, 24):
+                ranges = "%ss2CircleHtmRanges(%s)" % (
+                    self._prefix, circle % (repr(radius), level))
+                stmt = """SELECT %s, %ss2HtmRangesEncode(%s),
+                              %ss2HtmRangesDecode(%ss2HtmRangesEncode(%s)),
+                              %ss2HtmRangesToValues(%s),
+                              %ss2HtmRangesToValues(%ss2HtmRangesEncode(%s))""" % (
+                    ranges, self._prefix, ranges,
+                    self._prefix, self._prefix, ranges,
+                    self._prefix, ranges,
+                    self._prefix, self._prefix, ranges)
+                raw, enc, dec, values, encValues = self._query(stmt)
+                self.assertEqual(bytes(dec), bytes(raw), stmt)
+                self.assertEqual(encValues, values, stmt)
+                if len(raw) >= 10 * 16:
+                    self.assertTrue(len(enc) < len(raw), stmt)
+                # encoding is idempotent
+                stmt = "SELECT %ss2HtmRangesEncode(%%s)" % self._prefix
+                self.assertEqual(bytes(self._query(stmt, enc)[0]), bytes(enc))
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmRangesEncodeTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,155 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import random
+import sys
+import unittest
+
+from base import *
+
+
+class S2HtmRangesExTestCase(MySqlUdfTestCase):
+    """s2CircleHtmRangesEx() and s2CPolyHtmRangesEx() UDF test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        self._circles = [(10.0, 20.0, 1.0),
+                         (359.5, 0.0, 0.75),
+                         (123.0, -89.5, 2.0)]
+        self._polys = [(0.0, 0.0, 1.0, 0.0, 0.0, 1.0),
+                       (359.0, -1.0, 1.0, -1.0, 1.0, 1.0, 359.0, 1.0),
+                       (0.0, 88.0, 120.0, 88.0, 240.0, 88.0)]
+        super(S2HtmRangesExTestCase, self).setUp()
+
+    def _ranges(self, func, args, width):
+        stmt = "SELECT %s%s(%s)" % (self._prefix, func, ",".join(args))
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        if rows[0][0] is None:
+            return None
+        return unpackRanges(rows[0][0], width)
+
+    def _check(self, level, ex, ranges, points, ptIn):
+        """Checks classified ranges against unclassified ones (if given), and
+        against the HTM IDs and exact point-in-region results for a set of
+        points.
+        """
+        if ranges is not None:
+            self.assertEqual(mergeRanges(ex), mergeRanges(ranges))
+        for r in ex:
+            self.assertTrue(r[0] <= r[1] and r[2] in (0, 1))
+        for ra, dec in points:
+            stmt = "SELECT %ss2HtmId(%s, %s, %d), %s" % (
+                self._prefix, dbparam(ra), dbparam(dec), level, ptIn(ra, dec))
+            rows = self.query(stmt)
+            self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+            htmId, inside = rows[0]
+            r = findRange(htmId, ex)
+            if inside == 1:
+                self.assertNotEqual(r, None, stmt + ": point not covered")
+            if r is not None and r[2] == 1:
+                self.assertEqual(inside, 1, stmt + ": point not inside")
+
+    def _points(self, ra, dec, delta, n=200):
+        points = []
+        for i in range(n):
+            d = random.uniform(max(dec - delta, -90.0), min(dec + delta, 90.0))
+            c = math.cos(math.radians(d))
+            if c * 180.0 < delta:
+                r = random.uniform(0.0, 360.0)
+            else:
+                r = random.uniform(ra - delta / c, ra + delta / c) % 360.0
+            points.append((r, d))
+        return points
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        for i in range(3):
+            a = ["0", "0", "1", "10", "-1"]
+            a[i] = "NULL"
+            self.assertEqual(self._ranges("s2CircleHtmRangesEx", a, 3), None)
+        for a in (["0", "91", "1", "10", "-1"],
+                  ["0", "0", "-1", "10", "-1"],
+                  ["0", "0", "181", "10", "-1"],
+                  ["0", "0", "1", "-1", "-1"],
+                  ["0", "0", "1", "25", "-1"]):
+            self.assertEqual(self._ranges("s2CircleHtmRangesEx", a, 3), None)
+        poly = "%ss2CPolyToBin(0, 0, 1, 0, 0, 1)" % self._prefix
+        for a in (["NULL", "10", "-1"], ["'foo'", "10", "-1"],
+                  [poly, "-1", "-1"], [poly, "25", "-1"]):
+            self.assertEqual(self._ranges("s2CPolyHtmRangesEx", a, 3), None)
+        self.assertRaises(Exception, self._ranges, "s2CircleHtmRangesEx",
+                          ["0", "0", "1", "10"], 3)
+        self.assertRaises(Exception, self._ranges, "s2CircleHtmRangesEx",
+                          ["0", "0", "1", "10.0", "-1"], 3)
+        self.assertRaises(Exception, self._ranges, "s2CPolyHtmRangesEx",
+                          [poly, "10"], 3)
+
+    def testCircles(self):
+        """Test classified circle coverage against point-in-circle tests.
+        """
+        for ra, dec, radius in self._circles:
+            points = self._points(ra, dec, 1.5 * radius)
+            for level in (6, 10):
+                for maxranges in (-1, 8):
+                    args = list(map(dbparam, (ra, dec, radius, level, maxranges)))
+                    ex = self._ranges("s2CircleHtmRangesEx", args, 3)
+                    ranges = None
+                    if maxranges > 0:
+                        self.assertTrue(len(ex) <= maxranges)
+                    else:
+                        ranges = self._ranges("s2CircleHtmRanges", args, 2)
+                        self.assertTrue(any(r[2] == 1 for r in ex))
+                    ptIn = lambda a, d: "%ss2PtInCircle(%s, %s, %s)" % (
+                        self._prefix, dbparam(a), dbparam(d),
+                        ",".join(map(dbparam, (ra, dec, radius))))
+                    self._check(level, ex, ranges, points, ptIn)
+
+    def testPolygons(self):
+        """Test classified polygon coverage against point-in-polygon tests.
+        """
+        for poly in self._polys:
+            verts = ",".join(map(dbparam, poly))
+            pbin = "%ss2CPolyToBin(%s)" % (self._prefix, verts)
+            points = self._points(poly[0], poly[1], 3.0)
+            for level in (6, 10):
+                for maxranges in (-1, 8):
+                    args = [pbin, dbparam(level), dbparam(maxranges)]
+                    ex = self._ranges("s2CPolyHtmRangesEx", args, 3)
+                    ranges = None
+                    if maxranges > 0:
+                        self.assertTrue(len(ex) <= maxranges)
+                    else:
+                        ranges = self._ranges("s2CPolyHtmRanges", args, 2)
+                    ptIn = lambda a, d: "%ss2PtInCPoly(%s, %s, %s)" % (
+                        self._prefix, dbparam(a), dbparam(d), verts)
+                    self._check(level, ex, ranges, points, ptIn)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmRangesExTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
@@ -0,0 +1,113 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import sys
+import unittest
+
+from base import *
+
+
+def _ids(ranges, shift=0):
+    """Returns the set of IDs in a range list, converted to a level that
+    is finer (shift > 0) or coarser (shift < 0) by 2*|shift| bits.
+    """
+    s = set()
+    for r in ranges:
+        if shift >= 0:
+            s.update(range(r[0] << 2*shift, ((r[1] + 1) << 2*shift)))
+        else:
+            s.update(range(r[0] >> -2*shift, (r[1] >> -2*shift) + 1))
+    return s
+
+
+class S2HtmRangesSetOpsTestCase(MySqlUdfTestCase):
+    """s2HtmRangesUnion(), s2HtmRangesIntersect() and s2HtmRangesSubtract()
+    UDF test-case.
+    """
+    def _ranges(self, expr):
+        stmt = "SELECT " + expr
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        if rows[0][0] is None:
+            return None
+        return unpackRanges(rows[0][0])
+
+    def _circle(self, ra, dec, radius, level):
+        return "%ss2CircleHtmRanges(%s, %s, %s, %d, -1)" % (
+            self._prefix, dbparam(ra), dbparam(dec), dbparam(radius), level)
+
+    def _check(self, ca, levelA, cb, levelB, level=None):
+        """Checks all set operations on the ranges of 2 circles against
+        Python sets of IDs.
+        """
+        a = self._circle(*(ca + (levelA,)))
+        b = self._circle(*(cb + (levelB,)))
+        outLevel = max(levelA, levelB) if level is None else level
+        sa = _ids(self._ranges(a), outLevel - levelA)
+        sb = _ids(self._ranges(b), outLevel - levelB)
+        extra = [] if level is None else [str(level)]
+        encA = "%ss2HtmRangesEncode(%s)" % (self._prefix, a)
+        encB = "%ss2HtmRangesEncode(%s)" % (self._prefix, b)
+        for func, expected in (("s2HtmRangesUnion", sa | sb),
+                               ("s2HtmRangesIntersect", sa & sb),
+                               ("s2HtmRangesSubtract", sa - sb)):
+            for x, y in ((a, b), (encA, encB)):
+                ranges = self._ranges("%s%s(%s)" % (
+                    self._prefix, func, ",".join([x, y] + extra)))
+                self.assertEqual(_ids(ranges), expected, func)
+                # results are sorted and maximally merged
+                self.assertEqual(mergeRanges(ranges),
+                                 [tuple(r) for r in ranges], func)
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        c = self._circle(0.0, 0.0, 1.0, 8)
+        for func in ("s2HtmRangesUnion", "s2HtmRangesIntersect",
+                     "s2HtmRangesSubtract"):
+            f = self._prefix + func + "(%s)"
+            for args in (("NULL", c), (c, "NULL"), (c, "'foo'"),
+                         (c, c, "-1"), (c, c, "25")):
+                self.assertEqual(self._ranges(f % ",".join(args)), None)
+            for args in ((c,), (c, c, "8.0")):
+                self.assertRaises(Exception, self._ranges, f % ",".join(args))
+
+    def testSetOps(self):
+        """Test set operations on overlapping and disjoint circles.
+        """
+        cases = [((10.0, 10.0, 1.0), (10.5, 10.5, 1.0)),
+                 ((10.0, 10.0, 1.0), (10.1, 10.1, 0.2)),
+                 ((10.0, 10.0, 1.0), (50.0, -10.0, 1.0))]
+        for ca, cb in cases:
+            self._check(ca, 10, cb, 10)
+            # mixed levels, converted to the finer level or a given one
+            self._check(ca, 10, cb, 8)
+            self._check(ca, 10, cb, 8, 9)
+            self._check(ca, 10, cb, 8, 11)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmRangesSetOpsTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
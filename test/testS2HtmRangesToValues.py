@@ -0,0 +1,114 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import struct
+import sys
+import unittest
+
+from base import *
+
+
+def _text(v):
+    if isinstance(v, bytes):
+        return v.decode()
+    return v
+
+
+class S2HtmRangesToValuesTestCase(MySqlUdfTestCase):
+    """s2HtmRangesToValues() UDF and region stored procedure test-case.
+    """
+    def _s2HtmRangesToValues(self, arg):
+        stmt = "SELECT %ss2HtmRangesToValues(%s)" % (self._prefix, arg)
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return _text(rows[0][0])
+
+    def _values(self, ranges):
+        blob = struct.pack("=%dq" % (2 * len(ranges)), *flatten(ranges))
+        stmt = "SELECT %ss2HtmRangesToValues(%%s)" % self._prefix
+        self._cursor.execute(stmt, (blob,))
+        rows = self._cursor.fetchall()
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return _text(rows[0][0])
+
+    def _region(self, proc, args):
+        self._cursor.execute("CALL scisql.%s%s(%s)" % (
+            self._prefix, proc, ",".join(args)))
+        return [tuple(r) for r in self.query(
+            "SELECT htmMin, htmMax FROM scisql.Region ORDER BY htmMin")]
+
+    def _ranges(self, func, args):
+        rows = self.query("SELECT %s%s(%s)" % (
+            self._prefix, func, ",".join(args + ["256"])))
+        return [tuple(r) for r in unpackRanges(rows[0][0])]
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        self.assertEqual(self._s2HtmRangesToValues("NULL"), None)
+        self.assertEqual(self._s2HtmRangesToValues("''"), "")
+        # malformed range lists
+        self.assertEqual(self._s2HtmRangesToValues("'foo'"), None)
+        self.assertRaises(Exception, self.query,
+                          "SELECT %ss2HtmRangesToValues()" % self._prefix)
+        for ranges in ([(0, 0)],
+                       [(8 << 20, (8 << 20) + 5), ((9 << 20) + 2, 10 << 20)],
+                       [(3, 7), (2**62, 2**63 - 1)]):
+            values = ",".join("(%d,%d)" % r for r in ranges)
+            self.assertEqual(self._values(ranges), values)
+        # unsorted, overlapping or negative ranges are malformed
+        for ranges in ([(5, 3)], [(4, 9), (9, 12)], [(-1, 3)]):
+            self.assertEqual(self._values(ranges), None)
+
+    def testRegions(self):
+        """Test that the region stored procedures insert all ranges.
+        """
+        poly = "%ss2CPolyToBin(0, 0, 1, 0, 0, 1)" % self._prefix
+        # a 24-gon, whose binary representation does not fit in 255 bytes
+        angles = [2.0 * math.pi * i / 24 for i in range(24)]
+        bigPoly = "%ss2CPolyToBin(%s)" % (self._prefix, ",".join(
+            "%r, %r" % (10.0 + math.cos(a), math.sin(a)) for a in angles))
+        cases = [("s2CircleRegion", "s2CircleHtmRanges", ["0", "0", "0.5"]),
+                 ("s2CPolyRegion", "s2CPolyHtmRanges", [poly]),
+                 ("s2CPolyRegion", "s2CPolyHtmRanges", [bigPoly]),
+                 ("s2EllipseRegion", "s2EllipseHtmRanges",
+                  ["10", "20", "3600", "1800", "30"]),
+                 ("s2BoxRegion", "s2BoxHtmRanges", ["350", "-5", "10", "5"])]
+        for proc, func, args in cases:
+            for level in ("8", "14", "20"):
+                ranges = self._ranges(func, args + [level])
+                self.assertTrue(len(ranges) > 0)
+                self.assertEqual(self._region(proc, args + [level]), ranges)
+        # an empty region must leave an empty table behind
+        self.assertEqual(self._region("s2BoxRegion",
+                                      ["0", "1", "1", "0", "10"]), [])
+        self.assertRaises(Exception, self._region, "s2CircleRegion",
+                          ["0", "91", "1", "10"])
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2HtmRangesToValuesTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
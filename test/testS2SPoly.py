@@ -0,0 +1,288 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Copyright (C) 2011-2022 the SciSQL authors
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors:
+#     - Serge Monkewitz, IPAC/Caltech
+#
+# Work on this project has been sponsored by LSST and SLAC/DOE.
+#
+
+import math
+import random
+import sys
+import unittest
+
+from base import *
+
+
+def _v3(lon, lat):
+    lon = math.radians(lon)
+    lat = math.radians(lat)
+    return (math.cos(lat) * math.cos(lon), math.cos(lat) * math.sin(lon),
+            math.sin(lat))
+
+
+def _cross(a, b):
+    return (a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0])
+
+
+def _dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+
+def _normalize(a):
+    n = math.sqrt(_dot(a, a))
+    return (a[0] / n, a[1] / n, a[2] / n)
+
+
+class _Gnomonic(object):
+    """Gnomonic projection about the center of a polygon. Great circles
+    map to straight lines, so point-in-polygon tests become planar.
+    """
+    def __init__(self, verts):
+        v = [_v3(*p) for p in verts]
+        self.c = _normalize(tuple(sum(x[i] for x in v) for i in range(3)))
+        axis = (0.0, 0.0, 1.0) if abs(self.c[2]) < 0.9 else (1.0, 0.0, 0.0)
+        self.e = _normalize(_cross(axis, self.c))
+        self.n = _cross(self.c, self.e)
+        self.verts = [self.project(x) for x in v]
+
+    def project(self, v):
+        d = _dot(v, self.c)
+        return (_dot(v, self.e) / d, _dot(v, self.n) / d)
+
+    def contains(self, lon, lat):
+        """Returns 1 if a point is inside the polygon, 0 if it is outside,
+        and None if it is too close to call.
+        """
+        v = _v3(lon, lat)
+        if _dot(v, self.c) <= 1e-6:
+            return 0
+        x, y = self.project(v)
+        inside = False
+        n = len(self.verts)
+        for i in range(n):
+            x1, y1 = self.verts[i]
+            x2, y2 = self.verts[(i + 1) % n]
+            dx = x2 - x1
+            dy = y2 - y1
+            t = ((x - x1) * dx + (y - y1) * dy) / (dx * dx + dy * dy)
+            t = max(0.0, min(1.0, t))
+            if math.hypot(x - x1 - t * dx, y - y1 - t * dy) < 1e-9:
+                return None
+            if (y1 > y) != (y2 > y) and x < x1 + (y - y1) * dx / dy:
+                inside = not inside
+        return 1 if inside else 0
+
+
+def _star(lon, lat, n, r1, r2):
+    """Returns the vertices of a star with n points, centered on (lon, lat),
+    whose vertices alternate between angular distances r1 and r2 (in deg)
+    from the center.
+    """
+    g = _Gnomonic([(lon, lat)])
+    verts = []
+    for i in range(2 * n):
+        a = math.pi * i / n
+        r = math.radians(r1 if i % 2 == 0 else r2)
+        v = tuple(math.cos(r) * g.c[j] + math.sin(r) * (
+                  math.cos(a) * g.e[j] + math.sin(a) * g.n[j]) for j in range(3))
+        verts.append((math.degrees(math.atan2(v[1], v[0])) % 360.0,
+                      math.degrees(math.asin(max(-1.0, min(1.0, v[2]))))))
+    return verts
+
+
+class S2SPolyTestCase(MySqlUdfTestCase):
+    """s2PtInSPoly(), s2SPolyToBin(), s2SPolyHtmRanges() UDF and
+    s2SPolyRegion() stored procedure test-case.
+    """
+    def setUp(self):
+        random.seed(123456789)
+        self._polys = [
+            # a concave "L"
+            [(0.0, 0.0), (2.0, 0.0), (2.0, 1.0), (1.0, 1.0), (1.0, 2.0),
+             (0.0, 2.0)],
+            # a comb straddling the 0/360 longitude discontinuity
+            [(359.0, -1.0), (1.0, -1.0), (1.0, 1.0), (0.6, 1.0), (0.6, -0.5),
+             (0.2, -0.5), (0.2, 1.0), (359.8, 1.0), (359.8, -0.5),
+             (359.4, -0.5), (359.4, 1.0), (359.0, 1.0)],
+            # stars with few and many points, one near a pole
+            _star(45.0, 30.0, 5, 2.0, 0.7),
+            _star(200.0, -40.0, 100, 3.0, 2.0),
+            _star(0.0, 87.0, 12, 2.0, 1.0)]
+        super(S2SPolyTestCase, self).setUp()
+
+    def _query(self, expr):
+        stmt = "SELECT " + expr
+        rows = self.query(stmt)
+        self.assertEqual(len(rows), 1, stmt + " returned multiple rows")
+        return rows[0][0]
+
+    def _verts(self, poly):
+        return ",".join("%r, %r" % v for v in poly)
+
+    def _points(self, poly, n=300):
+        # longitudes relative to the first vertex, in [-180, 180)
+        ref = poly[0][0]
+        lon = [(v[0] - ref + 180.0) % 360.0 - 180.0 for v in poly]
+        lat = [v[1] for v in poly]
+        c = min(math.cos(math.radians(l)) for l in lat)
+        points = []
+        for i in range(n):
+            dec = random.uniform(max(min(lat) - 0.5, -90.0),
+                                 min(max(lat) + 0.5, 90.0))
+            if c < 0.1:
+                ra = random.uniform(0.0, 360.0)
+            else:
+                ra = (ref + random.uniform(min(lon) - 0.5, max(lon) + 0.5)) % 360.0
+            points.append((ra, dec))
+        return points
+
+    def testConstArgs(self):
+        """Test with constant arguments.
+        """
+        verts = [0, 0, 2, 0, 2, 1, 1, 1, 1, 2, 0, 2]
+        for i in range(len(verts)):
+            a = list(verts)
+            a[i] = None
+            self.assertEqual(self._query("%ss2SPolyToBin(%s)" % (
+                self._prefix, ",".join(map(dbparam, a)))), None)
+            self.assertEqual(self._query("%ss2PtInSPoly(0.5, 0.5, %s)" % (
+                self._prefix, ",".join(map(dbparam, a)))), 0)
+        self.assertEqual(self._query("%ss2PtInSPoly(NULL, 0.5, %s)" % (
+            self._prefix, ",".join(map(dbparam, verts)))), 0)
+        self.assertEqual(self._query("%ss2PtInSPoly(0.5, 0.5, NULL)" %
+                                     self._prefix), 0)
+        # invalid latitudes and self-intersecting polygons
+        for a in ("0, 91, 1, 0, 0, 1", "0, 0, 1, 0, 0, -91",
+                  "0, 0, 1, 1, 1, 0, 0, 1"):
+            self.assertEqual(self._query("%ss2SPolyToBin(%s)" % (
+                self._prefix, a)), None)
+            self.assertEqual(self._query("%ss2PtInSPoly(0.5, 0.5, %s)" % (
+                self._prefix, a)), None)
+        self.assertEqual(self._query("%ss2PtInSPoly(0.5, 91, %s)" % (
+            self._prefix, ",".join(map(dbparam, verts)))), None)
+        self.assertEqual(self._query("%ss2PtInSPoly(0.5, 0.5, 'foo')" %
+                                     self._prefix), None)
+        for a in ("0, 0, 1, 0", "0, 0, 1, 0, 0", ""):
+            self.assertRaises(Exception, self._query,
+                              "%ss2SPolyToBin(%s)" % (self._prefix, a))
+        self.assertRaises(Exception, self._query,
+                          "%ss2PtInSPoly(0.5, 0.5, 0, 0, 1, 0)" % self._prefix)
+        for poly in self._polys:
+            pbin = self._query("%ss2SPolyToBin(%s)" % (
+                self._prefix, self._verts(poly)))
+            self.assertEqual(len(pbin), 8 + 24 * len(poly))
+
+    def testPolygons(self):
+        """Test point-in-polygon results against a planar test on the
+        gnomonic projection of each polygon.
+        """
+        for poly in self._polys:
+            g = _Gnomonic(poly)
+            verts = self._verts(poly)
+            pbin = "%ss2SPolyToBin(%s)" % (self._prefix, verts)
+            rpoly = self._verts(reversed(poly))
+            ninside = 0
+            for ra, dec in self._points(poly):
+                expected = g.contains(ra, dec)
+                if expected is None:
+                    continue
+                ninside += expected
+                stmt = "%ss2PtInSPoly(%r, %r, %%s)" % (self._prefix, ra, dec)
+                for p in (verts, pbin, rpoly):
+                    self.assertEqual(self._query(stmt % p), expected, stmt % p)
+            self.assertTrue(ninside > 0)
+
+    def testConvex(self):
+        """Test that convex polygons give the same results as s2PtInCPoly().
+        """
+        for i in range(20):
+            ra = random.uniform(0.0, 360.0)
+            dec = random.uniform(-80.0, 80.0)
+            poly = _star(ra, dec, 3, 2.0, 2.0)
+            verts = self._verts(poly)
+            for ra, dec in self._points(poly, 20):
+                self.assertEqual(
+                    self._query("%ss2PtInSPoly(%r, %r, %s)" % (
+                        self._prefix, ra, dec, verts)),
+                    self._query("%ss2PtInCPoly(%r, %r, %s)" % (
+                        self._prefix, ra, dec, verts)))
+
+    def testColumnArgs(self):
+        """Test that constant polygons, which may be indexed, give the same
+        results as polygons taken from a table.
+        """
+        poly = self._polys[3]
+        g = _Gnomonic(poly)
+        pbin = "%ss2SPolyToBin(%s)" % (self._prefix, self._verts(poly))
+        with self.tempTable("S2SPoly", ("inside INTEGER",
+                                        "ra DOUBLE PRECISION",
+                                        "decl DOUBLE PRECISION",
+                                        "poly MEDIUMBLOB")):
+            for ra, dec in self._points(poly, 1000):
+                expected = g.contains(ra, dec)
+                if expected is not None:
+                    self._cursor.execute(
+                        "INSERT INTO S2SPoly VALUES (%d, %r, %r, NULL)" % (
+                            expected, ra, dec))
+            self._cursor.execute("UPDATE S2SPoly SET poly = " + pbin)
+            for p in (pbin, "poly"):
+                stmt = """SELECT COUNT(*) FROM S2SPoly
+                          WHERE %ss2PtInSPoly(ra, decl, %s) != inside""" % (
+                       self._prefix, p)
+                rows = self.query(stmt)
+                self.assertEqual(rows[0][0], 0, stmt + " did not return 0")
+
+    def testRanges(self):
+        """Test that s2SPolyHtmRanges() covers all points inside a polygon,
+        and that s2SPolyRegion() inserts its ranges.
+        """
+        self.assertEqual(self._query("%ss2SPolyHtmRanges(NULL, 10, -1)" %
+                                     self._prefix), None)
+        self.assertEqual(self._query("%ss2SPolyHtmRanges('foo', 10, -1)" %
+                                     self._prefix), None)
+        for poly in self._polys:
+            g = _Gnomonic(poly)
+            pbin = "%ss2SPolyToBin(%s)" % (self._prefix, self._verts(poly))
+            for level in (-1, 25):
+                self.assertEqual(self._query("%ss2SPolyHtmRanges(%s, %d, -1)" % (
+                    self._prefix, pbin, level)), None)
+            for level in (6, 10):
+                ranges = unpackRanges(self._query(
+                    "%ss2SPolyHtmRanges(%s, %d, -1)" % (self._prefix, pbin, level)))
+                self.assertTrue(len(ranges) > 0)
+                for ra, dec in self._points(poly, 100):
+                    if g.contains(ra, dec) == 1:
+                        htmId = self._query("%ss2HtmId(%r, %r, %d)" % (
+                            self._prefix, ra, dec, level))
+                        self.assertNotEqual(findRange(htmId, ranges), None)
+                ranges = [tuple(r) for r in unpackRanges(self._query(
+                    "%ss2SPolyHtmRanges(%s, %d, 256)" % (self._prefix, pbin, level)))]
+                self._cursor.execute("CALL scisql.%ss2SPolyRegion(%s, %d)" % (
+                    self._prefix, pbin, level))
+                region = [tuple(r) for r in self.query(
+                    "SELECT htmMin, htmMax FROM scisql.Region ORDER BY htmMin")]
+                self.assertEqual(region, ranges)
+
+
+if __name__ == "__main__":
+    suite = unittest.makeSuite(S2SPolyTestCase)
+    runner = unittest.TextTestRunner()
+    if not runner.run(suite).wasSuccessful():
+        sys.exit(1)
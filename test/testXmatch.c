@@ -0,0 +1,382 @@
+/*
+    Copyright (C) 2011-2022 the SciSQL authors
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+    Authors:
+        - Serge Monkewitz, IPAC/Caltech
+
+    Work on this project has been sponsored by LSST and SLAC/DOE.
+
+    ----------------------------------------------------------------
+
+    Compares the output of scisql_xmatch against a brute-force
+    cross-match. The scisql_xmatch executable is expected in the parent
+    directory of the test executable.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "geometry.h"
+
+
+#define SCISQL_ASSERT(pred, ...) \
+    do { \
+        if (!(pred)) { \
+            fprintf(stderr, #pred " is false: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while(0)
+
+/*  Number of points per cluster and clusters per table.
+ */
+#define NPOINTS 500
+#define NCLUSTERS 4
+
+
+typedef struct {
+    int64_t id1;
+    int64_t id2;
+    double sep;
+} match;
+
+typedef struct {
+    scisql_sc sc[NPOINTS*NCLUSTERS];
+    scisql_v3 v[NPOINTS*NCLUSTERS];
+    int64_t ids[NPOINTS*NCLUSTERS];
+    size_t n;
+} table;
+
+static char xmatchPath[4096];
+static char tmpDir[] = "/tmp/scisql_testXmatch_XXXXXX";
+static table t1, t2;
+static scisql_s2cpoly footprint;
+static int useFootprint = 0;
+
+
+/*  Returns a random point at angular distance at most r (degrees) from c.
+ */
+static void randomPointNear(scisql_v3 *v,
+                            const scisql_v3 *c,
+                            double r,
+                            unsigned short seed[3])
+{
+    scisql_v3 n, e, t = { 0.0, 0.0, 1.0 };
+    double a = erand48(seed) * 360.0 * SCISQL_RAD_PER_DEG;
+    double d = r * erand48(seed) * SCISQL_RAD_PER_DEG;
+    if (c->z > 0.9 || c->z < -0.9) {
+        t.x = 1.0;
+        t.z = 0.0;
+    }
+    scisql_v3_rcross(&n, c, &t);
+    scisql_v3_normalize(&n, &n);
+    scisql_v3_rcross(&e, c, &n);
+    scisql_v3_normalize(&e, &e);
+    v->x = c->x*cos(d) + sin(d)*(cos(a)*n.x + sin(a)*e.x);
+    v->y = c->y*cos(d) + sin(d)*(cos(a)*n.y + sin(a)*e.y);
+    v->z = c->z*cos(d) + sin(d)*(cos(a)*n.z + sin(a)*e.z);
+}
+
+/*  Fills a table with clusters of points around a point near the
+    equator, a point near the 0/360 longitude discontinuity, a point near
+    the north pole and a point at mid-southern latitude.
+ */
+static void makeTable(table *t, int64_t idbase, unsigned short seed[3]) {
+    static const double centers[NCLUSTERS][2] = {
+        { 10.0, 20.0 }, { 0.01, 0.0 }, { 0.0, 89.99 }, { 180.0, -45.0 }
+    };
+    size_t i, j;
+    t->n = 0;
+    for (i = 0; i < NCLUSTERS; ++i) {
+        scisql_sc sc;
+        scisql_v3 c, v;
+        scisql_sc_init(&sc, centers[i][0], centers[i][1]);
+        scisql_sctov3(&c, &sc);
+        for (j = 0; j < NPOINTS; ++j, ++t->n) {
+            randomPointNear(&v, &c, 0.5, seed);
+            scisql_v3_normalize(&v, &v);
+            scisql_v3tosc(&t->sc[t->n], &v);
+            /* positions are read back from files in spherical coordinates */
+            scisql_sctov3(&t->v[t->n], &t->sc[t->n]);
+            t->ids[t->n] = idbase + (int64_t) t->n;
+        }
+    }
+}
+
+static void putLe64(unsigned char *s, uint64_t u) {
+    int i;
+    for (i = 0; i < 8; ++i) {
+        s[i] = (unsigned char) (u >> 8*i);
+    }
+}
+
+static uint64_t getLe64(const unsigned char *s) {
+    uint64_t u = 0;
+    int i;
+    for (i = 7; i >= 0; --i) {
+        u = (u << 8) | s[i];
+    }
+    return u;
+}
+
+/*  Writes a table as a binary point file.
+ */
+static void writeBinary(const char *path, const table *t) {
+    unsigned char rec[24];
+    size_t i;
+    FILE *f = fopen(path, "wb");
+    SCISQL_ASSERT(f != 0, "failed to open %s", path);
+    memset(rec, 0, 16);
+    memcpy(rec, "SCISQLPT", 8);
+    rec[8] = 1;
+    SCISQL_ASSERT(fwrite(rec, 16, 1, f) == 1, "write failed");
+    for (i = 0; i < t->n; ++i) {
+        uint64_t u;
+        putLe64(rec, (uint64_t) t->ids[i]);
+        memcpy(&u, &t->sc[i].lon, sizeof(double));
+        putLe64(rec + 8, u);
+        memcpy(&u, &t->sc[i].lat, sizeof(double));
+        putLe64(rec + 16, u);
+        SCISQL_ASSERT(fwrite(rec, 24, 1, f) == 1, "write failed");
+    }
+    SCISQL_ASSERT(fclose(f) == 0, "failed to close %s", path);
+}
+
+/*  Writes a table as TSV, with a header line and an extra column.
+ */
+static void writeTsv(const char *path, const table *t) {
+    size_t i;
+    FILE *f = fopen(path, "w");
+    SCISQL_ASSERT(f != 0, "failed to open %s", path);
+    fprintf(f, "id\tjunk\tlon\tlat\n");
+    for (i = 0; i < t->n; ++i) {
+        fprintf(f, "%lld\tx\t%.17g\t%.17g\n", (long long) t->ids[i],
+                t->sc[i].lon, t->sc[i].lat);
+    }
+    SCISQL_ASSERT(fclose(f) == 0, "failed to close %s", path);
+}
+
+static int cmpMatch(const void *a, const void *b) {
+    const match *m1 = (const match *) a;
+    const match *m2 = (const match *) b;
+    if (m1->id1 != m2->id1) {
+        return (m1->id1 < m2->id1) ? -1 : 1;
+    }
+    if (m1->id2 != m2->id2) {
+        return (m1->id2 < m2->id2) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*  Runs scisql_xmatch with the given options, and returns its binary
+    output sorted by ID pair.
+ */
+static match * runXmatch(size_t *n,
+                         const char *opts,
+                         double radius,
+                         const char *in1,
+                         const char *in2)
+{
+    char cmd[5*4096], out[4096];
+    unsigned char *data;
+    match *m;
+    size_t len, i;
+    long sz;
+    FILE *f;
+
+    snprintf(out, sizeof(out), "%s/out", tmpDir);
+    snprintf(cmd, sizeof(cmd), "'%s' -b %s %.17g '%s' '%s' '%s'",
+             xmatchPath, opts, radius, out, in1, in2);
+    SCISQL_ASSERT(system(cmd) == 0, "%s failed", cmd);
+    f = fopen(out, "rb");
+    SCISQL_ASSERT(f != 0 && fseek(f, 0, SEEK_END) == 0, "%s", out);
+    sz = ftell(f);
+    SCISQL_ASSERT(sz >= 16, "%s: output too short", cmd);
+    len = (size_t) sz;
+    *n = (len - 16) / 24;
+    SCISQL_ASSERT(len == 16 + 24 * *n, "%s: bad output size %ld", cmd, sz);
+    data = (unsigned char *) malloc(len);
+    m = (match *) malloc((*n + 1) * sizeof(match));
+    SCISQL_ASSERT(data != 0 && m != 0, "memory allocation failed");
+    rewind(f);
+    SCISQL_ASSERT(fread(data, len, 1, f) == 1, "failed to read %s", out);
+    fclose(f);
+    unlink(out);
+    SCISQL_ASSERT(memcmp(data, "SCISQLXM", 8) == 0 && data[8] == 1,
+                  "%s: bad output header", cmd);
+    for (i = 0; i < *n; ++i) {
+        uint64_t u = getLe64(data + 16 + 24*i + 16);
+        m[i].id1 = (int64_t) getLe64(data + 16 + 24*i);
+        m[i].id2 = (int64_t) getLe64(data + 16 + 24*i + 8);
+        memcpy(&m[i].sep, &u, sizeof(double));
+    }
+    free(data);
+    qsort(m, *n, sizeof(match), &cmpMatch);
+    return m;
+}
+
+static void addMatch(match **m,
+                     size_t *n,
+                     size_t *cap,
+                     size_t i,
+                     size_t j,
+                     double d2)
+{
+    if (*n == *cap) {
+        *cap *= 2;
+        *m = (match *) realloc(*m, *cap * sizeof(match));
+        SCISQL_ASSERT(*m != 0, "memory allocation failed");
+    }
+    (*m)[*n].id1 = t1.ids[i];
+    (*m)[*n].id2 = t2.ids[j];
+    (*m)[*n].sep = 2.0 * asin(0.5 * sqrt(d2)) * SCISQL_DEG_PER_RAD;
+    ++*n;
+}
+
+/*  Cross-matches t1 and t2 by comparing every pair of points. The result
+    is sorted by ID pair.
+ */
+static match * bruteForce(size_t *n, double radius, int nearest) {
+    double dist2 = 2.0 * sin(0.5 * radius * SCISQL_RAD_PER_DEG);
+    size_t i, j, cap = 1024;
+    match *m = (match *) malloc(cap * sizeof(match));
+
+    SCISQL_ASSERT(m != 0, "memory allocation failed");
+    dist2 *= dist2;
+    *n = 0;
+    for (i = 0; i < t1.n; ++i) {
+        size_t best = t2.n;
+        double bestd2 = dist2;
+        if (useFootprint != 0 &&
+            scisql_s2cpoly_cv3(&footprint, &t1.v[i]) == 0) {
+            continue;
+        }
+        for (j = 0; j < t2.n; ++j) {
+            double d2 = scisql_v3_dist2(&t1.v[i], &t2.v[j]);
+            if (d2 > dist2) {
+                continue;
+            }
+            if (useFootprint != 0 &&
+                scisql_s2cpoly_cv3(&footprint, &t2.v[j]) == 0) {
+                continue;
+            }
+            if (nearest == 0) {
+                addMatch(&m, n, &cap, i, j, d2);
+            } else if (best == t2.n || d2 < bestd2) {
+                best = j;
+                bestd2 = d2;
+            }
+        }
+        if (best != t2.n) {
+            addMatch(&m, n, &cap, i, best, bestd2);
+        }
+    }
+    qsort(m, *n, sizeof(match), &cmpMatch);
+    return m;
+}
+
+/*  Checks scisql_xmatch output against a brute-force cross-match.
+ */
+/*  Sets the polygon that bruteForce() restricts both tables to, from
+    n vertices given as longitude/latitude pairs in degrees.
+ */
+static void setFootprint(const double *lonlat, size_t n) {
+    scisql_v3 verts[SCISQL_MAX_VERTS];
+    scisql_sc sc;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        SCISQL_ASSERT(scisql_sc_init(&sc, lonlat[2*i], lonlat[2*i + 1]) == 0,
+                      "invalid footprint vertex");
+        scisql_sctov3(&verts[i], &sc);
+    }
+    SCISQL_ASSERT(scisql_s2cpoly_init(&footprint, verts, n) == 0,
+                  "invalid footprint polygon");
+    useFootprint = 1;
+}
+
+
+static void check(const char *opts,
+                  double radius,
+                  const char *in1,
+                  const char *in2,
+                  int nearest)
+{
+    size_t n, nb, i;
+    match *m = runXmatch(&n, opts, radius, in1, in2);
+    match *b = bruteForce(&nb, radius, nearest);
+    SCISQL_ASSERT(nb > 0, "test data has no matches");
+    SCISQL_ASSERT(n == nb, "%s, radius %g: %lu matches, expecting %lu",
+                  opts, radius, (unsigned long) n, (unsigned long) nb);
+    for (i = 0; i < n; ++i) {
+        SCISQL_ASSERT(m[i].id1 == b[i].id1 && m[i].id2 == b[i].id2 &&
+                      m[i].sep == b[i].sep,
+                      "%s, radius %g: match %lu differs", opts, radius,
+                      (unsigned long) i);
+    }
+    free(m);
+    free(b);
+}
+
+
+int main(int argc SCISQL_UNUSED, char **argv) {
+    unsigned short seed[3] = { 71, 73, 79 };
+    static const double box[8] = {
+        9.9, 19.7, 10.1, 19.7, 10.1, 20.3, 9.9, 20.3
+    };
+    static const double wedge[6] = { -0.5, -0.5, 0.05, -0.2, 0.05, 0.5 };
+    char bin1[4096], bin2[4096], tsv1[4096];
+    const char *slash = strrchr(argv[0], '/');
+    int dirlen = (slash == 0) ? 1 : (int) (slash - argv[0]);
+
+    snprintf(xmatchPath, sizeof(xmatchPath), "%.*s/../scisql_xmatch",
+             dirlen, (slash == 0) ? "." : argv[0]);
+    SCISQL_ASSERT(access(xmatchPath, X_OK) == 0, "%s not found", xmatchPath);
+    SCISQL_ASSERT(mkdtemp(tmpDir) != 0, "failed to create a directory");
+    snprintf(bin1, sizeof(bin1), "%s/t1.bin", tmpDir);
+    snprintf(bin2, sizeof(bin2), "%s/t2.bin", tmpDir);
+    snprintf(tsv1, sizeof(tsv1), "%s/t1.tsv", tmpDir);
+    makeTable(&t1, 1, seed);
+    makeTable(&t2, 1000000, seed);
+    writeBinary(bin1, &t1);
+    writeBinary(bin2, &t2);
+    writeTsv(tsv1, &t1);
+
+    check("", 0.02, bin1, bin2, 0);
+    check("-t 4", 0.02, bin1, bin2, 0);
+    check("-l 0", 0.02, bin1, bin2, 0);
+    check("-l 14", 0.02, bin1, bin2, 0);
+    check("-s 1", 0.02, tsv1, bin2, 0);
+    check("-n", 0.02, bin1, bin2, 1);
+    check("-n -t 4 -l 12", 0.02, bin1, bin2, 1);
+    check("", 0.2, bin1, bin2, 0);
+    check("-n", 0.2, bin1, bin2, 1);
+
+    /* the footprint cuts through the clusters at (10,20) and (0.01,0) */
+    setFootprint(box, 4);
+    check("-p 9.9,19.7,10.1,19.7,10.1,20.3,9.9,20.3", 0.2, bin1, bin2, 0);
+    check("-p 9.9,19.7,10.1,19.7,10.1,20.3,9.9,20.3 -n -t 4",
+          0.2, bin1, bin2, 1);
+    setFootprint(wedge, 3);
+    check("-s 1 -p -0.5,-0.5,0.05,-0.2,0.05,0.5", 0.02, tsv1, bin2, 0);
+
+    unlink(bin1);
+    unlink(bin2);
+    unlink(tsv1);
+    rmdir(tmpDir);
+    return 0;
+}
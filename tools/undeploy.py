@@ -34,15 +34,37 @@ import MySQLdb as sql
 
 
 _udfs = ['angSep',
+         's2BoxHtmRanges',
+         's2CircleHpxRanges',
+         's2CircleHtmMoc',
          's2CircleHtmRanges',
+         's2CircleHtmRangesEx',
+         's2CPolyHpxRanges',
+         's2CPolyHtmMoc',
          's2CPolyHtmRanges',
+         's2CPolyHtmRangesEx',
+         's2EllipseHtmRanges',
          's2CPolyToBin',
+         's2HpxId',
+         's2HpxNestToRing',
          's2HtmId',
+         's2HtmInRanges',
          's2HtmLevel',
+         's2HtmMocToRanges',
+         's2HtmNeighbors',
+         's2HtmRangesDecode',
+         's2HtmRangesEncode',
+         's2HtmRangesIntersect',
+         's2HtmRangesSubtract',
+         's2HtmRangesToValues',
+         's2HtmRangesUnion',
          's2PtInBox',
          's2PtInCircle',
          's2PtInCPoly',
          's2PtInEllipse',
+         's2PtInSPoly',
+         's2SPolyHtmRanges',
+         's2SPolyToBin',
          'median',
          'percentile',
          'abMagToDn',
@@ -65,8 +87,11 @@ _udfs = ['angSep',
          'raiseError',
          ]
 
-_procs = ['s2CircleRegion',
+_procs = ['s2BoxRegion',
+          's2CircleRegion',
           's2CPolyRegion',
+          's2EllipseRegion',
+          's2SPolyRegion',
           'grantPermissions',
           ]
 